@@ -5,10 +5,12 @@
 #endif
 
 struct nla_policy joolnl_struct_list_policy[JNLAL_COUNT] = {
-	[JNLAL_ENTRY] = { .type = NLA_NESTED }
+	[JNLAL_ENTRY] = { .type = NLA_NESTED },
+	[JNLAL_RM_ENTRY] = { .type = NLA_NESTED },
 };
 struct nla_policy joolnl_plateau_list_policy[JNLAL_COUNT] = {
-	[JNLAL_ENTRY] = { .type = NLA_U16 }
+	[JNLAL_ENTRY] = { .type = NLA_U16 },
+	[JNLAL_RM_ENTRY] = { .type = NLA_U16 },
 };
 
 struct nla_policy joolnl_instance_entry_policy[JNLAIE_COUNT] = {
@@ -80,6 +82,30 @@ struct nla_policy joolnl_session_entry_policy[JNLASE_COUNT] = {
 	[JNLASE_EXPIRATION] = { .type = NLA_U32 },
 };
 
+struct nla_policy joolnl_session_filter_policy[JNLASF_COUNT] = {
+	[JNLASF_SRC6] = { .type = NLA_NESTED },
+	[JNLASF_SRC4] = { .type = NLA_NESTED },
+	[JNLASF_PORT_MIN] = { .type = NLA_U16 },
+	[JNLASF_PORT_MAX] = { .type = NLA_U16 },
+	[JNLASF_DST4] = { .type = NLA_NESTED },
+	[JNLASF_STATE] = { .type = NLA_U8 },
+	[JNLASF_MIN_AGE] = { .type = NLA_U32 },
+};
+
+struct nla_policy joolnl_session_group_policy[JNLASG_COUNT] = {
+	[JNLASG_PREFIX6] = { .type = NLA_NESTED },
+	[JNLASG_ADDR4] = JOOLNL_ADDR4_POLICY,
+	[JNLASG_VALUE] = { .type = NLA_U32 },
+	[JNLASG_SESSIONS] = { .type = NLA_U32 },
+};
+
+struct nla_policy joolnl_occupancy_policy[JNLAO_COUNT] = {
+	[JNLAO_PROTO] = { .type = NLA_U8 },
+	[JNLAO_ADDR4] = JOOLNL_ADDR4_POLICY,
+	[JNLAO_BIBS] = { .type = NLA_U32 },
+	[JNLAO_MARK] = { .type = NLA_U32 },
+};
+
 struct nla_policy siit_globals_policy[JNLAG_COUNT] = {
 	[JNLAG_ENABLED] = { .type = NLA_U8 },
 	[JNLAG_POOL6] = { .type = NLA_NESTED },
@@ -94,6 +120,8 @@ struct nla_policy siit_globals_policy[JNLAG_COUNT] = {
 	[JNLAG_RANDOMIZE_ERROR_ADDR] = { .type = NLA_U8 },
 	[JNLAG_POOL6791V6] = { .type = NLA_NESTED },
 	[JNLAG_POOL6791V4] = { .type = NLA_NESTED },
+	[JNLAG_ICMP_ERRORS_RATE] = { .type = NLA_U32 },
+	[JNLAG_ICMP_ERRORS_BURST] = { .type = NLA_U32 },
 };
 
 struct nla_policy nat64_globals_policy[JNLAG_COUNT] = {
@@ -124,6 +152,20 @@ struct nla_policy nat64_globals_policy[JNLAG_COUNT] = {
 	[JNLAG_JOOLD_CAPACITY] = { .type = NLA_U32 },
 	[JNLAG_JOOLD_MAX_PAYLOAD] = { .type = NLA_U32 },
 	[JNLAG_JOOLD_MAX_SESSIONS_PER_PACKET] = { .type = NLA_U32 },
+	[JNLAG_ICMP_ERRORS_RATE] = { .type = NLA_U32 },
+	[JNLAG_ICMP_ERRORS_BURST] = { .type = NLA_U32 },
+	[JNLAG_JOOLD_WINDOW_SIZE] = { .type = NLA_U32 },
+	[JNLAG_JOOLD_SYNC_TCP] = { .type = NLA_U8 },
+	[JNLAG_JOOLD_SYNC_UDP] = { .type = NLA_U8 },
+	[JNLAG_JOOLD_SYNC_ICMP] = { .type = NLA_U8 },
+	[JNLAG_JOOLD_ESTABLISHED_ONLY] = { .type = NLA_U8 },
+	[JNLAG_JOOLD_MIN_AGE] = { .type = NLA_U32 },
+	[JNLAG_JOOLD_MARK_MIN] = { .type = NLA_U32 },
+	[JNLAG_JOOLD_MARK_MAX] = { .type = NLA_U32 },
+	[JNLAG_JOOLD_MAX_RATE] = { .type = NLA_U32 },
+	[JNLAG_JOOLD_SHARD_COUNT] = { .type = NLA_U32 },
+	[JNLAG_JOOLD_SHARD_ID] = { .type = NLA_U32 },
+	[JNLAG_NETLINK_LOGGING] = { .type = NLA_U8 },
 };
 
 int iname_validate(const char *iname, bool allow_null)
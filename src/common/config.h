@@ -16,6 +16,8 @@
 
 #define JOOLNL_FAMILY "Jool"
 #define JOOLNL_MULTICAST_GRP_NAME "joold"
+/* Multicast group of the BIB/session event stream. (See bib_event_record.) */
+#define JOOLNL_EVENTS_GRP_NAME "jool_events"
 
 #define JOOLNL_HDR_MAGIC "jool"
 #define JOOLNL_HDR_MAGIC_LEN 4
@@ -61,6 +63,14 @@ enum joolnl_operation {
 	JNLOP_JOOLD_ADD,
 	JNLOP_JOOLD_ADVERTISE,
 	JNLOP_JOOLD_ACK,
+
+	/*
+	 * Operations added after 4.1.11 go below, so the ones above keep
+	 * their numbers. (Peers only check each other's major.minor.)
+	 */
+	JNLOP_STATS_OCCUPANCY,
+	JNLOP_SESSION_QUERY,
+	JNLOP_SESSION_EXPORT,
 };
 
 enum joolnl_attr_root {
@@ -77,16 +87,40 @@ enum joolnl_attr_root {
 	JNLAR_PROTO,
 	JNLAR_ATOMIC_INIT,
 	JNLAR_ATOMIC_END,
+	JNLAR_JOOLD_SEQ,
+	JNLAR_SESSION_RECORDS,
+	JNLAR_JOOLD_AD_END,
+	JNLAR_SESSION_FILTER,
+	JNLAR_SESSION_GROUPING,
+	JNLAR_TABLE_IMAGE,
+	JNLAR_ATOMIC_DIFF,
+	JNLAR_BULK_RESULTS,
+	JNLAR_EVENT_RECORDS,
+	JNLAR_EVENT_SEQ,
+	JNLAR_EVENT_LOST,
 	JNLAR_COUNT,
 #define JNLAR_MAX (JNLAR_COUNT - 1)
 };
 
 enum joolnl_attr_list {
 	JNLAL_ENTRY = 1,
+	/* Differential atomic configuration only: Entry to remove. */
+	JNLAL_RM_ENTRY,
 	JNLAL_COUNT,
 #define JNLAL_MAX (JNLAL_COUNT - 1)
 };
 
+/*
+ * Maximum number of entries a bulk add or remove request can carry.
+ *
+ * The EAMT, denylist4, pool4 and BIB add and remove operations accept a list
+ * of JNLAL_ENTRYs (in the table's *_ENTRIES attribute) instead of the
+ * JNLAR_OPERAND. The response then carries JNLAR_BULK_RESULTS: an array of
+ * __u16s, one per entry, in request order. Each is zero if the entry was
+ * applied, or the positive error code otherwise.
+ */
+#define JNL_BULK_MAX 1024
+
 extern struct nla_policy joolnl_struct_list_policy[JNLAL_COUNT];
 extern struct nla_policy joolnl_plateau_list_policy[JNLAL_COUNT];
 
@@ -204,6 +238,46 @@ enum joolnl_attr_session {
 
 extern struct nla_policy joolnl_session_entry_policy[JNLASE_COUNT];
 
+enum joolnl_attr_session_filter {
+	JNLASF_SRC6 = 1,
+	JNLASF_SRC4,
+	JNLASF_PORT_MIN,
+	JNLASF_PORT_MAX,
+	JNLASF_DST4,
+	JNLASF_STATE,
+	JNLASF_MIN_AGE,
+	JNLASF_COUNT,
+#define JNLASF_MAX (JNLASF_COUNT - 1)
+};
+
+extern struct nla_policy joolnl_session_filter_policy[JNLASF_COUNT];
+
+enum joolnl_attr_session_group {
+	JNLASG_PREFIX6 = 1,
+	JNLASG_ADDR4,
+	JNLASG_VALUE,
+	JNLASG_SESSIONS,
+	JNLASG_COUNT,
+#define JNLASG_MAX (JNLASG_COUNT - 1)
+};
+
+extern struct nla_policy joolnl_session_group_policy[JNLASG_COUNT];
+
+/*
+ * Number of BIB entries some pool4 address is serving, for one mark.
+ * JNLAO_MARK is absent if the entries did not belong to pool4.
+ */
+enum joolnl_attr_occupancy {
+	JNLAO_PROTO = 1,
+	JNLAO_ADDR4,
+	JNLAO_BIBS,
+	JNLAO_MARK,
+	JNLAO_COUNT,
+#define JNLAO_MAX (JNLAO_COUNT - 1)
+};
+
+extern struct nla_policy joolnl_occupancy_policy[JNLAO_COUNT];
+
 enum joolnl_attr_address_query {
 	JNLAAQ_ADDR6 = 1,
 	JNLAAQ_ADDR4,
@@ -254,6 +328,26 @@ enum joolnl_attr_global {
 	JNLAG_JOOLD_MAX_PAYLOAD,
 	JNLAG_JOOLD_MAX_SESSIONS_PER_PACKET,
 
+	/* Common, again */
+	JNLAG_ICMP_ERRORS_RATE,
+	JNLAG_ICMP_ERRORS_BURST,
+
+	/* joold, again */
+	JNLAG_JOOLD_WINDOW_SIZE,
+	JNLAG_JOOLD_SYNC_TCP,
+	JNLAG_JOOLD_SYNC_UDP,
+	JNLAG_JOOLD_SYNC_ICMP,
+	JNLAG_JOOLD_ESTABLISHED_ONLY,
+	JNLAG_JOOLD_MIN_AGE,
+	JNLAG_JOOLD_MARK_MIN,
+	JNLAG_JOOLD_MARK_MAX,
+	JNLAG_JOOLD_MAX_RATE,
+	JNLAG_JOOLD_SHARD_COUNT,
+	JNLAG_JOOLD_SHARD_ID,
+
+	/* NAT64, again */
+	JNLAG_NETLINK_LOGGING,
+
 	/* Needs to be last */
 	JNLAG_COUNT,
 #define JNLAG_MAX (JNLAG_COUNT - 1)
@@ -312,6 +406,160 @@ struct joolnlhdr {
 
 #define JOOLNL_HDRLEN NLMSG_ALIGN(sizeof(struct joolnlhdr))
 
+/*
+ * Session synchronization records.
+ *
+ * This is the content of the JNLAR_SESSION_RECORDS attribute, which joold
+ * relays untouched between the kernel modules of the synchronized hosts.
+ * It's a struct joold_records_hdr followed by @count packed records.
+ *
+ * Each record is
+ *
+ *	flags (1 byte, JSR_*)
+ *	proto (2 bits), timer type (2 bits), TCP state (4 bits)
+ *	src6 address (16 bytes; absent if JSR_SRC6_ADDR_REPEATED)
+ *	src6 port (2 bytes)
+ *	src4 address (4 bytes; absent if JSR_SRC4_ADDR_REPEATED)
+ *	src4 port (2 bytes)
+ *	dst4 address (4 bytes; absent if JSR_DST4_ADDR_REPEATED)
+ *	dst4 port (2 bytes)
+ *	dst6 address (16 bytes; only if JSR_DST6_ADDR)
+ *	dst6 port (2 bytes; only if JSR_DST6_PORT)
+ *	milliseconds since the session was last updated
+ *		(2 bytes, or 4 if JSR_AGE_LONG)
+ *
+ * Multibyte fields are in network byte order. "Repeated" fields are the same
+ * as in the previous record of the batch. Absent dst6 addresses are pool6 +
+ * dst4, and absent dst6 ports equal the dst4 port.
+ */
+struct joold_records_hdr {
+	/**
+	 * Always JOOLD_RECORDS_MAGIC.
+	 * (Legacy session containers start with a Netlink attribute length,
+	 * which can never be 0xFFFF inside of a UDP datagram.)
+	 */
+	__u8 magic[2];
+	__u8 version; /* JOOLD_RECORDS_VERSION */
+	__u8 reserved;
+	__be16 count;
+};
+
+#define JOOLD_RECORDS_MAGIC 0xFF
+#define JOOLD_RECORDS_VERSION 1
+#define JOOLD_RECORDS_HDRLEN sizeof(struct joold_records_hdr)
+
+#define JSR_SRC6_ADDR_REPEATED (1 << 0)
+#define JSR_SRC4_ADDR_REPEATED (1 << 1)
+#define JSR_DST4_ADDR_REPEATED (1 << 2)
+#define JSR_DST6_ADDR (1 << 3)
+#define JSR_DST6_PORT (1 << 4)
+#define JSR_AGE_LONG (1 << 5)
+
+/*
+ * Binary image of the BIB and session tables.
+ *
+ * This is what `jool session export` writes: a struct table_image_hdr,
+ * followed by fixed-size records until the end of the file. The kernel sends
+ * the records (without the header) in JNLAR_TABLE_IMAGE attributes.
+ *
+ * The records are grouped by table (TCP, UDP, ICMP). Within each table, the
+ * BIB entries come first, sorted by src4, followed by the sessions, sorted by
+ * src4 and then dst4.
+ *
+ * Multibyte fields are in network byte order.
+ */
+struct table_image_hdr {
+	__u8 magic[8]; /* TABLE_IMAGE_MAGIC, without the null character */
+	__be32 version; /* TABLE_IMAGE_VERSION */
+	/**
+	 * Size of each record. Newer versions might append fields; readers
+	 * should use this (rather than sizeof) to find the records.
+	 */
+	__be16 record_size;
+	__u16 reserved;
+	/** Seconds since the epoch, at the beginning of the export. */
+	__be64 timestamp;
+};
+
+#define TABLE_IMAGE_MAGIC "JOOLTBLS"
+#define TABLE_IMAGE_VERSION 1
+
+enum table_image_type {
+	TIR_BIB = 1,
+	TIR_SESSION = 2,
+};
+
+/* The BIB entry was created by the administrator. (BIB records only.) */
+#define TIRF_STATIC (1 << 0)
+
+struct table_image_record {
+	__u8 type; /* enum table_image_type */
+	__u8 proto; /* l4_protocol */
+	__u8 state; /* tcp_state (TCP sessions only) */
+	__u8 flags; /* TIRF_* */
+
+	struct in6_addr src6;
+	struct in6_addr dst6; /* Sessions only */
+	struct in_addr src4;
+	struct in_addr dst4; /* Sessions only */
+	__be16 src6_port;
+	__be16 dst6_port; /* Sessions only */
+	__be16 src4_port;
+	__be16 dst4_port; /* Sessions only */
+
+	/* Sessions only; all of these are in milliseconds. */
+	__be32 idle; /* Since the session was last updated */
+	__be32 age; /* Since the session was created */
+	__be32 expires; /* Until the session expires */
+};
+
+/*
+ * BIB/session event stream.
+ *
+ * If logging-netlink is enabled, the events that logging-bib and
+ * logging-session select are multicast to JOOLNL_EVENTS_GRP_NAME, instead of
+ * printed. Each message carries a Jool header (whose iname is the instance's),
+ * and:
+ *
+ * - JNLAR_EVENT_RECORDS: Array of struct bib_event_record.
+ * - JNLAR_EVENT_SEQ (u32): Sequence number of the message, per instance.
+ *   (Listeners that fall behind lose messages; this exposes the gaps.)
+ * - JNLAR_EVENT_LOST (u32): Number of records the instance has dropped so
+ *   far, because they could not be queued, or a listener could not take
+ *   them.
+ *
+ * Records are batched per CPU, so messages are not sorted by time; the
+ * timestamps are.
+ *
+ * Multibyte fields are in network byte order.
+ */
+enum bib_event_type {
+	BEV_BIB_ADD = 1,
+	BEV_BIB_RM,
+	BEV_SESSION_ADD,
+	BEV_SESSION_RM,
+};
+
+struct bib_event_record {
+	/** Nanoseconds since the epoch. */
+	__be64 timestamp;
+	__u8 type; /* enum bib_event_type */
+	__u8 proto; /* l4_protocol */
+	__u8 reserved[6];
+
+	struct in_addr src4;
+	struct in_addr dst4; /* Sessions only */
+	__be16 src6_port;
+	__be16 dst6_port; /* Sessions only */
+	__be16 src4_port;
+	__be16 dst4_port; /* Sessions only */
+	struct in6_addr src6;
+	struct in6_addr dst6; /* Sessions only */
+};
+
+/** Size of the largest possible record. */
+#define JOOLD_RECORD_MAX_LEN (1 + 1 + 16 + 2 + 4 + 2 + 4 + 2 + 16 + 2 + 4)
+
 struct config_prefix6 {
 	bool set;
 	/** Please note that this could be garbage; see above. */
@@ -324,6 +572,41 @@ struct config_prefix4 {
 	struct ipv4_prefix prefix;
 };
 
+/**
+ * Criteria a session has to meet to be listed or counted by a session query.
+ * Unset criteria match everything.
+ */
+struct session_filter {
+	/** Remote IPv6 address. */
+	struct config_prefix6 src6;
+	/** IPv4 address the NAT64 is masking @src6 with (ie. pool4 address). */
+	struct config_prefix4 src4;
+	/** Ports (or ICMP identifiers) of @src4. Unset is [0, 65535]. */
+	struct port_range ports;
+	/** Remote IPv4 address. */
+	struct config_prefix4 dst4;
+	bool state_set;
+	/** tcp_state. Only meaningful if @state_set. */
+	__u8 state;
+	/** Minimum milliseconds since the session was created. Zero is unset. */
+	__u32 min_age;
+};
+
+/** How a session query aggregates the sessions that match its filter. */
+enum session_grouping {
+	/** A single group, which counts every matching session. */
+	SG_TOTAL = 0,
+	/** One group per /64 of remote IPv6 address (ie. per subscriber.) */
+	SG_SRC6,
+	/** One group per pool4 address. */
+	SG_SRC4,
+	/** One group per TCP state. */
+	SG_STATE,
+	/** Histogram of the time the sessions have left before expiring. */
+	SG_LIFETIME,
+};
+#define SG_MAX SG_LIFETIME
+
 /**
  * Issued during atomic configuration initialization.
  */
@@ -407,6 +690,11 @@ struct bib_config {
 
 	bool bib_logging;
 	bool session_logging;
+	/**
+	 * Send the BIB and session logs to the JOOLNL_EVENTS_GRP_NAME
+	 * multicast group (as bib_event_records), instead of the kernel log?
+	 */
+	bool netlink_logging;
 
 	/** Use Address-Dependent Filtering? */
 	bool drop_by_addr;
@@ -427,9 +715,10 @@ struct joold_config {
 	 *        (Note: In theory, this might be more often than it seems.
 	 *        It's not whenever a connection is initiated;
 	 *        it's on every translated packet except ICMP errors.
-	 *        In practice however, flushes are prohibited until the next
-	 *        ACK (otherwise joold quickly saturates the kernel), so
-	 *        sessions will end up queuing up even in this mode.)
+	 *        In practice however, flushes are prohibited while
+	 *        @window_size packets are awaiting ACKs (otherwise joold
+	 *        quickly saturates the kernel), so sessions will end up
+	 *        queuing up even in this mode.)
 	 *        This is the preferred method in active scenarios.
 	 * false: Wait until we have enough sessions to fill a packet before
 	 *        sending them.
@@ -440,8 +729,8 @@ struct joold_config {
 
 	/**
 	 * The timer forcibly flushes the queue if this hasn't happened after
-	 * this amount of milliseconds, regardless of the ACK and @flush_asap.
-	 * This helps if an ACK is lost for some reason.
+	 * this amount of milliseconds, regardless of the ACKs and @flush_asap.
+	 * This helps if ACKs are lost for some reason.
 	 */
 	__u32 flush_deadline;
 
@@ -472,6 +761,57 @@ struct joold_config {
 	 * code. (I guess I'm missing something.)
 	 */
 	__u32 max_sessions_per_pkt;
+
+	/**
+	 * Maximum number of packets joold can have sent to userspace without
+	 * having received their ACKs.
+	 *
+	 * Each packet carries a sequence number, and each ACK acknowledges
+	 * every packet up to and including the one it names. 1 is the old
+	 * stop-and-wait behavior.
+	 */
+	__u32 window_size;
+
+	/*
+	 * Replication filters. Sessions that do not pass them are never queued.
+	 * Most short-lived sessions (DNS, pings) are worthless after a failover,
+	 * so there's no point in spending bandwidth on them.
+	 */
+
+	/** Synchronize TCP sessions? */
+	bool sync_tcp;
+	/** Synchronize UDP sessions? */
+	bool sync_udp;
+	/** Synchronize ICMP sessions? */
+	bool sync_icmp;
+	/** Skip TCP sessions that are still in the handshake (V4/V6 INIT)? */
+	bool established_only;
+	/** Sessions younger than this (in milliseconds) are not synchronized. */
+	__u32 min_age;
+	/**
+	 * Only synchronize sessions whose pool4 entry's mark is within
+	 * [@mark_min, @mark_max].
+	 */
+	__u32 mark_min;
+	__u32 mark_max;
+
+	/**
+	 * Maximum number of sessions each CPU is allowed to queue per second.
+	 * Zero means unlimited.
+	 */
+	__u32 max_rate;
+
+	/*
+	 * Sharding, for active-active clusters. The sessions are split into
+	 * @shard_count shards by source IPv6 address. This node owns shard
+	 * @shard_id, and backs up shard @shard_id - 1. Sessions from other
+	 * shards are dropped when they arrive from joold.
+	 */
+
+	/** Number of nodes in the cluster. 0 and 1 mean every node wants all. */
+	__u32 shard_count;
+	/** This node's index, in [0, @shard_count). */
+	__u32 shard_id;
 };
 
 /**
@@ -529,6 +869,15 @@ struct jool_globals {
 	 */
 	struct mtu_plateaus plateaus;
 
+	/**
+	 * Maximum number of ICMP errors (generated by Jool, not translated)
+	 * per second, per CPU, per destination prefix.
+	 * Zero disables the limit.
+	 */
+	__u32 icmp_errors_rate;
+	/** Maximum number of ICMP errors allowed to be sent in a row. */
+	__u32 icmp_errors_burst;
+
 	union {
 		struct {
 			/**
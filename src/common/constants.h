@@ -72,12 +72,15 @@
 #define DEFAULT_HANDLE_FIN_RCV_RST false
 #define DEFAULT_BIB_LOGGING false
 #define DEFAULT_SESSION_LOGGING false
+#define DEFAULT_NETLINK_LOGGING false
 
 #define DEFAULT_INSTANCE_ENABLED true
 #define DEFAULT_RESET_TRAFFIC_CLASS false
 #define DEFAULT_RESET_TOS false
 #define DEFAULT_NEW_TOS 0
 #define DEFAULT_LOWEST_IPV6_MTU 1280
+#define DEFAULT_ICMP_ERRORS_RATE 0
+#define DEFAULT_ICMP_ERRORS_BURST 10
 #define DEFAULT_COMPUTE_UDP_CSUM0 false
 #define DEFAULT_EAM_HAIRPIN_MODE EHM_INTRINSIC
 #define DEFAULT_RANDOMIZE_RFC6791 true
@@ -102,16 +105,27 @@
  * 			Typical MTU
  * 			- max(IPv4 header size, IPv6 header size)
  * 			- UDP header size
- * 			- root attribute header size
+ * 			- records header size
  * 		) / (
- * 			serialized session size
+ * 			maximum record size
  * 		)
  * 	)
  *
- * The root attribute header size and serialized session size need to be
- * computed the hard way. Run the joold unit test to find them in dmesg.
+ * See JOOLD_RECORDS_HDRLEN and JOOLD_RECORD_MAX_LEN. (Most records are
+ * considerably smaller than the maximum, but we don't want to fragment.)
  */
-#define DEFAULT_JOOLD_MAX_SESSIONS_PER_PKT ((1500 - 40 - 8 - 4) / 140)
+#define DEFAULT_JOOLD_MAX_SESSIONS_PER_PKT ((1500 - 40 - 8 - 6) / 54)
+#define DEFAULT_JOOLD_WINDOW_SIZE 4
+#define DEFAULT_JOOLD_SYNC_TCP true
+#define DEFAULT_JOOLD_SYNC_UDP true
+#define DEFAULT_JOOLD_SYNC_ICMP true
+#define DEFAULT_JOOLD_ESTABLISHED_ONLY false
+#define DEFAULT_JOOLD_MIN_AGE 0
+#define DEFAULT_JOOLD_MARK_MIN 0
+#define DEFAULT_JOOLD_MARK_MAX 0xFFFFFFFFU
+#define DEFAULT_JOOLD_MAX_RATE 0
+#define DEFAULT_JOOLD_SHARD_COUNT 0
+#define DEFAULT_JOOLD_SHARD_ID 0
 
 /* -- IPv6 Pool -- */
 
@@ -135,6 +149,13 @@
 /** Code 2 for ICMP messages of type ICMP_PARAMETERPROB. */
 #define ICMP_BAD_LENGTH 2
 
+/*
+ * ICMP error rate limiting groups destinations by these prefix lengths.
+ * (One IPv4 subnet, one IPv6 site.)
+ */
+#define ICMP_RATELIMIT_PREFIX4_LEN 24
+#define ICMP_RATELIMIT_PREFIX6_LEN 48
+
 
 /* -- Netlink -- */
 
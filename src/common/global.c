@@ -284,6 +284,35 @@ static int nl2raw_f_args(struct nlattr *attr, void *raw, bool force)
 	return 0;
 }
 
+static int nl2raw_joold_window_size(struct nlattr *attr, void *raw,
+		bool force)
+{
+	__u32 size;
+
+	size = nla_get_u32(attr);
+	if (size < 1) {
+		log_err("ss-window-size cannot be zero.");
+		return -EINVAL;
+	}
+
+	*((__u32 *)raw) = size;
+	return 0;
+}
+
+static int nl2raw_icmp_errors_burst(struct nlattr *attr, void *raw, bool force)
+{
+	__u32 burst;
+
+	burst = nla_get_u32(attr);
+	if (burst < 1) {
+		log_err("icmp-errors-burst cannot be zero.");
+		return -EINVAL;
+	}
+
+	*((__u32 *)raw) = burst;
+	return 0;
+}
+
 #else
 
 static void print_bool(void *value, bool csv)
@@ -961,6 +990,13 @@ static const struct joolnl_global_meta globals_metadata[] = {
 		.doc = "Log sessions as they are created and destroyed?",
 		.offset = offsetof(struct jool_globals, nat64.bib.session_logging),
 		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_NETLINK_LOGGING,
+		.name = "logging-netlink",
+		.type = &gt_bool,
+		.doc = "Send the BIB and session logs to Netlink listeners (in binary), instead of the kernel log?",
+		.offset = offsetof(struct jool_globals, nat64.bib.netlink_logging),
+		.xt = XT_NAT64,
 	}, {
 		.id = JNLAG_MAX_STORED_PKTS,
 		.name = "maximum-simultaneous-opens",
@@ -1010,6 +1046,103 @@ static const struct joolnl_global_meta globals_metadata[] = {
 		.doc = "Maximum number of sessions to send, per joold packet.",
 		.offset = offsetof(struct jool_globals, nat64.joold.max_sessions_per_pkt),
 		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_ICMP_ERRORS_RATE,
+		.name = "icmp-errors-rate",
+		.type = &gt_uint32,
+		.doc = "Maximum ICMP errors generated per second, per CPU, per destination prefix. (0 = unlimited)",
+		.offset = offsetof(struct jool_globals, icmp_errors_rate),
+		.xt = XT_ANY,
+	}, {
+		.id = JNLAG_ICMP_ERRORS_BURST,
+		.name = "icmp-errors-burst",
+		.type = &gt_uint32,
+		.doc = "Maximum ICMP errors generated in a row, per CPU, per destination prefix.",
+		.offset = offsetof(struct jool_globals, icmp_errors_burst),
+		.xt = XT_ANY,
+#ifdef __KERNEL__
+		.nl2raw = nl2raw_icmp_errors_burst,
+#endif
+	}, {
+		.id = JNLAG_JOOLD_WINDOW_SIZE,
+		.name = "ss-window-size",
+		.type = &gt_uint32,
+		.doc = "Maximum number of joold packets awaiting ACK.",
+		.offset = offsetof(struct jool_globals, nat64.joold.window_size),
+		.xt = XT_NAT64,
+#ifdef __KERNEL__
+		.nl2raw = nl2raw_joold_window_size,
+#endif
+	}, {
+		.id = JNLAG_JOOLD_SYNC_TCP,
+		.name = "ss-sync-tcp",
+		.type = &gt_bool,
+		.doc = "Synchronize TCP sessions?",
+		.offset = offsetof(struct jool_globals, nat64.joold.sync_tcp),
+		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_JOOLD_SYNC_UDP,
+		.name = "ss-sync-udp",
+		.type = &gt_bool,
+		.doc = "Synchronize UDP sessions?",
+		.offset = offsetof(struct jool_globals, nat64.joold.sync_udp),
+		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_JOOLD_SYNC_ICMP,
+		.name = "ss-sync-icmp",
+		.type = &gt_bool,
+		.doc = "Synchronize ICMP sessions?",
+		.offset = offsetof(struct jool_globals, nat64.joold.sync_icmp),
+		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_JOOLD_ESTABLISHED_ONLY,
+		.name = "ss-established-only",
+		.type = &gt_bool,
+		.doc = "Skip TCP sessions that have not completed their handshake?",
+		.offset = offsetof(struct jool_globals, nat64.joold.established_only),
+		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_JOOLD_MIN_AGE,
+		.name = "ss-min-session-age",
+		.type = &gt_timeout,
+		.doc = "Do not synchronize sessions younger than this.",
+		.offset = offsetof(struct jool_globals, nat64.joold.min_age),
+		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_JOOLD_MARK_MIN,
+		.name = "ss-mark-min",
+		.type = &gt_uint32,
+		.doc = "Do not synchronize sessions whose pool4 mark is lower than this.",
+		.offset = offsetof(struct jool_globals, nat64.joold.mark_min),
+		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_JOOLD_MARK_MAX,
+		.name = "ss-mark-max",
+		.type = &gt_uint32,
+		.doc = "Do not synchronize sessions whose pool4 mark is higher than this.",
+		.offset = offsetof(struct jool_globals, nat64.joold.mark_max),
+		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_JOOLD_MAX_RATE,
+		.name = "ss-max-rate",
+		.type = &gt_uint32,
+		.doc = "Maximum sessions queued for synchronization per second, per CPU. (0 = unlimited)",
+		.offset = offsetof(struct jool_globals, nat64.joold.max_rate),
+		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_JOOLD_SHARD_COUNT,
+		.name = "ss-shard-count",
+		.type = &gt_uint32,
+		.doc = "Number of nodes the sessions are sharded across. (0 = no sharding)",
+		.offset = offsetof(struct jool_globals, nat64.joold.shard_count),
+		.xt = XT_NAT64,
+	}, {
+		.id = JNLAG_JOOLD_SHARD_ID,
+		.name = "ss-shard-id",
+		.type = &gt_uint32,
+		.doc = "This node's shard; it also backs up the previous one.",
+		.offset = offsetof(struct jool_globals, nat64.joold.shard_id),
+		.xt = XT_NAT64,
 	},
 };
 
@@ -93,6 +93,29 @@ enum jool_stat_id {
 
 	JSTAT_ICMPEXT_BIG,
 
+	JSTAT_JOOLD_FILTERED,
+	JSTAT_JOOLD_RATELIMIT,
+	JSTAT_JOOLD_FOREIGN,
+	JSTAT_BIB_EVENTS_LOST,
+
+	JSTAT_TCP_BIB_ENTRIES,
+	JSTAT_UDP_BIB_ENTRIES,
+	JSTAT_ICMP_BIB_ENTRIES,
+	JSTAT_TCP_SESSIONS,
+	JSTAT_UDP_SESSIONS,
+	JSTAT_ICMP_SESSIONS,
+	/* TCP sessions per state. Same order as tcp_state. */
+	JSTAT_TCP_ESTABLISHED,
+	JSTAT_TCP_V6_INIT,
+	JSTAT_TCP_V4_INIT,
+	JSTAT_TCP_V4_FIN_RCV,
+	JSTAT_TCP_V6_FIN_RCV,
+	JSTAT_TCP_V4_FIN_V6_FIN_RCV,
+	JSTAT_TCP_TRANS,
+
+	JSTAT_ICMPERR_RATELIMIT,
+	JSTAT_JOOLD_RING_FULL,
+
 	/* These 3 need to be last, and in this order. */
 	JSTAT_UNKNOWN, /* "WTF was that" errors only. */
 	JSTAT_PADDING,
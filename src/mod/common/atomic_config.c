@@ -9,6 +9,7 @@
 #include "mod/common/nl/nl_common.h"
 #include "mod/common/db/eam.h"
 #include "mod/common/db/denylist4.h"
+#include "mod/common/db/global.h"
 #include "mod/common/joold.h"
 #include "mod/common/db/pool4/db.h"
 #include "mod/common/db/bib/db.h"
@@ -24,10 +25,28 @@
  * "configuration candidate") as Netlink messages arrive. The running
  * configuration is then only replaced when the candidate has been completed and
  * validated.
+ *
+ * A "differential" candidate is the same, except its tables are the running
+ * instance's. Userspace only sends the entries that need to be added or
+ * removed, and these are queued until the commit, where they are applied to
+ * the running tables. This way, commit time is proportional to the size of the
+ * change, not to the size of the configuration.
  */
 struct config_candidate {
 	struct xlator xlator;
 
+	/* Differential candidates only. */
+	bool diff;
+	/* Changes to the EAMT, denylist4 and BIB; see struct config_change. */
+	struct list_head removals;
+	struct list_head additions;
+	/*
+	 * pool4 is usually small, and its entries are merged and split as they
+	 * are added, so it's rebuilt from scratch instead. It only replaces the
+	 * running pool4 if the two differ.
+	 */
+	struct pool4 *pool4;
+
 	/** Last jiffy the user made an edit. */
 	unsigned long update_time;
 	/** Process ID of the client that is populating this candidate. */
@@ -43,14 +62,51 @@ struct config_candidate {
  */
 #define TIMEOUT msecs_to_jiffies(2000)
 
+enum config_change_type {
+	CHANGE_EAMT,
+	CHANGE_DENYLIST4,
+	CHANGE_BIB,
+};
+
+/**
+ * An entry a differential candidate wants to add to (or remove from) one of
+ * the running instance's tables.
+ */
+struct config_change {
+	enum config_change_type type;
+	/* Allow the entry to overlap with others? (EAMT and denylist4 only) */
+	bool force;
+	union {
+		struct eamt_entry eam;
+		struct ipv4_prefix prefix;
+		struct bib_entry bib;
+	};
+	struct list_head list_hook;
+};
+
 static LIST_HEAD(db);
 static DEFINE_MUTEX(lock);
 
+static void destroy_changes(struct list_head *changes)
+{
+	struct config_change *change;
+	struct config_change *tmp;
+
+	list_for_each_entry_safe(change, tmp, changes, list_hook) {
+		list_del(&change->list_hook);
+		wkfree(struct config_change, change);
+	}
+}
+
 static void candidate_destroy(struct config_candidate *candidate)
 {
 	LOG_DEBUG("Destroying atomic configuration candidate '%s'.",
 			candidate->xlator.iname);
 	xlator_put(&candidate->xlator);
+	destroy_changes(&candidate->removals);
+	destroy_changes(&candidate->additions);
+	if (candidate->pool4)
+		pool4db_put(candidate->pool4);
 	list_del(&candidate->list_hook);
 	wkfree(struct config_candidate, candidate);
 }
@@ -133,8 +189,45 @@ static int get_candidate(char *iname, struct config_candidate **result)
 	return -ESRCH;
 }
 
+/*
+ * Initializes @candidate as a clone of the running instance, except for the
+ * globals, which are reset. (Because, like in full mode, the file is supposed
+ * to define all of them, and omission means default.)
+ */
+static int init_diff(struct config_candidate *candidate, struct net *ns,
+		char *iname, xlator_flags flags)
+{
+	int error;
+
+	error = xlator_find(ns, flags, iname, &candidate->xlator);
+	if (error) {
+		if (error == -ESRCH)
+			log_err("Differential configuration requires an existing instance.");
+		return error;
+	}
+
+	error = globals_init(&candidate->xlator.globals, xlator_flags2xt(flags),
+			NULL);
+	if (error)
+		goto fail;
+
+	if (xlator_is_nat64(&candidate->xlator)) {
+		candidate->pool4 = pool4db_alloc();
+		if (!candidate->pool4) {
+			error = -ENOMEM;
+			goto fail;
+		}
+	}
+
+	return 0;
+
+fail:
+	xlator_put(&candidate->xlator);
+	return error;
+}
+
 static int handle_init(struct config_candidate **out, struct nlattr *attr,
-		char *iname, xlator_type xt)
+		char *iname, xlator_type xt, bool diff)
 {
 	struct config_candidate *candidate;
 	struct net *ns;
@@ -154,8 +247,15 @@ static int handle_init(struct config_candidate **out, struct nlattr *attr,
 		goto end;
 	}
 
-	error = xlator_init(&candidate->xlator, ns, iname, nla_get_u8(attr) | xt,
-			NULL);
+	candidate->diff = diff;
+	INIT_LIST_HEAD(&candidate->removals);
+	INIT_LIST_HEAD(&candidate->additions);
+	candidate->pool4 = NULL;
+
+	error = diff
+			? init_diff(candidate, ns, iname, nla_get_u8(attr) | xt)
+			: xlator_init(&candidate->xlator, ns, iname,
+					nla_get_u8(attr) | xt, NULL);
 	if (error) {
 		wkfree(struct config_candidate, candidate);
 		goto end;
@@ -170,6 +270,34 @@ end:	put_net(ns);
 	return error;
 }
 
+/*
+ * Full candidates only care about JNLAL_ENTRYs. Differential ones also accept
+ * removals.
+ */
+static bool is_entry(struct config_candidate *candidate, struct nlattr *attr)
+{
+	return nla_type(attr) == JNLAL_ENTRY || (candidate->diff
+			&& nla_type(attr) == JNLAL_RM_ENTRY);
+}
+
+/* Returns the new change; the caller needs to fill in the entry. */
+static struct config_change *queue_change(struct config_candidate *candidate,
+		struct nlattr *attr, enum config_change_type type, bool force)
+{
+	struct config_change *change;
+
+	change = wkmalloc(struct config_change, GFP_KERNEL);
+	if (!change)
+		return NULL;
+
+	change->type = type;
+	change->force = force;
+	list_add_tail(&change->list_hook, (nla_type(attr) == JNLAL_RM_ENTRY)
+			? &candidate->removals
+			: &candidate->additions);
+	return change;
+}
+
 static int handle_global(struct config_candidate *new, struct nlattr *attr,
 		joolnlhdr_flags flags)
 {
@@ -184,6 +312,7 @@ static int handle_eamt(struct config_candidate *new, struct nlattr *root,
 {
 	struct nlattr *attr;
 	struct eamt_entry entry;
+	struct config_change *change;
 	int rem;
 	int error;
 
@@ -195,11 +324,20 @@ static int handle_eamt(struct config_candidate *new, struct nlattr *root,
 	}
 
 	nla_for_each_nested(attr, root, rem) {
-		if (nla_type(attr) != JNLAL_ENTRY)
+		if (!is_entry(new, attr))
 			continue; /* ? */
 		error = jnla_get_eam(attr, "EAMT entry", &entry);
 		if (error)
 			return error;
+
+		if (new->diff) {
+			change = queue_change(new, attr, CHANGE_EAMT, force);
+			if (!change)
+				return -ENOMEM;
+			change->eam = entry;
+			continue;
+		}
+
 		error = eamt_add(new->xlator.siit.eamt, &entry, force, false);
 		if (error)
 			return error;
@@ -213,6 +351,7 @@ static int handle_denylist4(struct config_candidate *new, struct nlattr *root,
 {
 	struct nlattr *attr;
 	struct ipv4_prefix entry;
+	struct config_change *change;
 	int rem;
 	int error;
 
@@ -224,11 +363,20 @@ static int handle_denylist4(struct config_candidate *new, struct nlattr *root,
 	}
 
 	nla_for_each_nested(attr, root, rem) {
-		if (nla_type(attr) != JNLAL_ENTRY)
+		if (!is_entry(new, attr))
 			continue; /* ? */
 		error = jnla_get_prefix4(attr, "IPv4 denylist4 entry", &entry);
 		if (error)
 			return error;
+
+		if (new->diff) {
+			change = queue_change(new, attr, CHANGE_DENYLIST4, force);
+			if (!change)
+				return -ENOMEM;
+			change->prefix = entry;
+			continue;
+		}
+
 		error = denylist4_add(new->xlator.siit.denylist4, &entry, force);
 		if (error)
 			return error;
@@ -257,7 +405,9 @@ static int handle_pool4(struct config_candidate *new, struct nlattr *root)
 		error = jnla_get_pool4(attr, "pool4 entry", &entry);
 		if (error)
 			return error;
-		error = pool4db_add(new->xlator.nat64.pool4, &entry);
+		error = pool4db_add(new->diff
+				? new->pool4
+				: new->xlator.nat64.pool4, &entry);
 		if (error)
 			return error;
 	}
@@ -269,6 +419,7 @@ static int handle_bib(struct config_candidate *new, struct nlattr *root)
 {
 	struct nlattr *attr;
 	struct bib_entry entry;
+	struct config_change *change;
 	int rem;
 	int error;
 
@@ -280,11 +431,20 @@ static int handle_bib(struct config_candidate *new, struct nlattr *root)
 	}
 
 	nla_for_each_nested(attr, root, rem) {
-		if (nla_type(attr) != JNLAL_ENTRY)
+		if (!is_entry(new, attr))
 			continue; /* ? */
 		error = jnla_get_bib(attr, "BIB entry", &entry);
 		if (error)
 			return error;
+
+		if (new->diff) {
+			change = queue_change(new, attr, CHANGE_BIB, false);
+			if (!change)
+				return -ENOMEM;
+			change->bib = entry;
+			continue;
+		}
+
 		error = bib_add_static(&new->xlator, &entry);
 		if (error)
 			return error;
@@ -293,15 +453,162 @@ static int handle_bib(struct config_candidate *new, struct nlattr *root)
 	return 0;
 }
 
+/*
+ * If @undo, the change is being rolled back (ie. @add is the opposite of what
+ * the user requested), so validations are skipped.
+ */
+static int apply_change(struct config_candidate *candidate,
+		struct config_change *change, bool add, bool undo)
+{
+	struct xlator *jool = &candidate->xlator;
+	bool force = change->force || undo;
+
+	switch (change->type) {
+	case CHANGE_EAMT:
+		return add
+			? eamt_add(jool->siit.eamt, &change->eam, force, true)
+			: eamt_rm(jool->siit.eamt, &change->eam.prefix6,
+					&change->eam.prefix4);
+	case CHANGE_DENYLIST4:
+		return add
+			? denylist4_add(jool->siit.denylist4, &change->prefix,
+					force)
+			: denylist4_rm(jool->siit.denylist4, &change->prefix);
+	case CHANGE_BIB:
+		if (!add)
+			return bib_rm(jool, &change->bib);
+		/* candidate->pool4 is the pool4 the instance is going to have. */
+		if (!undo && !pool4db_contains(candidate->pool4, jool->ns,
+				change->bib.l4_proto, &change->bib.addr4)) {
+			log_err("%s BIB transport address '" TA4PP
+					"' does not belong to pool4.\n"
+					"Please add it there first.",
+					l4proto_to_string(change->bib.l4_proto),
+					TA4PA(change->bib.addr4));
+			return -EINVAL;
+		}
+		return bib_add_static(jool, &change->bib);
+	}
+
+	WARN(1, "Unknown configuration change type: %u", change->type);
+	return -EINVAL;
+}
+
+static int undo_change(struct config_candidate *candidate,
+		struct config_change *change, bool add)
+{
+	int error;
+
+	/* (Note: Restoring a BIB entry does not restore its sessions.) */
+	error = apply_change(candidate, change, !add, true);
+	if (error)
+		log_err("Could not roll back a configuration change (error %d).",
+				error);
+	return error;
+}
+
+/*
+ * Returns -ENOTRECOVERABLE if at least one of the changes could not be rolled
+ * back, 0 otherwise.
+ */
+static int undo_changes(struct config_candidate *candidate,
+		struct list_head *changes, bool add)
+{
+	struct config_change *change;
+	int error = 0;
+
+	list_for_each_entry_reverse(change, changes, list_hook)
+		if (undo_change(candidate, change, add))
+			error = -ENOTRECOVERABLE;
+
+	return error;
+}
+
+/*
+ * On failure, rolls back the changes from @changes that were applied.
+ * Returns -ENOTRECOVERABLE if the rollback itself failed.
+ */
+static int apply_changes(struct config_candidate *candidate,
+		struct list_head *changes, bool add)
+{
+	struct config_change *change;
+	int error;
+
+	list_for_each_entry(change, changes, list_hook) {
+		error = apply_change(candidate, change, add, false);
+		if (error)
+			goto rollback;
+	}
+
+	return 0;
+
+rollback:
+	list_for_each_entry_continue_reverse(change, changes, list_hook)
+		if (undo_change(candidate, change, add))
+			error = -ENOTRECOVERABLE;
+	return error;
+}
+
+/*
+ * Each table change is published (via RCU or the table's spinlock) as soon as
+ * it's applied, so the transaction is all-or-nothing, but not instantaneous.
+ * The globals and pool4 are published together, at the end.
+ *
+ * If the commit fails and the changes cannot be fully rolled back, returns
+ * -ENOTRECOVERABLE, because the running instance is left half-updated.
+ */
+static int commit_diff(struct config_candidate *candidate)
+{
+	struct xlator *jool = &candidate->xlator;
+	bool pool4_changed;
+	int error;
+
+	pool4_changed = xlator_is_nat64(jool)
+			&& !pool4db_equals(jool->nat64.pool4, candidate->pool4);
+
+	/* Removals first, so entries can be replaced. */
+	error = apply_changes(candidate, &candidate->removals, false);
+	if (error)
+		return error;
+	error = apply_changes(candidate, &candidate->additions, true);
+	if (error)
+		goto revert_removals;
+
+	if (pool4_changed)
+		swap(jool->nat64.pool4, candidate->pool4);
+
+	error = xlator_replace_clone(jool, pool4_changed);
+	if (error)
+		goto revert_pool4;
+
+	return 0;
+
+revert_pool4:
+	if (pool4_changed)
+		swap(jool->nat64.pool4, candidate->pool4);
+	if (undo_changes(candidate, &candidate->additions, true))
+		error = -ENOTRECOVERABLE;
+revert_removals:
+	if (undo_changes(candidate, &candidate->removals, false))
+		error = -ENOTRECOVERABLE;
+	return error;
+}
+
 static int commit(struct config_candidate *candidate)
 {
 	int error;
 
 	LOG_DEBUG("Handling atomic END attribute.");
 
-	error = xlator_replace(&candidate->xlator);
+	error = candidate->diff
+			? commit_diff(candidate)
+			: xlator_replace(&candidate->xlator);
+	if (error == -ENOTRECOVERABLE) {
+		log_err("The commit failed, and so did its rollback. The running configuration is incomplete; please reload it.");
+		return error;
+	}
 	if (error) {
-		log_err("xlator_replace() failed. Errcode %d", error);
+		log_err("The commit failed. Errcode %d", error);
 		return error;
 	}
 
@@ -326,7 +633,7 @@ int atomconfig_add(struct sk_buff *skb, struct genl_info *info)
 	mutex_lock(&lock);
 
 	error = info->attrs[JNLAR_ATOMIC_INIT]
-			? handle_init(&candidate, info->attrs[JNLAR_ATOMIC_INIT], jhdr->iname, jhdr->xt)
+			? handle_init(&candidate, info->attrs[JNLAR_ATOMIC_INIT], jhdr->iname, jhdr->xt, nla_get_flag(info->attrs[JNLAR_ATOMIC_DIFF]))
 			: get_candidate(jhdr->iname, &candidate);
 	if (error)
 		goto end;
@@ -40,7 +40,9 @@ static verdict core_common(struct xlation *state)
 		if (result != VERDICT_CONTINUE)
 			return result;
 	}
-	result = translating_the_packet(state);
+	result = ttp_fast_path_applies(state)
+			? translating_the_packet_fast(state)
+			: translating_the_packet(state);
 	if (result != VERDICT_CONTINUE)
 		return result;
 
@@ -1,6 +1,7 @@
 #include "mod/common/db/bib/db.h"
 
 #include <linux/ktime.h>
+#include <linux/sort.h>
 #include <net/ip6_checksum.h>
 
 #include "common/constants.h"
@@ -8,6 +9,7 @@
 #include "mod/common/log.h"
 #include "mod/common/wkmalloc.h"
 #include "mod/common/db/rbtree.h"
+#include "mod/common/db/bib/events.h"
 #include "mod/common/db/bib/pkt_queue.h"
 
 #define XGLOBALS(xlator) (xlator->globals.nat64.bib)
@@ -36,6 +38,12 @@ struct tabled_bib {
 	struct ipv4_transport_addr src4;
 	l4_protocol proto;
 	bool is_static;
+	/**
+	 * Mark of the pool4 entry @src4 belonged to when this entry was added.
+	 * Only meaningful if @marked. (Only used by the occupancy counters.)
+	 */
+	bool marked;
+	__u32 mark;
 
 	struct rb_node hook6;
 	struct rb_node hook4;
@@ -86,6 +94,7 @@ struct tabled_session {
 	struct rb_node tree_hook;
 
 	unsigned long update_time;
+	unsigned long creation_time;
 	/** MUST NOT be NULL. */
 	struct expire_timer *expirer;
 	struct list_head list_hook;
@@ -121,11 +130,26 @@ struct expire_timer {
 	fate_cb decide_fate_cb;
 };
 
+/*
+ * Number of BIB entries that share an IPv4 address and pool4 mark.
+ * (See struct bib_usage.)
+ */
+struct addr4_usage {
+	struct bib_usage usage;
+	struct rb_node hook;
+};
+
 struct bib_table {
 	/** Indexes the entries using their IPv6 identifiers. */
 	struct rb_root tree6;
 	/** Indexes the entries using their IPv4 identifiers. */
 	struct rb_root tree4;
+	/**
+	 * BIB entries per IPv4 address and mark; tree of struct addr4_usage.
+	 * Kept up to date as entries come and go, so the occupancy of each
+	 * address can be queried without walking @tree4.
+	 */
+	struct rb_root usage4;
 
 	spinlock_t lock;
 
@@ -171,6 +195,9 @@ struct bib {
 	/** The session table for ICMP conversations. */
 	struct bib_table icmp;
 
+	/** Binary log. (logging-netlink) */
+	struct bib_events *events;
+
 	struct kref refs;
 };
 
@@ -253,6 +280,7 @@ static void tstose(struct xlator *jool,
 	se->state = ts->state;
 	se->timer_type = ts->expirer->type;
 	se->update_time = ts->update_time;
+	se->creation_time = ts->creation_time;
 	se->timeout = get_timeout(jool, ts->expirer);
 	se->has_stored = !!ts->stored;
 }
@@ -366,6 +394,7 @@ static void init_table(struct bib_table *table,
 {
 	table->tree6 = RB_ROOT;
 	table->tree4 = RB_ROOT;
+	table->usage4 = RB_ROOT;
 	spin_lock_init(&table->lock);
 	init_expirer(&table->est_timer, est_timeout, SESSION_TIMER_EST, est_cb);
 
@@ -401,11 +430,16 @@ struct bib *bib_alloc(void)
 	db->tcp.pkt_queue = pktqueue_alloc();
 	if (!db->tcp.pkt_queue)
 		goto pktqueue_alloc_fail;
+	db->events = bibev_alloc();
+	if (!db->events)
+		goto events_alloc_fail;
 
 	kref_init(&db->refs);
 
 	return db;
 
+events_alloc_fail:
+	pktqueue_release(db->tcp.pkt_queue);
 pktqueue_alloc_fail:
 	wkfree(struct bib, db);
 db_alloc_fail:
@@ -439,6 +473,14 @@ static void release_bib_entry(struct tabled_bib *bib)
 	free_bib(bib);
 }
 
+static void release_usage4(struct bib_table *table)
+{
+	struct addr4_usage *usage, *tmp;
+
+	rbtree_foreach(usage, tmp, &table->usage4, hook)
+		wkfree(struct addr4_usage, usage);
+}
+
 static void bib_release(struct kref *refs)
 {
 	struct bib *db;
@@ -457,7 +499,12 @@ static void bib_release(struct kref *refs)
 	rbtree_foreach(bib, tmp, &db->icmp.tree4, hook4)
 		release_bib_entry(bib);
 
+	release_usage4(&db->udp);
+	release_usage4(&db->tcp);
+	release_usage4(&db->icmp);
+
 	pktqueue_release(db->tcp.pkt_queue);
+	bibev_free(db->events);
 
 	wkfree(struct bib, db);
 }
@@ -467,45 +514,79 @@ void bib_put(struct bib *db)
 	kref_put(&db->refs, bib_release);
 }
 
-static void log_bib(struct xlator *jool, struct tabled_bib *bib, char *action)
+static void init_event(struct bib_event_record *record,
+		enum bib_event_type type, struct tabled_bib *bib)
+{
+	memset(record, 0, sizeof(*record));
+	record->timestamp = cpu_to_be64(ktime_get_real_ns());
+	record->type = type;
+	record->proto = bib->proto;
+	record->src6 = bib->src6.l3;
+	record->src6_port = cpu_to_be16(bib->src6.l4);
+	record->src4 = bib->src4.l3;
+	record->src4_port = cpu_to_be16(bib->src4.l4);
+}
+
+static void log_bib(struct xlator *jool, struct tabled_bib *bib,
+		enum bib_event_type type)
 {
+	struct bib_event_record record;
 	time64_t tsec;
 	struct tm time;
 
 	if (!jool->globals.nat64.bib.bib_logging)
 		return;
 
+	if (jool->globals.nat64.bib.netlink_logging) {
+		init_event(&record, type, bib);
+		bibev_add(jool, jool->nat64.bib->events, &record);
+		return;
+	}
+
 	tsec = ktime_get_real_seconds();
 	time64_to_tm(tsec, 0, &time);
 	log_info("%s %ld/%d/%d %d:%d:%d (GMT) - %s " TA6PP " to " TA4PP " (%s)",
 			jool->iname,
 			1900 + time.tm_year, time.tm_mon + 1, time.tm_mday,
-			time.tm_hour, time.tm_min, time.tm_sec, action,
+			time.tm_hour, time.tm_min, time.tm_sec,
+			(type == BEV_BIB_ADD) ? "Mapped" : "Forgot",
 			TA6PA(bib->src6), TA4PA(bib->src4),
 			l4proto_to_string(bib->proto));
 }
 
 static void log_new_bib(struct xlator *jool, struct tabled_bib *bib)
 {
-	return log_bib(jool, bib, "Mapped");
+	return log_bib(jool, bib, BEV_BIB_ADD);
 }
 
 static void log_session(struct xlator *jool,
 		struct tabled_session *session,
-		char *action)
+		enum bib_event_type type)
 {
+	struct bib_event_record record;
 	time64_t tsec;
 	struct tm time;
 
 	if (!jool->globals.nat64.bib.session_logging)
 		return;
 
+	if (jool->globals.nat64.bib.netlink_logging) {
+		init_event(&record, type, session->bib);
+		record.dst6 = session->dst6.l3;
+		record.dst6_port = cpu_to_be16(session->dst6.l4);
+		record.dst4 = session->dst4.l3;
+		record.dst4_port = cpu_to_be16(session->dst4.l4);
+		bibev_add(jool, jool->nat64.bib->events, &record);
+		return;
+	}
+
 	tsec = ktime_get_real_seconds();
 	time64_to_tm(tsec, 0, &time);
 	log_info("%s %ld/%d/%d %d:%d:%d (GMT) - %s " TA6PP "|" TA6PP "|"
 			TA4PP "|" TA4PP "|%s", jool->iname,
 			1900 + time.tm_year, time.tm_mon + 1, time.tm_mday,
-			time.tm_hour, time.tm_min, time.tm_sec, action,
+			time.tm_hour, time.tm_min, time.tm_sec,
+			(type == BEV_SESSION_ADD) ? "Added session" : "Forgot session",
 			TA6PA(session->bib->src6), TA6PA(session->dst6),
 			TA4PA(session->bib->src4), TA4PA(session->dst4),
 			l4proto_to_string(session->bib->proto));
@@ -513,7 +594,143 @@ static void log_session(struct xlator *jool,
 
 static void log_new_session(struct xlator *jool, struct tabled_session *session)
 {
-	return log_session(jool, session, "Added session");
+	return log_session(jool, session, BEV_SESSION_ADD);
+}
+
+static enum jool_stat_id const BIB_STATS[] = {
+	[L4PROTO_TCP] = JSTAT_TCP_BIB_ENTRIES,
+	[L4PROTO_UDP] = JSTAT_UDP_BIB_ENTRIES,
+	[L4PROTO_ICMP] = JSTAT_ICMP_BIB_ENTRIES,
+};
+
+static enum jool_stat_id const SESSION_STATS[] = {
+	[L4PROTO_TCP] = JSTAT_TCP_SESSIONS,
+	[L4PROTO_UDP] = JSTAT_UDP_SESSIONS,
+	[L4PROTO_ICMP] = JSTAT_ICMP_SESSIONS,
+};
+
+/* Sorts by address, then unmarked before marked, then by mark. */
+static int compare_usage4(struct addr4_usage const *node,
+		struct bib_usage const *key)
+{
+	int gap;
+
+	gap = ipv4_addr_cmp(&node->usage.addr, &key->addr);
+	if (gap)
+		return gap;
+	if (node->usage.marked != key->marked)
+		return node->usage.marked ? 1 : -1;
+	if (!key->marked || node->usage.mark == key->mark)
+		return 0;
+	return (node->usage.mark < key->mark) ? -1 : 1;
+}
+
+/*
+ * Adds @delta to the BIB entry count of @bib's address and mark. Must be
+ * called with @table's lock held.
+ *
+ * Nodes are allocated the first time an address/mark is seen, and released
+ * once it stops being used. If the allocation fails, the address simply
+ * remains untracked (and its count will be low) until it empties.
+ */
+static void count_usage4(struct xlator *jool, struct bib_table *table,
+		struct tabled_bib *bib, int delta)
+{
+	struct bib_usage key;
+	struct addr4_usage *usage;
+	struct rb_node **node, *parent;
+
+	key.addr = bib->src4.l3;
+	key.marked = bib->marked;
+	key.mark = bib->marked ? bib->mark : 0;
+
+	rbtree_find_node(&key, &table->usage4, compare_usage4,
+			struct addr4_usage, hook, parent, node);
+
+	if (*node) {
+		usage = rb_entry(*node, struct addr4_usage, hook);
+		if (delta < 0 && usage->usage.bibs <= -delta) {
+			rb_erase(&usage->hook, &table->usage4);
+			wkfree(struct addr4_usage, usage);
+		} else {
+			usage->usage.bibs += delta;
+		}
+		return;
+	}
+
+	if (delta <= 0)
+		return;
+
+	usage = wkmalloc(struct addr4_usage, GFP_ATOMIC);
+	if (!usage) {
+		jstat_inc(jool->stats, JSTAT_ENOMEM);
+		return;
+	}
+	usage->usage = key;
+	usage->usage.bibs = delta;
+	rb_link_node(&usage->hook, parent, node);
+	rb_insert_color(&usage->hook, &table->usage4);
+}
+
+/*
+ * Updates the occupancy counters after @bib joined or left @table.
+ *
+ * When @bib joins, it is attributed to the pool4 mark whose range contains its
+ * address *and port*, so an address split between marks by port range is
+ * counted correctly. The mark is remembered, so @bib leaves the same counter
+ * even if pool4 has changed since.
+ */
+static void count_bib(struct xlator *jool, struct bib_table *table,
+		struct tabled_bib *bib, int delta)
+{
+	if (delta > 0) {
+		bib->marked = !pool4db_find_mark(jool->nat64.pool4, bib->proto,
+				&bib->src4, &bib->mark);
+	}
+
+	jstat_add(jool->stats, JSTAT_BIB_ENTRIES, delta);
+	jstat_add(jool->stats, BIB_STATS[bib->proto], delta);
+	count_usage4(jool, table, bib, delta);
+}
+
+/* Adds @delta to the counter of TCP sessions in @state. */
+static void count_state(struct xlator *jool, tcp_state state, int delta)
+{
+	BUILD_BUG_ON(JSTAT_TCP_TRANS - JSTAT_TCP_ESTABLISHED != TRANS);
+
+	/* Sessions are validated on entry; this would be a bug. */
+	if (WARN_ONCE((unsigned int)state > TRANS, "Bogus TCP state: %u",
+			state))
+		return;
+
+	jstat_add(jool->stats, JSTAT_TCP_ESTABLISHED + state, delta);
+}
+
+/*
+ * Updates the occupancy counters after @session joined or left its table.
+ * @session->bib has to be set.
+ */
+static void count_session(struct xlator *jool, struct tabled_session *session,
+		int delta)
+{
+	jstat_add(jool->stats, JSTAT_SESSIONS, delta);
+	jstat_add(jool->stats, SESSION_STATS[session->bib->proto], delta);
+	if (session->bib->proto == L4PROTO_TCP)
+		count_state(jool, session->state, delta);
+}
+
+/* Changes @session's state, keeping the per-state counters in sync. */
+static void set_state(struct xlator *jool, struct tabled_session *session,
+		tcp_state state)
+{
+	if (session->state == state)
+		return;
+
+	if (session->bib->proto == L4PROTO_TCP) {
+		count_state(jool, session->state, -1);
+		count_state(jool, state, 1);
+	}
+	session->state = state;
 }
 
 /**
@@ -581,16 +798,16 @@ static void rm(struct xlator *jool,
 
 	rb_erase(&session->tree_hook, &bib->sessions);
 	list_del(&session->list_hook);
-	log_session(jool, session, "Forgot session");
+	log_session(jool, session, BEV_SESSION_RM);
+	count_session(jool, session, -1);
 	free_session(session);
-	jstat_dec(jool->stats, JSTAT_SESSIONS);
 
 	if (!bib->is_static && RB_EMPTY_ROOT(&bib->sessions)) {
 		rb_erase(&bib->hook6, &table->tree6);
 		rb_erase(&bib->hook4, &table->tree4);
-		log_bib(jool, bib, "Forgot");
+		log_bib(jool, bib, BEV_BIB_RM);
+		count_bib(jool, table, bib, -1);
 		free_bib(bib);
-		jstat_dec(jool->stats, JSTAT_BIB_ENTRIES);
 	}
 }
 
@@ -666,7 +883,7 @@ static bool decide_fate(struct xlator *jool,
 	fate = cb->cb(&tmp, cb->arg);
 
 	/* The callback above is entitled to tweak these fields. */
-	session->state = tmp.state;
+	set_state(jool, session, tmp.state);
 	session->update_time = tmp.update_time;
 	if (!tmp.has_stored)
 		kill_stored_pkt(jool, table, session);
@@ -839,17 +1056,19 @@ struct slot_group {
 	struct tree_slot session;
 };
 
-static void commit_bib_add(struct xlator *jool, struct slot_group *slots)
+static void commit_bib_add(struct xlator *jool, struct bib_table *table,
+		struct slot_group *slots, struct tabled_bib *bib)
 {
 	treeslot_commit(&slots->bib6);
 	treeslot_commit(&slots->bib4);
-	jstat_inc(jool->stats, JSTAT_BIB_ENTRIES);
+	count_bib(jool, table, bib, 1);
 }
 
-static void commit_session_add(struct xlator *jool, struct tree_slot *slot)
+static void commit_session_add(struct xlator *jool, struct tree_slot *slot,
+		struct tabled_session *session)
 {
 	treeslot_commit(slot);
-	jstat_inc(jool->stats, JSTAT_SESSIONS);
+	count_session(jool, session, 1);
 }
 
 static void attach_timer(struct tabled_session *session,
@@ -1019,6 +1238,7 @@ static int create_bib_session6(struct bib_session_tuple *tuple,
 	tuple->session->dst6 = tuple6->dst.addr6;
 	tuple->session->dst4 = *dst4;
 	tuple->session->state = state;
+	tuple->session->creation_time = jiffies;
 	tuple->session->stored = NULL;
 	return 0;
 }
@@ -1040,6 +1260,7 @@ static struct tabled_session *create_session4(struct tuple *tuple4,
 	session->dst6 = *dst6;
 	session->dst4 = tuple4->src.addr4;
 	session->state = state;
+	session->creation_time = jiffies;
 	session->stored = NULL;
 	return session;
 }
@@ -1066,6 +1287,7 @@ static int create_bib_session(struct session_entry *session,
 	tuple->session->dst4 = session->dst4;
 	tuple->session->state = session->state;
 	tuple->session->update_time = session->update_time;
+	tuple->session->creation_time = jiffies;
 	tuple->session->stored = NULL;
 	return 0;
 }
@@ -1078,20 +1300,21 @@ static int create_bib_session(struct session_entry *session,
  * supposed to be added.
  */
 static void commit_add6(struct xlation *state,
+		struct bib_table *table,
 		struct bib_session_tuple *old,
 		struct bib_session_tuple *new,
 		struct slot_group *slots,
 		struct expire_timer *expirer)
 {
 	new->session->bib = old->bib ? : new->bib;
-	commit_session_add(&state->jool, &slots->session);
+	commit_session_add(&state->jool, &slots->session, new->session);
 	attach_timer(new->session, expirer);
 	log_new_session(&state->jool, new->session);
 	tstobs(state, new->session);
 	new->session = NULL; /* Do not free! */
 
 	if (!old->bib) {
-		commit_bib_add(&state->jool, slots);
+		commit_bib_add(&state->jool, table, slots, new->bib);
 		log_new_bib(&state->jool, new->bib);
 		new->bib = NULL; /* Do not free! */
 	}
@@ -1113,7 +1336,7 @@ static void commit_add4(struct xlation *state,
 	struct tabled_session *session = *new;
 
 	session->bib = old->bib;
-	commit_session_add(&state->jool, slot);
+	commit_session_add(&state->jool, slot, session);
 	attach_timer(session, expirer);
 	log_new_session(&state->jool, session);
 	tstobs(state, session);
@@ -1141,12 +1364,12 @@ static int commit_add(struct xlator *jool,
 		return error;
 
 	new->session->bib = old->bib ? : new->bib;
-	commit_session_add(jool, &slots->session);
+	commit_session_add(jool, &slots->session, new->session);
 	log_new_session(jool, new->session);
 	new->session = NULL; /* Do not free! */
 
 	if (!old->bib) {
-		commit_bib_add(jool, slots);
+		commit_bib_add(jool, table, slots, new->bib);
 		log_new_bib(jool, new->bib);
 		new->bib = NULL; /* Do not free! */
 	}
@@ -1154,19 +1377,17 @@ static int commit_add(struct xlator *jool,
 	return 0;
 }
 
-static int detach_sessions(struct bib_table *table, struct tabled_bib *bib)
+static void detach_sessions(struct xlator *jool, struct bib_table *table,
+		struct tabled_bib *bib)
 {
 	struct tabled_session *session, *tmp;
-	int detached = 0;
 
 	rbtree_foreach(session, tmp, &bib->sessions, tree_hook) {
 		list_del(&session->list_hook);
 		if (session->stored)
 			table->pkt_count--;
-		detached--;
+		count_session(jool, session, -1);
 	}
-
-	return detached;
 }
 
 static void detach_bib(struct xlator *jool, struct bib_table *table,
@@ -1174,9 +1395,8 @@ static void detach_bib(struct xlator *jool, struct bib_table *table,
 {
 	rb_erase(&bib->hook6, &table->tree6);
 	rb_erase(&bib->hook4, &table->tree4);
-	jstat_dec(jool->stats, JSTAT_BIB_ENTRIES);
-	/* NOTE THAT detach_sessions() RETURNS NEGATIVE. */
-	jstat_add(jool->stats, JSTAT_SESSIONS, detach_sessions(table, bib));
+	count_bib(jool, table, bib, -1);
+	detach_sessions(jool, table, bib);
 }
 
 struct bib_delete_list {
@@ -1393,12 +1613,12 @@ static int upgrade_pktqueue_session(struct xlator *jool,
 		goto trainwreck;
 	treeslot_commit(&bib_slot6);
 	treeslot_commit(&bib_slot4);
-	jstat_inc(jool->stats, JSTAT_BIB_ENTRIES);
+	count_bib(jool, table, bib, 1);
 
 	rb_link_node(&session->tree_hook, NULL, &bib->sessions.rb_node);
 	rb_insert_color(&session->tree_hook, &bib->sessions);
 	attach_timer(session, &table->syn4_timer);
-	jstat_inc(jool->stats, JSTAT_SESSIONS);
+	count_session(jool, session, 1);
 
 	pktqueue_put_node(jool, sos);
 
@@ -1614,7 +1834,7 @@ int bib_add6(struct xlation *state,
 	}
 
 	/* New connection; add the session. (And maybe the BIB entry as well) */
-	commit_add6(state, &old, &new, &slots, &table->est_timer);
+	commit_add6(state, table, &old, &new, &slots, &table->est_timer);
 	/* Fall through */
 
 end:
@@ -1757,7 +1977,7 @@ verdict bib_add_tcp6(struct xlation *state,
 
 	/* All exits up till now require @new.* to be deleted. */
 
-	commit_add6(state, &old, &new, &slots, &table->trans_timer);
+	commit_add6(state, table, &old, &new, &slots, &table->trans_timer);
 	result = VERDICT_CONTINUE;
 	/* Fall through */
 
@@ -1924,14 +2144,67 @@ int bib_find(struct bib *db, struct tuple *tuple, struct bib_session *result)
 	return 0;
 }
 
+/**
+ * Core of bib_add_session(). Assumes @table's lock is held.
+ *
+ * @new has to have been initialized by create_bib_session(). Whatever it still
+ * holds after this function returns is the caller's to free.
+ * @hint is a BIB entry from @table the caller suspects @new belongs to, or
+ * NULL. If it's right, the BIB lookups are skipped.
+ * If @new ends up in the database (or collides with an existing session),
+ * @bib will point to its BIB entry. Otherwise it's left untouched.
+ */
+static int add_session_locked(struct xlator *jool,
+		struct bib_table *table,
+		struct bib_session_tuple *new,
+		session_timer_type timer_type,
+		struct collision_cb *cb,
+		struct tabled_bib *hint,
+		struct bib_delete_list *bdl,
+		struct tabled_bib **bib)
+{
+	struct bib_session_tuple old;
+	struct slot_group slots;
+	struct tabled_bib *result;
+	int error;
+
+	if (hint && taddr6_equals(&hint->src6, &new->bib->src6)) {
+		/* Same as find_bib_session6()'s path for existing BIBs. */
+		if (new->bib->proto == L4PROTO_ICMP)
+			new->session->dst4.l4 = hint->src4.l4;
+		old.bib = hint;
+		old.session = find_session_slot(hint, new->session, NULL,
+				&slots.session);
+	} else {
+		error = find_bib_session6(jool, table, NULL, new, &old, &slots,
+				bdl);
+		if (error)
+			return error;
+	}
+
+	if (old.session) {
+		/* There's no packet; ignore the verdict. */
+		decide_fate(jool, cb, table, old.session, NULL);
+		*bib = old.bib;
+		return 0;
+	}
+
+	result = old.bib ? : new->bib;
+	error = commit_add(jool, table, &old, new, &slots, timer_type);
+	if (error)
+		return error;
+
+	*bib = result;
+	return 0;
+}
+
 int bib_add_session(struct xlator *jool,
 		struct session_entry *session,
 		struct collision_cb *cb)
 {
 	struct bib_table *table;
 	struct bib_session_tuple new;
-	struct bib_session_tuple old;
-	struct slot_group slots;
+	struct tabled_bib *bib;
 	struct bib_delete_list bdl = { NULL };
 	int error;
 
@@ -1944,21 +2217,8 @@ int bib_add_session(struct xlator *jool,
 		return error;
 
 	spin_lock_bh(&table->lock);
-
-	error = find_bib_session6(jool, table, NULL, &new, &old, &slots, &bdl);
-	if (error)
-		goto end;
-
-	if (old.session) {
-		/* There's no packet; ignore the verdict. */
-		decide_fate(jool, cb, table, old.session, NULL);
-		goto end;
-	}
-
-	error = commit_add(jool, table, &old, &new, &slots, session->timer_type);
-	/* Fall through */
-
-end:
+	error = add_session_locked(jool, table, &new, session->timer_type, cb,
+			NULL, &bdl, &bib);
 	spin_unlock_bh(&table->lock);
 
 	if (new.bib)
@@ -1970,6 +2230,157 @@ end:
 	return error;
 }
 
+/* Maximum number of sessions bib_add_sessions() adds per lock acquisition. */
+#define BULK_CHUNK 32
+
+struct bulk_fate_arg {
+	fate_cb cb;
+	struct session_entry *new;
+	/* Was @cb called? If so, what did it return? */
+	bool called;
+	enum session_fate fate;
+};
+
+static enum session_fate bulk_fate(struct session_entry *old, void *arg)
+{
+	struct bulk_fate_arg *bulk = arg;
+
+	bulk->called = true;
+	bulk->fate = bulk->cb(old, bulk->new);
+	return bulk->fate;
+}
+
+/*
+ * Can the BIB entry of the session that was just added (or collided) be reused
+ * as a hint? Not if the callback removed the session, because that might have
+ * taken the BIB entry with it.
+ */
+static bool bulk_bib_survives(struct bulk_fate_arg const *arg)
+{
+	if (!arg->called)
+		return true;
+
+	switch (arg->fate) {
+	case FATE_TIMER_SLOW:
+	case FATE_PRESERVE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Sorts sessions in the order bib_add_sessions() wants to find them. */
+static int compare_bulk(void const *a, void const *b)
+{
+	struct session_entry const *s1 = a;
+	struct session_entry const *s2 = b;
+	int gap;
+
+	gap = s1->proto - s2->proto;
+	if (gap)
+		return gap;
+	gap = taddr6_compare(&s1->src6, &s2->src6);
+	if (gap)
+		return gap;
+	return taddr4_compare(&s1->dst4, &s2->dst4);
+}
+
+static void add_chunk(struct xlator *jool, struct bib_table *table,
+		struct session_entry *sessions, unsigned int count,
+		struct bulk_fate_arg *arg, struct bib_bulk_result *result)
+{
+	struct collision_cb cb;
+	struct bib_session_tuple new;
+	struct tabled_bib *hint;
+	struct tabled_bib *bib;
+	struct bib_delete_list bdl = { NULL };
+	unsigned int i;
+	int error;
+
+	cb.cb = bulk_fate;
+	cb.arg = arg;
+	hint = NULL;
+
+	spin_lock_bh(&table->lock);
+
+	for (i = 0; i < count; i++) {
+		error = create_bib_session(&sessions[i], &new);
+		if (error) {
+			result->errors++;
+			continue;
+		}
+
+		arg->new = &sessions[i];
+		arg->called = false;
+		bib = NULL;
+		error = add_session_locked(jool, table, &new,
+				sessions[i].timer_type, &cb, hint, &bdl, &bib);
+		/* Sorted input: The next session likely shares @bib. */
+		hint = bulk_bib_survives(arg) ? bib : NULL;
+
+		if (error == -EEXIST)
+			result->collisions++;
+		else if (error)
+			result->errors++;
+		else if (!arg->called)
+			result->added++;
+		else if (arg->fate == FATE_PRESERVE)
+			result->collisions++;
+		else
+			result->updated++;
+
+		if (new.bib)
+			free_bib(new.bib);
+		if (new.session)
+			free_session(new.session);
+	}
+
+	spin_unlock_bh(&table->lock);
+
+	commit_delete_list(&bdl);
+}
+
+/**
+ * bib_add_sessions - Like bib_add_session(), for several sessions at once.
+ *
+ * The sessions are sorted by protocol and BIB entry (so @sessions will be
+ * reordered), then added in chunks, each under a single acquisition of the
+ * table's lock. Consecutive sessions that belong to the same BIB entry skip
+ * the BIB lookups.
+ *
+ * When a session already exists, @cb is called with the existing session and
+ * the incoming one (as its second argument). Returning FATE_PRESERVE counts as
+ * a collision.
+ */
+void bib_add_sessions(struct xlator *jool, struct session_entry *sessions,
+		unsigned int count, fate_cb cb, struct bib_bulk_result *result)
+{
+	struct bib_table *table;
+	struct bulk_fate_arg arg;
+	unsigned int start;
+	unsigned int end;
+
+	memset(result, 0, sizeof(*result));
+	sort(sessions, count, sizeof(*sessions), compare_bulk, NULL);
+	arg.cb = cb;
+
+	for (start = 0; start < count; start = end) {
+		end = start + 1;
+		while (end < count && end - start < BULK_CHUNK
+				&& sessions[end].proto == sessions[start].proto)
+			end++;
+
+		table = get_table(jool->nat64.bib, sessions[start].proto);
+		if (!table) {
+			result->errors += end - start;
+			continue;
+		}
+
+		add_chunk(jool, table, &sessions[start], end - start, &arg,
+				result);
+	}
+}
+
 static void __clean(struct xlator *jool,
 		struct expire_timer *expirer,
 		struct bib_table *table,
@@ -2011,7 +2422,7 @@ static void clean_table(struct xlator *jool, struct bib_table *table)
 	spin_unlock_bh(&table->lock);
 
 	post_fate(jool, &probes);
-	pktqueue_clean(&icmps);
+	pktqueue_clean(jool, &icmps);
 }
 
 /**
@@ -2023,6 +2434,7 @@ void bib_clean(struct xlator *jool)
 	clean_table(jool, &db->udp);
 	clean_table(jool, &db->tcp);
 	clean_table(jool, &db->icmp);
+	bibev_flush(jool, db->events);
 }
 
 static struct rb_node *find_starting_point(struct bib_table *table,
@@ -2055,30 +2467,141 @@ static struct rb_node *find_starting_point(struct bib_table *table,
 	return (compare_src4(bib, offset) < 0) ? rb_next(parent) : parent;
 }
 
+/*
+ * Number of entries the foreaches copy out of the table per lock acquisition.
+ * Small enough that the packet path barely notices the lock was taken, and
+ * the chunk fits in a page.
+ */
+#define FOREACH_CHUNK 32
+
+/*
+ * The foreaches do not call @cb while holding the table's lock. Instead, they
+ * copy a chunk of entries, release the lock, hand the copies to @cb, and then
+ * find their way back to where they left off. (The same way userspace
+ * requests resume from an offset.)
+ *
+ * So however large the table, translation is never blocked by more than a
+ * chunk's worth of copying. In exchange, the iteration is not a snapshot;
+ * entries added or removed between chunks may or may not be seen.
+ */
 int bib_foreach(struct bib *db, l4_protocol proto,
 		bib_foreach_entry_cb cb, void *cb_arg,
 		const struct ipv4_transport_addr *offset)
 {
 	struct bib_table *table;
 	struct rb_node *node;
-	struct tabled_bib *tabled;
-	struct bib_entry bib;
+	struct bib_entry *chunk;
+	struct ipv4_transport_addr cursor;
+	unsigned int count;
+	unsigned int i;
 	int error = 0;
 
 	table = get_table(db, proto);
 	if (!table)
 		return -EINVAL;
 
-	spin_lock_bh(&table->lock);
+	/* Atomic because joold advertisements are also driven by the timer. */
+	chunk = __wkmalloc("BIB foreach chunk", FOREACH_CHUNK * sizeof(*chunk),
+			GFP_ATOMIC);
+	if (!chunk)
+		return -ENOMEM;
 
-	node = find_starting_point(table, offset, false);
-	for (; node && !error; node = rb_next(node)) {
-		tabled = bib4_entry(node);
-		tbtobe(tabled, &bib);
-		error = cb(&bib, cb_arg);
-	}
+	do {
+		spin_lock_bh(&table->lock);
+		node = find_starting_point(table, offset, false);
+		for (count = 0; node && count < FOREACH_CHUNK; count++) {
+			tbtobe(bib4_entry(node), &chunk[count]);
+			node = rb_next(node);
+		}
+		spin_unlock_bh(&table->lock);
 
-	spin_unlock_bh(&table->lock);
+		for (i = 0; i < count; i++) {
+			error = cb(&chunk[i], cb_arg);
+			if (error)
+				goto end;
+		}
+
+		if (count) {
+			cursor = chunk[count - 1].addr4;
+			offset = &cursor;
+		}
+	} while (count == FOREACH_CHUNK);
+
+end:
+	__wkfree("BIB foreach chunk", chunk);
+	return error;
+}
+
+/* Returns the first address from @table's usage tree that follows @offset. */
+static struct rb_node *find_usage_start(struct bib_table *table,
+		struct bib_usage const *offset)
+{
+	struct addr4_usage *usage;
+	struct rb_node **node, *parent;
+
+	if (!offset)
+		return rb_first(&table->usage4);
+
+	rbtree_find_node(offset, &table->usage4, compare_usage4,
+			struct addr4_usage, hook, parent, node);
+	if (*node)
+		return rb_next(*node);
+	if (!parent)
+		return NULL;
+
+	usage = rb_entry(parent, struct addr4_usage, hook);
+	return (compare_usage4(usage, offset) < 0) ? rb_next(parent) : parent;
+}
+
+/*
+ * Hands @cb the number of BIB entries each IPv4 address and mark of @proto's
+ * table has, in ascending address order. Chunked like bib_foreach().
+ */
+int bib_foreach_usage(struct bib *db, l4_protocol proto,
+		bib_usage_cb cb, void *cb_arg, struct bib_usage const *offset)
+{
+	struct bib_table *table;
+	struct rb_node *node;
+	struct addr4_usage *usage;
+	struct bib_usage *chunk;
+	struct bib_usage cursor;
+	unsigned int count;
+	unsigned int i;
+	int error = 0;
+
+	table = get_table(db, proto);
+	if (!table)
+		return -EINVAL;
+
+	chunk = __wkmalloc("BIB usage chunk", FOREACH_CHUNK * sizeof(*chunk),
+			GFP_KERNEL);
+	if (!chunk)
+		return -ENOMEM;
+
+	do {
+		spin_lock_bh(&table->lock);
+		node = find_usage_start(table, offset);
+		for (count = 0; node && count < FOREACH_CHUNK; count++) {
+			usage = rb_entry(node, struct addr4_usage, hook);
+			chunk[count] = usage->usage;
+			node = rb_next(node);
+		}
+		spin_unlock_bh(&table->lock);
+
+		for (i = 0; i < count; i++) {
+			error = cb(&chunk[i], cb_arg);
+			if (error)
+				goto end;
+		}
+
+		if (count) {
+			cursor = chunk[count - 1];
+			offset = &cursor;
+		}
+	} while (count == FOREACH_CHUNK);
+
+end:
+	__wkfree("BIB usage chunk", chunk);
 	return error;
 }
 
@@ -2159,18 +2682,17 @@ static void find_session_offset(struct bib_table *table,
 				node; \
 				node = node2session(rb_next(&node->tree_hook)))
 
-int bib_foreach_session(struct xlator *jool, l4_protocol proto,
-		session_foreach_entry_cb cb, void *cb_arg,
-		struct session_foreach_offset *offset)
+/*
+ * Copies up to FOREACH_CHUNK sessions, starting from @offset (or from the
+ * beginning, if @offset is NULL), into @chunk. Returns the number of sessions
+ * copied.
+ */
+static unsigned int copy_session_chunk(struct xlator *jool,
+		struct bib_table *table, struct session_foreach_offset *offset,
+		struct session_entry *chunk)
 {
-	struct bib_table *table;
 	struct bib_session_tuple pos;
-	struct session_entry tmp;
-	int error = 0;
-
-	table = get_table(jool->nat64.bib, proto);
-	if (!table)
-		return -EINVAL;
+	unsigned int count = 0;
 
 	spin_lock_bh(&table->lock);
 
@@ -2186,15 +2708,58 @@ int bib_foreach_session(struct xlator *jool, l4_protocol proto,
 
 	foreach_bib(table, pos.bib) {
 goto_bib:	foreach_session(&pos.bib->sessions, pos.session) {
-goto_session:		tstose(jool, pos.session, &tmp);
-			error = cb(&tmp, cb_arg);
-			if (error)
+goto_session:		if (count >= FOREACH_CHUNK)
 				goto end;
+			tstose(jool, pos.session, &chunk[count]);
+			count++;
 		}
 	}
 
 end:
 	spin_unlock_bh(&table->lock);
+	return count;
+}
+
+/* See bib_foreach(). */
+int bib_foreach_session(struct xlator *jool, l4_protocol proto,
+		session_foreach_entry_cb cb, void *cb_arg,
+		struct session_foreach_offset *offset)
+{
+	struct bib_table *table;
+	struct session_entry *chunk;
+	struct session_foreach_offset cursor;
+	unsigned int count;
+	unsigned int i;
+	int error = 0;
+
+	table = get_table(jool->nat64.bib, proto);
+	if (!table)
+		return -EINVAL;
+
+	chunk = __wkmalloc("Session foreach chunk",
+			FOREACH_CHUNK * sizeof(*chunk), GFP_ATOMIC);
+	if (!chunk)
+		return -ENOMEM;
+
+	do {
+		count = copy_session_chunk(jool, table, offset, chunk);
+
+		for (i = 0; i < count; i++) {
+			error = cb(&chunk[i], cb_arg);
+			if (error)
+				goto end;
+		}
+
+		if (count) {
+			cursor.offset.src = chunk[count - 1].src4;
+			cursor.offset.dst = chunk[count - 1].dst4;
+			cursor.include_offset = false;
+			offset = &cursor;
+		}
+	} while (count == FOREACH_CHUNK);
+
+end:
+	__wkfree("Session foreach chunk", chunk);
 	return error;
 }
 
@@ -2285,7 +2850,7 @@ static int __bib_add_static(struct xlator *jool, struct bib_entry *new,
 
 	treeslot_commit(&slot6);
 	treeslot_commit(&slot4);
-	jstat_inc(jool->stats, JSTAT_BIB_ENTRIES);
+	count_bib(jool, table, bib, 1);
 
 	/*
 	 * Since the BIB entry is now available, and assuming ADF is disabled,
@@ -98,9 +98,32 @@ int bib_find(struct bib *db, struct tuple *tuple,
 		struct bib_session *result);
 int bib_add_session(struct xlator *jool, struct session_entry *new,
 		struct collision_cb *cb);
+
+/** Outcome of a bib_add_sessions() call. */
+struct bib_bulk_result {
+	/** Sessions that did not exist, and were added. */
+	unsigned int added;
+	/** Sessions that already existed, and were handed to the callback. */
+	unsigned int updated;
+	/**
+	 * Sessions that clashed with a different entry, and were therefore
+	 * rejected. (Either their IPv4 transport address belongs to some other
+	 * BIB entry, or the callback returned FATE_PRESERVE.)
+	 */
+	unsigned int collisions;
+	/** Sessions that could not be added for any other reason. */
+	unsigned int errors;
+};
+
+void bib_add_sessions(struct xlator *jool, struct session_entry *sessions,
+		unsigned int count, fate_cb cb, struct bib_bulk_result *result);
 void bib_clean(struct xlator *jool);
 
-/* These are used by userspace request handling. */
+/*
+ * These are used by userspace request handling.
+ * They do not hold the table's lock while calling the callback. (See
+ * bib_foreach().)
+ */
 
 typedef int (*bib_foreach_entry_cb)(struct bib_entry const *, void *);
 typedef int (*session_foreach_entry_cb)(struct session_entry const *, void *);
@@ -116,6 +139,25 @@ int bib_foreach(struct bib *db, l4_protocol proto,
 int bib_foreach_session(struct xlator *jool, l4_protocol proto,
 		session_foreach_entry_cb cb, void *cb_arg,
 		struct session_foreach_offset *offset);
+
+/**
+ * Number of BIB entries a table holds for some IPv4 address and pool4 mark.
+ *
+ * @mark is the mark of the pool4 entry the BIB entries' address and port
+ * belonged to when they were added. Entries that did not belong to pool4 (eg.
+ * static ones outside of it) are counted separately, with @marked false.
+ */
+struct bib_usage {
+	struct in_addr addr;
+	bool marked;
+	__u32 mark;
+	unsigned int bibs;
+};
+
+typedef int (*bib_usage_cb)(struct bib_usage const *, void *);
+int bib_foreach_usage(struct bib *db, l4_protocol proto,
+		bib_usage_cb cb, void *cb_arg, struct bib_usage const *offset);
+
 int bib_find6(struct bib *db, l4_protocol proto,
 		struct ipv6_transport_addr *addr,
 		struct bib_entry *result);
@@ -53,6 +53,11 @@ struct session_entry {
 
 	/** Jiffy (from the epoch) this session was last updated/used. */
 	unsigned long update_time;
+	/**
+	 * Jiffy at which this Jool instance learned about the session.
+	 * (Sessions received from joold count as new.)
+	 */
+	unsigned long creation_time;
 	/*
 	 * Number of jiffies before this session is to be downgraded. (Either
 	 * deleted or changed into a transitory state.)
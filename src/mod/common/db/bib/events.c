@@ -0,0 +1,247 @@
+#include "mod/common/db/bib/events.h"
+
+#include <linux/percpu.h>
+#include "mod/common/log.h"
+#include "mod/common/stats.h"
+#include "mod/common/timer.h"
+#include "mod/common/wkmalloc.h"
+#include "mod/common/nl/nl_handler.h"
+#include "mod/common/steps/send_packet.h"
+
+/* Records per message. (So the message fits in a page.) */
+#define BIBEV_BATCH 56
+/* Batches a CPU can fill before the timer gets to them. */
+#define BIBEV_BATCHES 4
+
+struct bibev_batch {
+	struct bib_event_record records[BIBEV_BATCH];
+	unsigned int count;
+};
+
+/*
+ * Events recently queued by one CPU.
+ *
+ * The batches are a ring. @ready batches, starting from @first, are full (or
+ * were closed by the flusher), and wait to be sent. The one after them is
+ * being filled by the packet path.
+ */
+struct bibev_buffer {
+	struct bibev_batch batches[BIBEV_BATCHES];
+	unsigned int first;
+	unsigned int ready;
+	/*
+	 * The owner CPU only contends for this with the flusher, which holds
+	 * it just long enough to claim or release batches.
+	 */
+	spinlock_t lock;
+};
+
+struct bib_events {
+	struct bibev_buffer __percpu *buffers;
+	/** Sequence number of the next message. */
+	atomic_t seq;
+	/** Records dropped so far. */
+	atomic_t lost;
+};
+
+struct bib_events *bibev_alloc(void)
+{
+	struct bib_events *events;
+	struct bibev_buffer *buffer;
+	unsigned int b;
+	int cpu;
+
+	events = wkmalloc(struct bib_events, GFP_KERNEL);
+	if (!events)
+		return NULL;
+
+	events->buffers = alloc_percpu(struct bibev_buffer);
+	if (!events->buffers) {
+		wkfree(struct bib_events, events);
+		return NULL;
+	}
+
+	for_each_possible_cpu(cpu) {
+		buffer = per_cpu_ptr(events->buffers, cpu);
+		for (b = 0; b < BIBEV_BATCHES; b++)
+			buffer->batches[b].count = 0;
+		buffer->first = 0;
+		buffer->ready = 0;
+		spin_lock_init(&buffer->lock);
+	}
+	atomic_set(&events->seq, 0);
+	atomic_set(&events->lost, 0);
+
+	return events;
+}
+
+/* Pending records are discarded. */
+void bibev_free(struct bib_events *events)
+{
+	free_percpu(events->buffers);
+	wkfree(struct bib_events, events);
+}
+
+static void lose(struct xlator *jool, struct bib_events *events,
+		unsigned int count)
+{
+	atomic_add(count, &events->lost);
+	jstat_add(jool->stats, JSTAT_BIB_EVENTS_LOST, count);
+}
+
+/*
+ * Copies @batch's records to a new message.
+ * Returns NULL (and counts the records as lost) on failure.
+ */
+static struct sk_buff *cut_message(struct xlator *jool,
+		struct bib_events *events, struct bibev_batch *batch)
+{
+	struct sk_buff *skb;
+	struct joolnlhdr *jhdr;
+	struct nlattr *attr;
+	size_t len;
+	int error;
+
+	len = batch->count * sizeof(struct bib_event_record);
+	skb = genlmsg_new(JOOLNL_HDRLEN + nla_total_size(len)
+			+ 2 * nla_total_size(sizeof(__u32)), GFP_ATOMIC);
+	if (!skb)
+		goto fail;
+
+	jhdr = genlmsg_put(skb, 0, 0, jnl_family(), 0, 0);
+	if (WARN(!jhdr, "genlmsg_put() returned NULL"))
+		goto revert_skb;
+
+	memset(jhdr, 0, sizeof(*jhdr));
+	memcpy(jhdr->magic, JOOLNL_HDR_MAGIC, JOOLNL_HDR_MAGIC_LEN);
+	jhdr->version = cpu_to_be32(xlat_version());
+	jhdr->xt = XT_NAT64;
+	memcpy(jhdr->iname, jool->iname, INAME_MAX_SIZE);
+
+	attr = nla_reserve(skb, JNLAR_EVENT_RECORDS, len);
+	if (WARN(!attr, "nla_reserve() returned NULL"))
+		goto revert_skb;
+	memcpy(nla_data(attr), batch->records, len);
+
+	error = nla_put_u32(skb, JNLAR_EVENT_SEQ,
+			atomic_inc_return(&events->seq) - 1);
+	if (WARN(error, "nla_put_u32() returned %d", error))
+		goto revert_skb;
+	error = nla_put_u32(skb, JNLAR_EVENT_LOST, atomic_read(&events->lost));
+	if (WARN(error, "nla_put_u32() returned %d", error))
+		goto revert_skb;
+
+	genlmsg_end(skb, jhdr);
+	return skb;
+
+revert_skb:
+	kfree_skb(skb);
+fail:
+	lose(jool, events, batch->count);
+	return NULL;
+}
+
+static void send_batch(struct xlator *jool, struct bib_events *events,
+		struct bibev_batch *batch)
+{
+	struct sk_buff *skb;
+	int error;
+
+	skb = cut_message(jool, events, batch);
+	if (!skb)
+		return;
+
+	error = sendpkt_multicast_events(jool, skb);
+	/*
+	 * -ESRCH means nobody is listening. The records were not lost, so much
+	 * as not wanted.
+	 * Anything else (normally -ENOBUFS) means a listener fell behind.
+	 */
+	if (error && error != -ESRCH)
+		lose(jool, events, batch->count);
+}
+
+/**
+ * Queues @record, to be sent to userspace by the cleaning timer. Safe to call
+ * with a table's spinlock held; never allocates nor sends anything.
+ *
+ * If the timer has fallen behind and the CPU's batches are all full, @record
+ * is dropped (and counted as lost).
+ */
+void bibev_add(struct xlator *jool, struct bib_events *events,
+		struct bib_event_record const *record)
+{
+	struct bibev_buffer *buffer;
+	struct bibev_batch *batch;
+	bool full;
+
+	full = false;
+
+	buffer = get_cpu_ptr(events->buffers);
+	spin_lock_bh(&buffer->lock);
+
+	if (buffer->ready >= BIBEV_BATCHES) {
+		spin_unlock_bh(&buffer->lock);
+		put_cpu_ptr(events->buffers);
+		lose(jool, events, 1);
+		return;
+	}
+
+	batch = &buffer->batches[(buffer->first + buffer->ready)
+			% BIBEV_BATCHES];
+	batch->records[batch->count++] = *record;
+	if (batch->count >= BIBEV_BATCH) {
+		buffer->ready++;
+		full = true;
+	}
+
+	spin_unlock_bh(&buffer->lock);
+	put_cpu_ptr(events->buffers);
+
+	if (full)
+		jtimer_kick();
+}
+
+/**
+ * Sends every CPU's pending records to userspace.
+ *
+ * Meant to be called by the cleaning timer only, so flushes never overlap.
+ * The messages are built and sent without the buffer locks, so the packet
+ * path can keep filling the next batch in the meantime.
+ */
+void bibev_flush(struct xlator *jool, struct bib_events *events)
+{
+	struct bibev_buffer *buffer;
+	struct bibev_batch *batch;
+	unsigned int first;
+	unsigned int ready;
+	unsigned int b;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		buffer = per_cpu_ptr(events->buffers, cpu);
+
+		spin_lock_bh(&buffer->lock);
+		if (buffer->ready < BIBEV_BATCHES) {
+			batch = &buffer->batches[(buffer->first + buffer->ready)
+					% BIBEV_BATCHES];
+			if (batch->count > 0)
+				buffer->ready++;
+		}
+		first = buffer->first;
+		ready = buffer->ready;
+		spin_unlock_bh(&buffer->lock);
+
+		/* The packet path doesn't touch closed batches. */
+		for (b = 0; b < ready; b++) {
+			batch = &buffer->batches[(first + b) % BIBEV_BATCHES];
+			send_batch(jool, events, batch);
+			batch->count = 0;
+		}
+
+		spin_lock_bh(&buffer->lock);
+		buffer->first = (first + ready) % BIBEV_BATCHES;
+		buffer->ready -= ready;
+		spin_unlock_bh(&buffer->lock);
+	}
+}
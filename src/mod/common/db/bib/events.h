@@ -0,0 +1,26 @@
+#ifndef SRC_MOD_NAT64_BIB_EVENTS_H_
+#define SRC_MOD_NAT64_BIB_EVENTS_H_
+
+/**
+ * @file
+ * Binary stream of BIB and session events (see struct bib_event_record),
+ * multicast to the listeners of JOOLNL_EVENTS_GRP_NAME.
+ *
+ * The packet path only appends the record to its CPU's buffer. The cleaning
+ * timer sends the buffers; a full one pulls the timer forward. Records that
+ * arrive while all of a CPU's batches are full are dropped and counted.
+ */
+
+#include "common/config.h"
+#include "mod/common/xlator.h"
+
+struct bib_events;
+
+struct bib_events *bibev_alloc(void);
+void bibev_free(struct bib_events *events);
+
+void bibev_add(struct xlator *jool, struct bib_events *events,
+		struct bib_event_record const *record);
+void bibev_flush(struct xlator *jool, struct bib_events *events);
+
+#endif /* SRC_MOD_NAT64_BIB_EVENTS_H_ */
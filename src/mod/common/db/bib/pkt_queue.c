@@ -18,9 +18,9 @@ static unsigned long get_timeout(void)
 	return msecs_to_jiffies(1000 * TCP_INCOMING_SYN);
 }
 
-static void send_icmp_error(struct pktqueue_session *node)
+static void send_icmp_error(struct xlator *jool, struct pktqueue_session *node)
 {
-	icmp64_send(NULL, node->skb, ICMPERR_PORT_UNREACHABLE, 0);
+	icmp64_send(jool, node->skb, ICMPERR_PORT_UNREACHABLE, 0);
 	kfree_skb(node->skb);
 	wkfree(struct pktqueue_session, node);
 }
@@ -51,7 +51,7 @@ void pktqueue_release(struct pktqueue *queue)
 	struct pktqueue_session *tmp;
 
 	list_for_each_entry_safe(node, tmp, &queue->node_list, list_hook)
-		send_icmp_error(node);
+		send_icmp_error(NULL, node);
 	wkfree(struct pktqueue, queue);
 }
 
@@ -219,9 +219,9 @@ unsigned int pktqueue_prepare_clean(struct pktqueue *queue,
 	return removed;
 }
 
-void pktqueue_clean(struct list_head *probes)
+void pktqueue_clean(struct xlator *jool, struct list_head *probes)
 {
 	struct pktqueue_session *node, *tmp;
 	list_for_each_entry_safe(node, tmp, probes, list_hook)
-		send_icmp_error(node);
+		send_icmp_error(jool, node);
 }
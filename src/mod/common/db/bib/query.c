@@ -0,0 +1,193 @@
+#include "mod/common/db/bib/query.h"
+
+#include "mod/common/address.h"
+#include "mod/common/log.h"
+#include "mod/common/wkmalloc.h"
+#include "mod/common/db/rbtree.h"
+
+/*
+ * Maximum number of groups a query can yield. It's here so careless queries
+ * (such as grouping a huge table by subscriber, without a filter) cannot
+ * exhaust the kernel's memory. (Each group costs less than 48 bytes.)
+ */
+#define MAX_GROUPS (1 << 18)
+
+/* Lower bounds of the SG_LIFETIME buckets, in milliseconds. */
+static const __u32 LIFETIME_BUCKETS[] = {
+	0,
+	10 * 1000,
+	60 * 1000,
+	5 * 60 * 1000,
+	30 * 60 * 1000,
+	2 * 60 * 60 * 1000,
+};
+
+void session_filter_init(struct session_filter *filter)
+{
+	memset(filter, 0, sizeof(*filter));
+	filter->ports.max = 65535;
+}
+
+bool session_filter_match(struct session_filter const *filter,
+		struct session_entry const *session)
+{
+	if (filter->src6.set && !prefix6_contains(&filter->src6.prefix,
+			&session->src6.l3))
+		return false;
+	if (filter->src4.set && !prefix4_contains(&filter->src4.prefix,
+			&session->src4.l3))
+		return false;
+	if (!port_range_contains(&filter->ports, session->src4.l4))
+		return false;
+	if (filter->dst4.set && !prefix4_contains(&filter->dst4.prefix,
+			&session->dst4.l3))
+		return false;
+	if (filter->state_set && session->state != filter->state)
+		return false;
+	if (filter->min_age && time_before(jiffies, session->creation_time
+			+ msecs_to_jiffies(filter->min_age)))
+		return false;
+
+	return true;
+}
+
+struct session_groups *sgroups_create(enum session_grouping grouping)
+{
+	struct session_groups *groups;
+
+	groups = wkmalloc(struct session_groups, GFP_KERNEL);
+	if (!groups)
+		return NULL;
+
+	groups->grouping = grouping;
+	groups->tree = RB_ROOT;
+	groups->count = 0;
+	return groups;
+}
+
+void sgroups_destroy(struct session_groups *groups)
+{
+	struct session_group *group, *tmp;
+
+	rbtree_foreach(group, tmp, &groups->tree, hook)
+		wkfree(struct session_group, group);
+	wkfree(struct session_groups, groups);
+}
+
+static __u32 get_lifetime_bucket(struct session_entry const *session)
+{
+	unsigned long dying_time;
+	__u32 remaining;
+	unsigned int i;
+
+	dying_time = session->update_time + session->timeout;
+	remaining = time_after(dying_time, jiffies)
+			? jiffies_to_msecs(dying_time - jiffies)
+			: 0;
+
+	for (i = ARRAY_SIZE(LIFETIME_BUCKETS) - 1; i > 0; i--)
+		if (remaining >= LIFETIME_BUCKETS[i])
+			break;
+	return LIFETIME_BUCKETS[i];
+}
+
+static void compute_key(enum session_grouping grouping,
+		struct session_entry const *session,
+		struct session_group *group)
+{
+	memset(&group->key, 0, sizeof(group->key));
+
+	switch (grouping) {
+	case SG_TOTAL:
+		break;
+	case SG_SRC6:
+		group->key.prefix6.s6_addr32[0] = session->src6.l3.s6_addr32[0];
+		group->key.prefix6.s6_addr32[1] = session->src6.l3.s6_addr32[1];
+		break;
+	case SG_SRC4:
+		group->key.addr4 = session->src4.l3;
+		break;
+	case SG_STATE:
+		group->key.value = cpu_to_be32(session->state);
+		break;
+	case SG_LIFETIME:
+		group->key.value = cpu_to_be32(get_lifetime_bucket(session));
+		break;
+	}
+}
+
+static int compare_group(struct session_group const *group,
+		struct session_group const *key)
+{
+	return memcmp(&group->key, &key->key, sizeof(key->key));
+}
+
+struct collect_args {
+	struct session_filter const *filter;
+	struct session_groups *groups;
+};
+
+static int collect_session(struct session_entry const *session, void *arg)
+{
+	struct collect_args *args = arg;
+	struct session_groups *groups = args->groups;
+	struct session_group key, *group;
+	struct rb_node **node, *parent;
+
+	if (!session_filter_match(args->filter, session))
+		return 0;
+
+	compute_key(groups->grouping, session, &key);
+	rbtree_find_node(&key, &groups->tree, compare_group,
+			struct session_group, hook, parent, node);
+	if (*node) {
+		group = rb_entry(*node, struct session_group, hook);
+		group->sessions++;
+		return 0;
+	}
+
+	if (groups->count >= MAX_GROUPS) {
+		log_err("The query yields more than %u groups. Please narrow down the filter.",
+				MAX_GROUPS);
+		return -E2BIG;
+	}
+
+	group = wkmalloc(struct session_group, GFP_KERNEL);
+	if (!group)
+		return -ENOMEM;
+	group->key = key.key;
+	group->sessions = 1;
+	rb_link_node(&group->hook, parent, node);
+	rb_insert_color(&group->hook, &groups->tree);
+	groups->count++;
+	return 0;
+}
+
+/**
+ * Adds the sessions from @proto's table that match @filter to @groups.
+ *
+ * bib_foreach_session() does not hold the table's lock while it runs the
+ * callback, so this is allowed to sleep.
+ */
+int sgroups_collect(struct xlator *jool, l4_protocol proto,
+		struct session_filter const *filter,
+		struct session_groups *groups)
+{
+	struct collect_args args;
+
+	args.filter = filter;
+	args.groups = groups;
+	return bib_foreach_session(jool, proto, collect_session, &args, NULL);
+}
+
+struct session_group *sgroups_first(struct session_groups *groups)
+{
+	struct rb_node *node = rb_first(&groups->tree);
+	return node ? rb_entry(node, struct session_group, hook) : NULL;
+}
+
+struct session_group *sgroups_next(struct session_group *group)
+{
+	struct rb_node *node = rb_next(&group->hook);
+	return node ? rb_entry(node, struct session_group, hook) : NULL;
+}
@@ -0,0 +1,54 @@
+#ifndef SRC_MOD_NAT64_BIB_QUERY_H_
+#define SRC_MOD_NAT64_BIB_QUERY_H_
+
+/**
+ * @file
+ * Session table queries that are answered in kernelspace, so userspace does
+ * not need to download the entire table only to filter or count it.
+ */
+
+#include "mod/common/db/bib/db.h"
+
+void session_filter_init(struct session_filter *filter);
+bool session_filter_match(struct session_filter const *filter,
+		struct session_entry const *session);
+
+struct session_group {
+	/*
+	 * Every field is stored in network byte order, and the unused bytes
+	 * are zero, so keys can be sorted with memcmp().
+	 */
+	union {
+		/** SG_SRC6: The /64 of the remote IPv6 address. */
+		struct in6_addr prefix6;
+		/** SG_SRC4: The pool4 address. */
+		struct in_addr addr4;
+		/**
+		 * SG_STATE: The tcp_state.
+		 * SG_LIFETIME: Lower bound of the bucket, in milliseconds.
+		 */
+		__be32 value;
+	} key;
+	/** Number of matching sessions that belong to the group. */
+	__u32 sessions;
+	struct rb_node hook;
+};
+
+struct session_groups {
+	enum session_grouping grouping;
+	/** Tree of struct session_group, sorted by key. */
+	struct rb_root tree;
+	unsigned int count;
+};
+
+struct session_groups *sgroups_create(enum session_grouping grouping);
+void sgroups_destroy(struct session_groups *groups);
+
+int sgroups_collect(struct xlator *jool, l4_protocol proto,
+		struct session_filter const *filter,
+		struct session_groups *groups);
+
+struct session_group *sgroups_first(struct session_groups *groups);
+struct session_group *sgroups_next(struct session_group *group);
+
+#endif /* SRC_MOD_NAT64_BIB_QUERY_H_ */
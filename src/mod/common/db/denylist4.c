@@ -145,6 +145,97 @@ int denylist4_rm(struct addr4_pool *pool, struct ipv4_prefix *prefix)
 	return -ESRCH;
 }
 
+/**
+ * Adds the @count prefixes from @prefixes to @pool, taking the lock only once.
+ *
+ * The result of @prefixes[i] is written in @results[i]. Prefixes whose result
+ * is already nonzero are skipped.
+ */
+void denylist4_add_many(struct addr4_pool *pool, struct ipv4_prefix *prefixes,
+		int *results, unsigned int count, bool force)
+{
+	struct list_head *list;
+	struct pool_entry *entry;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (results[i])
+			continue;
+		results[i] = prefix4_validate(&prefixes[i]);
+		if (results[i])
+			continue;
+		results[i] = prefix4_validate_scope(&prefixes[i], force);
+	}
+
+	mutex_lock(&lock);
+	list = rcu_dereference_protected(pool->list, lockdep_is_held(&lock));
+
+	for (i = 0; i < count; i++) {
+		if (results[i])
+			continue;
+		entry = wkmalloc(struct pool_entry, GFP_KERNEL);
+		if (!entry) {
+			results[i] = -ENOMEM;
+			continue;
+		}
+		entry->prefix = prefixes[i];
+		list_add_tail_rcu(&entry->list_hook, list);
+	}
+
+	mutex_unlock(&lock);
+}
+
+/**
+ * Removes the @count prefixes from @prefixes from @pool. The lock is taken
+ * once, and all the removals share a single RCU grace period.
+ *
+ * Results work as in denylist4_add_many().
+ */
+void denylist4_rm_many(struct addr4_pool *pool, struct ipv4_prefix *prefixes,
+		int *results, unsigned int count)
+{
+	struct list_head *list;
+	struct list_head *node;
+	struct list_head *tmp;
+	struct pool_entry *entry;
+	LIST_HEAD(garbage);
+	unsigned int i;
+
+	mutex_lock(&lock);
+	list = rcu_dereference_protected(pool->list, lockdep_is_held(&lock));
+
+	for (i = 0; i < count; i++) {
+		if (results[i])
+			continue;
+		results[i] = -ESRCH;
+		list_for_each(node, list) {
+			entry = get_entry(node);
+			if (prefix4_equals(&prefixes[i], &entry->prefix)) {
+				list_del_rcu(&entry->list_hook);
+				/*
+				 * Readers might still be walking ->next, so
+				 * borrow ->prev to queue the entry instead.
+				 */
+				entry->list_hook.prev = garbage.prev;
+				garbage.prev = &entry->list_hook;
+				results[i] = 0;
+				break;
+			}
+		}
+	}
+
+	mutex_unlock(&lock);
+
+	if (garbage.prev == &garbage)
+		return;
+
+	synchronize_rcu_bh();
+	for (node = garbage.prev; node != &garbage; node = tmp) {
+		tmp = node->prev;
+		wkfree(struct pool_entry, get_entry(node));
+	}
+}
+
 int denylist4_flush(struct addr4_pool *pool)
 {
 	struct list_head *old;
@@ -16,6 +16,10 @@ void denylist4_put(struct addr4_pool *pool);
 int denylist4_add(struct addr4_pool *pool, struct ipv4_prefix *prefix,
 		bool force);
 int denylist4_rm(struct addr4_pool *pool, struct ipv4_prefix *prefix);
+void denylist4_add_many(struct addr4_pool *pool, struct ipv4_prefix *prefixes,
+		int *results, unsigned int count, bool force);
+void denylist4_rm_many(struct addr4_pool *pool, struct ipv4_prefix *prefixes,
+		int *results, unsigned int count);
 int denylist4_flush(struct addr4_pool *pool);
 
 bool interface_contains(struct net *ns, struct in_addr *addr);
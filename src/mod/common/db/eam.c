@@ -208,6 +208,29 @@ static int eamt_add4(struct eam_table *eamt, struct eamt_entry *eam,
 	return error;
 }
 
+/* Assumes the prefixes were validated, and the lock is held. */
+static int eamt_add_lockless(struct eam_table *eamt, struct eamt_entry *new,
+		bool force, bool synchronize)
+{
+	int error;
+
+	error = validate_overlapping(eamt, new, force);
+	if (error)
+		return error;
+
+	error = eamt_add6(eamt, new, synchronize);
+	if (error)
+		return error;
+	error = eamt_add4(eamt, new, synchronize);
+	if (error) {
+		__revert_add6(eamt, &new->prefix6, synchronize);
+		return error;
+	}
+
+	eamt->count++;
+	return 0;
+}
+
 int eamt_add(struct eam_table *eamt, struct eamt_entry *new, bool force,
 		bool synchronize)
 {
@@ -218,24 +241,106 @@ int eamt_add(struct eam_table *eamt, struct eamt_entry *new, bool force,
 		return error;
 
 	mutex_lock(&lock);
+	error = eamt_add_lockless(eamt, new, force, synchronize);
+	mutex_unlock(&lock);
 
-	error = validate_overlapping(eamt, new, force);
-	if (error)
-		goto end;
+	return error;
+}
 
-	error = eamt_add6(eamt, new, synchronize);
+/*
+ * eamt_add_many() rebuilds the tries instead of adding to them in place, unless
+ * the table has more than this many entries per new entry. (An in-place
+ * addition can cost a grace period; copying an entry costs an allocation.)
+ */
+#define EAMT_CLONE_RATIO 1024
+
+/*
+ * Adds the entries to copies of @eamt's tries, which are not visible to
+ * readers, so they need no synchronization. Then publishes the copies, and
+ * moves the old nodes to @garbage.
+ *
+ * Fails (with no side effects) only if the copies cannot be built.
+ */
+static int add_many_shadowed(struct eam_table *eamt,
+		struct eamt_entry *entries, int *results, unsigned int count,
+		bool force, struct list_head *garbage)
+{
+	struct eam_table shadow;
+	unsigned int i;
+	int error;
+
+	rtrie_init(&shadow.trie6, sizeof(struct eamt_entry), &lock);
+	rtrie_init(&shadow.trie4, sizeof(struct eamt_entry), &lock);
+	shadow.count = eamt->count;
+
+	error = rtrie_clone(&shadow.trie6, &eamt->trie6);
 	if (error)
+		goto fail;
+	error = rtrie_clone(&shadow.trie4, &eamt->trie4);
+	if (error)
+		goto fail;
+
+	for (i = 0; i < count; i++) {
+		if (!results[i])
+			results[i] = eamt_add_lockless(&shadow, &entries[i],
+					force, false);
+	}
+
+	rtrie_replace(&eamt->trie6, &shadow.trie6, garbage);
+	rtrie_replace(&eamt->trie4, &shadow.trie4, garbage);
+	eamt->count = shadow.count;
+	return 0;
+
+fail:
+	rtrie_clean(&shadow.trie6);
+	rtrie_clean(&shadow.trie4);
+	return error;
+}
+
+/**
+ * Adds the @count entries from @entries to @eamt, taking the lock only once.
+ * (They are not added atomically; each one is independent.)
+ *
+ * The result of @entries[i] is written in @results[i]. Entries whose result
+ * is already nonzero are skipped.
+ *
+ * Unless the table is much larger than the batch, the whole batch costs a
+ * single RCU grace period.
+ */
+void eamt_add_many(struct eam_table *eamt, struct eamt_entry *entries,
+		int *results, unsigned int count, bool force)
+{
+	LIST_HEAD(garbage);
+	unsigned int pending;
+	unsigned int i;
+
+	pending = 0;
+	for (i = 0; i < count; i++) {
+		if (!results[i])
+			results[i] = validate_prefixes(&entries[i]);
+		if (!results[i])
+			pending++;
+	}
+	if (!pending)
+		return;
+
+	mutex_lock(&lock);
+
+	if (eamt->count <= (u64)pending * EAMT_CLONE_RATIO
+			&& !add_many_shadowed(eamt, entries, results, count,
+					force, &garbage))
 		goto end;
-	error = eamt_add4(eamt, new, synchronize);
-	if (error) {
-		__revert_add6(eamt, &new->prefix6, synchronize);
-		goto end;
+
+	/* Table too big, or out of memory; go the slow way. */
+	for (i = 0; i < count; i++) {
+		if (!results[i])
+			results[i] = eamt_add_lockless(eamt, &entries[i], force,
+					true);
 	}
 
-	eamt->count++;
 end:
 	mutex_unlock(&lock);
-	return error;
+	rtrie_free_garbage(&garbage);
 }
 
 static int get_exact6(struct eam_table *eamt, struct ipv6_prefix *prefix,
@@ -264,18 +369,24 @@ static int get_exact4(struct eam_table *eamt, struct ipv4_prefix *prefix,
 	return (eam->prefix4.len == prefix->len) ? 0 : -ESRCH;
 }
 
+/* If @garbage isn't NULL, see rtrie_rm_deferred(). */
 static int __rm(struct eam_table *eamt,
 		struct ipv6_prefix *prefix6,
-		struct ipv4_prefix *prefix4)
+		struct ipv4_prefix *prefix4,
+		struct list_head *garbage)
 {
 	struct rtrie_key key6 = PREFIX_TO_KEY(prefix6);
 	struct rtrie_key key4 = PREFIX_TO_KEY(prefix4);
 	int error;
 
-	error = rtrie_rm(&eamt->trie6, &key6, true);
+	error = garbage
+			? rtrie_rm_deferred(&eamt->trie6, &key6, garbage)
+			: rtrie_rm(&eamt->trie6, &key6, true);
 	if (error)
 		goto corrupted;
-	error = rtrie_rm(&eamt->trie4, &key4, true);
+	error = garbage
+			? rtrie_rm_deferred(&eamt->trie4, &key4, garbage)
+			: rtrie_rm(&eamt->trie4, &key4, true);
 	if (error)
 		goto corrupted;
 	eamt->count--;
@@ -292,7 +403,8 @@ corrupted:
 
 static int eamt_rm_lockless(struct eam_table *eamt,
 		struct ipv6_prefix *prefix6,
-		struct ipv4_prefix *prefix4)
+		struct ipv4_prefix *prefix4,
+		struct list_head *garbage)
 {
 	struct eamt_entry eam6;
 	struct eamt_entry eam4;
@@ -300,12 +412,14 @@ static int eamt_rm_lockless(struct eam_table *eamt,
 
 	if (!prefix4) {
 		error = get_exact6(eamt, prefix6, &eam6);
-		return error ? error : __rm(eamt, prefix6, &eam6.prefix4);
+		return error ? error : __rm(eamt, prefix6, &eam6.prefix4,
+				garbage);
 	}
 
 	if (!prefix6) {
 		error = get_exact4(eamt, prefix4, &eam4);
-		return error ? error : __rm(eamt, &eam4.prefix6, prefix4);
+		return error ? error : __rm(eamt, &eam4.prefix6, prefix4,
+				garbage);
 	}
 
 	error = get_exact6(eamt, prefix6, &eam6);
@@ -316,7 +430,7 @@ static int eamt_rm_lockless(struct eam_table *eamt,
 		return error;
 
 	return eamt_entry_equals(&eam6, &eam4)
-			? __rm(eamt, prefix6, prefix4)
+			? __rm(eamt, prefix6, prefix4, garbage)
 			: -ESRCH;
 }
 
@@ -330,12 +444,38 @@ int eamt_rm(struct eam_table *eamt,
 		return -EINVAL;
 
 	mutex_lock(&lock);
-	error = eamt_rm_lockless(eamt, prefix6, prefix4);
+	error = eamt_rm_lockless(eamt, prefix6, prefix4, NULL);
 	mutex_unlock(&lock);
 
 	return error;
 }
 
+/**
+ * Removes the @count entries from @entries from @eamt. (Both prefixes of each
+ * entry must match.) The lock is taken once, and all the removals share a
+ * single RCU grace period.
+ *
+ * Results work as in eamt_add_many().
+ */
+void eamt_rm_many(struct eam_table *eamt, struct eamt_entry *entries,
+		int *results, unsigned int count)
+{
+	LIST_HEAD(garbage);
+	unsigned int i;
+
+	mutex_lock(&lock);
+	for (i = 0; i < count; i++) {
+		if (!results[i])
+			results[i] = eamt_rm_lockless(eamt,
+					&entries[i].prefix6,
+					&entries[i].prefix4,
+					&garbage);
+	}
+	mutex_unlock(&lock);
+
+	rtrie_free_garbage(&garbage);
+}
+
 bool eamt_contains6(struct eam_table *eamt, struct in6_addr *addr)
 {
 	struct rtrie_key key = ADDR_TO_KEY(addr);
@@ -32,6 +32,10 @@ int eamt_add(struct eam_table *jool, struct eamt_entry *new, bool force,
 		bool synchronize);
 int eamt_rm(struct eam_table *eamt, struct ipv6_prefix *prefix6,
 		struct ipv4_prefix *prefix4);
+void eamt_add_many(struct eam_table *eamt, struct eamt_entry *entries,
+		int *results, unsigned int count, bool force);
+void eamt_rm_many(struct eam_table *eamt, struct eamt_entry *entries,
+		int *results, unsigned int count);
 void eamt_flush(struct eam_table *eamt);
 
 typedef int (*eamt_foreach_cb)(struct eamt_entry const *, void *);
@@ -79,6 +79,8 @@ int globals_init(struct jool_globals *config, xlator_type type,
 	config->lowest_ipv6_mtu = DEFAULT_LOWEST_IPV6_MTU;
 	memcpy(config->plateaus.values, &PLATEAUS, sizeof(PLATEAUS));
 	config->plateaus.count = ARRAY_SIZE(PLATEAUS);
+	config->icmp_errors_rate = DEFAULT_ICMP_ERRORS_RATE;
+	config->icmp_errors_burst = DEFAULT_ICMP_ERRORS_BURST;
 
 	switch (type) {
 	case XT_SIIT:
@@ -101,6 +103,7 @@ int globals_init(struct jool_globals *config, xlator_type type,
 		config->nat64.bib.ttl.icmp = 1000 * ICMP_DEFAULT;
 		config->nat64.bib.bib_logging = DEFAULT_BIB_LOGGING;
 		config->nat64.bib.session_logging = DEFAULT_SESSION_LOGGING;
+		config->nat64.bib.netlink_logging = DEFAULT_NETLINK_LOGGING;
 		config->nat64.bib.drop_by_addr = DEFAULT_ADDR_DEPENDENT_FILTERING;
 		config->nat64.bib.drop_external_tcp = DEFAULT_DROP_EXTERNAL_CONNECTIONS;
 		config->nat64.bib.max_stored_pkts = DEFAULT_MAX_STORED_PKTS;
@@ -111,6 +114,17 @@ int globals_init(struct jool_globals *config, xlator_type type,
 		config->nat64.joold.capacity = DEFAULT_JOOLD_CAPACITY;
 		config->nat64.joold.max_payload = DEFAULT_JOOLD_MAX_PAYLOAD;
 		config->nat64.joold.max_sessions_per_pkt = DEFAULT_JOOLD_MAX_SESSIONS_PER_PKT;
+		config->nat64.joold.window_size = DEFAULT_JOOLD_WINDOW_SIZE;
+		config->nat64.joold.sync_tcp = DEFAULT_JOOLD_SYNC_TCP;
+		config->nat64.joold.sync_udp = DEFAULT_JOOLD_SYNC_UDP;
+		config->nat64.joold.sync_icmp = DEFAULT_JOOLD_SYNC_ICMP;
+		config->nat64.joold.established_only = DEFAULT_JOOLD_ESTABLISHED_ONLY;
+		config->nat64.joold.min_age = DEFAULT_JOOLD_MIN_AGE;
+		config->nat64.joold.mark_min = DEFAULT_JOOLD_MARK_MIN;
+		config->nat64.joold.mark_max = DEFAULT_JOOLD_MARK_MAX;
+		config->nat64.joold.max_rate = DEFAULT_JOOLD_MAX_RATE;
+		config->nat64.joold.shard_count = DEFAULT_JOOLD_SHARD_COUNT;
+		config->nat64.joold.shard_id = DEFAULT_JOOLD_SHARD_ID;
 		break;
 
 	default:
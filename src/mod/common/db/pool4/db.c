@@ -41,6 +41,14 @@ struct pool4_table {
 		struct in_addr addr;
 	};
 
+	/*
+	 * Address tables only: The mark of the entries this table was built
+	 * from, so pool4db_find_mark() doesn't have to walk the mark tables.
+	 * Meaningless if @mixed_marks (the address is shared by several marks).
+	 */
+	__u32 addr_mark;
+	bool mixed_marks;
+
 	unsigned int taddr_count;
 	unsigned int sample_count;
 	struct rb_node tree_hook;
@@ -253,6 +261,8 @@ static struct pool4_table *create_table(struct ipv4_range *range)
 	table->sample_count = 1;
 	table->max_iterations_allowed = 0;
 	table->max_iterations_flags = ITERATIONS_AUTO;
+	table->addr_mark = 0;
+	table->mixed_marks = false;
 
 	entry = first_table_entry(table);
 	*entry = *range;
@@ -509,13 +519,17 @@ static int add_to_addr_tree(struct pool4 *pool,
 		return -EINVAL;
 
 	table = find_by_addr(tree, &new->prefix.addr);
-	if (table)
+	if (table) {
+		if (table->addr_mark != entry->mark)
+			table->mixed_marks = true;
 		return pool4_add_range(tree, table, new);
+	}
 
 	table = create_table(new);
 	if (!table)
 		return -ENOMEM;
 	table->addr = new->prefix.addr;
+	table->addr_mark = entry->mark;
 	table->max_iterations_flags = ITERATIONS_AUTO;
 	table->max_iterations_allowed = 0;
 
@@ -832,6 +846,71 @@ bool pool4db_contains(struct pool4 *pool, struct net *ns, l4_protocol proto,
 	return found;
 }
 
+/*
+ * Slow version of pool4db_find_mark(), for addresses that belong to several
+ * marks. It's a linear walk over @proto's mark tables.
+ */
+static int walk_marks(struct pool4 *pool, l4_protocol proto,
+		struct ipv4_transport_addr const *addr, __u32 *mark)
+{
+	struct rb_root *tree;
+	struct rb_node *node;
+	struct pool4_table *table;
+	struct ipv4_range *entry;
+
+	tree = get_tree(&pool->tree_mark, proto);
+	if (!tree)
+		return -EINVAL;
+
+	for (node = rb_first(tree); node; node = rb_next(node)) {
+		table = rb_entry(node, struct pool4_table, tree_hook);
+		foreach_table_range(entry, table) {
+			if (entry->prefix.addr.s_addr != addr->l3.s_addr)
+				continue;
+			if (port_range_contains(&entry->ports, addr->l4)) {
+				*mark = table->mark;
+				return 0;
+			}
+		}
+	}
+
+	return -ESRCH;
+}
+
+/**
+ * Finds the mark of the pool4 entry @addr belongs to.
+ * (ie. the mark of the IPv6 traffic that would be masked as @addr.)
+ *
+ * This is a lookup on the address tree, unless @addr's address was added
+ * under more than one mark.
+ */
+int pool4db_find_mark(struct pool4 *pool, l4_protocol proto,
+		struct ipv4_transport_addr const *addr, __u32 *mark)
+{
+	struct rb_root *tree;
+	struct pool4_table *table;
+	int error;
+
+	tree = get_tree(&pool->tree_addr, proto);
+	if (!tree)
+		return -EINVAL;
+
+	spin_lock_bh(&pool->lock);
+
+	table = find_by_addr(tree, &addr->l3);
+	if (!table || !find_port_range(table, addr->l4)) {
+		error = -ESRCH;
+	} else if (table->mixed_marks) {
+		error = walk_marks(pool, proto, addr, mark);
+	} else {
+		*mark = table->addr_mark;
+		error = 0;
+	}
+
+	spin_unlock_bh(&pool->lock);
+	return error;
+}
+
 static int find_offset(struct pool4_table *table, struct ipv4_range *offset,
 		struct ipv4_range **result)
 {
@@ -992,6 +1071,72 @@ eagain:
 	return -EAGAIN;
 }
 
+static bool tables_equal(struct pool4_table *t1, struct pool4_table *t2)
+{
+	struct ipv4_range *r1;
+	struct ipv4_range *r2;
+
+	if (t1->mark != t2->mark
+			|| t1->sample_count != t2->sample_count
+			|| t1->max_iterations_allowed != t2->max_iterations_allowed
+			|| t1->max_iterations_flags != t2->max_iterations_flags)
+		return false;
+
+	r2 = first_table_entry(t2);
+	foreach_table_range(r1, t1) {
+		if (!ipv4_range_equals(r1, r2))
+			return false;
+		r2++;
+	}
+
+	return true;
+}
+
+static bool trees_equal(struct rb_root *tree1, struct rb_root *tree2)
+{
+	struct rb_node *node1;
+	struct rb_node *node2;
+
+	node1 = rb_first(tree1);
+	node2 = rb_first(tree2);
+	while (node1 && node2) {
+		if (!tables_equal(
+				rb_entry(node1, struct pool4_table, tree_hook),
+				rb_entry(node2, struct pool4_table, tree_hook)))
+			return false;
+		node1 = rb_next(node1);
+		node2 = rb_next(node2);
+	}
+
+	return !node1 && !node2;
+}
+
+/**
+ * Returns true if @pool1 and @pool2 contain the same entries.
+ *
+ * Both pools store their entries in canonical form (split by address, with
+ * fused port ranges), so this is a simple walk. (The address trees are derived
+ * from the mark trees, so they don't need to be compared.)
+ */
+bool pool4db_equals(struct pool4 *pool1, struct pool4 *pool2)
+{
+	bool result;
+
+	if (pool1 == pool2)
+		return true;
+
+	spin_lock_bh(&pool1->lock);
+	spin_lock_nested(&pool2->lock, SINGLE_DEPTH_NESTING);
+
+	result = trees_equal(&pool1->tree_mark.tcp, &pool2->tree_mark.tcp)
+			&& trees_equal(&pool1->tree_mark.udp, &pool2->tree_mark.udp)
+			&& trees_equal(&pool1->tree_mark.icmp, &pool2->tree_mark.icmp);
+
+	spin_unlock(&pool2->lock);
+	spin_unlock_bh(&pool1->lock);
+	return result;
+}
+
 static void print_tree(struct rb_root *tree, bool mark)
 {
 	struct rb_node *node = rb_first(tree);
@@ -36,6 +36,10 @@ void pool4db_flush(struct pool4 *pool);
 
 bool pool4db_contains(struct pool4 *pool, struct net *ns, l4_protocol proto,
 		struct ipv4_transport_addr const *addr);
+bool pool4db_equals(struct pool4 *pool1, struct pool4 *pool2);
+
+int pool4db_find_mark(struct pool4 *pool, l4_protocol proto,
+		struct ipv4_transport_addr const *addr, __u32 *mark);
 
 typedef int (*pool4db_foreach_entry_cb)(struct pool4_entry const *, void *);
 int pool4db_foreach_sample(struct pool4 *pool, l4_protocol proto,
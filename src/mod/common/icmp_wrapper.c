@@ -1,9 +1,156 @@
 #include "mod/common/icmp_wrapper.h"
 
 #include <linux/icmpv6.h>
+#include <linux/inetdevice.h>
+#include <linux/jhash.h>
+#include <linux/kref.h>
+#include <linux/math64.h>
+#include <linux/random.h>
 #include <net/icmp.h>
+#include "common/constants.h"
 #include "common/types.h"
 #include "mod/common/log.h"
+#include "mod/common/stats.h"
+#include "mod/common/wkmalloc.h"
+
+/*
+ * ICMP error rate limiting.
+ *
+ * Token buckets keyed by destination prefix. Each CPU has its own table of
+ * buckets, so updating them requires no locking. The table has a fixed size;
+ * prefixes that hash to the same slot share the bucket. (Handing out a fresh
+ * bucket to every newcomer would defeat the limiter during scans, which visit
+ * many more prefixes than there are slots.)
+ */
+
+#define ICMPRL_BUCKETS 64
+
+struct icmprl_bucket {
+	/* Available tokens, multiplied by HZ. */
+	__u64 credit;
+	/* Last time @credit was updated. (jiffies) */
+	unsigned long stamp;
+};
+
+struct icmprl_table {
+	struct icmprl_bucket buckets[ICMPRL_BUCKETS];
+};
+
+struct icmp_ratelimit {
+	struct icmprl_table __percpu *tables;
+	/* Prevents outsiders from choosing which prefixes collide. */
+	__u32 seed;
+	struct kref refcounter;
+};
+
+struct icmp_ratelimit *icmprl_alloc(void)
+{
+	struct icmp_ratelimit *result;
+
+	result = wkmalloc(struct icmp_ratelimit, GFP_KERNEL);
+	if (!result)
+		return NULL;
+
+	result->tables = alloc_percpu(struct icmprl_table);
+	if (!result->tables) {
+		wkfree(struct icmp_ratelimit, result);
+		return NULL;
+	}
+	get_random_bytes(&result->seed, sizeof(result->seed));
+	kref_init(&result->refcounter);
+
+	return result;
+}
+
+void icmprl_get(struct icmp_ratelimit *rl)
+{
+	kref_get(&rl->refcounter);
+}
+
+static void icmprl_release(struct kref *refcount)
+{
+	struct icmp_ratelimit *rl;
+	rl = container_of(refcount, struct icmp_ratelimit, refcounter);
+
+	free_percpu(rl->tables);
+	wkfree(struct icmp_ratelimit, rl);
+}
+
+void icmprl_put(struct icmp_ratelimit *rl)
+{
+	kref_put(&rl->refcounter, icmprl_release);
+}
+
+static __u32 icmprl_key4(struct xlator *jool, struct sk_buff *skb)
+{
+	/* The error will be addressed to the offending packet's source. */
+	__be32 prefix = ip_hdr(skb)->saddr
+			& inet_make_mask(ICMP_RATELIMIT_PREFIX4_LEN);
+	return jhash_1word((__force __u32)prefix, jool->icmp_rl->seed);
+}
+
+static __u32 icmprl_key6(struct xlator *jool, struct sk_buff *skb)
+{
+	struct in6_addr prefix;
+
+	ipv6_addr_prefix(&prefix, &ipv6_hdr(skb)->saddr,
+			ICMP_RATELIMIT_PREFIX6_LEN);
+	return jhash(&prefix, sizeof(prefix), jool->icmp_rl->seed);
+}
+
+/**
+ * Refills @bucket (@rate tokens per second, up to @burst tokens) as of @now,
+ * then spends one of its tokens, if there's any.
+ */
+static bool icmprl_spend(struct icmprl_bucket *bucket, unsigned long now,
+		__u32 rate, __u32 burst)
+{
+	unsigned long elapsed;
+	__u64 cap;
+
+	cap = (__u64)burst * HZ;
+
+	/* Careful: elapsed * rate could overflow if elapsed is big. */
+	elapsed = now - bucket->stamp;
+	if (elapsed > div_u64(cap, rate))
+		bucket->credit = cap;
+	else
+		bucket->credit = min_t(__u64, cap,
+				bucket->credit + (__u64)elapsed * rate);
+	bucket->stamp = now;
+
+	if (bucket->credit < HZ)
+		return false;
+
+	bucket->credit -= HZ;
+	return true;
+}
+
+/**
+ * Spends one of @key's tokens, if there's any.
+ */
+static bool icmprl_allow(struct xlator *jool, __u32 key)
+{
+	struct icmprl_bucket *bucket;
+	bool allow;
+
+	/* Timers and Netlink requests also send errors; keep them out. */
+	local_bh_disable();
+	bucket = &this_cpu_ptr(jool->icmp_rl->tables)->buckets[
+			key % ICMPRL_BUCKETS];
+	allow = icmprl_spend(bucket, jiffies, jool->globals.icmp_errors_rate,
+			jool->globals.icmp_errors_burst);
+	local_bh_enable();
+
+	if (!allow)
+		jstat_inc(jool->stats, JSTAT_ICMPERR_RATELIMIT);
+	return allow;
+}
+
+static bool is_ratelimited(struct xlator *jool)
+{
+	return jool && jool->globals.icmp_errors_rate;
+}
 
 static int route4_input(struct xlator *jool, struct sk_buff *skb)
 {
@@ -57,13 +204,6 @@ bool icmp64_send4(struct xlator *jool, struct sk_buff *skb,
 	if (unlikely(!skb) || !skb->dev)
 		return false;
 
-	/*
-	 * I don't know why the kernel needs this nonsense,
-	 * but it's not my fault.
-	 */
-	if (route4_input(jool, skb))
-		return false;
-
 	switch (error) {
 	case ICMPERR_ADDR_UNREACHABLE:
 		type = ICMP_DEST_UNREACH;
@@ -97,6 +237,18 @@ bool icmp64_send4(struct xlator *jool, struct sk_buff *skb,
 		return false; /* Not supported or needed. */
 	}
 
+	if (is_ratelimited(jool) && !icmprl_allow(jool, icmprl_key4(jool, skb))) {
+		__log_debug(jool, "ICMPv4 error rate limit reached.");
+		return false;
+	}
+
+	/*
+	 * I don't know why the kernel needs this nonsense,
+	 * but it's not my fault.
+	 */
+	if (route4_input(jool, skb))
+		return false;
+
 	__log_debug(jool, "Sending ICMPv4 error: %s, type: %d, code: %d, rest: %u.",
 			icmp_error_to_string(error), type, code, info);
 	icmp_send(skb, type, code, cpu_to_be32(info));
@@ -142,6 +294,11 @@ bool icmp64_send6(struct xlator *jool, struct sk_buff *skb,
 		return false; /* Not supported or needed. */
 	}
 
+	if (is_ratelimited(jool) && !icmprl_allow(jool, icmprl_key6(jool, skb))) {
+		__log_debug(jool, "ICMPv6 error rate limit reached.");
+		return false;
+	}
+
 	__log_debug(jool, "Sending ICMPv6 error: %s, type: %d, code: %d, rest: %u",
 			icmp_error_to_string(error), type, code, info);
 	icmpv6_send(skb, type, code, info);
@@ -33,8 +33,19 @@ typedef enum icmp_errcode {
 	ICMPERR_FILTER,
 } icmp_error_code;
 
+/**
+ * Per-instance ICMP error rate limiter. (See the icmp-errors-rate global.)
+ */
+struct icmp_ratelimit *icmprl_alloc(void);
+void icmprl_get(struct icmp_ratelimit *rl);
+void icmprl_put(struct icmp_ratelimit *rl);
+
 /**
  * Wrappers for icmp_send() and icmpv6_send().
+ *
+ * They return false if the error was not sent, which includes @jool's rate
+ * limiter forbidding it. @jool can be NULL, in which case the error is not
+ * rate limited.
  */
 bool icmp64_send6(struct xlator *jool, struct sk_buff *skb,
 		icmp_error_code error, __u32 info);
@@ -1,15 +1,22 @@
 #include "mod/common/joold.h"
 
+#include <linux/hashtable.h>
 #include <linux/inet.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
 
 #include "common/constants.h"
+#include "mod/common/address.h"
 #include "mod/common/log.h"
+#include "mod/common/rfc6052.h"
 #include "mod/common/wkmalloc.h"
 #include "mod/common/xlator.h"
 #include "mod/common/nl/attribute.h"
 #include "mod/common/nl/nl_core.h"
 #include "mod/common/nl/nl_handler.h"
+#include "mod/common/stats.h"
 #include "mod/common/db/bib/db.h"
+#include "mod/common/db/pool4/db.h"
 #include "mod/common/steps/send_packet.h"
 
 #define GLOBALS(xlator) (xlator->globals.nat64.joold)
@@ -19,22 +26,82 @@ struct counted_list {
 	unsigned int count;
 };
 
+#define JQF_AD_ONGOING (1 << 1) /** Advertisement requested by user? */
+#define JQF_AD_FETCHING (1 << 2) /** Someone is reading the next ad chunk. */
+
+/* Needs to be a power of two. */
+#define JOOLD_RING_SIZE 64
+
 /**
- * Can we send our packet yet?
- * (We need to wait for ACKs because the kernel can't handle too many
- * Netlink messages at once.)
+ * Sessions recently queued by one CPU's packet path.
+ *
+ * There is a single producer (the CPU, with bottom halves disabled) and a
+ * single consumer (whoever holds the queue's lock), so neither of them needs to
+ * lock the ring itself.
  */
-#define JQF_ACK_RECEIVED (1 << 0)
-#define JQF_AD_ONGOING (1 << 1) /** Advertisement requested by user? */
+struct joold_ring {
+	struct deferred_session *slots[JOOLD_RING_SIZE];
+	/** Next slot the producer will write. Only the producer writes it. */
+	unsigned int head;
+	/** Next slot the consumer will read. Only the consumer writes it. */
+	unsigned int tail;
+
+	/*
+	 * ss-max-rate token bucket. Only the producer touches these.
+	 * @credit is measured in sessions * HZ.
+	 */
+	__u64 credit;
+	unsigned long stamp;
+};
+
+/**
+ * Position of an ongoing advertisement within the session tables.
+ * Advertisements are read in chunks, as the window allows them to be sent.
+ */
+struct joold_ad_cursor {
+	/** Table the next chunk will be read from. Past ICMP means "done." */
+	l4_protocol proto;
+	/** Last session that was read from @proto's table. */
+	struct session_foreach_offset offset;
+	/** false: The next chunk starts at the beginning of @proto's table. */
+	bool offset_set;
+};
 
 struct joold_queue {
 	unsigned int flags; /** JQF */
+	/** Only meaningful while JQF_AD_ONGOING. */
+	struct joold_ad_cursor ad;
+
+	/**
+	 * Sessions the packet path has queued, but have not been moved to
+	 * @deferred yet.
+	 */
+	struct joold_ring __percpu *rings;
 
 	struct counted_list deferred; /** Queued sessions */
+	/**
+	 * Index of @deferred, by session.
+	 * Allows updates of a session that hasn't been sent yet to be merged
+	 * into its existing node.
+	 */
+	DECLARE_HASHTABLE(index, 8);
+
+	/*
+	 * Sliding window.
+	 * (We need to wait for ACKs because the kernel can't handle too many
+	 * Netlink messages at once.)
+	 *
+	 * @next_seq is the sequence number the next packet will carry.
+	 * @acked_seq is the sequence number of the oldest packet that hasn't
+	 * been acknowledged yet. (ie. everything before it has.)
+	 * So `next_seq - acked_seq` is the number of packets in flight.
+	 */
+	__u32 next_seq;
+	__u32 acked_seq;
 
 	/**
 	 * Jiffy at which the last batch of sessions was sent.
-	 * If the ACK was lost for some reason, this should get us back on
+	 * If the ACKs were lost for some reason, this should get us back on
 	 * track.
 	 */
 	unsigned long last_flush_time;
@@ -43,11 +110,41 @@ struct joold_queue {
 	struct kref refs;
 };
 
+/**
+ * Sessions cut from the queue, waiting to be sent to userspace once the lock
+ * is released.
+ */
+struct joold_prepared {
+	struct list_head sessions;
+	/** Number of packets @sessions needs to be split into. */
+	unsigned int packets;
+	/** Sequence number of the first of these packets. */
+	__u32 seq;
+	/** Do these packets conclude an advertisement? */
+	bool ad_end;
+};
+
 struct ad_arg {
-	struct joold_queue *queue;
-	struct list_head *ready;
+	struct xlator *jool;
+	struct joold_ad_cursor cursor;
+	/** Sessions read so far. */
+	struct list_head sessions;
+	unsigned int count;
+	/** Maximum number of sessions this chunk is allowed to read. */
+	unsigned int budget;
+	/** Sessions looked at so far, whether they passed the filters or not. */
+	unsigned int visited;
 };
 
+/*
+ * Maximum number of sessions one advertisement chunk is allowed to look at.
+ * Without it, a stretch of sessions rejected by the ss-sync-* and ss-mark-*
+ * filters would cost no budget, and the chunk could end up walking the whole
+ * database. (If a chunk runs out of walk but not of budget, the next ACK or
+ * joold_clean() resumes it.)
+ */
+#define AD_WALK_MAX 1024
+
 /**
  * A session or group of sessions that need to be transmitted to other Jool
  * instances in the near future.
@@ -56,6 +153,8 @@ struct deferred_session {
 	struct session_entry session;
 	/** List hook to joold_queue.deferred.  */
 	struct list_head lh;
+	/** Hash table hook to joold_queue.index. */
+	struct hlist_node hn;
 };
 
 static struct kmem_cache *deferred_cache;
@@ -95,127 +194,668 @@ static void delete_sessions(struct list_head *sessions)
 	}
 }
 
+/**
+ * Is @session worth synchronizing? (See the replication filters in
+ * struct joold_config.)
+ */
+static bool should_sync(struct xlator *jool,
+		struct session_entry const *session)
+{
+	__u32 mark;
+
+	switch (session->proto) {
+	case L4PROTO_TCP:
+		if (!GLOBALS(jool).sync_tcp)
+			return false;
+		if (GLOBALS(jool).established_only && (session->state == V6_INIT
+				|| session->state == V4_INIT))
+			return false;
+		break;
+	case L4PROTO_UDP:
+		if (!GLOBALS(jool).sync_udp)
+			return false;
+		break;
+	case L4PROTO_ICMP:
+		if (!GLOBALS(jool).sync_icmp)
+			return false;
+		break;
+	case L4PROTO_OTHER:
+		return false;
+	}
+
+	if (GLOBALS(jool).min_age && time_before(jiffies,
+			session->creation_time
+			+ msecs_to_jiffies(GLOBALS(jool).min_age)))
+		return false;
+
+	/* The mark lookup is not free, so only do it if it can matter. */
+	if (GLOBALS(jool).mark_min != 0 || GLOBALS(jool).mark_max != U32_MAX) {
+		/* Not in pool4 (eg. empty pool4 or static BIB entry) = mark 0. */
+		if (pool4db_find_mark(jool->nat64.pool4, session->proto,
+				&session->src4, &mark))
+			mark = 0;
+		if (mark < GLOBALS(jool).mark_min
+				|| mark > GLOBALS(jool).mark_max)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * ss-max-rate. Spends one of @ring's tokens, if there's any.
+ * Assumes bottom halves are disabled, and @ring is the current CPU's.
+ */
+static bool rate_allow(struct xlator *jool, struct joold_ring *ring)
+{
+	unsigned long now;
+	unsigned long elapsed;
+	__u64 cap;
+	__u32 rate;
+
+	rate = GLOBALS(jool).max_rate;
+	if (!rate)
+		return true;
+
+	/* Bursts of up to one second's worth. */
+	cap = (__u64)rate * HZ;
+	now = jiffies;
+
+	/* Careful: elapsed * rate could overflow if elapsed is big. */
+	elapsed = now - ring->stamp;
+	if (elapsed >= HZ)
+		ring->credit = cap;
+	else
+		ring->credit = min_t(__u64, cap,
+				ring->credit + (__u64)elapsed * rate);
+	ring->stamp = now;
+
+	if (ring->credit < HZ)
+		return false;
+	ring->credit -= HZ;
+	return true;
+}
+
 /* "advertise session," not "add session." Although we're adding it too. */
 static int ad_session(struct session_entry const *_session, void *arg)
 {
-	struct counted_list *list;
+	struct ad_arg *ad;
 	struct deferred_session *session;
 
+	ad = arg;
+	/*
+	 * Peek one session past the budget before stopping, so a chunk that
+	 * happens to end the table is not mistaken for an unfinished one.
+	 */
+	if (ad->count >= ad->budget || ad->visited >= AD_WALK_MAX)
+		return 1;
+
+	/* Remember our place anyway, so the next chunk starts after it. */
+	ad->cursor.offset.offset.src = _session->src4;
+	ad->cursor.offset.offset.dst = _session->dst4;
+	ad->cursor.offset.include_offset = false;
+	ad->cursor.offset_set = true;
+	ad->visited++;
+
+	if (!should_sync(ad->jool, _session))
+		return 0;
+
 	session = ALLOC_DEFERRED;
 	if (!session)
 		return -ENOMEM;
 	session->session = *_session;
 
-	list = arg;
-	list_add_tail(&session->lh, &list->list);
-	list->count++;
+	list_add_tail(&session->lh, &ad->sessions);
+	ad->count++;
 	return 0;
 }
 
-static bool should_send(struct xlator *jool)
+static bool ad_done(struct joold_ad_cursor const *cursor)
+{
+	return cursor->proto > L4PROTO_ICMP;
+}
+
+static bool window_full(struct xlator *jool)
+{
+	struct joold_queue *queue = jool->nat64.joold;
+	return queue->next_seq - queue->acked_seq >= GLOBALS(jool).window_size;
+}
+
+/*
+ * If nothing has been sent for a while, assume the ACKs of the packets in
+ * flight were lost, and restart the window.
+ * Assumes the lock is held.
+ */
+static void check_deadline(struct xlator *jool)
+{
+	struct joold_queue *queue;
+	unsigned long deadline;
+
+	queue = jool->nat64.joold;
+	deadline = msecs_to_jiffies(GLOBALS(jool).flush_deadline);
+	if (time_before(queue->last_flush_time + deadline, jiffies))
+		queue->acked_seq = queue->next_seq;
+}
+
+/*
+ * Would the queue be ready to send a packet if it contained @count sessions?
+ */
+static bool __should_send(struct xlator *jool, unsigned int count)
 {
 	struct joold_queue *queue;
 	unsigned long deadline;
 
 	queue = jool->nat64.joold;
 
-	if (queue->deferred.count == 0)
+	if (count == 0)
+		return false;
+
+	if (window_full(jool))
 		return false;
 
 	deadline = msecs_to_jiffies(GLOBALS(jool).flush_deadline);
 	if (time_before(queue->last_flush_time + deadline, jiffies))
 		return true;
 
-	if (!(queue->flags & JQF_ACK_RECEIVED))
-		return false;
-
 	if (queue->flags & JQF_AD_ONGOING)
 		return true;
 
 	if (GLOBALS(jool).flush_asap)
 		return true;
 
-	return queue->deferred.count >= GLOBALS(jool).max_sessions_per_pkt;
+	return count >= GLOBALS(jool).max_sessions_per_pkt;
+}
+
+static bool should_send(struct xlator *jool)
+{
+	return __should_send(jool, jool->nat64.joold->deferred.count);
 }
 
-static bool too_many_sessions(struct xlator *jool)
+/*
+ * Unlocked guess of whether the packet path should flush, now that the queue
+ * holds about @count sessions.
+ *
+ * Flushing needs the queue's lock, which all the CPUs would be fighting over
+ * if this were as eager as __should_send(). So the packet path only flushes
+ * full packets, or (if flush-asap) when nothing is in flight, since no ACK is
+ * coming to do it then. The rest is left to the ACKs and joold_clean().
+ */
+static bool packet_path_should_send(struct xlator *jool, unsigned int count)
 {
 	struct joold_queue *queue = jool->nat64.joold;
 
-	if (queue->flags & JQF_AD_ONGOING)
+	if (window_full(jool))
+		return false;
+	if (count >= GLOBALS(jool).max_sessions_per_pkt)
+		return true;
+	return GLOBALS(jool).flush_asap
+			&& READ_ONCE(queue->next_seq) == READ_ONCE(queue->acked_seq);
+}
+
+/*
+ * Moves the first (up to) max_sessions_per_pkt sessions from @from to @to.
+ * Returns the number of sessions moved.
+ */
+static unsigned int cut_packet(struct xlator *jool, struct list_head *from,
+		struct list_head *to)
+{
+	struct list_head *cut;
+	unsigned int d;
+
+	INIT_LIST_HEAD(to);
+	cut = from;
+	for (d = 0; d < GLOBALS(jool).max_sessions_per_pkt; d++) {
+		if (cut->next == from)
+			break;
+		cut = cut->next;
+	}
+
+	list_cut_position(to, from, cut);
+	return d;
+}
+
+static u32 hash_session(struct session_entry const *session)
+{
+	return jhash_3words(
+		(__force u32)session->src6.l3.s6_addr32[3],
+		(__force u32)session->dst6.l3.s6_addr32[3],
+		(session->src6.l4 << 16) | session->src4.l4,
+		session->proto
+	);
+}
+
+/*
+ * Adds @session to the queue, or merges it into the node of the same session
+ * if there's one already.
+ * Always swallows @session.
+ * Assumes the lock is held.
+ *
+ * @advertised sessions skip the ss-capacity check, since ad_budget() already
+ * bounds them.
+ */
+static void defer_session(struct xlator *jool, struct deferred_session *session,
+		bool advertised)
+{
+	struct joold_queue *queue;
+	struct deferred_session *old;
+	u32 hash;
+
+	queue = jool->nat64.joold;
+	hash = hash_session(&session->session);
+
+	hash_for_each_possible(queue->index, old, hn, hash) {
+		if (session_equals(&old->session, &session->session)) {
+			/* CPUs are drained in order, not chronologically. */
+			if (!time_before(session->session.update_time,
+					old->session.update_time))
+				old->session = session->session;
+			FREE_DEFERRED(session);
+			return;
+		}
+	}
+
+	if (!advertised && queue->deferred.count >= GLOBALS(jool).capacity) {
+		log_warn_once("joold: Too many sessions deferred! I need to drop some; sorry.");
+		FREE_DEFERRED(session);
+		return;
+	}
+
+	list_add_tail(&session->lh, &queue->deferred.list);
+	hash_add(queue->index, &session->hn, hash);
+	/* The packet path peeks at this without the lock. */
+	WRITE_ONCE(queue->deferred.count, queue->deferred.count + 1);
+}
+
+static struct deferred_session **ring_slot(struct joold_ring *ring,
+		unsigned int index)
+{
+	return &ring->slots[index & (JOOLD_RING_SIZE - 1)];
+}
+
+/*
+ * Producer side of the ring. Assumes bottom halves are disabled.
+ * On success, @pending will be the number of sessions the ring holds.
+ */
+static bool ring_push(struct joold_ring *ring, struct deferred_session *session,
+		unsigned int *pending)
+{
+	unsigned int head;
+	unsigned int tail;
+
+	head = ring->head;
+	tail = smp_load_acquire(&ring->tail);
+	if (head - tail >= JOOLD_RING_SIZE)
 		return false;
 
-	return queue->deferred.count >= GLOBALS(jool).capacity;
+	*ring_slot(ring, head) = session;
+	smp_store_release(&ring->head, head + 1);
+
+	*pending = head + 1 - tail;
+	return true;
+}
+
+/*
+ * Consumer side of the rings; moves everything the packet path has queued
+ * to the deferred list.
+ * Assumes the lock is held.
+ */
+static void drain_rings(struct xlator *jool)
+{
+	struct joold_queue *queue;
+	struct joold_ring *ring;
+	unsigned int head;
+	unsigned int tail;
+	int cpu;
+
+	queue = jool->nat64.joold;
+
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu_ptr(queue->rings, cpu);
+		head = smp_load_acquire(&ring->head);
+		for (tail = ring->tail; tail != head; tail++)
+			defer_session(jool, *ring_slot(ring, tail), false);
+		smp_store_release(&ring->tail, tail);
+	}
+}
+
+static void init_prepared(struct joold_prepared *prepared)
+{
+	INIT_LIST_HEAD(&prepared->sessions);
+	prepared->packets = 0;
+	prepared->seq = 0;
+	prepared->ad_end = false;
 }
 
 /**
- * Always swallows @session, can be NULL.
  * Assumes the lock is held.
  * You have to send_to_userspace(@jool, @prepared) after releasing the spinlock.
  */
 static void send_to_userspace_prepare(struct xlator *jool,
-		struct deferred_session *session,
-		struct list_head *prepared)
+		struct joold_prepared *prepared)
 {
 	struct joold_queue *queue;
-	struct list_head *cut;
-	unsigned int d;
+	struct deferred_session *session;
+	struct list_head packet;
+	unsigned int cut;
 
 	queue = jool->nat64.joold;
 
-	if (session) {
-		if (too_many_sessions(jool)) {
-			log_warn_once("joold: Too many sessions deferred! I need to drop some; sorry.");
-		} else {
-			list_add_tail(&session->lh, &queue->deferred.list);
-			queue->deferred.count++;
+	drain_rings(jool);
+	check_deadline(jool);
+
+	prepared->seq = queue->next_seq;
+
+	while (should_send(jool)) {
+		cut = cut_packet(jool, &queue->deferred.list, &packet);
+		WRITE_ONCE(queue->deferred.count, queue->deferred.count - cut);
+		list_for_each_entry(session, &packet, lh)
+			hash_del(&session->hn);
+		list_splice_tail(&packet, &prepared->sessions);
+		prepared->packets++;
+
+		/*
+		 * BTW: This sucks.
+		 * We're assuming that the nlcore_send_multicast_message()
+		 * during send_to_userspace() is going to succeed.
+		 * But the alternative is to do the
+		 * nlcore_send_multicast_message() with the lock held, and I
+		 * don't have the stomach for that.
+		 */
+		queue->next_seq++;
+		if ((queue->flags & JQF_AD_ONGOING)
+				&& queue->deferred.count == 0
+				&& ad_done(&queue->ad)) {
+			queue->flags &= ~JQF_AD_ONGOING;
+			prepared->ad_end = true;
 		}
+		queue->last_flush_time = jiffies;
 	}
+}
 
-	if (!should_send(jool))
-		return;
+/*
+ * Session records (see struct joold_records_hdr)
+ * ==============================================
+ */
+
+/** Writes into @buffer, or merely measures if @buffer is NULL. */
+struct record_writer {
+	__u8 *buffer;
+	unsigned int offset;
+};
+
+struct record_reader {
+	__u8 const *buffer;
+	unsigned int len;
+	unsigned int offset;
+};
+
+#define JSR_REPEATED (JSR_SRC6_ADDR_REPEATED | JSR_SRC4_ADDR_REPEATED \
+		| JSR_DST4_ADDR_REPEATED)
+#define JSR_ALL (JSR_REPEATED | JSR_DST6_ADDR | JSR_DST6_PORT | JSR_AGE_LONG)
+
+static void put_bytes(struct record_writer *writer, void const *src,
+		unsigned int len)
+{
+	if (writer->buffer)
+		memcpy(writer->buffer + writer->offset, src, len);
+	writer->offset += len;
+}
 
-	if (queue->deferred.count <= GLOBALS(jool).max_sessions_per_pkt) {
-		cut = queue->deferred.list.prev;
-		d = queue->deferred.count;
+static void put_be16(struct record_writer *writer, __u16 value)
+{
+	__be16 be = cpu_to_be16(value);
+	put_bytes(writer, &be, sizeof(be));
+}
+
+static void put_be32(struct record_writer *writer, __u32 value)
+{
+	__be32 be = cpu_to_be32(value);
+	put_bytes(writer, &be, sizeof(be));
+}
+
+static int get_bytes(struct record_reader *reader, void *dst, unsigned int len)
+{
+	if (reader->len - reader->offset < len)
+		return -EINVAL;
+	memcpy(dst, reader->buffer + reader->offset, len);
+	reader->offset += len;
+	return 0;
+}
+
+static int get_be16(struct record_reader *reader, __u16 *result)
+{
+	__be16 be;
+	int error;
+
+	error = get_bytes(reader, &be, sizeof(be));
+	if (!error)
+		*result = be16_to_cpu(be);
+	return error;
+}
+
+static int get_be32(struct record_reader *reader, __u32 *result)
+{
+	__be32 be;
+	int error;
+
+	error = get_bytes(reader, &be, sizeof(be));
+	if (!error)
+		*result = be32_to_cpu(be);
+	return error;
+}
+
+/*
+ * Serializes @session, omitting whatever the receiver can infer from @prev
+ * (the previous record in the batch, NULL if none) and its own @pool6.
+ */
+static void put_record(struct ipv6_prefix const *pool6,
+		struct record_writer *writer,
+		struct session_entry const *session,
+		struct session_entry const *prev)
+{
+	struct in6_addr dst6;
+	unsigned int age;
+	__u8 flags;
+	__u8 meta;
+
+	flags = 0;
+	if (prev) {
+		if (addr6_equals(&prev->src6.l3, &session->src6.l3))
+			flags |= JSR_SRC6_ADDR_REPEATED;
+		if (prev->src4.l3.s_addr == session->src4.l3.s_addr)
+			flags |= JSR_SRC4_ADDR_REPEATED;
+		if (prev->dst4.l3.s_addr == session->dst4.l3.s_addr)
+			flags |= JSR_DST4_ADDR_REPEATED;
+	}
+	if (__rfc6052_4to6(pool6, &session->dst4.l3, &dst6)
+			|| !addr6_equals(&dst6, &session->dst6.l3))
+		flags |= JSR_DST6_ADDR;
+	if (session->dst6.l4 != session->dst4.l4)
+		flags |= JSR_DST6_PORT;
+
+	age = time_after(session->update_time, jiffies)
+			? 0
+			: jiffies_to_msecs(jiffies - session->update_time);
+	if (age > MAX_U16)
+		flags |= JSR_AGE_LONG;
+
+	meta = (session->proto << 6)
+			| ((session->timer_type & 0x3) << 4)
+			| (session->state & 0xF);
+
+	put_bytes(writer, &flags, sizeof(flags));
+	put_bytes(writer, &meta, sizeof(meta));
+	if (!(flags & JSR_SRC6_ADDR_REPEATED))
+		put_bytes(writer, &session->src6.l3, sizeof(session->src6.l3));
+	put_be16(writer, session->src6.l4);
+	if (!(flags & JSR_SRC4_ADDR_REPEATED))
+		put_bytes(writer, &session->src4.l3, sizeof(session->src4.l3));
+	put_be16(writer, session->src4.l4);
+	if (!(flags & JSR_DST4_ADDR_REPEATED))
+		put_bytes(writer, &session->dst4.l3, sizeof(session->dst4.l3));
+	put_be16(writer, session->dst4.l4);
+	if (flags & JSR_DST6_ADDR)
+		put_bytes(writer, &session->dst6.l3, sizeof(session->dst6.l3));
+	if (flags & JSR_DST6_PORT)
+		put_be16(writer, session->dst6.l4);
+	if (flags & JSR_AGE_LONG)
+		put_be32(writer, age);
+	else
+		put_be16(writer, age);
+}
+
+/*
+ * Serializes @sessions (up to @count of them) as a complete records blob.
+ * Returns the length of the blob.
+ */
+static unsigned int put_records(struct xlator *jool,
+		struct record_writer *writer,
+		struct list_head *sessions, unsigned int count)
+{
+	struct joold_records_hdr hdr;
+	struct deferred_session *session;
+	struct session_entry const *prev;
+	unsigned int i;
+
+	hdr.magic[0] = JOOLD_RECORDS_MAGIC;
+	hdr.magic[1] = JOOLD_RECORDS_MAGIC;
+	hdr.version = JOOLD_RECORDS_VERSION;
+	hdr.reserved = 0;
+	hdr.count = cpu_to_be16(count);
+	put_bytes(writer, &hdr, sizeof(hdr));
+
+	prev = NULL;
+	i = 0;
+	list_for_each_entry(session, sessions, lh) {
+		if (i++ >= count)
+			break;
+		put_record(&jool->globals.pool6.prefix, writer,
+				&session->session, prev);
+		prev = &session->session;
+	}
+
+	return writer->offset;
+}
+
+static int get_record(struct ipv6_prefix const *pool6,
+		struct record_reader *reader,
+		struct session_entry const *prev,
+		struct session_entry *result)
+{
+	struct session_entry session;
+	__u8 flags;
+	__u8 meta;
+	__u16 age16;
+	__u32 age;
+
+	memset(&session, 0, sizeof(session));
+
+	if (get_bytes(reader, &flags, sizeof(flags)))
+		goto truncated;
+	if (get_bytes(reader, &meta, sizeof(meta)))
+		goto truncated;
+
+	if (flags & ~JSR_ALL) {
+		log_err("joold record has unknown flags: %x", flags);
+		return -EINVAL;
+	}
+	if (!prev && (flags & JSR_REPEATED)) {
+		log_err("First joold record refers to a previous record.");
+		return -EINVAL;
+	}
+
+	session.proto = meta >> 6;
+	session.timer_type = (meta >> 4) & 0x3;
+	session.state = meta & 0xF;
+	if (session.proto == L4PROTO_OTHER
+			|| session.timer_type > SESSION_TIMER_SYN4
+			|| session.state > TRANS) {
+		log_err("joold record has bogus metadata: %x", meta);
+		return -EINVAL;
+	}
+
+	if (flags & JSR_SRC6_ADDR_REPEATED)
+		session.src6.l3 = prev->src6.l3;
+	else if (get_bytes(reader, &session.src6.l3, sizeof(session.src6.l3)))
+		goto truncated;
+	if (get_be16(reader, &session.src6.l4))
+		goto truncated;
+
+	if (flags & JSR_SRC4_ADDR_REPEATED)
+		session.src4.l3 = prev->src4.l3;
+	else if (get_bytes(reader, &session.src4.l3, sizeof(session.src4.l3)))
+		goto truncated;
+	if (get_be16(reader, &session.src4.l4))
+		goto truncated;
+
+	if (flags & JSR_DST4_ADDR_REPEATED)
+		session.dst4.l3 = prev->dst4.l3;
+	else if (get_bytes(reader, &session.dst4.l3, sizeof(session.dst4.l3)))
+		goto truncated;
+	if (get_be16(reader, &session.dst4.l4))
+		goto truncated;
+
+	if (flags & JSR_DST6_ADDR) {
+		if (get_bytes(reader, &session.dst6.l3, sizeof(session.dst6.l3)))
+			goto truncated;
+	} else if (__rfc6052_4to6(pool6, &session.dst4.l3, &session.dst6.l3)) {
+		return -EINVAL;
+	}
+	if (flags & JSR_DST6_PORT) {
+		if (get_be16(reader, &session.dst6.l4))
+			goto truncated;
 	} else {
-		cut = &queue->deferred.list;
-		for (d = 0; d < GLOBALS(jool).max_sessions_per_pkt; d++)
-			cut = cut->next;
+		session.dst6.l4 = session.dst4.l4;
 	}
 
-	list_cut_position(prepared, &queue->deferred.list, cut);
-	queue->deferred.count -= d;
+	if (flags & JSR_AGE_LONG) {
+		if (get_be32(reader, &age))
+			goto truncated;
+	} else {
+		if (get_be16(reader, &age16))
+			goto truncated;
+		age = age16;
+	}
 
-	/*
-	 * BTW: This sucks.
-	 * We're assuming that the nlcore_send_multicast_message() during
-	 * send_to_userspace() is going to succeed.
-	 * But the alternative is to do the nlcore_send_multicast_message()
-	 * with the lock held, and I don't have the stomach for that.
-	 */
-	queue->flags &= ~JQF_ACK_RECEIVED;
-	if (queue->deferred.count == 0)
-		queue->flags &= ~JQF_AD_ONGOING;
-	queue->last_flush_time = jiffies;
+	session.update_time = jiffies - msecs_to_jiffies(age);
+	/* The database infers timeouts from its own timers. */
+	session.timeout = 0;
+	session.has_stored = false;
+
+	*result = session;
+	return 0;
+
+truncated:
+	log_err("joold record is truncated.");
+	return -EINVAL;
 }
 
 /*
+ * Sends @sessions as packet number @seq.
  * Swallows ownership of the sessions.
  */
-static void send_to_userspace(struct xlator *jool, struct list_head *sessions)
+static void send_packet(struct xlator *jool, struct list_head *sessions,
+		__u32 seq)
 {
 	struct sk_buff *skb;
 	struct joolnlhdr *jhdr;
 	struct nlattr *root;
 	struct deferred_session *session;
+	struct record_writer writer;
 	unsigned int count;
 	int error;
 
-	if (list_empty(sessions))
-		return;
+	count = 0;
+	list_for_each_entry(session, sessions, lh)
+		count++;
+
+	/* Measure first, so the attribute can be reserved exactly. */
+	writer.buffer = NULL;
+	writer.offset = 0;
+	put_records(jool, &writer, sessions, count);
 
-	skb = genlmsg_new(1500, GFP_ATOMIC);
+	skb = genlmsg_new(JOOLNL_HDRLEN + nla_total_size(writer.offset)
+			+ nla_total_size(sizeof(__u32)), GFP_ATOMIC);
 	if (!skb)
 		goto revert_list;
 
@@ -229,24 +869,22 @@ static void send_to_userspace(struct xlator *jool, struct list_head *sessions)
 	jhdr->xt = XT_NAT64;
 	memcpy(jhdr->iname, jool->iname, INAME_MAX_SIZE);
 
-	root = nla_nest_start(skb, JNLAR_SESSION_ENTRIES);
-	if (WARN(!root, "nla_nest_start() returned NULL"))
+	/* The session container needs to be the first attribute. */
+	root = nla_reserve(skb, JNLAR_SESSION_RECORDS, writer.offset);
+	if (WARN(!root, "nla_reserve() returned NULL"))
 		goto revert_skb;
 
-	count = 0;
-	while (!list_empty(sessions)) {
-		session = first_deferred(sessions);
-		error = jnla_put_session(skb, JNLAL_ENTRY, &session->session);
-		if (WARN(error, "jnla_put_session() returned %d", error))
-			goto revert_skb;
-		list_del(&session->lh);
-		FREE_DEFERRED(session);
-		count++;
-	}
+	writer.buffer = nla_data(root);
+	writer.offset = 0;
+	put_records(jool, &writer, sessions, count);
+
+	error = nla_put_u32(skb, JNLAR_JOOLD_SEQ, seq);
+	if (WARN(error, "nla_put_u32() returned %d", error))
+		goto revert_skb;
 
-	nla_nest_end(skb, root);
 	genlmsg_end(skb, jhdr);
 	sendpkt_multicast(jool, skb);
+	delete_sessions(sessions);
 	return;
 
 revert_skb:
@@ -255,6 +893,63 @@ revert_list:
 	delete_sessions(sessions);
 }
 
+/*
+ * Tells userspace that every session of the advertisement has been sent.
+ * (joold uses this to conclude snapshots.)
+ *
+ * This one carries neither sessions nor sequence number; it does not occupy
+ * the window, and joold does not ACK it.
+ */
+static void send_ad_end(struct xlator *jool)
+{
+	struct sk_buff *skb;
+	struct joolnlhdr *jhdr;
+
+	skb = genlmsg_new(JOOLNL_HDRLEN + nla_total_size(0), GFP_ATOMIC);
+	if (!skb)
+		return;
+
+	jhdr = genlmsg_put(skb, 0, 0, jnl_family(), 0, 0);
+	if (WARN(!jhdr, "genlmsg_put() returned NULL"))
+		goto revert;
+
+	memset(jhdr, 0, sizeof(*jhdr));
+	memcpy(jhdr->magic, JOOLNL_HDR_MAGIC, JOOLNL_HDR_MAGIC_LEN);
+	jhdr->version = cpu_to_be32(xlat_version());
+	jhdr->xt = XT_NAT64;
+	memcpy(jhdr->iname, jool->iname, INAME_MAX_SIZE);
+
+	if (WARN(nla_put_flag(skb, JNLAR_JOOLD_AD_END),
+			"nla_put_flag() failed"))
+		goto revert;
+
+	genlmsg_end(skb, jhdr);
+	sendpkt_multicast(jool, skb);
+	return;
+
+revert:
+	kfree_skb(skb);
+}
+
+/*
+ * Swallows ownership of the sessions.
+ */
+static void send_to_userspace(struct xlator *jool,
+		struct joold_prepared *prepared)
+{
+	struct list_head packet;
+	unsigned int p;
+
+	for (p = 0; p < prepared->packets; p++) {
+		if (!cut_packet(jool, &prepared->sessions, &packet))
+			break;
+		send_packet(jool, &packet, prepared->seq + p);
+	}
+
+	if (prepared->ad_end)
+		send_ad_end(jool);
+}
+
 /**
  * joold_create - Constructor for joold_queue structs.
  */
@@ -271,20 +966,32 @@ struct joold_queue *joold_alloc(void)
 	}
 
 	queue = wkmalloc(struct joold_queue, GFP_KERNEL);
-	if (!queue) {
-		if (cache_created)
-			joold_teardown();
-		return NULL;
-	}
-
-	queue->flags = JQF_ACK_RECEIVED;
+	if (!queue)
+		goto queue_fail;
+	queue->rings = alloc_percpu(struct joold_ring);
+	if (!queue->rings)
+		goto rings_fail;
+
+	queue->flags = 0;
+	queue->ad.proto = L4PROTO_OTHER;
+	queue->ad.offset_set = false;
 	INIT_LIST_HEAD(&queue->deferred.list);
 	queue->deferred.count = 0;
+	hash_init(queue->index);
+	queue->next_seq = 0;
+	queue->acked_seq = 0;
 	queue->last_flush_time = jiffies;
 	spin_lock_init(&queue->lock);
 	kref_init(&queue->refs);
 
 	return queue;
+
+rings_fail:
+	wkfree(struct joold_queue, queue);
+queue_fail:
+	if (cache_created)
+		joold_teardown();
+	return NULL;
 }
 
 void joold_get(struct joold_queue *queue)
@@ -295,7 +1002,18 @@ void joold_get(struct joold_queue *queue)
 static void joold_release(struct kref *refs)
 {
 	struct joold_queue *queue;
+	struct joold_ring *ring;
+	int cpu;
+
 	queue = container_of(refs, struct joold_queue, refs);
+
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu_ptr(queue->rings, cpu);
+		for (; ring->tail != ring->head; ring->tail++)
+			FREE_DEFERRED(*ring_slot(ring, ring->tail));
+	}
+	free_percpu(queue->rings);
+
 	delete_sessions(&queue->deferred.list);
 	wkfree(struct joold_queue, queue);
 }
@@ -311,81 +1029,155 @@ void joold_put(struct joold_queue *queue)
  * This is the function that gets called whenever a packet translation
  * successfully triggers the creation of a session entry. @session will be sent
  * to the joold daemon.
+ *
+ * Sessions that do not pass the replication filters, or exceed ss-max-rate,
+ * are dropped (and counted) right away.
+ *
+ * The session is normally queued in the current CPU's ring, which requires no
+ * locking. The queue's lock is only requested if a full packet seems to be
+ * ready (see packet_path_should_send()), and even then, if somebody else is
+ * already flushing, we leave them to it. (Anything they miss will be picked up
+ * by the next ACK, or by joold_clean().)
+ *
+ * If the ring is full, the session can only be queued if the lock happens to
+ * be free. Otherwise it is dropped (and counted); the packet path never waits
+ * for the lock.
  */
 void joold_add(struct xlator *jool, struct session_entry *_session)
 {
 	struct joold_queue *queue;
+	struct joold_ring *ring;
 	struct deferred_session *session;
-	struct list_head prepared;
+	struct joold_prepared prepared;
+	unsigned int pending;
+	bool queued;
 
 	if (!GLOBALS(jool).enabled)
 		return;
 
+	if (!should_sync(jool, _session)) {
+		jstat_inc(jool->stats, JSTAT_JOOLD_FILTERED);
+		return;
+	}
+
+	queue = jool->nat64.joold;
+
+	local_bh_disable();
+	ring = this_cpu_ptr(queue->rings);
+	if (!rate_allow(jool, ring)) {
+		local_bh_enable();
+		jstat_inc(jool->stats, JSTAT_JOOLD_RATELIMIT);
+		return;
+	}
 	session = ALLOC_DEFERRED;
-	if (!session)
+	if (!session) {
+		local_bh_enable();
 		return;
+	}
 	session->session = *_session;
-	queue = jool->nat64.joold;
-	INIT_LIST_HEAD(&prepared);
+	queued = ring_push(ring, session, &pending);
+	local_bh_enable();
+
+	init_prepared(&prepared);
+
+	if (queued) {
+		/* Unlocked peek; it's just a hint. */
+		if (!packet_path_should_send(jool,
+				READ_ONCE(queue->deferred.count) + pending))
+			return;
+		if (!spin_trylock_bh(&queue->lock))
+			return;
+	} else {
+		/* Ring full; somebody is already flushing if the lock's taken. */
+		if (!spin_trylock_bh(&queue->lock)) {
+			FREE_DEFERRED(session);
+			jstat_inc(jool->stats, JSTAT_JOOLD_RING_FULL);
+			return;
+		}
+		drain_rings(jool);
+		defer_session(jool, session, false);
+	}
 
-	spin_lock_bh(&queue->lock);
-	send_to_userspace_prepare(jool, session, &prepared);
+	send_to_userspace_prepare(jool, &prepared);
 	spin_unlock_bh(&queue->lock);
 
 	send_to_userspace(jool, &prepared);
 }
 
-struct add_params {
-	struct session_entry new;
-	bool success;
-};
-
+/* Called by bib_add_sessions() on sessions that already exist. */
 static enum session_fate collision_cb(struct session_entry *old, void *arg)
 {
-	struct add_params *params = arg;
-	struct session_entry *new = &params->new;
+	struct session_entry *new = arg;
 
 	if (session_equals(old, new)) { /* It's the same session; update it. */
 		old->state = new->state;
 		old->timer_type = new->timer_type;
 		old->update_time = new->update_time;
-		params->success = true;
 		return FATE_TIMER_SLOW;
 	}
 
 	log_err("We're out of sync: Incoming session entry " SEPP
 			" collides with DB entry " SEPP ".",
 			SEPA(new), SEPA(old));
-	params->success = false;
 	return FATE_PRESERVE;
 }
 
-static bool add_new_session(struct xlator *jool, struct nlattr *attr)
+/* Number of incoming sessions handed to the database at a time. */
+#define SYNC_BATCH_SIZE 64
+
+/* Incoming sessions, waiting to be added to the database. */
+struct sync_batch {
+	struct session_entry *sessions;
+	unsigned int count;
+	bool success;
+};
+
+static int batch_init(struct sync_batch *batch)
+{
+	batch->sessions = __wkmalloc("joold sync batch",
+			SYNC_BATCH_SIZE * sizeof(struct session_entry),
+			GFP_KERNEL);
+	if (!batch->sessions)
+		return -ENOMEM;
+	batch->count = 0;
+	batch->success = true;
+	return 0;
+}
+
+static void batch_flush(struct xlator *jool, struct sync_batch *batch)
 {
-	struct add_params params;
-	struct collision_cb cb;
-	int error;
+	struct bib_bulk_result result;
 
-	__log_debug(jool, "Adding session!");
+	if (batch->count == 0)
+		return;
 
-	error = jnla_get_session(attr, "joold session",
-			&jool->globals.nat64.bib, &params.new);
-	if (error)
-		return false;
+	bib_add_sessions(jool, batch->sessions, batch->count, collision_cb,
+			&result);
+	__log_debug(jool, "Synced %u sessions: %u added, %u updated, %u collisions, %u errors.",
+			batch->count, result.added, result.updated,
+			result.collisions, result.errors);
 
-	params.success = true;
-	cb.cb = collision_cb;
-	cb.arg = &params;
+	if (result.collisions || result.errors)
+		batch->success = false;
+	batch->count = 0;
+}
 
-	error = bib_add_session(jool, &params.new, &cb);
-	if (error == -EEXIST)
-		return params.success;
-	if (error) {
-		log_err("sessiondb_add() threw unknown error code %d.", error);
-		return false;
-	}
+/* Returns the slot where the next incoming session should be written. */
+static struct session_entry *batch_next(struct xlator *jool,
+		struct sync_batch *batch)
+{
+	if (batch->count >= SYNC_BATCH_SIZE)
+		batch_flush(jool, batch);
+	return &batch->sessions[batch->count++];
+}
 
-	return true;
+/* Flushes what's left, releases @batch, and returns the final verdict. */
+static int batch_end(struct xlator *jool, struct sync_batch *batch)
+{
+	batch_flush(jool, batch);
+	__wkfree("joold sync batch", batch->sessions);
+	__log_debug(jool, "Done.");
+	return batch->success ? 0 : -EINVAL;
 }
 
 static bool joold_disabled(struct xlator *jool)
@@ -398,6 +1190,48 @@ static bool joold_disabled(struct xlator *jool)
 	return false;
 }
 
+static bool shards_invalid(struct xlator *jool)
+{
+	if (GLOBALS(jool).shard_count > 1
+			&& GLOBALS(jool).shard_id >= GLOBALS(jool).shard_count) {
+		log_err("ss-shard-id (%u) must be lower than ss-shard-count (%u).",
+				GLOBALS(jool).shard_id,
+				GLOBALS(jool).shard_count);
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * ss-shard-*. Does this node own or back up @session's shard?
+ *
+ * Node i owns the sessions whose source IPv6 address hashes to i, and backs
+ * up the ones that hash to i - 1. So every session is stored by two nodes
+ * (not counting the one that created it), and each node stores about 2/N of
+ * the cluster's sessions.
+ */
+static bool shard_wanted(struct xlator *jool,
+		struct session_entry const *session)
+{
+	u32 words[4];
+	__u32 count;
+	__u32 shard;
+	unsigned int i;
+
+	count = GLOBALS(jool).shard_count;
+	if (count <= 1)
+		return true;
+
+	/* Every node has to agree, whatever its endianness. */
+	for (i = 0; i < 4; i++)
+		words[i] = be32_to_cpu(session->src6.l3.s6_addr32[i]);
+	shard = jhash2(words, 4, 0) % count;
+
+	return shard == GLOBALS(jool).shard_id
+			|| (shard + 1) % count == GLOBALS(jool).shard_id;
+}
+
 /**
  * joold_sync - Parses a bunch of sessions out of @data and adds them to @jool's
  * session database.
@@ -408,88 +1242,271 @@ static bool joold_disabled(struct xlator *jool)
 int joold_sync(struct xlator *jool, struct nlattr *root)
 {
 	struct nlattr *attr;
+	struct sync_batch batch;
+	struct session_entry *session;
 	int rem;
-	bool success;
+	int error;
 
-	if (joold_disabled(jool))
+	if (joold_disabled(jool) || shards_invalid(jool))
 		return -EINVAL;
 
-	success = true;
-	nla_for_each_nested(attr, root, rem)
-		success &= add_new_session(jool, attr);
+	error = batch_init(&batch);
+	if (error)
+		return error;
+
+	nla_for_each_nested(attr, root, rem) {
+		session = batch_next(jool, &batch);
+		if (jnla_get_session(attr, "joold session",
+				&jool->globals.nat64.bib, session)) {
+			batch.count--;
+			batch.success = false;
+		} else if (!shard_wanted(jool, session)) {
+			batch.count--;
+			jstat_inc(jool->stats, JSTAT_JOOLD_FOREIGN);
+		}
+	}
 
-	__log_debug(jool, "Done.");
-	return success ? 0 : -EINVAL;
+	return batch_end(jool, &batch);
 }
 
-int joold_advertise(struct xlator *jool)
+/**
+ * joold_sync_records - Same as joold_sync(), except the sessions are
+ * serialized as records. (See struct joold_records_hdr.)
+ */
+int joold_sync_records(struct xlator *jool, struct nlattr *attr)
 {
-	l4_protocol proto;
-	struct joold_queue *queue;
-	struct counted_list sessions;
-	struct list_head prepared;
+	struct record_reader reader;
+	struct joold_records_hdr hdr;
+	struct sync_batch batch;
+	struct session_entry *session;
+	struct session_entry last;
+	struct session_entry *prev;
+	unsigned int count;
+	unsigned int i;
 	int error;
 
-	if (joold_disabled(jool))
+	if (joold_disabled(jool) || shards_invalid(jool))
 		return -EINVAL;
 
-	/* Collect the current sessions */
-	INIT_LIST_HEAD(&sessions.list);
-	sessions.count = 0;
-	for (proto = L4PROTO_TCP; proto <= L4PROTO_ICMP; proto++) {
-		error = bib_foreach_session(jool, proto, ad_session, &sessions,
-				NULL);
-		if (error) {
-			log_err("joold advertisement interrupted.");
-			delete_sessions(&sessions.list);
-			return error;
+	reader.buffer = nla_data(attr);
+	reader.len = nla_len(attr);
+	reader.offset = 0;
+
+	if (get_bytes(&reader, &hdr, sizeof(hdr))) {
+		log_err("joold records lack a header.");
+		return -EINVAL;
+	}
+	if (hdr.magic[0] != JOOLD_RECORDS_MAGIC
+			|| hdr.magic[1] != JOOLD_RECORDS_MAGIC) {
+		log_err("joold records have a bogus magic number.");
+		return -EINVAL;
+	}
+	if (hdr.version != JOOLD_RECORDS_VERSION) {
+		log_err("joold records version %u is unsupported. (Expected %u.)",
+				hdr.version, JOOLD_RECORDS_VERSION);
+		return -EINVAL;
+	}
+
+	error = batch_init(&batch);
+	if (error)
+		return error;
+
+	count = be16_to_cpu(hdr.count);
+	prev = NULL;
+
+	for (i = 0; i < count; i++) {
+		session = batch_next(jool, &batch);
+		if (get_record(&jool->globals.pool6.prefix, &reader, prev,
+				session)) {
+			batch.count--;
+			batch.success = false;
+			break;
+		}
+		/* The batch gets reordered when flushed; keep our own copy. */
+		last = *session;
+		prev = &last;
+
+		if (!shard_wanted(jool, session)) {
+			batch.count--;
+			jstat_inc(jool->stats, JSTAT_JOOLD_FOREIGN);
 		}
 	}
 
-	if (sessions.count == 0)
+	return batch_end(jool, &batch);
+}
+
+/*
+ * Number of advertised sessions the queue should read next; enough to fill the
+ * packets the window still allows, minus the sessions already waiting.
+ * Assumes the lock is held.
+ */
+static unsigned int ad_budget(struct xlator *jool)
+{
+	struct joold_queue *queue;
+	unsigned int open;
+	unsigned int wanted;
+
+	queue = jool->nat64.joold;
+
+	if (!(queue->flags & JQF_AD_ONGOING))
+		return 0;
+	if (queue->flags & JQF_AD_FETCHING)
 		return 0;
+	if (ad_done(&queue->ad))
+		return 0;
+
+	drain_rings(jool);
+	check_deadline(jool);
+	if (window_full(jool))
+		return 0;
+
+	open = GLOBALS(jool).window_size - (queue->next_seq - queue->acked_seq);
+	wanted = open * GLOBALS(jool).max_sessions_per_pkt;
+	return (wanted > queue->deferred.count)
+			? (wanted - queue->deferred.count)
+			: 0;
+}
+
+/*
+ * Reads up to @arg->budget sessions (looking at no more than AD_WALK_MAX),
+ * starting from @arg->cursor, and moves the cursor past them.
+ * Does not need the lock, and must not be called while holding it.
+ */
+static int ad_fetch(struct xlator *jool, struct ad_arg *arg)
+{
+	struct joold_ad_cursor *cursor;
+	int error;
+
+	cursor = &arg->cursor;
+	while (!ad_done(cursor)) {
+		error = bib_foreach_session(jool, cursor->proto, ad_session,
+				arg, cursor->offset_set ? &cursor->offset : NULL);
+		if (error < 0)
+			return error;
+		if (error > 0) /* Chunk spent; resume from @cursor later. */
+			return 0;
+
+		cursor->proto++;
+		cursor->offset_set = false;
+	}
+
+	return 0;
+}
+
+/*
+ * Tops up the queue with the next chunk of the ongoing advertisement (if any),
+ * then sends whatever the window allows.
+ *
+ * Reading the advertisement as the window opens (rather than all at once)
+ * keeps its memory bounded to about one window's worth of sessions,
+ * regardless of the size of the database.
+ */
+static int ad_continue(struct xlator *jool)
+{
+	struct joold_queue *queue;
+	struct ad_arg arg;
+	struct deferred_session *session;
+	struct joold_prepared prepared;
+	int error;
 
 	queue = jool->nat64.joold;
-	INIT_LIST_HEAD(&prepared);
+	arg.jool = jool;
+	INIT_LIST_HEAD(&arg.sessions);
+	arg.count = 0;
+	arg.visited = 0;
+	init_prepared(&prepared);
+	error = 0;
+
+	spin_lock_bh(&queue->lock);
+
+	arg.budget = ad_budget(jool);
+	if (arg.budget == 0)
+		goto send;
+	arg.cursor = queue->ad;
+	queue->flags |= JQF_AD_FETCHING;
+	spin_unlock_bh(&queue->lock);
+
+	error = ad_fetch(jool, &arg);
 
 	spin_lock_bh(&queue->lock);
+	queue->flags &= ~JQF_AD_FETCHING;
+	queue->ad = arg.cursor;
+	if (error) {
+		log_err("joold advertisement interrupted.");
+		queue->ad.proto = L4PROTO_OTHER;
+	}
+
+	while (!list_empty(&arg.sessions)) {
+		session = first_deferred(&arg.sessions);
+		list_del(&session->lh);
+		defer_session(jool, session, true);
+	}
+
+	if (ad_done(&queue->ad) && queue->deferred.count == 0) {
+		queue->flags &= ~JQF_AD_ONGOING;
+		prepared.ad_end = true;
+	}
+	/* Fall through. */
+
+send:
+	send_to_userspace_prepare(jool, &prepared);
+	spin_unlock_bh(&queue->lock);
 
+	send_to_userspace(jool, &prepared);
+	return error;
+}
+
+int joold_advertise(struct xlator *jool)
+{
+	struct joold_queue *queue;
+
+	if (joold_disabled(jool))
+		return -EINVAL;
+
+	queue = jool->nat64.joold;
+
+	spin_lock_bh(&queue->lock);
 	if (queue->flags & JQF_AD_ONGOING) {
 		spin_unlock_bh(&queue->lock);
-		delete_sessions(&sessions.list);
 		log_err("joold advertisement already in progress.");
 		return -EINVAL;
 	}
 	queue->flags |= JQF_AD_ONGOING;
-
-	list_move_all(&sessions.list, &queue->deferred.list);
-	queue->deferred.count += sessions.count;
-
-	send_to_userspace_prepare(jool, NULL, &prepared);
-
+	queue->ad.proto = L4PROTO_TCP;
+	queue->ad.offset_set = false;
 	spin_unlock_bh(&queue->lock);
 
-	send_to_userspace(jool, &prepared);
-	return 0;
+	/* The rest is read as the ACKs (or joold_clean()) open the window. */
+	return ad_continue(jool);
 }
 
-void joold_ack(struct xlator *jool)
+/**
+ * joold_ack - Acknowledges every packet up to and including number @seq.
+ *
+ * NULL @seq acknowledges everything that has been sent. (This is what older
+ * joolds, which don't know about sequence numbers, request.)
+ */
+void joold_ack(struct xlator *jool, __u32 const *seq)
 {
 	struct joold_queue *queue;
-	struct list_head prepared;
 
 	if (joold_disabled(jool))
 		return;
 
 	queue = jool->nat64.joold;
-	INIT_LIST_HEAD(&prepared);
 
 	spin_lock_bh(&queue->lock);
-	queue->flags |= JQF_ACK_RECEIVED;
-	send_to_userspace_prepare(jool, NULL, &prepared);
+	if (!seq) {
+		queue->acked_seq = queue->next_seq;
+	} else if (*seq - queue->acked_seq < queue->next_seq - queue->acked_seq) {
+		queue->acked_seq = *seq + 1;
+	} else {
+		/* Duplicate, or belongs to a window we already gave up on. */
+		__log_debug(jool, "Ignoring stale joold ACK #%u.", *seq);
+	}
 	spin_unlock_bh(&queue->lock);
 
-	send_to_userspace(jool, &prepared);
+	ad_continue(jool);
 }
 
 /**
@@ -497,21 +1514,12 @@ void joold_ack(struct xlator *jool)
  * the deadline is in the past and no new packets have triggered a flush.
  * It's just a last-resort attempt to prevent nodes from lingering here for too
  * long that's generally only useful in non-flush-asap mode.
+ * (It also keeps advertisements going if their ACKs were lost.)
  */
 void joold_clean(struct xlator *jool)
 {
-	spinlock_t *lock;
-	struct list_head prepared;
-
 	if (!GLOBALS(jool).enabled)
 		return;
 
-	lock = &jool->nat64.joold->lock;
-	INIT_LIST_HEAD(&prepared);
-
-	spin_lock_bh(lock);
-	send_to_userspace_prepare(jool, NULL, &prepared);
-	spin_unlock_bh(lock);
-
-	send_to_userspace(jool, &prepared);
+	ad_continue(jool);
 }
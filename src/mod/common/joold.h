@@ -20,10 +20,11 @@ void joold_get(struct joold_queue *queue);
 void joold_put(struct joold_queue *queue);
 
 int joold_sync(struct xlator *jool, struct nlattr *root);
+int joold_sync_records(struct xlator *jool, struct nlattr *attr);
 void joold_add(struct xlator *jool, struct session_entry *entry);
 
 int joold_advertise(struct xlator *jool);
-void joold_ack(struct xlator *jool);
+void joold_ack(struct xlator *jool, __u32 const *seq);
 
 void joold_clean(struct xlator *jool);
 
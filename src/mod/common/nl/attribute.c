@@ -440,6 +440,10 @@ int jnla_get_session(struct nlattr *attr, char const *name,
 	error = jnla_get_u8(attrs[JNLASE_STATE], "State", &u8);
 	if (error)
 		return error;
+	if (u8 > TRANS) {
+		log_err("Unknown TCP state: %u", u8);
+		return -EINVAL;
+	}
 	entry->state = u8;
 	error = jnla_get_u8(attrs[JNLASE_TIMER], "Timer", &u8);
 	if (error)
@@ -1,5 +1,6 @@
 #include "mod/common/nl/bib.h"
 
+#include "mod/common/error_pool.h"
 #include "mod/common/log.h"
 #include "mod/common/xlator.h"
 #include "mod/common/nl/attribute.h"
@@ -63,6 +64,200 @@ revert_start:
 	return error;
 }
 
+/*
+ * Dump cursor, in netlink_callback.args. (See the session equivalent.)
+ *
+ * - BDA_PROTO: Table being dumped.
+ * - BDA_OFFSET_SET: Do the following hold the last entry dumped?
+ * - BDA_ADDR, BDA_PORT: IPv4 transport address of the last entry dumped.
+ */
+#define BDA_PROTO 1
+#define BDA_OFFSET_SET 2
+#define BDA_ADDR 3
+#define BDA_PORT 4
+
+struct bib_dump_arg {
+	struct sk_buff *skb;
+	struct ipv4_transport_addr last;
+	unsigned int count;
+};
+
+static int dump_bib_entry(struct bib_entry const *entry, void *arg)
+{
+	struct bib_dump_arg *dump = arg;
+
+	if (jnla_put_bib(dump->skb, JNLAL_ENTRY, entry))
+		return 1;
+
+	dump->last = entry->addr4;
+	dump->count++;
+	return 0;
+}
+
+static void save_cursor(struct netlink_callback *cb,
+		struct ipv4_transport_addr const *last)
+{
+	cb->args[BDA_OFFSET_SET] = true;
+	cb->args[BDA_ADDR] = be32_to_cpu(last->l3.s_addr);
+	cb->args[BDA_PORT] = last->l4;
+}
+
+static struct ipv4_transport_addr *load_cursor(struct netlink_callback *cb,
+		struct ipv4_transport_addr *offset)
+{
+	if (!cb->args[BDA_OFFSET_SET])
+		return NULL;
+
+	offset->l3.s_addr = cpu_to_be32(cb->args[BDA_ADDR]);
+	offset->l4 = cb->args[BDA_PORT];
+	return offset;
+}
+
+/* Reads the request into @cb's cursor. */
+static int dump_start(struct netlink_callback *cb, struct nlattr *attrs[])
+{
+	struct bib_entry offset;
+	int error;
+
+	if (attrs[JNLAR_OFFSET]) {
+		error = jnla_get_bib(attrs[JNLAR_OFFSET], "Iteration offset",
+				&offset);
+		if (error)
+			return error;
+		cb->args[BDA_PROTO] = offset.l4_proto;
+		save_cursor(cb, &offset.addr4);
+	} else if (attrs[JNLAR_PROTO]) {
+		cb->args[BDA_PROTO] = nla_get_u8(attrs[JNLAR_PROTO]);
+	} else {
+		log_err("The request is missing a protocol.");
+		return -EINVAL;
+	}
+
+	cb->args[JDUMP_STATE] = JDUMP_ONGOING;
+	return 0;
+}
+
+int handle_bib_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct nlattr *attrs[JNLAR_COUNT];
+	struct xlator jool;
+	struct jool_dump dump;
+	struct bib_dump_arg arg;
+	struct ipv4_transport_addr offset;
+	int error;
+
+	if (cb->args[JDUMP_STATE] == JDUMP_DONE)
+		return 0;
+
+	error_pool_activate();
+
+	error = dump_handle_start(cb, XT_NAT64, &jool, attrs);
+	if (error)
+		goto fail;
+
+	if (cb->args[JDUMP_STATE] == JDUMP_START) {
+		__log_debug(&jool, "Dumping BIB to userspace.");
+		error = dump_start(cb, attrs);
+		if (error)
+			goto revert_start;
+	}
+
+	error = jdump_init(&dump, skb, cb);
+	if (error)
+		goto revert_start;
+
+	arg.skb = skb;
+	arg.count = 0;
+	error = bib_foreach(jool.nat64.bib, cb->args[BDA_PROTO], dump_bib_entry,
+			&arg, load_cursor(cb, &offset));
+	if (arg.count)
+		save_cursor(cb, &arg.last);
+
+	error = jdump_end(&dump, error);
+	request_handle_end(&jool);
+	error_pool_deactivate();
+	return error;
+
+revert_start:
+	request_handle_end(&jool);
+fail:
+	error = jdump_error(skb, cb, error);
+	error_pool_deactivate();
+	return error;
+}
+
+static int bib_add_usr(struct xlator *jool, struct bib_entry *new)
+{
+	if (!pool4db_contains(jool->nat64.pool4, jool->ns, new->l4_proto, &new->addr4)) {
+		log_err("Transport address '" TA4PP "' does not belong to pool4.\n"
+				"Please add it there first.", TA4PA(new->addr4));
+		return -EINVAL;
+	}
+
+	return bib_add_static(jool, new);
+}
+
+/* Reads the JNLAR_BIB_ENTRIES of a bulk request into @bulk. */
+static int get_bib_entries(struct genl_info *info, struct jool_bulk *bulk)
+{
+	struct bib_entry *entries;
+	struct nlattr *attr;
+	unsigned int i;
+	int rem;
+	int error;
+
+	error = jbulk_init(bulk, info->attrs[JNLAR_BIB_ENTRIES],
+			sizeof(*entries));
+	if (error)
+		return error;
+
+	entries = bulk->entries;
+	i = 0;
+	nla_for_each_nested(attr, info->attrs[JNLAR_BIB_ENTRIES], rem) {
+		bulk->results[i] = jnla_get_bib(attr, "BIB entry", &entries[i]);
+		i++;
+	}
+
+	return 0;
+}
+
+/*
+ * Unlike the single-entry removal, every entry must include both transport
+ * addresses.
+ *
+ * The BIB's spinlock is only held for the duration of each insertion or
+ * removal (and the table is per-protocol), so there is nothing to gain by
+ * holding it across the whole batch. The point of the bulk path is to spare
+ * the round trips.
+ */
+static int handle_bib_bulk(struct xlator *jool, struct genl_info *info,
+		bool add)
+{
+	struct jool_bulk bulk;
+	struct bib_entry *entries;
+	unsigned int i;
+	int error;
+
+	__log_debug(jool, "%s BIB entries.", add ? "Adding" : "Removing");
+
+	error = get_bib_entries(info, &bulk);
+	if (error)
+		return jresponse_send_simple(jool, info, error);
+
+	entries = bulk.entries;
+	for (i = 0; i < bulk.count; i++) {
+		if (bulk.results[i])
+			continue;
+		bulk.results[i] = add
+				? bib_add_usr(jool, &entries[i])
+				: bib_rm(jool, &entries[i]);
+	}
+
+	error = jresponse_send_bulk(jool, info, &bulk);
+	jbulk_cleanup(&bulk);
+	return error;
+}
+
 int handle_bib_add(struct sk_buff *skb, struct genl_info *info)
 {
 	struct xlator jool;
@@ -73,20 +268,19 @@ int handle_bib_add(struct sk_buff *skb, struct genl_info *info)
 	if (error)
 		return jresponse_send_simple(NULL, info, error);
 
+	if (info->attrs[JNLAR_BIB_ENTRIES]) {
+		error = handle_bib_bulk(&jool, info, true);
+		request_handle_end(&jool);
+		return error;
+	}
+
 	__log_debug(&jool, "Adding BIB entry.");
 
 	error = jnla_get_bib(info->attrs[JNLAR_OPERAND], "Operand", &new);
 	if (error)
 		goto revert_start;
 
-	if (!pool4db_contains(jool.nat64.pool4, jool.ns, new.l4_proto, &new.addr4)) {
-		log_err("Transport address '" TA4PP "' does not belong to pool4.\n"
-				"Please add it there first.", TA4PA(new.addr4));
-		error = -EINVAL;
-		goto revert_start;
-	}
-
-	error = bib_add_static(&jool, &new);
+	error = bib_add_usr(&jool, &new);
 revert_start:
 	error = jresponse_send_simple(&jool, info, error);
 	request_handle_end(&jool);
@@ -104,6 +298,12 @@ int handle_bib_rm(struct sk_buff *skb, struct genl_info *info)
 	if (error)
 		return jresponse_send_simple(NULL, info, error);
 
+	if (info->attrs[JNLAR_BIB_ENTRIES]) {
+		error = handle_bib_bulk(&jool, info, false);
+		request_handle_end(&jool);
+		return error;
+	}
+
 	__log_debug(&jool, "Removing BIB entry.");
 
 	if (!info->attrs[JNLAR_OPERAND]) {
@@ -59,6 +59,73 @@ revert_start:
 	return error;
 }
 
+/* Reads the JNLAR_BL4_ENTRIES of a bulk request into @bulk. */
+static int get_denylist4_entries(struct genl_info *info,
+		struct jool_bulk *bulk)
+{
+	struct ipv4_prefix *prefixes;
+	struct nlattr *attr;
+	unsigned int i;
+	int rem;
+	int error;
+
+	error = jbulk_init(bulk, info->attrs[JNLAR_BL4_ENTRIES],
+			sizeof(*prefixes));
+	if (error)
+		return error;
+
+	prefixes = bulk->entries;
+	i = 0;
+	nla_for_each_nested(attr, info->attrs[JNLAR_BL4_ENTRIES], rem) {
+		bulk->results[i] = jnla_get_prefix4(attr, "Denylist4 entry",
+				&prefixes[i]);
+		i++;
+	}
+
+	return 0;
+}
+
+static int handle_denylist4_add_bulk(struct xlator *jool,
+		struct genl_info *info)
+{
+	struct jool_bulk bulk;
+	int error;
+
+	__log_debug(jool, "Adding Denylist4 entries.");
+
+	error = get_denylist4_entries(info, &bulk);
+	if (error)
+		return jresponse_send_simple(jool, info, error);
+
+	denylist4_add_many(jool->siit.denylist4, bulk.entries, bulk.results,
+			bulk.count,
+			get_jool_hdr(info)->flags & JOOLNLHDR_FLAGS_FORCE);
+
+	error = jresponse_send_bulk(jool, info, &bulk);
+	jbulk_cleanup(&bulk);
+	return error;
+}
+
+static int handle_denylist4_rm_bulk(struct xlator *jool,
+		struct genl_info *info)
+{
+	struct jool_bulk bulk;
+	int error;
+
+	__log_debug(jool, "Removing Denylist4 entries.");
+
+	error = get_denylist4_entries(info, &bulk);
+	if (error)
+		return jresponse_send_simple(jool, info, error);
+
+	denylist4_rm_many(jool->siit.denylist4, bulk.entries, bulk.results,
+			bulk.count);
+
+	error = jresponse_send_bulk(jool, info, &bulk);
+	jbulk_cleanup(&bulk);
+	return error;
+}
+
 int handle_denylist4_add(struct sk_buff *skb, struct genl_info *info)
 {
 	struct xlator jool;
@@ -69,6 +136,12 @@ int handle_denylist4_add(struct sk_buff *skb, struct genl_info *info)
 	if (error)
 		return jresponse_send_simple(NULL, info, error);
 
+	if (info->attrs[JNLAR_BL4_ENTRIES]) {
+		error = handle_denylist4_add_bulk(&jool, info);
+		request_handle_end(&jool);
+		return error;
+	}
+
 	__log_debug(&jool, "Adding Denylist4 entry.");
 
 	error = jnla_get_prefix4(info->attrs[JNLAR_OPERAND], "Operand", &operand);
@@ -95,6 +168,12 @@ int handle_denylist4_rm(struct sk_buff *skb, struct genl_info *info)
 	if (error)
 		return jresponse_send_simple(NULL, info, error);
 
+	if (info->attrs[JNLAR_BL4_ENTRIES]) {
+		error = handle_denylist4_rm_bulk(&jool, info);
+		request_handle_end(&jool);
+		return error;
+	}
+
 	__log_debug(&jool, "Removing Denylist4 entry.");
 
 	error = jnla_get_prefix4(info->attrs[JNLAR_OPERAND], "Operand", &operand);
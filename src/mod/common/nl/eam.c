@@ -63,6 +63,67 @@ revert_start:
 	return error;
 }
 
+/* Reads the JNLAR_EAMT_ENTRIES of a bulk request into @bulk. */
+static int get_eam_entries(struct genl_info *info, struct jool_bulk *bulk)
+{
+	struct eamt_entry *entries;
+	struct nlattr *attr;
+	unsigned int i;
+	int rem;
+	int error;
+
+	error = jbulk_init(bulk, info->attrs[JNLAR_EAMT_ENTRIES],
+			sizeof(*entries));
+	if (error)
+		return error;
+
+	entries = bulk->entries;
+	i = 0;
+	nla_for_each_nested(attr, info->attrs[JNLAR_EAMT_ENTRIES], rem) {
+		bulk->results[i] = jnla_get_eam(attr, "EAM entry", &entries[i]);
+		i++;
+	}
+
+	return 0;
+}
+
+static int handle_eamt_add_bulk(struct xlator *jool, struct genl_info *info)
+{
+	struct jool_bulk bulk;
+	int error;
+
+	__log_debug(jool, "Adding EAM entries.");
+
+	error = get_eam_entries(info, &bulk);
+	if (error)
+		return jresponse_send_simple(jool, info, error);
+
+	eamt_add_many(jool->siit.eamt, bulk.entries, bulk.results, bulk.count,
+			get_jool_hdr(info)->flags & JOOLNLHDR_FLAGS_FORCE);
+
+	error = jresponse_send_bulk(jool, info, &bulk);
+	jbulk_cleanup(&bulk);
+	return error;
+}
+
+static int handle_eamt_rm_bulk(struct xlator *jool, struct genl_info *info)
+{
+	struct jool_bulk bulk;
+	int error;
+
+	__log_debug(jool, "Removing EAM entries.");
+
+	error = get_eam_entries(info, &bulk);
+	if (error)
+		return jresponse_send_simple(jool, info, error);
+
+	eamt_rm_many(jool->siit.eamt, bulk.entries, bulk.results, bulk.count);
+
+	error = jresponse_send_bulk(jool, info, &bulk);
+	jbulk_cleanup(&bulk);
+	return error;
+}
+
 int handle_eamt_add(struct sk_buff *skb, struct genl_info *info)
 {
 	struct xlator jool;
@@ -73,6 +134,12 @@ int handle_eamt_add(struct sk_buff *skb, struct genl_info *info)
 	if (error)
 		return jresponse_send_simple(NULL, info, error);
 
+	if (info->attrs[JNLAR_EAMT_ENTRIES]) {
+		error = handle_eamt_add_bulk(&jool, info);
+		request_handle_end(&jool);
+		return error;
+	}
+
 	__log_debug(&jool, "Adding EAM entry.");
 
 	error = jnla_get_eam(info->attrs[JNLAR_OPERAND], "Operand", &addend);
@@ -99,6 +166,12 @@ int handle_eamt_rm(struct sk_buff *skb, struct genl_info *info)
 	if (error)
 		return jresponse_send_simple(NULL, info, error);
 
+	if (info->attrs[JNLAR_EAMT_ENTRIES]) {
+		error = handle_eamt_rm_bulk(&jool, info);
+		request_handle_end(&jool);
+		return error;
+	}
+
 	__log_debug(&jool, "Removing EAM entry.");
 
 	if (!info->attrs[JNLAR_OPERAND]) {
@@ -123,7 +123,7 @@ int handle_global_update(struct sk_buff *skb, struct genl_info *info)
 	 * Notice that this @jool is also a clone and we're the only thread
 	 * with access to it.
 	 */
-	error = xlator_replace(&jool);
+	error = xlator_replace_clone(&jool, false);
 
 revert_start:
 	error = jresponse_send_simple(&jool, info, error);
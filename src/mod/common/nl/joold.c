@@ -5,6 +5,38 @@
 #include "mod/common/nl/nl_core.h"
 #include "mod/common/joold.h"
 
+/*
+ * Userspace may coalesce several datagrams (from the network) into a single
+ * request, by way of repeating the container attribute. info->attrs[] only
+ * remembers the last one, so we have to walk the message ourselves.
+ */
+static int sync_all(struct xlator *jool, struct genl_info *info)
+{
+	struct nlattr *attr;
+	int rem;
+	int error;
+
+	nla_for_each_attr(attr,
+			genlmsg_data(info->genlhdr) + sizeof(struct joolnlhdr),
+			genlmsg_len(info->genlhdr) - sizeof(struct joolnlhdr),
+			rem) {
+		switch (nla_type(attr)) {
+		case JNLAR_SESSION_RECORDS:
+			error = joold_sync_records(jool, attr);
+			break;
+		case JNLAR_SESSION_ENTRIES:
+			error = joold_sync(jool, attr);
+			break;
+		default:
+			continue;
+		}
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
 int handle_joold_add(struct sk_buff *skb, struct genl_info *info)
 {
 	struct xlator jool;
@@ -16,7 +48,7 @@ int handle_joold_add(struct sk_buff *skb, struct genl_info *info)
 
 	__log_debug(&jool, "Handling joold add.");
 
-	error = joold_sync(&jool, info->attrs[JNLAR_SESSION_ENTRIES]);
+	error = sync_all(&jool, info);
 	if (error)
 		goto revert_start;
 
@@ -54,6 +86,7 @@ int handle_joold_advertise(struct sk_buff *skb, struct genl_info *info)
 int handle_joold_ack(struct sk_buff *skb, struct genl_info *info)
 {
 	struct xlator jool;
+	__u32 seq;
 	int error;
 
 	error = request_handle_start(info, XT_NAT64, &jool, true);
@@ -62,7 +95,12 @@ int handle_joold_ack(struct sk_buff *skb, struct genl_info *info)
 
 	__log_debug(&jool, "Handling joold ack.");
 
-	joold_ack(&jool);
+	if (info->attrs[JNLAR_JOOLD_SEQ]) {
+		seq = nla_get_u32(info->attrs[JNLAR_JOOLD_SEQ]);
+		joold_ack(&jool, &seq);
+	} else {
+		joold_ack(&jool, NULL);
+	}
 
 	request_handle_end(&jool);
 	return 0; /* Do not ack the ack. */
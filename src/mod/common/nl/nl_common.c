@@ -4,19 +4,31 @@
 #include "mod/common/init.h"
 #include "mod/common/log.h"
 #include "mod/common/nl/nl_core.h"
+#include "mod/common/nl/nl_handler.h"
 
-char *get_iname(struct genl_info *info)
+static char *hdr_iname(struct joolnlhdr *hdr)
 {
-	struct joolnlhdr *hdr;
-	hdr = get_jool_hdr(info);
 	return (hdr->iname[0] != 0) ? hdr->iname : INAME_DEFAULT;
 }
 
+char *get_iname(struct genl_info *info)
+{
+	return hdr_iname(get_jool_hdr(info));
+}
+
 struct joolnlhdr *get_jool_hdr(struct genl_info *info)
 {
 	return (struct joolnlhdr *)((u8 *)info->genlhdr + GENL_HDRLEN);
 }
 
+/* Returns NULL if the dump request is too short to contain a Jool header. */
+struct joolnlhdr *get_dump_hdr(struct netlink_callback *cb)
+{
+	if (nlmsg_len(cb->nlh) < GENL_HDRLEN + sizeof(struct joolnlhdr))
+		return NULL;
+	return (struct joolnlhdr *)((u8 *)nlmsg_data(cb->nlh) + GENL_HDRLEN);
+}
+
 static int validate_magic(struct joolnlhdr *hdr)
 {
 	if (memcmp(hdr->magic, JOOLNL_HDR_MAGIC, JOOLNL_HDR_MAGIC_LEN) == 0)
@@ -65,23 +77,11 @@ static int validate_version(struct joolnlhdr *hdr)
 	return -EINVAL;
 }
 
-int request_handle_start(struct genl_info *info, xlator_type xt,
-		struct xlator *jool, bool require_net_admin)
+static int __request_handle_start(struct joolnlhdr *hdr, xlator_type xt,
+		struct xlator *jool)
 {
-	struct joolnlhdr *hdr;
 	int error;
 
-	if (require_net_admin && !capable(CAP_NET_ADMIN)) {
-		log_err("CAP_NET_ADMIN capability required. (Maybe try su or sudo?)");
-		return -EPERM;
-	}
-
-	if (!info->attrs) {
-		log_err("Userspace request lacks Netlink attributes.");
-		return -EINVAL;
-	}
-
-	hdr = get_jool_hdr(info);
 	if (!hdr) {
 		log_err("Userspace request lacks a Jool header.");
 		return -EINVAL;
@@ -102,9 +102,9 @@ int request_handle_start(struct genl_info *info, xlator_type xt,
 	}
 
 	if (jool) {
-		error = xlator_find_current(get_iname(info), XF_ANY | hdr->xt, jool);
+		error = xlator_find_current(hdr_iname(hdr), XF_ANY | hdr->xt, jool);
 		if (error == -ESRCH)
-			log_err("This namespace lacks an instance named '%s'.", get_iname(info));
+			log_err("This namespace lacks an instance named '%s'.", hdr_iname(hdr));
 		if (error)
 			return error;
 	}
@@ -112,8 +112,89 @@ int request_handle_start(struct genl_info *info, xlator_type xt,
 	return 0;
 }
 
+int request_handle_start(struct genl_info *info, xlator_type xt,
+		struct xlator *jool, bool require_net_admin)
+{
+	if (require_net_admin && !capable(CAP_NET_ADMIN)) {
+		log_err("CAP_NET_ADMIN capability required. (Maybe try su or sudo?)");
+		return -EPERM;
+	}
+
+	if (!info->attrs) {
+		log_err("Userspace request lacks Netlink attributes.");
+		return -EINVAL;
+	}
+
+	return __request_handle_start(get_jool_hdr(info), xt, jool);
+}
+
+/*
+ * request_handle_start(), for dumpit handlers. Dumps do not get a genl_info,
+ * so the request's attributes are parsed into @attrs here.
+ *
+ * Dumps always require CAP_NET_ADMIN.
+ */
+int dump_handle_start(struct netlink_callback *cb, xlator_type xt,
+		struct xlator *jool, struct nlattr *attrs[])
+{
+	int error;
+
+	if (!capable(CAP_NET_ADMIN)) {
+		log_err("CAP_NET_ADMIN capability required. (Maybe try su or sudo?)");
+		return -EPERM;
+	}
+
+	if (!get_dump_hdr(cb)) {
+		log_err("Userspace request lacks a Jool header.");
+		return -EINVAL;
+	}
+
+	error = nlmsg_parse(cb->nlh, GENL_HDRLEN + sizeof(struct joolnlhdr),
+			attrs, JNLAR_MAX, jnl_policy(), NULL);
+	if (error) {
+		log_err("Userspace request's attributes are malformed.");
+		return error;
+	}
+
+	return __request_handle_start(get_dump_hdr(cb), xt, jool);
+}
+
 void request_handle_end(struct xlator *jool)
 {
 	if (jool)
 		xlator_put(jool);
 }
+
+/*
+ * Counts the JNLAL_ENTRYs of @root, the entry list of a bulk add or remove
+ * request. (See JNL_BULK_MAX.)
+ */
+int bulk_count_entries(struct nlattr *root, unsigned int *count)
+{
+	struct nlattr *attr;
+	unsigned int total;
+	int rem;
+
+	total = 0;
+	nla_for_each_nested(attr, root, rem) {
+		if (nla_type(attr) != JNLAL_ENTRY) {
+			log_err("The entry list contains an unknown attribute: %d",
+					nla_type(attr));
+			return -EINVAL;
+		}
+		total++;
+	}
+
+	if (total == 0) {
+		log_err("The entry list is empty.");
+		return -EINVAL;
+	}
+	if (total > JNL_BULK_MAX) {
+		log_err("The request contains %u entries, but the maximum is %u.",
+				total, JNL_BULK_MAX);
+		return -E2BIG;
+	}
+
+	*count = total;
+	return 0;
+}
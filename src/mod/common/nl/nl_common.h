@@ -7,9 +7,14 @@
 
 char *get_iname(struct genl_info *info);
 struct joolnlhdr *get_jool_hdr(struct genl_info *info);
+struct joolnlhdr *get_dump_hdr(struct netlink_callback *cb);
 
 int request_handle_start(struct genl_info *info, xlator_type xt,
 		struct xlator *jool, bool require_net_admin);
+int dump_handle_start(struct netlink_callback *cb, xlator_type xt,
+		struct xlator *jool, struct nlattr *attrs[]);
 void request_handle_end(struct xlator *jool);
 
+int bulk_count_entries(struct nlattr *root, unsigned int *count);
+
 #endif /* SRC_MOD_COMMON_NL_COMMON_H_ */
@@ -147,3 +147,181 @@ revert_msg:
 	return error;
 }
 
+/*
+ * Allocates @bulk's arrays, for the JNLAL_ENTRYs listed in @root.
+ * (The caller fills them.)
+ */
+int jbulk_init(struct jool_bulk *bulk, struct nlattr *root, size_t entry_size)
+{
+	unsigned int count;
+	int error;
+
+	error = bulk_count_entries(root, &count);
+	if (error)
+		return error;
+
+	bulk->count = count;
+	bulk->entries = __wkmalloc("Bulk entries", count * entry_size,
+			GFP_KERNEL);
+	if (!bulk->entries)
+		return -ENOMEM;
+	bulk->results = __wkmalloc("Bulk results", count * sizeof(int),
+			GFP_KERNEL);
+	if (!bulk->results) {
+		__wkfree("Bulk entries", bulk->entries);
+		return -ENOMEM;
+	}
+
+	memset(bulk->results, 0, count * sizeof(int));
+	return 0;
+}
+
+void jbulk_cleanup(struct jool_bulk *bulk)
+{
+	__wkfree("Bulk results", bulk->results);
+	__wkfree("Bulk entries", bulk->entries);
+}
+
+/*
+ * Sends the per-entry results of @bulk to userspace, as JNLAR_BULK_RESULTS.
+ *
+ * The request itself succeeded, so the response is not flagged as an error.
+ * The messages of the entries that failed are dropped; the error codes are
+ * all userspace gets.
+ */
+int jresponse_send_bulk(struct xlator *jool, struct genl_info *info,
+		struct jool_bulk *bulk)
+{
+	struct jool_response response;
+	struct nlattr *attr;
+	__u16 *codes;
+	unsigned int i;
+	int error;
+
+	error = jresponse_init(&response, info);
+	if (error)
+		return error;
+
+	attr = nla_reserve(response.skb, JNLAR_BULK_RESULTS,
+			bulk->count * sizeof(__u16));
+	if (!attr) {
+		report_put_failure();
+		jresponse_cleanup(&response);
+		return jresponse_send_simple(jool, info, -EINVAL);
+	}
+
+	codes = nla_data(attr);
+	for (i = 0; i < bulk->count; i++) {
+		error = abs(bulk->results[i]);
+		codes[i] = (error > MAX_U16) ? MAX_U16 : error;
+	}
+
+	__log_debug(jool, "Sending %u bulk results to userspace.", bulk->count);
+	return jresponse_send(&response);
+}
+
+
+int jdump_init(struct jool_dump *dump, struct sk_buff *skb,
+		struct netlink_callback *cb)
+{
+	dump->cb = cb;
+	dump->skb = skb;
+	dump->hdr = genlmsg_put(skb, NETLINK_CB(cb->skb).portid,
+			cb->nlh->nlmsg_seq, jnl_family(), NLM_F_MULTI,
+			((struct genlmsghdr *)nlmsg_data(cb->nlh))->cmd);
+	if (!dump->hdr) {
+		pr_err("genlmsg_put() failed.\n");
+		return -ENOMEM;
+	}
+
+	memcpy(dump->hdr, get_dump_hdr(cb), sizeof(*dump->hdr));
+	dump->hdr->flags = 0;
+	dump->initial_len = skb->len;
+	return 0;
+}
+
+/*
+ * Wraps up the packet, given the result of the foreach that filled it.
+ * Returns what the dumpit handler should return.
+ *
+ * Unlike the doit handlers, there is no need for JOOLNLHDR_FLAGS_M; Netlink
+ * itself tells userspace when the dump is over.
+ */
+int jdump_end(struct jool_dump *dump, int error)
+{
+	if (error < 0) {
+		genlmsg_cancel(dump->skb, dump->hdr);
+		return jdump_error(dump->skb, dump->cb, error);
+	}
+
+	if (dump->skb->len == dump->initial_len) {
+		genlmsg_cancel(dump->skb, dump->hdr);
+		if (error > 0) {
+			/* Not even one entry fit in an empty packet. */
+			report_put_failure();
+			return jdump_error(dump->skb, dump->cb, -EINVAL);
+		}
+		dump->cb->args[JDUMP_STATE] = JDUMP_DONE;
+		return 0;
+	}
+
+	if (error == 0)
+		dump->cb->args[JDUMP_STATE] = JDUMP_DONE;
+	genlmsg_end(dump->skb, dump->hdr);
+	return dump->skb->len;
+}
+
+/*
+ * Ends the dump with an error packet, so userspace gets the error pool's
+ * friendly message rather than a naked error code.
+ */
+int jdump_error(struct sk_buff *skb, struct netlink_callback *cb, int error)
+{
+	struct joolnlhdr *hdr;
+	struct joolnlhdr *request;
+	char *error_msg;
+	size_t error_msg_size;
+	int error_code;
+
+	cb->args[JDUMP_STATE] = JDUMP_DONE;
+
+	error_code = abs(error);
+	if (error_code > MAX_U16)
+		error_code = MAX_U16;
+
+	if (error_pool_get_message(&error_msg, &error_msg_size))
+		return error; /* Error msg already printed. */
+
+	hdr = genlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+			jnl_family(), NLM_F_MULTI,
+			((struct genlmsghdr *)nlmsg_data(cb->nlh))->cmd);
+	if (!hdr)
+		goto fail;
+
+	request = get_dump_hdr(cb);
+	if (request)
+		memcpy(hdr, request, sizeof(*hdr));
+	else
+		memset(hdr, 0, sizeof(*hdr));
+	hdr->flags = JOOLNLHDR_FLAGS_ERROR;
+
+	if (nla_put_u16(skb, JNLAERR_CODE, error_code))
+		goto cancel;
+	if (nla_put_string(skb, JNLAERR_MSG, error_msg)) {
+		if (error_msg_size <= 128)
+			goto cancel;
+		error_msg[128] = '\0';
+		if (nla_put_string(skb, JNLAERR_MSG, error_msg))
+			goto cancel;
+	}
+
+	genlmsg_end(skb, hdr);
+	__wkfree("Error msg out", error_msg);
+	return skb->len;
+
+cancel:
+	genlmsg_cancel(skb, hdr);
+fail:
+	__wkfree("Error msg out", error_msg);
+	return error;
+}
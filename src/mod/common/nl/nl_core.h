@@ -10,6 +10,23 @@ struct jool_response {
 	unsigned int initial_len;
 };
 
+/* A packet of a Netlink dump (NLM_F_DUMP) response. */
+struct jool_dump {
+	struct netlink_callback *cb; /* Request */
+	struct sk_buff *skb; /* Packet to userspace */
+	struct joolnlhdr *hdr; /* Quick access to @skb's Jool header */
+	unsigned int initial_len;
+};
+
+/*
+ * Dumpit handlers keep their cursor in netlink_callback.args. Index
+ * JDUMP_STATE is shared; the rest belong to the handler.
+ */
+#define JDUMP_STATE 0
+#define JDUMP_START 0
+#define JDUMP_ONGOING 1
+#define JDUMP_DONE 2
+
 struct xlator;
 
 int jresponse_init(struct jool_response *response, struct genl_info *info);
@@ -22,5 +39,24 @@ int jresponse_send_array(struct xlator *jool, struct jool_response *response,
 int jresponse_send_simple(struct xlator *jool, struct genl_info *info,
 		int error);
 
+/* A bulk add or remove request. (See JNL_BULK_MAX.) */
+struct jool_bulk {
+	unsigned int count;
+	/* Array of @count entries; its type depends on the table. */
+	void *entries;
+	/* Outcome of each entry; zero or negative error code. */
+	int *results;
+};
+
+int jbulk_init(struct jool_bulk *bulk, struct nlattr *root, size_t entry_size);
+void jbulk_cleanup(struct jool_bulk *bulk);
+int jresponse_send_bulk(struct xlator *jool, struct genl_info *info,
+		struct jool_bulk *bulk);
+
+int jdump_init(struct jool_dump *dump, struct sk_buff *skb,
+		struct netlink_callback *cb);
+int jdump_end(struct jool_dump *dump, int error);
+int jdump_error(struct sk_buff *skb, struct netlink_callback *cb, int error);
+
 
 #endif /* SRC_MOD_COMMON_NL_CORE_H_ */
@@ -55,6 +55,17 @@ static struct nla_policy const jool_policy[JNLAR_COUNT] = {
 	[JNLAR_PROTO] = { .type = NLA_U8 },
 	[JNLAR_ATOMIC_INIT] = { .type = NLA_U8 },
 	[JNLAR_ATOMIC_END] = { .type = NLA_BINARY, .len = 0 },
+	[JNLAR_JOOLD_SEQ] = { .type = NLA_U32 },
+	[JNLAR_SESSION_RECORDS] = { .type = NLA_BINARY },
+	[JNLAR_JOOLD_AD_END] = { .type = NLA_FLAG },
+	[JNLAR_SESSION_FILTER] = { .type = NLA_NESTED },
+	[JNLAR_SESSION_GROUPING] = { .type = NLA_U8 },
+	[JNLAR_TABLE_IMAGE] = { .type = NLA_BINARY },
+	[JNLAR_ATOMIC_DIFF] = { .type = NLA_FLAG },
+	[JNLAR_BULK_RESULTS] = { .type = NLA_BINARY },
+	[JNLAR_EVENT_RECORDS] = { .type = NLA_BINARY },
+	[JNLAR_EVENT_SEQ] = { .type = NLA_U32 },
+	[JNLAR_EVENT_LOST] = { .type = NLA_U32 },
 };
 
 #if LINUX_VERSION_AT_LEAST(5, 2, 0, 8, 0)
@@ -96,6 +107,10 @@ static const struct genl_ops ops[] = {
 		.cmd = JNLOP_STATS_FOREACH,
 		.doit = handle_stats_foreach,
 		JOOL_POLICY
+	}, {
+		.cmd = JNLOP_STATS_OCCUPANCY,
+		.dumpit = handle_stats_occupancy,
+		JOOL_POLICY
 	}, {
 		.cmd = JNLOP_GLOBAL_FOREACH,
 		.doit = handle_global_foreach,
@@ -155,6 +170,7 @@ static const struct genl_ops ops[] = {
 	}, {
 		.cmd = JNLOP_BIB_FOREACH,
 		.doit = handle_bib_foreach,
+		.dumpit = handle_bib_dump,
 		JOOL_POLICY
 	}, {
 		.cmd = JNLOP_BIB_ADD,
@@ -167,6 +183,16 @@ static const struct genl_ops ops[] = {
 	}, {
 		.cmd = JNLOP_SESSION_FOREACH,
 		.doit = handle_session_foreach,
+		.dumpit = handle_session_dump,
+		JOOL_POLICY
+	}, {
+		.cmd = JNLOP_SESSION_QUERY,
+		.dumpit = handle_session_query,
+		.done = handle_session_query_done,
+		JOOL_POLICY
+	}, {
+		.cmd = JNLOP_SESSION_EXPORT,
+		.dumpit = handle_session_export,
 		JOOL_POLICY
 	}, {
 		.cmd = JNLOP_FILE_HANDLE,
@@ -187,9 +213,12 @@ static const struct genl_ops ops[] = {
 	}
 };
 
+/* Indexes need to match JNL_MCGRP_*. */
 static struct genl_multicast_group mc_groups[] = {
 	{
 		.name = JOOLNL_MULTICAST_GRP_NAME,
+	}, {
+		.name = JOOLNL_EVENTS_GRP_NAME,
 	},
 };
 
@@ -257,3 +286,8 @@ struct genl_family *jnl_family(void)
 {
 	return &jool_family;
 }
+
+struct nla_policy const *jnl_policy(void)
+{
+	return jool_policy;
+}
@@ -10,6 +10,10 @@
 #include <linux/skbuff.h>
 #include <net/genetlink.h>
 
+/* Multicast groups, relative to the family's first one. */
+#define JNL_MCGRP_JOOLD 0
+#define JNL_MCGRP_EVENTS 1
+
 int nlhandler_setup(void);
 void nlhandler_teardown(void);
 
@@ -17,5 +21,6 @@ int handle_jool_message(struct sk_buff *skb, struct genl_info *info);
 
 u32 jnl_gid(void);
 struct genl_family *jnl_family(void);
+struct nla_policy const *jnl_policy(void);
 
 #endif /* SRC_MOD_COMMON_NL_HANDLER_H_ */
@@ -73,6 +73,76 @@ revert_start:
 	return error;
 }
 
+/* Reads the JNLAR_POOL4_ENTRIES of a bulk request into @bulk. */
+static int get_pool4_entries(struct genl_info *info, struct jool_bulk *bulk)
+{
+	struct pool4_entry *entries;
+	struct nlattr *attr;
+	unsigned int i;
+	int rem;
+	int error;
+
+	error = jbulk_init(bulk, info->attrs[JNLAR_POOL4_ENTRIES],
+			sizeof(*entries));
+	if (error)
+		return error;
+
+	entries = bulk->entries;
+	i = 0;
+	nla_for_each_nested(attr, info->attrs[JNLAR_POOL4_ENTRIES], rem) {
+		bulk->results[i] = jnla_get_pool4(attr, "pool4 entry",
+				&entries[i]);
+		i++;
+	}
+
+	return 0;
+}
+
+static int pool4_rm(struct xlator *jool, struct genl_info *info,
+		struct pool4_entry *entry)
+{
+	int error;
+
+	error = pool4db_rm_usr(jool->nat64.pool4, entry);
+	if (xlator_is_nat64(jool) && !(get_jool_hdr(info)->flags & JOOLNLHDR_FLAGS_QUICK))
+		bib_rm_range(jool, entry->proto, &entry->range);
+
+	return error;
+}
+
+/*
+ * pool4's lock is a spinlock that is only held for the duration of each
+ * insertion or removal, so there is nothing to gain by holding it across the
+ * whole batch. The point of the bulk path is to spare the round trips.
+ */
+static int handle_pool4_bulk(struct xlator *jool, struct genl_info *info,
+		bool add)
+{
+	struct jool_bulk bulk;
+	struct pool4_entry *entries;
+	unsigned int i;
+	int error;
+
+	__log_debug(jool, "%s pool4 entries.", add ? "Adding" : "Removing");
+
+	error = get_pool4_entries(info, &bulk);
+	if (error)
+		return jresponse_send_simple(jool, info, error);
+
+	entries = bulk.entries;
+	for (i = 0; i < bulk.count; i++) {
+		if (bulk.results[i])
+			continue;
+		bulk.results[i] = add
+				? pool4db_add(jool->nat64.pool4, &entries[i])
+				: pool4_rm(jool, info, &entries[i]);
+	}
+
+	error = jresponse_send_bulk(jool, info, &bulk);
+	jbulk_cleanup(&bulk);
+	return error;
+}
+
 int handle_pool4_add(struct sk_buff *skb, struct genl_info *info)
 {
 	struct xlator jool;
@@ -83,6 +153,12 @@ int handle_pool4_add(struct sk_buff *skb, struct genl_info *info)
 	if (error)
 		return jresponse_send_simple(NULL, info, error);
 
+	if (info->attrs[JNLAR_POOL4_ENTRIES]) {
+		error = handle_pool4_bulk(&jool, info, true);
+		request_handle_end(&jool);
+		return error;
+	}
+
 	__log_debug(&jool, "Adding elements to pool4.");
 
 	error = jnla_get_pool4(info->attrs[JNLAR_OPERAND], "Operand", &entry);
@@ -114,16 +190,19 @@ int handle_pool4_rm(struct sk_buff *skb, struct genl_info *info)
 	if (error)
 		return jresponse_send_simple(NULL, info, error);
 
+	if (info->attrs[JNLAR_POOL4_ENTRIES]) {
+		error = handle_pool4_bulk(&jool, info, false);
+		request_handle_end(&jool);
+		return error;
+	}
+
 	__log_debug(&jool, "Removing elements from pool4.");
 
 	error = jnla_get_pool4(info->attrs[JNLAR_OPERAND], "Operand", &entry);
 	if (error)
 		goto revert_start;
 
-	error = pool4db_rm_usr(jool.nat64.pool4, &entry);
-	if (xlator_is_nat64(&jool) && !(get_jool_hdr(info)->flags & JOOLNLHDR_FLAGS_QUICK))
-		bib_rm_range(&jool, entry.proto, &entry.range);
-
+	error = pool4_rm(&jool, info, &entry);
 revert_start:
 	error = jresponse_send_simple(&jool, info, error);
 	request_handle_end(&jool);
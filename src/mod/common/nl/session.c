@@ -1,11 +1,13 @@
 #include "mod/common/nl/session.h"
 
+#include "mod/common/error_pool.h"
 #include "mod/common/log.h"
 #include "mod/common/xlator.h"
 #include "mod/common/nl/attribute.h"
 #include "mod/common/nl/nl_common.h"
 #include "mod/common/nl/nl_core.h"
 #include "mod/common/db/bib/db.h"
+#include "mod/common/db/bib/query.h"
 
 static int parse_offset(struct nlattr *root, struct session_foreach_offset *entry)
 {
@@ -33,6 +35,61 @@ static int parse_offset(struct nlattr *root, struct session_foreach_offset *entr
 	return 0;
 }
 
+static int parse_filter(struct nlattr *root, struct session_filter *filter)
+{
+	struct nlattr *attrs[JNLASF_COUNT];
+	int error;
+
+	session_filter_init(filter);
+	if (!root)
+		return 0;
+
+	error = jnla_parse_nested(attrs, JNLASF_MAX, root,
+			joolnl_session_filter_policy, "session filter");
+	if (error)
+		return error;
+
+	if (attrs[JNLASF_SRC6]) {
+		error = jnla_get_prefix6(attrs[JNLASF_SRC6], "IPv6 source prefix",
+				&filter->src6.prefix);
+		if (error)
+			return error;
+		filter->src6.set = true;
+	}
+	if (attrs[JNLASF_SRC4]) {
+		error = jnla_get_prefix4(attrs[JNLASF_SRC4], "IPv4 source prefix",
+				&filter->src4.prefix);
+		if (error)
+			return error;
+		filter->src4.set = true;
+	}
+	if (attrs[JNLASF_PORT_MIN])
+		filter->ports.min = nla_get_u16(attrs[JNLASF_PORT_MIN]);
+	if (attrs[JNLASF_PORT_MAX])
+		filter->ports.max = nla_get_u16(attrs[JNLASF_PORT_MAX]);
+	if (attrs[JNLASF_DST4]) {
+		error = jnla_get_prefix4(attrs[JNLASF_DST4],
+				"IPv4 destination prefix", &filter->dst4.prefix);
+		if (error)
+			return error;
+		filter->dst4.set = true;
+	}
+	if (attrs[JNLASF_STATE]) {
+		filter->state = nla_get_u8(attrs[JNLASF_STATE]);
+		filter->state_set = true;
+	}
+	if (attrs[JNLASF_MIN_AGE])
+		filter->min_age = nla_get_u32(attrs[JNLASF_MIN_AGE]);
+
+	if (filter->ports.min > filter->ports.max) {
+		log_err("The filter's port range is empty: [%u, %u]",
+				filter->ports.min, filter->ports.max);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static int serialize_session_entry(struct session_entry const *entry, void *arg)
 {
 	return jnla_put_session(arg, JNLAL_ENTRY, entry) ? 1 : 0;
@@ -93,3 +150,484 @@ revert_start:
 	request_handle_end(&jool);
 	return error;
 }
+
+/*
+ * Dump cursor, in netlink_callback.args:
+ *
+ * - SDA_PROTO: Table being dumped.
+ * - SDA_OFFSET_SET: Do the following hold the last session dumped?
+ * - SDA_SRC_ADDR, SDA_DST_ADDR: IPv4 addresses of the last session dumped.
+ * - SDA_PORTS: IPv4 ports of the last session dumped (src << 16 | dst).
+ *
+ * Sessions are not refcounted, so the cursor is a key rather than a pointer;
+ * resuming costs one descent of the tree per packet.
+ */
+#define SDA_PROTO 1
+#define SDA_OFFSET_SET 2
+#define SDA_SRC_ADDR 3
+#define SDA_DST_ADDR 4
+#define SDA_PORTS 5
+
+struct session_dump_arg {
+	struct sk_buff *skb;
+	struct session_filter filter;
+	/* Last session visited (dumped or filtered out) */
+	struct taddr4_tuple last;
+	unsigned int count;
+};
+
+static int dump_session_entry(struct session_entry const *entry, void *arg)
+{
+	struct session_dump_arg *dump = arg;
+
+	if (session_filter_match(&dump->filter, entry)
+			&& jnla_put_session(dump->skb, JNLAL_ENTRY, entry))
+		return 1;
+
+	dump->last.src = entry->src4;
+	dump->last.dst = entry->dst4;
+	dump->count++;
+	return 0;
+}
+
+static void save_cursor(struct netlink_callback *cb,
+		struct taddr4_tuple const *last)
+{
+	cb->args[SDA_OFFSET_SET] = true;
+	cb->args[SDA_SRC_ADDR] = be32_to_cpu(last->src.l3.s_addr);
+	cb->args[SDA_DST_ADDR] = be32_to_cpu(last->dst.l3.s_addr);
+	cb->args[SDA_PORTS] = (last->src.l4 << 16) | last->dst.l4;
+}
+
+static struct session_foreach_offset *load_cursor(struct netlink_callback *cb,
+		struct session_foreach_offset *offset)
+{
+	if (!cb->args[SDA_OFFSET_SET])
+		return NULL;
+
+	offset->offset.src.l3.s_addr = cpu_to_be32(cb->args[SDA_SRC_ADDR]);
+	offset->offset.src.l4 = cb->args[SDA_PORTS] >> 16;
+	offset->offset.dst.l3.s_addr = cpu_to_be32(cb->args[SDA_DST_ADDR]);
+	offset->offset.dst.l4 = cb->args[SDA_PORTS] & 0xFFFF;
+	offset->include_offset = false;
+	return offset;
+}
+
+/* Reads the request into @cb's cursor. */
+static int dump_start(struct netlink_callback *cb, struct nlattr *attrs[])
+{
+	struct session_foreach_offset offset;
+	int error;
+
+	if (!attrs[JNLAR_PROTO]) {
+		log_err("The request is missing a transport protocol.");
+		return -EINVAL;
+	}
+	cb->args[SDA_PROTO] = nla_get_u8(attrs[JNLAR_PROTO]);
+
+	if (attrs[JNLAR_OFFSET]) {
+		error = parse_offset(attrs[JNLAR_OFFSET], &offset);
+		if (error)
+			return error;
+		save_cursor(cb, &offset.offset);
+	}
+
+	cb->args[JDUMP_STATE] = JDUMP_ONGOING;
+	return 0;
+}
+
+int handle_session_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct nlattr *attrs[JNLAR_COUNT];
+	struct xlator jool;
+	struct jool_dump dump;
+	struct session_dump_arg arg;
+	struct session_foreach_offset offset;
+	int error;
+
+	if (cb->args[JDUMP_STATE] == JDUMP_DONE)
+		return 0;
+
+	error_pool_activate();
+
+	error = dump_handle_start(cb, XT_NAT64, &jool, attrs);
+	if (error)
+		goto fail;
+
+	if (cb->args[JDUMP_STATE] == JDUMP_START) {
+		__log_debug(&jool, "Dumping sessions to userspace.");
+		error = dump_start(cb, attrs);
+		if (error)
+			goto revert_start;
+	}
+
+	/* The request is parsed again on every packet, so this is cheap. */
+	error = parse_filter(attrs[JNLAR_SESSION_FILTER], &arg.filter);
+	if (error)
+		goto revert_start;
+
+	error = jdump_init(&dump, skb, cb);
+	if (error)
+		goto revert_start;
+
+	arg.skb = skb;
+	arg.count = 0;
+	error = bib_foreach_session(&jool, cb->args[SDA_PROTO],
+			dump_session_entry, &arg, load_cursor(cb, &offset));
+	if (arg.count)
+		save_cursor(cb, &arg.last);
+
+	error = jdump_end(&dump, error);
+	request_handle_end(&jool);
+	error_pool_deactivate();
+	return error;
+
+revert_start:
+	request_handle_end(&jool);
+fail:
+	error = jdump_error(skb, cb, error);
+	error_pool_deactivate();
+	return error;
+}
+
+/*
+ * Query cursor, in netlink_callback.args:
+ *
+ * - SQA_GROUPS: The struct session_groups computed during the first packet.
+ *   Released by handle_session_query_done().
+ * - SQA_NEXT: The first group that did not fit in the previous packet.
+ *
+ * Unlike the table cursors, these can be pointers because the groups belong
+ * to this dump alone.
+ */
+#define SQA_GROUPS 1
+#define SQA_NEXT 2
+
+static int query_start(struct xlator *jool, struct netlink_callback *cb,
+		struct nlattr *attrs[])
+{
+	struct session_filter filter;
+	struct session_groups *groups;
+	l4_protocol proto;
+	__u8 grouping;
+	int error;
+
+	if (!attrs[JNLAR_PROTO]) {
+		log_err("The request is missing a transport protocol.");
+		return -EINVAL;
+	}
+	proto = nla_get_u8(attrs[JNLAR_PROTO]);
+
+	grouping = attrs[JNLAR_SESSION_GROUPING]
+			? nla_get_u8(attrs[JNLAR_SESSION_GROUPING])
+			: SG_TOTAL;
+	if (grouping > SG_MAX) {
+		log_err("Unknown session grouping: %u", grouping);
+		return -EINVAL;
+	}
+
+	error = parse_filter(attrs[JNLAR_SESSION_FILTER], &filter);
+	if (error)
+		return error;
+
+	groups = sgroups_create(grouping);
+	if (!groups)
+		return -ENOMEM;
+
+	error = sgroups_collect(jool, proto, &filter, groups);
+	if (error) {
+		sgroups_destroy(groups);
+		return error;
+	}
+
+	cb->args[SQA_GROUPS] = (long)groups;
+	cb->args[SQA_NEXT] = (long)sgroups_first(groups);
+	cb->args[JDUMP_STATE] = JDUMP_ONGOING;
+	return 0;
+}
+
+static int put_group(struct sk_buff *skb, enum session_grouping grouping,
+		struct session_group const *group)
+{
+	struct nlattr *root;
+	struct ipv6_prefix prefix6;
+	int error;
+
+	root = nla_nest_start(skb, JNLAL_ENTRY);
+	if (!root)
+		return -EMSGSIZE;
+
+	switch (grouping) {
+	case SG_TOTAL:
+		error = 0;
+		break;
+	case SG_SRC6:
+		prefix6.addr = group->key.prefix6;
+		prefix6.len = 64;
+		error = jnla_put_prefix6(skb, JNLASG_PREFIX6, &prefix6);
+		break;
+	case SG_SRC4:
+		error = jnla_put_addr4(skb, JNLASG_ADDR4, &group->key.addr4);
+		break;
+	default:
+		error = nla_put_u32(skb, JNLASG_VALUE,
+				be32_to_cpu(group->key.value));
+	}
+
+	if (error || nla_put_u32(skb, JNLASG_SESSIONS, group->sessions)) {
+		nla_nest_cancel(skb, root);
+		return -EMSGSIZE;
+	}
+
+	nla_nest_end(skb, root);
+	return 0;
+}
+
+int handle_session_query(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct nlattr *attrs[JNLAR_COUNT];
+	struct xlator jool;
+	struct jool_dump dump;
+	struct session_groups *groups;
+	struct session_group *group;
+	int error;
+
+	if (cb->args[JDUMP_STATE] == JDUMP_DONE)
+		return 0;
+
+	error_pool_activate();
+
+	error = dump_handle_start(cb, XT_NAT64, &jool, attrs);
+	if (error)
+		goto fail;
+
+	if (cb->args[JDUMP_STATE] == JDUMP_START) {
+		__log_debug(&jool, "Querying sessions.");
+		error = query_start(&jool, cb, attrs);
+		if (error)
+			goto revert_start;
+	}
+
+	error = jdump_init(&dump, skb, cb);
+	if (error)
+		goto revert_start;
+
+	groups = (struct session_groups *)cb->args[SQA_GROUPS];
+	group = (struct session_group *)cb->args[SQA_NEXT];
+	for (; group; group = sgroups_next(group)) {
+		if (put_group(skb, groups->grouping, group)) {
+			error = 1;
+			break;
+		}
+	}
+	cb->args[SQA_NEXT] = (long)group;
+
+	error = jdump_end(&dump, error);
+	request_handle_end(&jool);
+	error_pool_deactivate();
+	return error;
+
+revert_start:
+	request_handle_end(&jool);
+fail:
+	error = jdump_error(skb, cb, error);
+	error_pool_deactivate();
+	return error;
+}
+
+int handle_session_query_done(struct netlink_callback *cb)
+{
+	if (cb->args[SQA_GROUPS]) {
+		sgroups_destroy((struct session_groups *)cb->args[SQA_GROUPS]);
+		cb->args[SQA_GROUPS] = 0;
+	}
+	return 0;
+}
+
+/*
+ * Export cursor, in netlink_callback.args:
+ *
+ * - EXA_TABLE: Table being exported. (proto * 2, plus one for the sessions.)
+ * - The rest is the same as the session dump's. (During the BIB phases, only
+ *   the src fields are meaningful.)
+ */
+#define EXA_TABLE 1
+#define EXA_TABLE_COUNT (2 * (L4PROTO_ICMP + 1))
+
+struct export_arg {
+	struct sk_buff *skb;
+	/* Last entry exported */
+	struct taddr4_tuple last;
+	unsigned int count;
+};
+
+static struct table_image_record *reserve_record(struct sk_buff *skb)
+{
+	struct table_image_record *record;
+
+	if (skb_tailroom(skb) < sizeof(*record))
+		return NULL;
+
+	record = (struct table_image_record *)skb_put(skb, sizeof(*record));
+	memset(record, 0, sizeof(*record));
+	return record;
+}
+
+static __u32 msecs_since(unsigned long jiffy)
+{
+	return time_after(jiffies, jiffy) ? jiffies_to_msecs(jiffies - jiffy) : 0;
+}
+
+static __u32 msecs_until(unsigned long jiffy)
+{
+	return time_after(jiffy, jiffies) ? jiffies_to_msecs(jiffy - jiffies) : 0;
+}
+
+static int export_bib(struct bib_entry const *bib, void *arg)
+{
+	struct export_arg *export = arg;
+	struct table_image_record *record;
+
+	record = reserve_record(export->skb);
+	if (!record)
+		return 1;
+
+	record->type = TIR_BIB;
+	record->proto = bib->l4_proto;
+	record->flags = bib->is_static ? TIRF_STATIC : 0;
+	record->src6 = bib->addr6.l3;
+	record->src6_port = cpu_to_be16(bib->addr6.l4);
+	record->src4 = bib->addr4.l3;
+	record->src4_port = cpu_to_be16(bib->addr4.l4);
+
+	export->last.src = bib->addr4;
+	export->count++;
+	return 0;
+}
+
+static int export_session(struct session_entry const *session, void *arg)
+{
+	struct export_arg *export = arg;
+	struct table_image_record *record;
+
+	record = reserve_record(export->skb);
+	if (!record)
+		return 1;
+
+	record->type = TIR_SESSION;
+	record->proto = session->proto;
+	record->state = session->state;
+	record->src6 = session->src6.l3;
+	record->dst6 = session->dst6.l3;
+	record->src4 = session->src4.l3;
+	record->dst4 = session->dst4.l3;
+	record->src6_port = cpu_to_be16(session->src6.l4);
+	record->dst6_port = cpu_to_be16(session->dst6.l4);
+	record->src4_port = cpu_to_be16(session->src4.l4);
+	record->dst4_port = cpu_to_be16(session->dst4.l4);
+	record->idle = cpu_to_be32(msecs_since(session->update_time));
+	record->age = cpu_to_be32(msecs_since(session->creation_time));
+	record->expires = cpu_to_be32(msecs_until(session->update_time
+			+ session->timeout));
+
+	export->last.src = session->src4;
+	export->last.dst = session->dst4;
+	export->count++;
+	return 0;
+}
+
+static struct ipv4_transport_addr *load_bib_cursor(struct netlink_callback *cb,
+		struct ipv4_transport_addr *offset)
+{
+	if (!cb->args[SDA_OFFSET_SET])
+		return NULL;
+
+	offset->l3.s_addr = cpu_to_be32(cb->args[SDA_SRC_ADDR]);
+	offset->l4 = cb->args[SDA_PORTS] >> 16;
+	return offset;
+}
+
+/*
+ * Sends the BIB and session tables as a struct table_image_record array.
+ *
+ * Each packet carries a single JNLAR_TABLE_IMAGE attribute, which is grown one
+ * record at a time until the packet is full. Fixed-size records cost a fraction
+ * of the nested attributes the other dumps use, both here and in userspace.
+ */
+int handle_session_export(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct nlattr *attrs[JNLAR_COUNT];
+	struct xlator jool;
+	struct jool_dump dump;
+	struct nlattr *root;
+	struct export_arg arg;
+	struct ipv4_transport_addr offset4;
+	struct session_foreach_offset offset;
+	l4_protocol proto;
+	int error;
+
+	if (cb->args[JDUMP_STATE] == JDUMP_DONE)
+		return 0;
+
+	error_pool_activate();
+
+	error = dump_handle_start(cb, XT_NAT64, &jool, attrs);
+	if (error)
+		goto fail;
+
+	if (cb->args[JDUMP_STATE] == JDUMP_START) {
+		__log_debug(&jool, "Exporting the BIB and session tables.");
+		cb->args[EXA_TABLE] = 0;
+		cb->args[JDUMP_STATE] = JDUMP_ONGOING;
+	}
+
+	error = jdump_init(&dump, skb, cb);
+	if (error)
+		goto revert_start;
+
+	root = nla_reserve(skb, JNLAR_TABLE_IMAGE, 0);
+	if (!root) {
+		error = jdump_end(&dump, 1);
+		goto end;
+	}
+
+	memset(&arg, 0, sizeof(arg));
+	arg.skb = skb;
+	for (; cb->args[EXA_TABLE] < EXA_TABLE_COUNT; cb->args[EXA_TABLE]++) {
+		proto = cb->args[EXA_TABLE] / 2;
+		arg.count = 0;
+
+		if (cb->args[EXA_TABLE] % 2 == 0) {
+			error = bib_foreach(jool.nat64.bib, proto, export_bib,
+					&arg, load_bib_cursor(cb, &offset4));
+		} else {
+			error = bib_foreach_session(&jool, proto,
+					export_session, &arg,
+					load_cursor(cb, &offset));
+		}
+
+		if (arg.count)
+			save_cursor(cb, &arg.last);
+		if (error)
+			break;
+		cb->args[SDA_OFFSET_SET] = false;
+		memset(&arg.last, 0, sizeof(arg.last));
+	}
+
+	root->nla_len = skb_tail_pointer(skb) - (unsigned char *)root;
+	if (root->nla_len == NLA_HDRLEN)
+		nlmsg_trim(skb, root);
+
+	error = jdump_end(&dump, error);
+end:
+	request_handle_end(&jool);
+	error_pool_deactivate();
+	return error;
+
+revert_start:
+	request_handle_end(&jool);
+fail:
+	error = jdump_error(skb, cb, error);
+	error_pool_deactivate();
+	return error;
+}
@@ -1,10 +1,13 @@
 #include "mod/common/nl/stats.h"
 
+#include "mod/common/error_pool.h"
 #include "mod/common/log.h"
 #include "mod/common/stats.h"
+#include "mod/common/xlator.h"
 #include "mod/common/nl/attribute.h"
 #include "mod/common/nl/nl_common.h"
 #include "mod/common/nl/nl_core.h"
+#include "mod/common/db/bib/db.h"
 
 int handle_stats_foreach(struct sk_buff *skb, struct genl_info *info)
 {
@@ -67,3 +70,111 @@ revert_start:
 	request_handle_end(&jool);
 	return error;
 }
+
+/*
+ * Occupancy dump cursor, in netlink_callback.args:
+ *
+ * - ODA_PROTO: Table being dumped.
+ * - ODA_OFFSET_SET: Do the fields below hold the last counter dumped?
+ * - ODA_ADDR: Address of the last counter dumped from ODA_PROTO's table.
+ * - ODA_MARKED: Was the last counter dumped attributed to a mark?
+ * - ODA_MARK: If so, which one.
+ */
+#define ODA_PROTO 1
+#define ODA_OFFSET_SET 2
+#define ODA_ADDR 3
+#define ODA_MARKED 4
+#define ODA_MARK 5
+
+struct occupancy_dump_arg {
+	struct netlink_callback *cb;
+	struct sk_buff *skb;
+	l4_protocol proto;
+};
+
+static int dump_usage(struct bib_usage const *usage, void *arg)
+{
+	struct occupancy_dump_arg *dump = arg;
+	struct nlattr *root;
+
+	root = nla_nest_start(dump->skb, JNLAL_ENTRY);
+	if (!root)
+		return 1;
+
+	if (nla_put_u8(dump->skb, JNLAO_PROTO, dump->proto)
+			|| jnla_put_addr4(dump->skb, JNLAO_ADDR4, &usage->addr)
+			|| nla_put_u32(dump->skb, JNLAO_BIBS, usage->bibs)
+			|| (usage->marked && nla_put_u32(dump->skb, JNLAO_MARK,
+					usage->mark))) {
+		nla_nest_cancel(dump->skb, root);
+		return 1;
+	}
+
+	nla_nest_end(dump->skb, root);
+	dump->cb->args[ODA_OFFSET_SET] = true;
+	dump->cb->args[ODA_ADDR] = be32_to_cpu(usage->addr.s_addr);
+	dump->cb->args[ODA_MARKED] = usage->marked;
+	dump->cb->args[ODA_MARK] = usage->mark;
+	return 0;
+}
+
+/*
+ * Sends the number of BIB entries each pool4 address (and mark) is serving,
+ * from every table. The counters are maintained by the BIB, so this does not
+ * walk the entries themselves.
+ */
+int handle_stats_occupancy(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct nlattr *attrs[JNLAR_COUNT];
+	struct xlator jool;
+	struct jool_dump dump;
+	struct occupancy_dump_arg arg;
+	struct bib_usage offset;
+	int error;
+
+	if (cb->args[JDUMP_STATE] == JDUMP_DONE)
+		return 0;
+
+	error_pool_activate();
+
+	error = dump_handle_start(cb, XT_NAT64, &jool, attrs);
+	if (error)
+		goto fail;
+
+	if (cb->args[JDUMP_STATE] == JDUMP_START) {
+		__log_debug(&jool, "Dumping pool4 occupancy.");
+		cb->args[ODA_PROTO] = L4PROTO_TCP;
+		cb->args[JDUMP_STATE] = JDUMP_ONGOING;
+	}
+
+	error = jdump_init(&dump, skb, cb);
+	if (error)
+		goto revert_start;
+
+	arg.cb = cb;
+	arg.skb = skb;
+	for (; cb->args[ODA_PROTO] <= L4PROTO_ICMP; cb->args[ODA_PROTO]++) {
+		arg.proto = cb->args[ODA_PROTO];
+		offset.addr.s_addr = cpu_to_be32(cb->args[ODA_ADDR]);
+		offset.marked = cb->args[ODA_MARKED];
+		offset.mark = cb->args[ODA_MARK];
+		error = bib_foreach_usage(jool.nat64.bib, arg.proto,
+				dump_usage, &arg,
+				cb->args[ODA_OFFSET_SET] ? &offset : NULL);
+		if (error)
+			break;
+		cb->args[ODA_OFFSET_SET] = false;
+	}
+
+	error = jdump_end(&dump, error);
+	request_handle_end(&jool);
+	error_pool_deactivate();
+	return error;
+
+revert_start:
+	request_handle_end(&jool);
+fail:
+	error = jdump_error(skb, cb, error);
+	error_pool_deactivate();
+	return error;
+}
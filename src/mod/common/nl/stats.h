@@ -4,5 +4,6 @@
 #include <net/genetlink.h>
 
 int handle_stats_foreach(struct sk_buff *jool, struct genl_info *info);
+int handle_stats_occupancy(struct sk_buff *skb, struct netlink_callback *cb);
 
 #endif /* SRC_MOD_COMMON_NL_STATS_H_ */
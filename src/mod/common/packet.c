@@ -6,6 +6,7 @@
 #include "common/config.h"
 #include "common/constants.h"
 #include "mod/common/icmp_wrapper.h"
+#include "mod/common/ipv6_hdr_iterator.h"
 #include "mod/common/log.h"
 #include "mod/common/stats.h"
 #include "mod/common/translation_state.h"
@@ -29,6 +30,8 @@ struct pkt_metadata {
 	unsigned int l4_offset;
 	/* Offset is from skb->data. */
 	unsigned int payload_offset;
+	/* IPv6 only. Offsets are from the IPv6 header. */
+	struct ipv6_chain chain6;
 };
 
 #define skb_hdr_ptr(skb, offset, buffer) \
@@ -126,6 +129,27 @@ static verdict paranoid_validations(struct xlation *state, size_t min_hdr_size)
 	return VERDICT_CONTINUE;
 }
 
+/**
+ * Summarizes @hdr6's extension header chain into @chain.
+ *
+ * Only for packets whose headers have already been pulled and validated. (ie.
+ * when pkt_init_ipv6() could not leave the summary behind.)
+ */
+void ipv6_chain_init(struct ipv6_chain *chain, struct ipv6hdr const *hdr6)
+{
+	struct hdr_iterator iterator = HDR_ITERATOR_INIT(hdr6);
+
+	chain->rt_offset = 0;
+	do {
+		if (iterator.hdr_type == NEXTHDR_ROUTING && !chain->rt_offset)
+			chain->rt_offset = iterator.data - (void const *)hdr6;
+	} while (hdr_iterator_next(&iterator) == EAGAIN);
+
+	chain->last_type = iterator.hdr_type;
+	chain->last_offset = iterator.data - (void const *)hdr6;
+	chain->set = true;
+}
+
 /**
  * Walks through @skb's headers, collecting data and adding it to @meta.
  *
@@ -163,8 +187,13 @@ static verdict summarize_skb6(struct xlation *state,
 	offset = hdr6_offset + sizeof(struct ipv6hdr);
 
 	meta->fhdr_offset = 0;
+	meta->chain6.set = true;
+	meta->chain6.rt_offset = 0;
 
 	do {
+		meta->chain6.last_type = nexthdr;
+		meta->chain6.last_offset = offset - hdr6_offset;
+
 		switch (nexthdr) {
 		case NEXTHDR_TCP:
 			meta->l4_proto = L4PROTO_TCP;
@@ -227,6 +256,9 @@ static verdict summarize_skb6(struct xlation *state,
 			if (!ptr.opt)
 				return truncated(state, "extension header");
 
+			if (nexthdr == NEXTHDR_ROUTING && !meta->chain6.rt_offset)
+				meta->chain6.rt_offset = offset - hdr6_offset;
+
 			offset += ipv6_optlen(ptr.opt);
 			nexthdr = ptr.opt->nexthdr;
 			break;
@@ -293,6 +325,7 @@ static verdict validate_inner6(struct xlation *state,
 		return truncated(state, "inner headers");
 	}
 
+	state->in.inner_chain6 = meta.chain6;
 	return VERDICT_CONTINUE;
 }
 
@@ -360,6 +393,7 @@ verdict pkt_init_ipv6(struct xlation *state, struct sk_buff *skb)
 	if (result != VERDICT_CONTINUE)
 		return result;
 
+	state->in.inner_chain6.set = false;
 	if (meta.l4_proto == L4PROTO_ICMP) {
 		/* Do not move this to summarize_skb6(), because it risks infinite recursion. */
 		result = handle_icmp6(state, &meta);
@@ -376,6 +410,7 @@ verdict pkt_init_ipv6(struct xlation *state, struct sk_buff *skb)
 	state->in.frag_offset = meta.fhdr_offset;
 	skb_set_transport_header(skb, meta.l4_offset);
 	state->in.payload_offset = meta.payload_offset;
+	state->in.chain6 = meta.chain6;
 	state->in.original_pkt = &state->in;
 
 	return VERDICT_CONTINUE;
@@ -188,6 +188,28 @@ static inline unsigned int tcp_hdr_len(const struct tcphdr *hdr)
 	return hdr->doff << 2;
 }
 
+/**
+ * Summary of an IPv6 header's extension header chain.
+ *
+ * pkt_init_ipv6() already walks the chain during validation, so it leaves this
+ * behind to spare the translation code from having to walk it again.
+ *
+ * Offsets are relative to the IPv6 header (not skb->data), so they survive
+ * skb_pull()s.
+ */
+struct ipv6_chain {
+	/** Has this summary been initialized? */
+	bool set;
+	/** Type of the first header that is not a known extension header. */
+	__u8 last_type;
+	/** Offset of the header described by @last_type. */
+	unsigned int last_offset;
+	/** Offset of the (first) Routing header. Zero if there's none. */
+	unsigned int rt_offset;
+};
+
+void ipv6_chain_init(struct ipv6_chain *chain, struct ipv6hdr const *hdr6);
+
 /**
  * We need to store packet metadata, so we encapsulate sk_buffs into this.
  *
@@ -229,6 +251,16 @@ struct packet {
 	 * carelessly.
 	 */
 	unsigned int payload_offset;
+	/**
+	 * IPv6 only; extension header chain of the packet's IPv6 header.
+	 * Access via pkt_chain6().
+	 */
+	struct ipv6_chain chain6;
+	/**
+	 * ICMPv6 errors only; extension header chain of the inner packet's
+	 * IPv6 header. Access via pkt_inner_chain6().
+	 */
+	struct ipv6_chain inner_chain6;
 	/**
 	 * If this is an incoming packet (as in, incoming to Jool), this points
 	 * to the same packet (pkt->original_pkt = pkt). Otherwise (which
@@ -253,6 +285,8 @@ static inline void pkt_fill(struct packet *pkt, struct sk_buff *skb,
 	/* pkt->is_hairpin = false; */
 	pkt->frag_offset = frag ? ((unsigned char *)frag - skb->data) : 0;
 	pkt->payload_offset = (unsigned char *)payload - skb->data;
+	pkt->chain6.set = false;
+	pkt->inner_chain6.set = false;
 	pkt->original_pkt = original_pkt;
 }
 
@@ -315,6 +349,22 @@ static inline void *pkt_payload(const struct packet *pkt)
 	return pkt->skb->data + pkt->payload_offset;
 }
 
+/* l3_proto must be IPv6. */
+static inline struct ipv6_chain const *pkt_chain6(struct packet *pkt)
+{
+	if (!pkt->chain6.set)
+		ipv6_chain_init(&pkt->chain6, pkt_ip6_hdr(pkt));
+	return &pkt->chain6;
+}
+
+/* l3_proto must be IPv6, and the packet must be an ICMPv6 error. */
+static inline struct ipv6_chain const *pkt_inner_chain6(struct packet *pkt)
+{
+	if (!pkt->inner_chain6.set)
+		ipv6_chain_init(&pkt->inner_chain6, pkt_payload(pkt));
+	return &pkt->inner_chain6;
+}
+
 static inline bool pkt_is_inner(const struct packet *pkt)
 {
 	return pkt->is_inner;
@@ -841,15 +841,13 @@ static verdict ttcp46_ipv6_common(struct xlation *state)
 	struct iphdr *hdr4 = pkt_ip4_hdr(in);
 	struct ipv6hdr *hdr6 = pkt_ip6_hdr(out);
 	struct frag_hdr *frag_header;
+	__u8 tclass;
+
+	tclass = hdr4->tos & ~state->jool.pipeline.tclass_clear;
 
 	hdr6->version = 6;
-	if (state->jool.globals.reset_traffic_class) {
-		hdr6->priority = 0;
-		hdr6->flow_lbl[0] = 0;
-	} else {
-		hdr6->priority = hdr4->tos >> 4;
-		hdr6->flow_lbl[0] = hdr4->tos << 4;
-	}
+	hdr6->priority = tclass >> 4;
+	hdr6->flow_lbl[0] = tclass << 4;
 	hdr6->flow_lbl[1] = 0;
 	hdr6->flow_lbl[2] = 0;
 	/* hdr6->payload_len */
@@ -1143,17 +1141,54 @@ static void compute_icmp6_csum(struct packet *out)
 	out->skb->ip_summed = CHECKSUM_NONE;
 }
 
-static verdict validate_icmp4_csum(struct xlation *state)
+/*
+ * Same as compute_icmp6_csum(), except the payload's contribution is derived
+ * from the incoming checksum rather than summed again.
+ */
+static void update_icmp6error_csum(struct xlation const *state,
+		struct icmperr_csum const *csum)
+{
+	struct packet const *out = &state->out;
+	struct ipv6hdr *out_ip6 = pkt_ip6_hdr(out);
+	struct icmp6hdr *out_icmp = pkt_icmp6_hdr(out);
+
+	out_icmp->icmp6_cksum = 0;
+	out_icmp->icmp6_cksum = csum_ipv6_magic(&out_ip6->saddr,
+			&out_ip6->daddr, pkt_datagram_len(out), IPPROTO_ICMPV6,
+			icmperr_csum_compute(state, csum));
+	out->skb->ip_summed = CHECKSUM_NONE;
+}
+
+/**
+ * Validates @state->in's checksum (unless somebody already did), and stores
+ * the sum of its ICMPv4 message in @csum->in_msg (if it can be known).
+ */
+static verdict validate_icmp4_csum(struct xlation *state,
+		struct icmperr_csum *csum)
 {
 	struct packet *in = &state->in;
-	__sum16 csum;
 
-	if (in->skb->ip_summed != CHECKSUM_NONE)
+	if (is_csum_verified(in->skb)) {
+		/* A correct ICMPv4 message always adds up to zero. */
+		csum->in_msg = 0;
+		csum->in_msg_valid = true;
 		return VERDICT_CONTINUE;
+	}
+
+	if (in->skb->ip_summed != CHECKSUM_NONE) {
+		/*
+		 * CHECKSUM_PARTIAL (the field is not final yet) or unverified
+		 * CHECKSUM_COMPLETE. Either way, the message's sum is unknown,
+		 * so the outgoing checksum will be computed from scratch.
+		 */
+		csum->in_msg_valid = false;
+		return VERDICT_CONTINUE;
+	}
 
-	csum = csum_fold(skb_checksum(in->skb, skb_transport_offset(in->skb),
-			pkt_datagram_len(in), 0));
-	if (csum != 0) {
+	csum->in_msg = skb_checksum(in->skb, skb_transport_offset(in->skb),
+			pkt_datagram_len(in), 0);
+	csum->in_msg_valid = true;
+	if (csum_fold(csum->in_msg) != 0) {
 		log_debug(state, "Checksum doesn't match.");
 		return drop(state, JSTAT46_ICMP_CSUM);
 	}
@@ -1234,20 +1269,20 @@ static verdict trim_1280(struct xlation *state)
 
 static verdict post_icmp6error(struct xlation *state)
 {
+	struct icmperr_csum csum;
 	verdict result;
 
 	log_debug(state, "Translating the inner packet (4->6)...");
 
 	/*
-	 * We will later recompute the checksum from scratch, but we should not
-	 * translate a corrupted ICMPv4 error into an OK-csum ICMPv6 one,
-	 * so validate first.
+	 * We should not translate a corrupted ICMPv4 error into an OK-csum
+	 * ICMPv6 one, so validate first.
 	 */
-	result = validate_icmp4_csum(state);
+	result = validate_icmp4_csum(state, &csum);
 	if (result != VERDICT_CONTINUE)
 		return result;
 
-	result = ttpcomm_translate_inner_packet(state, &ttp46_steps);
+	result = ttpcomm_translate_inner_packet(state, &ttp46_steps, &csum);
 	if (result != VERDICT_CONTINUE)
 		return result;
 
@@ -1259,7 +1294,11 @@ static verdict post_icmp6error(struct xlation *state)
 	if (result != VERDICT_CONTINUE)
 		return result;
 
-	compute_icmp6_csum(&state->out);
+	/* ICMP extensions rearrange the payload; no shortcuts. */
+	if (pkt_icmp6_hdr(&state->out)->icmp6_length)
+		compute_icmp6_csum(&state->out);
+	else
+		update_icmp6error_csum(state, &csum);
 	return VERDICT_CONTINUE;
 }
 
@@ -5,27 +5,25 @@
 #include <net/udp.h>
 #include <net/tcp.h>
 
-#include "mod/common/ipv6_hdr_iterator.h"
 #include "mod/common/linux_version.h"
 #include "mod/common/log.h"
 #include "mod/common/route.h"
 #include "mod/common/steps/compute_outgoing_tuple.h"
 
-static __u8 xlat_tos(struct jool_globals const *config, struct ipv6hdr const *hdr)
+static __u8 xlat_tos(struct xlator const *jool, struct ipv6hdr const *hdr)
 {
-	return config->reset_tos ? config->new_tos : get_traffic_class(hdr);
+	return (get_traffic_class(hdr) & ~jool->pipeline.tos_clear)
+			| jool->pipeline.tos_set;
 }
 
 /**
  * One-liner for creating the IPv4 header's Protocol field.
  */
-static __u8 xlat_proto(struct ipv6hdr const *hdr6)
+static __u8 xlat_proto(struct ipv6_chain const *chain)
 {
-	struct hdr_iterator iterator = HDR_ITERATOR_INIT(hdr6);
-	hdr_iterator_last(&iterator);
-	return (iterator.hdr_type == NEXTHDR_ICMP)
+	return (chain->last_type == NEXTHDR_ICMP)
 			? IPPROTO_ICMP
-			: iterator.hdr_type;
+			: chain->last_type;
 }
 
 static verdict xlat64_external_addresses(struct xlation *state)
@@ -203,9 +201,9 @@ static verdict compute_flowix64(struct xlation *state)
 	hdr6 = pkt_ip6_hdr(&state->in);
 
 	flow4->flowi4_mark = state->in.skb->mark;
-	flow4->flowi4_tos = xlat_tos(&state->jool.globals, hdr6);
+	flow4->flowi4_tos = xlat_tos(&state->jool, hdr6);
 	flow4->flowi4_scope = RT_SCOPE_UNIVERSE;
-	flow4->flowi4_proto = xlat_proto(hdr6);
+	flow4->flowi4_proto = xlat_proto(pkt_chain6(&state->in));
 	/*
 	 * ANYSRC disables the source address reachable validation.
 	 * It's best to include it because none of the xlat addresses are
@@ -429,7 +427,7 @@ static verdict validate_size(struct xlation *state)
 
 static verdict ttp64_alloc_skb(struct xlation *state)
 {
-	struct packet const *in = &state->in;
+	struct packet *in = &state->in;
 	struct sk_buff *out;
 	struct skb_shared_info *shinfo;
 	verdict result;
@@ -472,12 +470,8 @@ static verdict ttp64_alloc_skb(struct xlation *state)
 	skb_pull(out, pkt_hdrs_len(in));
 
 	if (is_first_frag6(pkt_frag_hdr(in)) && pkt_is_icmp6_error(in)) {
-		struct ipv6hdr *hdr = pkt_payload(in);
-		struct hdr_iterator iterator = HDR_ITERATOR_INIT(hdr);
-		hdr_iterator_last(&iterator);
-
 		/* Remove inner l3 headers from the copy. */
-		skb_pull(out, iterator.data - (void *)hdr);
+		skb_pull(out, pkt_inner_chain6(in)->last_offset);
 
 		/* Add inner l3 headers to the copy. */
 		skb_push(out, sizeof(struct iphdr));
@@ -592,25 +586,25 @@ static __be16 xlat_frag_off(struct frag_hdr const *hdr_frag,
  * has_nonzero_segments_left - Returns true if @hdr6's packet has a routing
  * header, and its Segments Left field is not zero.
  *
+ * @chain: @hdr6's extension header chain summary.
  * @location: if the packet has nonzero segments left, the offset
  *		of the segments left field (from the start of @hdr6) will be
  *		stored here.
  */
 static bool has_nonzero_segments_left(struct ipv6hdr const *hdr6,
-		__u32 *location)
+		struct ipv6_chain const *chain, __u32 *location)
 {
 	struct ipv6_rt_hdr const *rt_hdr;
-	unsigned int offset;
 
-	rt_hdr = hdr_iterator_find(hdr6, NEXTHDR_ROUTING);
-	if (!rt_hdr)
+	if (!chain->rt_offset)
 		return false;
 
+	rt_hdr = ((void const *)hdr6) + chain->rt_offset;
 	if (rt_hdr->segments_left == 0)
 		return false;
 
-	offset = ((void *)rt_hdr) - (void *)hdr6;
-	*location = offset + offsetof(struct ipv6_rt_hdr, segments_left);
+	*location = chain->rt_offset
+			+ offsetof(struct ipv6_rt_hdr, segments_left);
 	return true;
 }
 
@@ -633,7 +627,8 @@ static verdict ttp64_ipv4_external(struct xlation *state)
 		log_debug(state, "Packet's hop limit <= 1.");
 		return drop_icmp(state, JSTAT64_TTL, ICMPERR_TTL, 0);
 	}
-	if (has_nonzero_segments_left(hdr6, &nonzero_location)) {
+	if (has_nonzero_segments_left(hdr6, pkt_chain6(&state->in),
+			&nonzero_location)) {
 		log_debug(state, "Packet's segments left field is nonzero.");
 		return drop_icmp(state, JSTAT64_SEGMENTS_LEFT,
 				ICMPERR_HDR_FIELD, nonzero_location);
@@ -665,7 +660,7 @@ static verdict ttp64_ipv4_external(struct xlation *state)
  */
 static verdict ttp64_ipv4_internal(struct xlation *state)
 {
-	struct packet const *in = &state->in;
+	struct packet *in = &state->in;
 	struct packet *out = &state->out;
 	struct ipv6hdr const *hdr6 = pkt_ip6_hdr(in);
 	struct iphdr *hdr4 = pkt_ip4_hdr(out);
@@ -673,13 +668,13 @@ static verdict ttp64_ipv4_internal(struct xlation *state)
 
 	hdr4->version = 4;
 	hdr4->ihl = 5;
-	hdr4->tos = xlat_tos(&state->jool.globals, hdr6);
+	hdr4->tos = xlat_tos(&state->jool, hdr6);
 	hdr4->tot_len = cpu_to_be16(get_tot_len_ipv6(in->skb) - pkt_hdrs_len(in)
 			+ pkt_hdrs_len(out));
 	generate_ipv4_id(state, hdr4, hdr_frag);
 	hdr4->frag_off = xlat_frag_off(hdr_frag, state);
 	hdr4->ttl = hdr6->hop_limit;
-	hdr4->protocol = xlat_proto(hdr6);
+	hdr4->protocol = xlat_proto(pkt_chain6(in));
 	hdr4->saddr = state->flowx.v4.inner_src.s_addr;
 	hdr4->daddr = state->flowx.v4.inner_dst.s_addr;
 	hdr4->check = 0;
@@ -865,22 +860,62 @@ static void compute_icmp4_csum(struct packet const *out)
 	out->skb->ip_summed = CHECKSUM_NONE;
 }
 
-static verdict validate_icmp6_csum(struct xlation *state)
+/**
+ * Use this when the headers changed completely, but the payload was only
+ * (maybe) truncated. The payload's contribution is derived from the incoming
+ * checksum rather than summed again.
+ */
+static void update_icmp4error_csum(struct xlation const *state,
+		struct icmperr_csum const *csum)
+{
+	struct icmphdr *hdr = pkt_icmp4_hdr(&state->out);
+
+	/* There's no ICMPv4 pseudo-header. */
+	hdr->checksum = 0;
+	hdr->checksum = csum_fold(icmperr_csum_compute(state, csum));
+	state->out.skb->ip_summed = CHECKSUM_NONE;
+}
+
+/**
+ * Validates @state->in's checksum (unless somebody already did), and stores
+ * the sum of its ICMPv6 message (pseudoheader excluded) in @csum->in_msg (if
+ * it can be known).
+ */
+static verdict validate_icmp6_csum(struct xlation *state,
+		struct icmperr_csum *csum)
 {
 	struct packet const *in = &state->in;
 	struct ipv6hdr const *hdr6;
 	unsigned int len;
-	__sum16 csum;
-
-	if (in->skb->ip_summed != CHECKSUM_NONE)
-		return VERDICT_CONTINUE;
 
 	hdr6 = pkt_ip6_hdr(in);
 	len = pkt_datagram_len(in);
-	csum = csum_ipv6_magic(&hdr6->saddr, &hdr6->daddr, len, NEXTHDR_ICMP,
-			skb_checksum(in->skb, skb_transport_offset(in->skb),
-					len, 0));
-	if (csum != 0) {
+
+	if (is_csum_verified(in->skb)) {
+		/*
+		 * A correct checksum means the message adds up to the negation
+		 * of the pseudoheader, so there's no need to read it.
+		 */
+		csum->in_msg = csum_unfold(csum_ipv6_magic(&hdr6->saddr,
+				&hdr6->daddr, len, NEXTHDR_ICMP, 0));
+		csum->in_msg_valid = true;
+		return VERDICT_CONTINUE;
+	}
+
+	if (in->skb->ip_summed != CHECKSUM_NONE) {
+		/*
+		 * CHECKSUM_PARTIAL or unverified CHECKSUM_COMPLETE. The sum is
+		 * unknown; the outgoing checksum will be computed from scratch.
+		 */
+		csum->in_msg_valid = false;
+		return VERDICT_CONTINUE;
+	}
+
+	csum->in_msg = skb_checksum(in->skb, skb_transport_offset(in->skb),
+			len, 0);
+	csum->in_msg_valid = true;
+	if (csum_ipv6_magic(&hdr6->saddr, &hdr6->daddr, len, NEXTHDR_ICMP,
+			csum->in_msg) != 0) {
 		log_debug(state, "Checksum doesn't match.");
 		return drop(state, JSTAT64_ICMP_CSUM);
 	}
@@ -954,15 +989,16 @@ static verdict trim_576(struct xlation *state)
 
 static verdict post_icmp4error(struct xlation *state, bool handle_extensions)
 {
+	struct icmperr_csum csum;
 	verdict result;
 
 	log_debug(state, "Translating the inner packet (6->4)...");
 
-	result = validate_icmp6_csum(state);
+	result = validate_icmp6_csum(state, &csum);
 	if (result != VERDICT_CONTINUE)
 		return result;
 
-	result = ttpcomm_translate_inner_packet(state, &ttp64_steps);
+	result = ttpcomm_translate_inner_packet(state, &ttp64_steps, &csum);
 	if (result != VERDICT_CONTINUE)
 		return result;
 
@@ -976,7 +1012,11 @@ static verdict post_icmp4error(struct xlation *state, bool handle_extensions)
 	if (result != VERDICT_CONTINUE)
 		return result;
 
-	compute_icmp4_csum(&state->out);
+	/* ICMP extensions rearrange the payload; no shortcuts. */
+	if (icmp4_length(pkt_icmp4_hdr(&state->out)))
+		compute_icmp4_csum(&state->out);
+	else
+		update_icmp4error_csum(state, &csum);
 	return VERDICT_CONTINUE;
 }
 
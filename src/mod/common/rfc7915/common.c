@@ -1,8 +1,8 @@
 #include "mod/common/rfc7915/common.h"
 
 #include <linux/icmp.h>
+#include <net/checksum.h>
 #include "common/config.h"
-#include "mod/common/ipv6_hdr_iterator.h"
 #include "mod/common/linux_version.h"
 #include "mod/common/log.h"
 #include "mod/common/packet.h"
@@ -71,6 +71,7 @@ static int move_pointers_out(struct packet *in, struct packet *out,
 
 	out->l4_proto = pkt_l4_proto(in);
 	out->is_inner = true;
+	out->chain6.set = false;
 	out->payload_offset = skb_transport_offset(out->skb)
 			+ pkt_l4hdr_len(in);
 
@@ -99,16 +100,13 @@ static int move_pointers4(struct packet *in, struct packet *out, bool do_out)
 
 static int move_pointers6(struct packet *in, struct packet *out, bool do_out)
 {
-	struct ipv6hdr *hdr6 = pkt_payload(in);
-	struct hdr_iterator iterator = HDR_ITERATOR_INIT(hdr6);
+	struct ipv6_chain chain = *pkt_inner_chain6(in);
 	int error;
 
-	hdr_iterator_last(&iterator);
-
-	error = move_pointers_in(in, iterator.hdr_type,
-			iterator.data - (void *)hdr6);
+	error = move_pointers_in(in, chain.last_type, chain.last_offset);
 	if (error)
 		return error;
+	in->chain6 = chain;
 
 	return do_out ? move_pointers_out(in, out, sizeof(struct iphdr)) : 0;
 }
@@ -120,6 +118,7 @@ static void backup_pointers(struct packet *pkt, struct bkp_skb *bkp)
 	bkp->offset.l4 = skb_transport_offset(pkt->skb);
 	bkp->payload = pkt->payload_offset;
 	bkp->l4_proto = pkt_l4_proto(pkt);
+	bkp->chain6 = pkt->chain6;
 }
 
 static void restore_pointers(struct packet *pkt, struct bkp_skb *bkp)
@@ -129,6 +128,7 @@ static void restore_pointers(struct packet *pkt, struct bkp_skb *bkp)
 	skb_set_transport_header(pkt->skb, bkp->offset.l4);
 	pkt->payload_offset = bkp->payload;
 	pkt->l4_proto = bkp->l4_proto;
+	pkt->chain6 = bkp->chain6;
 	pkt->is_inner = 0;
 }
 
@@ -164,17 +164,25 @@ void restore_outer_packet(struct xlation *state, struct bkp_skb_tuple *bkp,
 		restore_pointers(&state->out, &bkp->out);
 }
 
+/*
+ * Stores in @result the step that translates @state's layer 4 header. (NULL if
+ * the header is not translated.)
+ */
 verdict xlat_l4_function(struct xlation *state,
-		struct translation_steps const *steps)
+		struct translation_steps const *steps, header_xlat_fn *result)
 {
 	switch (state->in.l4_proto) {
 	case L4PROTO_TCP:
-		return steps->xlat_tcp(state);
+		*result = steps->xlat_tcp;
+		return VERDICT_CONTINUE;
 	case L4PROTO_UDP:
-		return steps->xlat_udp(state);
+		*result = steps->xlat_udp;
+		return VERDICT_CONTINUE;
 	case L4PROTO_ICMP:
-		return steps->xlat_icmp(state);
+		*result = steps->xlat_icmp;
+		return VERDICT_CONTINUE;
 	case L4PROTO_OTHER:
+		*result = NULL;
 		return VERDICT_CONTINUE;
 	}
 
@@ -183,7 +191,8 @@ verdict xlat_l4_function(struct xlation *state,
 }
 
 verdict ttpcomm_translate_inner_packet(struct xlation *state,
-		struct translation_steps const *steps)
+		struct translation_steps const *steps,
+		struct icmperr_csum *csum)
 {
 	struct bkp_skb_tuple bkp;
 	verdict result;
@@ -192,6 +201,12 @@ verdict ttpcomm_translate_inner_packet(struct xlation *state,
 	if (result != VERDICT_CONTINUE)
 		return result;
 
+	/* Outer ICMP header + inner L3 header + inner L4 header */
+	csum->in_hdrs_len = bkp.in.payload - bkp.in.offset.l4
+			+ pkt_hdrs_len(&state->in);
+	csum->out_hdrs_len = bkp.out.payload - bkp.out.offset.l4
+			+ pkt_hdrs_len(&state->out);
+
 	result = steps->xlat_inner_l3(state);
 	if (result == VERDICT_UNTRANSLATABLE) {
 		/*
@@ -213,6 +228,82 @@ end:
 	return result;
 }
 
+/**
+ * Returns the checksum of @state->out's ICMP error message (pseudoheader
+ * excluded), without reading most of it.
+ *
+ * Everything that follows the inner packet's headers was copied verbatim from
+ * @state->in, so its sum can be inferred from @csum->in_msg by subtracting the
+ * incoming headers. Only the headers (which were rewritten) and whatever the
+ * translation trimmed off the tail need to be traversed.
+ *
+ * Assumes @state->out's checksum field is zero. Falls back to a full traversal
+ * if @csum->in_msg is unknown, or the payload was rearranged. (eg. ICMP
+ * extension padding.)
+ */
+__wsum icmperr_csum_compute(struct xlation const *state,
+		struct icmperr_csum const *csum)
+{
+	struct sk_buff *in = state->in.skb;
+	struct sk_buff *out = state->out.skb;
+	int in_offset;
+	int out_offset;
+	unsigned int in_len;
+	unsigned int out_len;
+	unsigned int in_body_len;
+	unsigned int out_body_len;
+	__wsum body;
+
+	in_offset = skb_transport_offset(in);
+	out_offset = skb_transport_offset(out);
+	in_len = in->len - in_offset;
+	out_len = out->len - out_offset;
+
+	if (!csum->in_msg_valid || out->next || in_len < csum->in_hdrs_len
+			|| out_len < csum->out_hdrs_len)
+		goto full;
+
+	in_body_len = in_len - csum->in_hdrs_len;
+	out_body_len = out_len - csum->out_hdrs_len;
+	if (out_body_len > in_body_len)
+		goto full;
+
+	/*
+	 * Header lengths are always even, so @body starts at the same parity
+	 * in both packets. No need to swap.
+	 */
+	body = csum_sub(csum->in_msg, skb_checksum(in, in_offset,
+			csum->in_hdrs_len, 0));
+	if (out_body_len < in_body_len) {
+		body = csum_block_sub(body, skb_checksum(in,
+				in_offset + csum->in_hdrs_len + out_body_len,
+				in_body_len - out_body_len, 0), out_body_len);
+	}
+
+	return csum_add(skb_checksum(out, out_offset, csum->out_hdrs_len, 0),
+			body);
+
+full:
+	return skb_checksum(out, out_offset, out_len, 0);
+}
+
+/**
+ * Returns true if somebody already made sure @skb's layer 4 checksum is
+ * correct, which means the message can be assumed to add up to what its
+ * checksum field says without reading it.
+ */
+bool is_csum_verified(struct sk_buff const *skb)
+{
+	switch (skb->ip_summed) {
+	case CHECKSUM_UNNECESSARY:
+		return true;
+	case CHECKSUM_COMPLETE:
+		return skb->csum_valid;
+	}
+
+	return false;
+}
+
 /**
  * partialize_skb - set up @out_skb so the layer 4 checksum will be computed
  * from almost-scratch by the OS or by the NIC later.
@@ -50,10 +50,35 @@ struct translation_steps {
 	header_xlat_fn xlat_icmp;
 };
 
+/**
+ * State needed to compute a translated ICMP error's checksum incrementally.
+ * See icmperr_csum_compute().
+ */
+struct icmperr_csum {
+	/** Sum of the incoming ICMP message. (Pseudoheader excluded.) */
+	__wsum in_msg;
+	/**
+	 * Is @in_msg known? (It's not if the incoming checksum could be
+	 * neither trusted nor validated, such as when it's CHECKSUM_PARTIAL.)
+	 */
+	bool in_msg_valid;
+	/**
+	 * Length of the incoming packet's ICMP header plus the inner packet's
+	 * layer 3 and layer 4 headers.
+	 */
+	unsigned int in_hdrs_len;
+	/** Same as @in_hdrs_len, except for the outgoing packet. */
+	unsigned int out_hdrs_len;
+};
+
 void partialize_skb(struct sk_buff *skb, __u16 csum_offset);
+bool is_csum_verified(struct sk_buff const *skb);
 bool will_need_frag_hdr(const struct iphdr *hdr);
 verdict ttpcomm_translate_inner_packet(struct xlation *state,
-		struct translation_steps const *steps);
+		struct translation_steps const *steps,
+		struct icmperr_csum *csum);
+__wsum icmperr_csum_compute(struct xlation const *state,
+		struct icmperr_csum const *csum);
 
 struct bkp_skb {
 	unsigned int pulled;
@@ -63,6 +88,7 @@ struct bkp_skb {
 	} offset;
 	unsigned int payload;
 	l4_protocol l4_proto;
+	struct ipv6_chain chain6;
 };
 
 struct bkp_skb_tuple {
@@ -76,7 +102,7 @@ void restore_outer_packet(struct xlation *state, struct bkp_skb_tuple *bkp,
 		bool do_out);
 
 verdict xlat_l4_function(struct xlation *state,
-		struct translation_steps const *steps);
+		struct translation_steps const *steps, header_xlat_fn *result);
 
 bool must_not_translate(struct in_addr *addr, struct net *ns);
 
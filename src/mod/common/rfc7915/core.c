@@ -52,9 +52,38 @@ static void __kfree_skb_list(struct xlation *state)
 	state->out.skb = NULL;
 }
 
+/*
+ * Translates @state's packet. This is the part both paths below share:
+ * Allocation, outer layer 3 header and (unless NULL) @xlat_l4.
+ */
+static verdict run_steps(struct xlation *state,
+		struct translation_steps const *steps, header_xlat_fn xlat_l4)
+{
+	verdict result;
+
+	result = steps->skb_alloc(state);
+	if (result != VERDICT_CONTINUE)
+		return result;
+	result = steps->xlat_outer_l3(state);
+	if (result != VERDICT_CONTINUE)
+		goto revert;
+	if (xlat_l4) {
+		result = xlat_l4(state);
+		if (result != VERDICT_CONTINUE)
+			goto revert;
+	}
+
+	return VERDICT_CONTINUE;
+
+revert:
+	__kfree_skb_list(state);
+	return result;
+}
+
 verdict translating_the_packet(struct xlation *state)
 {
 	struct translation_steps const *steps;
+	header_xlat_fn xlat_l4;
 	verdict result;
 
 	switch (xlator_get_type(&state->jool)) {
@@ -78,23 +107,68 @@ verdict translating_the_packet(struct xlation *state)
 		return drop(state, JSTAT_UNKNOWN);
 	}
 
-	result = steps->skb_alloc(state);
-	if (result != VERDICT_CONTINUE)
-		return result;
-	result = steps->xlat_outer_l3(state);
-	if (result != VERDICT_CONTINUE)
-		goto revert;
+	xlat_l4 = NULL;
 	if (has_l4_hdr(state)) {
-		result = xlat_l4_function(state, steps);
+		result = xlat_l4_function(state, steps, &xlat_l4);
 		if (result != VERDICT_CONTINUE)
-			goto revert;
+			return result;
 	}
 
+	result = run_steps(state, steps, xlat_l4);
+	if (result != VERDICT_CONTINUE)
+		return result;
+
 	if (xlation_is_nat64(state))
 		log_debug(state, "Done step 4.");
 	return VERDICT_CONTINUE;
+}
 
-revert:
-	__kfree_skb_list(state);
-	return result;
+/*
+ * Unfragmented TCP and UDP through SIIT (ie. the bulk of a SIIT-DC border
+ * relay's traffic) doesn't need any of the dispatch above: There are no
+ * tuples, no inner packets and no fragments.
+ */
+bool ttp_fast_path_applies(struct xlation *state)
+{
+	struct packet *in = &state->in;
+
+	if (!xlation_is_siit(state))
+		return false;
+
+	switch (pkt_l4_proto(in)) {
+	case L4PROTO_TCP:
+	case L4PROTO_UDP:
+		break;
+	default:
+		return false;
+	}
+
+	switch (pkt_l3_proto(in)) {
+	case L3PROTO_IPV6:
+		return !pkt_frag_hdr(in);
+	case L3PROTO_IPV4:
+		return !is_fragmented_ipv4(pkt_ip4_hdr(in));
+	}
+
+	return false;
+}
+
+/**
+ * Same as translating_the_packet(), except only for packets that satisfy
+ * ttp_fast_path_applies(). The steps are picked directly instead of
+ * dispatched.
+ */
+verdict translating_the_packet_fast(struct xlation *state)
+{
+	struct translation_steps const *steps;
+	header_xlat_fn xlat_l4;
+
+	steps = (pkt_l3_proto(&state->in) == L3PROTO_IPV6)
+			? &ttp64_steps
+			: &ttp46_steps;
+	xlat_l4 = (pkt_l4_proto(&state->in) == L4PROTO_TCP)
+			? steps->xlat_tcp
+			: steps->xlat_udp;
+
+	return run_steps(state, steps, xlat_l4);
 }
@@ -16,4 +16,7 @@
 
 verdict translating_the_packet(struct xlation *state);
 
+bool ttp_fast_path_applies(struct xlation *state);
+verdict translating_the_packet_fast(struct xlation *state);
+
 #endif /* SRC_MOD_COMMON_RFC7915_CORE_H_ */
@@ -482,7 +482,29 @@ bool rtrie_is_empty(struct rtrie *trie)
 	return result;
 }
 
-int rtrie_rm(struct rtrie *trie, struct rtrie_key *key, bool synchronize)
+/*
+ * Frees @node, which was just detached from the trie.
+ *
+ * If @garbage isn't NULL, @node is queued there instead, so the caller can
+ * wait for a single grace period for many removals. (See rtrie_free_garbage().)
+ */
+static void release_node(struct rtrie_node *node, bool synchronize,
+		struct list_head *garbage)
+{
+	list_del(&node->list_hook);
+
+	if (garbage) {
+		list_add(&node->list_hook, garbage);
+		return;
+	}
+
+	if (synchronize)
+		synchronize_rcu_bh();
+	__wkfree("Rtrie node", node);
+}
+
+static int __rtrie_rm(struct rtrie *trie, struct rtrie_key *key,
+		bool synchronize, struct list_head *garbage)
 {
 	struct rtrie_node *node;
 	struct rtrie_node *new;
@@ -493,6 +515,11 @@ int rtrie_rm(struct rtrie *trie, struct rtrie_key *key, bool synchronize)
 	if (!node || !key_equals(&node->key, key))
 		return -ESRCH;
 
+	/*
+	 * Note: ->parent is not RCU-friendly, so it can be updated before the
+	 * grace period ends.
+	 */
+
 	if (node->left && node->right) {
 		new = create_inode(&node->key,
 				deref_updater(trie, node->left),
@@ -504,14 +531,11 @@ int rtrie_rm(struct rtrie *trie, struct rtrie_key *key, bool synchronize)
 		parent_ptr = get_parent_ptr(trie, node);
 
 		rcu_assign_pointer(*parent_ptr, new);
-		if (synchronize)
-			synchronize_rcu_bh();
 
 		deref_updater(trie, new->left)->parent = new;
 		deref_updater(trie, new->right)->parent = new;
 		list_add(&new->list_hook, &trie->list);
-		list_del(&node->list_hook);
-		__wkfree("Rtrie node", node);
+		release_node(node, synchronize, garbage);
 		return 0;
 	}
 
@@ -526,29 +550,20 @@ int rtrie_rm(struct rtrie *trie, struct rtrie_key *key, bool synchronize)
 
 		if (node->left) {
 			rcu_assign_pointer(*parent_ptr, node->left);
-			if (synchronize)
-				synchronize_rcu_bh();
 			deref_updater(trie, node->left)->parent = parent;
-			list_del(&node->list_hook);
-			__wkfree("Rtrie node", node);
+			release_node(node, synchronize, garbage);
 			return 0;
 		}
 
 		if (node->right) {
 			rcu_assign_pointer(*parent_ptr, node->right);
-			if (synchronize)
-				synchronize_rcu_bh();
 			deref_updater(trie, node->right)->parent = parent;
-			list_del(&node->list_hook);
-			__wkfree("Rtrie node", node);
+			release_node(node, synchronize, garbage);
 			return 0;
 		}
 
 		rcu_assign_pointer(*parent_ptr, NULL);
-		if (synchronize)
-			synchronize_rcu_bh();
-		list_del(&node->list_hook);
-		__wkfree("Rtrie node", node);
+		release_node(node, synchronize, garbage);
 
 		node = parent;
 	} while (node && node->color == COLOR_BLACK);
@@ -556,6 +571,81 @@ int rtrie_rm(struct rtrie *trie, struct rtrie_key *key, bool synchronize)
 	return 0;
 }
 
+int rtrie_rm(struct rtrie *trie, struct rtrie_key *key, bool synchronize)
+{
+	return __rtrie_rm(trie, key, synchronize, NULL);
+}
+
+/**
+ * Like rtrie_rm(), except the removed nodes are not freed; they are moved to
+ * @garbage instead. Release them with rtrie_free_garbage() (which does not
+ * need the lock) once you're done removing.
+ */
+int rtrie_rm_deferred(struct rtrie *trie, struct rtrie_key *key,
+		struct list_head *garbage)
+{
+	return __rtrie_rm(trie, key, true, garbage);
+}
+
+/* Waits for the readers to let go of @garbage's nodes, then frees them. */
+void rtrie_free_garbage(struct list_head *garbage)
+{
+	struct rtrie_node *node;
+	struct rtrie_node *tmp;
+
+	if (list_empty(garbage))
+		return;
+
+	synchronize_rcu_bh();
+
+	list_for_each_entry_safe(node, tmp, garbage, list_hook) {
+		list_del(&node->list_hook);
+		__wkfree("Rtrie node", node);
+	}
+}
+
+/**
+ * Adds copies of @src's values to @dst. @dst must not be visible to any
+ * readers yet, so this doesn't synchronize.
+ *
+ * On failure, @dst might contain some of the copies; rtrie_clean() it.
+ */
+int rtrie_clone(struct rtrie *dst, struct rtrie *src)
+{
+	struct rtrie_node *node;
+	int error;
+
+	/* Reverse, so @dst's list ends up in the same order as @src's. */
+	list_for_each_entry_reverse(node, &src->list, list_hook) {
+		if (node->color != COLOR_WHITE)
+			continue;
+		error = rtrie_add(dst, node + 1,
+				node->key.bytes - (__u8 *)(node + 1),
+				node->key.len, false);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
+/**
+ * Publishes @src's nodes as @dst's, in a single pointer assignment. @src ends
+ * up empty.
+ *
+ * @dst's previous nodes are moved to @garbage; release them with
+ * rtrie_free_garbage().
+ */
+void rtrie_replace(struct rtrie *dst, struct rtrie *src,
+		struct list_head *garbage)
+{
+	rcu_assign_pointer(dst->root, deref_updater(src, src->root));
+	RCU_INIT_POINTER(src->root, NULL);
+
+	list_splice_init(&dst->list, garbage);
+	list_splice_init(&src->list, &dst->list);
+}
+
 void rtrie_flush(struct rtrie *trie)
 {
 	struct rtrie_node *node;
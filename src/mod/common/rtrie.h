@@ -103,6 +103,12 @@ void rtrie_print(char const *prefix, struct rtrie *trie);
 int rtrie_add(struct rtrie *trie, void *value, size_t key_offset, __u8 key_len,
 		bool synchronize);
 int rtrie_rm(struct rtrie *trie, struct rtrie_key *key, bool synchronize);
+int rtrie_rm_deferred(struct rtrie *trie, struct rtrie_key *key,
+		struct list_head *garbage);
+void rtrie_free_garbage(struct list_head *garbage);
+int rtrie_clone(struct rtrie *dst, struct rtrie *src);
+void rtrie_replace(struct rtrie *dst, struct rtrie *src,
+		struct list_head *garbage);
 void rtrie_flush(struct rtrie *trie);
 
 typedef int (*rtrie_foreach_cb)(void const *, void *);
@@ -1,7 +1,6 @@
 #include "mod/common/steps/determine_incoming_tuple.h"
 
 #include "mod/common/icmp_wrapper.h"
-#include "mod/common/ipv6_hdr_iterator.h"
 #include "mod/common/log.h"
 #include "mod/common/stats.h"
 
@@ -199,7 +198,7 @@ static verdict ipv6_icmp_err(struct xlation *state)
 {
 	struct packet *pkt = &state->in;
 	struct tuple *tuple6 = &pkt->tuple;
-	struct hdr_iterator iterator;
+	struct ipv6_chain const *chain;
 	union {
 		struct ipv6hdr const *ip6;
 		struct udphdr const *udp;
@@ -212,26 +211,25 @@ static verdict ipv6_icmp_err(struct xlation *state)
 	tuple6->src.addr6.l3 = inner.ip6->daddr;
 	tuple6->dst.addr6.l3 = inner.ip6->saddr;
 
-	hdr_iterator_init(&iterator, inner.ip6);
-	hdr_iterator_last(&iterator);
+	chain = pkt_inner_chain6(pkt);
 
-	switch (iterator.hdr_type) {
+	switch (chain->last_type) {
 	case NEXTHDR_UDP:
-		inner.udp = iterator.data;
+		inner.udp = ((void const *)inner.ip6) + chain->last_offset;
 		tuple6->src.addr6.l4 = be16_to_cpu(inner.udp->dest);
 		tuple6->dst.addr6.l4 = be16_to_cpu(inner.udp->source);
 		tuple6->l4_proto = L4PROTO_UDP;
 		break;
 
 	case NEXTHDR_TCP:
-		inner.tcp = iterator.data;
+		inner.tcp = ((void const *)inner.ip6) + chain->last_offset;
 		tuple6->src.addr6.l4 = be16_to_cpu(inner.tcp->dest);
 		tuple6->dst.addr6.l4 = be16_to_cpu(inner.tcp->source);
 		tuple6->l4_proto = L4PROTO_TCP;
 		break;
 
 	case NEXTHDR_ICMP:
-		inner.icmp = iterator.data;
+		inner.icmp = ((void const *)inner.ip6) + chain->last_offset;
 
 		if (is_icmp6_error(inner.icmp->icmp6_type)) {
 			log_debug(state, "Bogus pkt: ICMP error inside ICMP error.");
@@ -245,7 +243,7 @@ static verdict ipv6_icmp_err(struct xlation *state)
 		break;
 
 	default:
-		return unknown_inner_proto(state, iterator.hdr_type);
+		return unknown_inner_proto(state, chain->last_type);
 	}
 
 	tuple6->l3_proto = L3PROTO_IPV6;
@@ -73,3 +73,9 @@ void sendpkt_multicast(struct xlator *jool, struct sk_buff *skb)
 		__log_debug(jool, "Multicast message sent.");
 	}
 }
+
+int sendpkt_multicast_events(struct xlator *jool, struct sk_buff *skb)
+{
+	return genlmsg_multicast_netns(jnl_family(), jool->ns, skb, 0,
+			JNL_MCGRP_EVENTS, GFP_ATOMIC);
+}
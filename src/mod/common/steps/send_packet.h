@@ -30,4 +30,10 @@ verdict sendpkt_send(struct xlation *state);
  */
 void sendpkt_multicast(struct xlator *jool, struct sk_buff *skb);
 
+/**
+ * Same as sendpkt_multicast(), except the message goes to the BIB events
+ * group, and the result is returned so the caller can count its losses.
+ */
+int sendpkt_multicast_events(struct xlator *jool, struct sk_buff *skb);
+
 #endif /* SRC_MOD_COMMON_SEND_PACKET_H_ */
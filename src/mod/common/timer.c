@@ -58,6 +58,16 @@ int jtimer_setup(void)
 	return 0;
 }
 
+/**
+ * Asks the timer to run as soon as possible, instead of waiting for the rest
+ * of its period. Safe in atomic context.
+ */
+void jtimer_kick(void)
+{
+	if (time_after(READ_ONCE(timer.expires), jiffies))
+		mod_timer(&timer, jiffies);
+}
+
 /**
  * This function should be always called *before* other destroy()s.
  */
@@ -13,5 +13,6 @@
 
 int jtimer_setup(void);
 void jtimer_teardown(void);
+void jtimer_kick(void);
 
 #endif /* SRC_MOD_NAT64_TIMER_H_ */
@@ -7,6 +7,7 @@
 #include "common/xlat.h"
 #include "db/global.h"
 #include "mod/common/atomic_config.h"
+#include "mod/common/icmp_wrapper.h"
 #include "mod/common/joold.h"
 #include "mod/common/kernel_hook.h"
 #include "mod/common/log.h"
@@ -129,6 +130,7 @@ static void destroy_jool_instance(struct jool_instance *instance, bool unhook)
 static void xlator_get(struct xlator *jool)
 {
 	jstat_get(jool->stats);
+	icmprl_get(jool->icmp_rl);
 
 	switch (xlator_get_type(jool)) {
 	case XT_SIIT:
@@ -267,6 +269,9 @@ static int init_siit(struct xlator *jool, struct ipv6_prefix *pool6)
 	jool->stats = jstat_alloc();
 	if (!jool->stats)
 		goto stats_fail;
+	jool->icmp_rl = icmprl_alloc();
+	if (!jool->icmp_rl)
+		goto icmprl_fail;
 	jool->siit.eamt = eamt_alloc();
 	if (!jool->siit.eamt)
 		goto eamt_fail;
@@ -281,6 +286,8 @@ static int init_siit(struct xlator *jool, struct ipv6_prefix *pool6)
 denylist4_fail:
 	eamt_put(jool->siit.eamt);
 eamt_fail:
+	icmprl_put(jool->icmp_rl);
+icmprl_fail:
 	jstat_put(jool->stats);
 stats_fail:
 	return -ENOMEM;
@@ -297,6 +304,9 @@ static int init_nat64(struct xlator *jool, struct ipv6_prefix *pool6)
 	jool->stats = jstat_alloc();
 	if (!jool->stats)
 		goto stats_fail;
+	jool->icmp_rl = icmprl_alloc();
+	if (!jool->icmp_rl)
+		goto icmprl_fail;
 	jool->nat64.pool4 = pool4db_alloc();
 	if (!jool->nat64.pool4)
 		goto pool4_fail;
@@ -316,6 +326,8 @@ joold_fail:
 bib_fail:
 	pool4db_put(jool->nat64.pool4);
 pool4_fail:
+	icmprl_put(jool->icmp_rl);
+icmprl_fail:
 	jstat_put(jool->stats);
 stats_fail:
 	return -ENOMEM;
@@ -338,13 +350,39 @@ int xlator_init(struct xlator *jool, struct net *ns, char *iname,
 
 	switch (xlator_flags2xt(flags)) {
 	case XT_SIIT:
-		return init_siit(jool, pool6);
+		error = init_siit(jool, pool6);
+		break;
 	case XT_NAT64:
-		return init_nat64(jool, pool6);
+		error = init_nat64(jool, pool6);
+		break;
+	default:
+		log_err(XT_VALIDATE_ERRMSG);
+		return -EINVAL;
 	}
 
-	log_err(XT_VALIDATE_ERRMSG);
-	return -EINVAL;
+	if (!error)
+		xlator_compile(jool);
+	return error;
+}
+
+/**
+ * Caches the per-packet consequences of @jool's globals in @jool->pipeline.
+ * Needs to be called every time @jool's globals change, before @jool is
+ * published.
+ */
+void xlator_compile(struct xlator *jool)
+{
+	struct jool_globals *globals = &jool->globals;
+
+	if (globals->reset_tos) {
+		jool->pipeline.tos_clear = 0xFF;
+		jool->pipeline.tos_set = globals->new_tos;
+	} else {
+		jool->pipeline.tos_clear = 0;
+		jool->pipeline.tos_set = 0;
+	}
+
+	jool->pipeline.tclass_clear = globals->reset_traffic_class ? 0xFF : 0;
 }
 
 static int basic_validations(char const *iname, bool allow_null_iname,
@@ -640,7 +678,7 @@ static int basic_replace_validations(struct xlator *jool)
 	return 0;
 }
 
-int xlator_replace(struct xlator *jool)
+static int __xlator_replace(struct xlator *jool, bool check_bib)
 {
 	struct jool_instance *old;
 	struct jool_instance *new;
@@ -653,14 +691,17 @@ int xlator_replace(struct xlator *jool)
 					: NULL);
 	if (error)
 		return error;
-	error = basic_replace_validations(jool);
-	if (error)
-		return error;
+	if (check_bib) {
+		error = basic_replace_validations(jool);
+		if (error)
+			return error;
+	}
 
 	new = wkmalloc(struct jool_instance, GFP_KERNEL);
 	if (!new)
 		return -ENOMEM;
 	memcpy(&new->jool, jool, sizeof(*jool));
+	xlator_compile(&new->jool);
 	xlator_get(&new->jool);
 	new->hash_set = false;
 	new->nf_ops = NULL;
@@ -733,6 +774,21 @@ abort:
 	return -EINVAL;
 }
 
+int xlator_replace(struct xlator *jool)
+{
+	return __xlator_replace(jool, true);
+}
+
+/**
+ * Like xlator_replace(), except @jool is expected to be a clone of the running
+ * instance (see xlator_find()), which means its tables have already been
+ * validated. Only check the BIB against pool4 if the latter was swapped.
+ */
+int xlator_replace_clone(struct xlator *jool, bool check_bib)
+{
+	return __xlator_replace(jool, check_bib);
+}
+
 int xlator_flush(xlator_type xt)
 {
 	struct net *ns;
@@ -864,6 +920,7 @@ int xlator_find_netfilter(struct net *ns, struct xlator *result)
 void xlator_put(struct xlator *jool)
 {
 	jstat_put(jool->stats);
+	icmprl_put(jool->icmp_rl);
 
 	switch (xlator_get_type(jool)) {
 	case XT_SIIT:
@@ -5,6 +5,8 @@
 #include "mod/common/stats.h"
 #include "mod/common/types.h"
 
+struct icmp_ratelimit;
+
 /**
  * A Jool translator "instance". The point is that each network namespace has
  * a separate instance (if Jool has been loaded there).
@@ -32,6 +34,7 @@ struct xlator {
 	xlator_flags flags;
 
 	struct jool_stats *stats;
+	struct icmp_ratelimit *icmp_rl;
 	struct jool_globals globals;
 	union {
 		struct {
@@ -47,6 +50,24 @@ struct xlator {
 
 	bool (*is_hairpin)(struct xlation *);
 	verdict (*handling_hairpinning)(struct xlation *);
+
+	/*
+	 * Header field transformations derived from @globals.
+	 *
+	 * They are recomputed by xlator_compile() whenever the configuration
+	 * is committed, so the translation code doesn't have to query (and
+	 * branch on) the respective globals on every packet.
+	 *
+	 * Zero means "copy the field as is," which is also the default
+	 * configuration.
+	 */
+	struct {
+		/* IPv4 TOS = (IPv6 Traffic Class & ~tos_clear) | tos_set */
+		__u8 tos_clear;
+		__u8 tos_set;
+		/* IPv6 Traffic Class = IPv4 TOS & ~tclass_clear */
+		__u8 tclass_clear;
+	} pipeline;
 };
 
 /* User context (reads and writes) */
@@ -65,6 +86,8 @@ void jool_xlator_flush_batch(struct list_head *net_exit_list, xlator_type xt);
 int xlator_init(struct xlator *jool, struct net *ns, char *iname,
 		xlator_flags flags, struct ipv6_prefix *pool6);
 int xlator_replace(struct xlator *jool);
+int xlator_replace_clone(struct xlator *jool, bool check_bib);
+void xlator_compile(struct xlator *jool);
 
 /* Any context (reads) */
 
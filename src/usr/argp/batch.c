@@ -0,0 +1,179 @@
+#include "usr/argp/batch.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "usr/argp/log.h"
+#include "usr/argp/xlator_type.h"
+
+/* Maximum number of tokens a batch line can have. */
+#define MAX_TOKENS 64
+
+/* The socket every command shares while the batch runs. */
+static struct joolnl_socket shared;
+static bool running;
+
+struct batch_stats {
+	unsigned int total;
+	unsigned int failed;
+};
+
+bool batch_is_running(void)
+{
+	return running;
+}
+
+/**
+ * Command handlers should use this instead of joolnl_setup(). During a batch,
+ * it returns the shared socket.
+ */
+struct jool_result cli_socket_setup(struct joolnl_socket *sk)
+{
+	if (running) {
+		*sk = shared;
+		return result_success();
+	}
+
+	return joolnl_setup(sk, xt_get());
+}
+
+void cli_socket_teardown(struct joolnl_socket *sk)
+{
+	if (!running)
+		joolnl_teardown(sk);
+}
+
+/* Reports the result of a request whose response was collected late. */
+static void report_response(unsigned int line, struct jool_result *result,
+		void *arg)
+{
+	struct batch_stats *stats = arg;
+
+	if (result->error) {
+		pr_err("Line %u: %s", line, result->msg);
+		stats->failed++;
+	}
+
+	result_cleanup(result);
+}
+
+/*
+ * Splits @line into whitespace-separated tokens, in place. '#' starts a
+ * comment. (There is no quoting, because no command needs it.)
+ *
+ * Returns the number of tokens, or -E2BIG.
+ */
+static int tokenize(char *line, char **argv)
+{
+	char *token;
+	int argc;
+
+	argc = 0;
+	for (token = strtok(line, " \t\r\n"); token;
+			token = strtok(NULL, " \t\r\n")) {
+		if (token[0] == '#')
+			break;
+		if (argc >= MAX_TOKENS)
+			return -E2BIG;
+		argv[argc++] = token;
+	}
+
+	return argc;
+}
+
+static int run_lines(FILE *file, char *iname, batch_cmd_handler handler,
+		struct joolnl_batch *batch, struct batch_stats *stats)
+{
+	char *line = NULL;
+	size_t line_size = 0;
+	char *argv[MAX_TOKENS];
+	int argc;
+	int error;
+
+	while (getline(&line, &line_size, file) != -1) {
+		batch->tag++;
+
+		argc = tokenize(line, argv);
+		if (argc == 0)
+			continue;
+
+		stats->total++;
+		if (argc < 0) {
+			pr_err("Line %u: Too many arguments (max %u).",
+					batch->tag, MAX_TOKENS);
+			stats->failed++;
+			continue;
+		}
+
+		/* The handler prints its own error message. */
+		error = handler(iname, argc, argv);
+		if (error) {
+			pr_err("The command from line %u failed.", batch->tag);
+			stats->failed++;
+		}
+	}
+
+	error = ferror(file) ? errno : 0;
+	free(line);
+	if (error)
+		pr_err("Could not read the batch: %s", strerror(error));
+	return error;
+}
+
+/**
+ * Runs every command from @file_name ("-" is stdin) through @handler, which
+ * should expect the same arguments as `jool` (minus <ARGP1>).
+ *
+ * A failed command does not stop the batch; its error is reported along with
+ * the line number. Notice that, since the responses of the add/remove/update
+ * operations are collected in the background, their errors can be reported
+ * after the output of later lines.
+ */
+int batch_run(char *iname, char const *file_name, batch_cmd_handler handler)
+{
+	FILE *file;
+	struct joolnl_batch batch;
+	struct batch_stats stats = { 0 };
+	struct jool_result result;
+	int error;
+
+	if (strcmp(file_name, "-") == 0) {
+		file = stdin;
+	} else {
+		file = fopen(file_name, "r");
+		if (!file) {
+			error = errno;
+			pr_err("Could not open file '%s': %s", file_name,
+					strerror(error));
+			return error;
+		}
+	}
+
+	result = joolnl_setup(&shared, xt_get());
+	if (result.error) {
+		error = pr_result(&result);
+		goto end;
+	}
+
+	joolnl_batch_start(&shared, &batch, report_response, &stats);
+	running = true;
+
+	error = run_lines(file, iname, handler, &batch, &stats);
+
+	running = false;
+	joolnl_batch_end(&shared);
+	joolnl_teardown(&shared);
+
+	if (!error && stats.failed) {
+		pr_err("%u out of %u commands failed.", stats.failed,
+				stats.total);
+		error = -EINVAL;
+	}
+
+end:
+	if (file != stdin)
+		fclose(file);
+	return error;
+}
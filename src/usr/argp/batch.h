@@ -0,0 +1,24 @@
+#ifndef SRC_USR_ARGP_BATCH_H_
+#define SRC_USR_ARGP_BATCH_H_
+
+/**
+ * @file
+ * Batch mode: Runs many commands (one per line, read from a file or stdin)
+ * through a single Netlink socket.
+ *
+ * The command handlers need to get their sockets from cli_socket_setup() for
+ * this to work.
+ */
+
+#include <stdbool.h>
+#include "usr/nl/core.h"
+
+typedef int (*batch_cmd_handler)(char *iname, int argc, char **argv);
+
+int batch_run(char *iname, char const *file_name, batch_cmd_handler handler);
+bool batch_is_running(void);
+
+struct jool_result cli_socket_setup(struct joolnl_socket *sk);
+void cli_socket_teardown(struct joolnl_socket *sk);
+
+#endif /* SRC_USR_ARGP_BATCH_H_ */
@@ -14,6 +14,7 @@
 #include "common/xlat.h"
 #include "usr/util/str_utils.h"
 #include "usr/nl/file.h"
+#include "usr/argp/batch.h"
 #include "usr/argp/command.h"
 #include "usr/argp/log.h"
 #include "usr/argp/xlator_type.h"
@@ -227,6 +228,21 @@ static struct cmd_option session_ops[] = {
 			.xt = XT_NAT64,
 			.handler = handle_session_display,
 			.handle_autocomplete = autocomplete_session_display,
+		}, {
+			.label = "count",
+			.xt = XT_NAT64,
+			.handler = handle_session_count,
+			.handle_autocomplete = autocomplete_session_count,
+		}, {
+			.label = "export",
+			.xt = XT_NAT64,
+			.handler = handle_session_export,
+			.handle_autocomplete = autocomplete_session_export,
+		}, {
+			.label = "monitor",
+			.xt = XT_NAT64,
+			.handler = handle_session_monitor,
+			.handle_autocomplete = autocomplete_session_monitor,
 		},
 		{ 0 },
 };
@@ -458,7 +474,8 @@ static int __handle(char *iname, int argc, char **argv)
 	return more_args_expected(node->children);
 }
 
-static int handle(char *iname, int argc, char **argv)
+/* If @batch isn't NULL, the commands are read from that file instead. */
+static int handle(char *iname, int argc, char **argv, char const *batch)
 {
 	int error;
 
@@ -466,7 +483,14 @@ static int handle(char *iname, int argc, char **argv)
 	if (error)
 		return error;
 
-	error = __handle(iname, argc, argv);
+	if (!batch) {
+		error = __handle(iname, argc, argv);
+	} else if (argc > 0) {
+		pr_err("--batch reads the commands from a file; it does not take any more arguments.");
+		error = -EINVAL;
+	} else {
+		error = batch_run(iname, batch, __handle);
+	}
 
 	teardown_cmd_option_array(tree);
 	return error;
@@ -569,6 +593,10 @@ static const struct option OPTIONS[] = {
 		.name = "file",
 		.has_arg = required_argument,
 		.val = 'f',
+	}, {
+		.name = "batch",
+		.has_arg = required_argument,
+		.val = 1001,
 	},
 	{ 0 },
 };
@@ -577,6 +605,7 @@ static int show_usage(char *program_name)
 {
 	printf("%s (\n", program_name);
 	printf("        [<ARGP1>] <MODE> <OPERATION> [<ARGP2>]\n");
+	printf("        | [<ARGP1>] --batch <BATCH>\n");
 	printf("        | [-h|--help]\n");
 	printf("        | (-V|--version)\n");
 	printf("        | --usage\n");
@@ -601,6 +630,13 @@ static int show_help(char *program_name)
 	printf("- <FILE> is a path to a JSON file that contains the instance name\n");
 	printf("\n");
 
+	printf("<BATCH>\n");
+	printf("=======\n");
+	printf("Path to a file (or - for stdin) containing one command per line,\n");
+	printf("minus <ARGP1>. (Example: 'eamt add 2001:db8::1 192.0.2.1')\n");
+	printf("The commands share a single Netlink socket.\n");
+	printf("\n");
+
 	printf("<MODE>s -> <OPERATION>s\n");
 	printf("=======================\n");
 	for (mode = tree; mode && mode->label; mode++) {
@@ -637,6 +673,7 @@ int jool_main(int argc, char **argv)
 {
 	int opt;
 	char *iname = NULL;
+	char *batch = NULL;
 	struct jool_result result;
 
 	if (argc == 1)
@@ -658,8 +695,11 @@ int jool_main(int argc, char **argv)
 			if (result.error)
 				return pr_result(&result);
 			break;
+		case 1001:
+			batch = optarg;
+			break;
 		}
 	}
 
-	return handle(iname, argc - optind, argv + optind);
+	return handle(iname, argc - optind, argv + optind, batch);
 }
@@ -6,6 +6,7 @@
 #include "common/xlat.h"
 #include "common/constants.h"
 #include "usr/util/str_utils.h"
+#include "usr/argp/batch.h"
 #include "usr/argp/log.h"
 
 const char *argp_program_version = JOOL_VERSION_STR;
@@ -245,7 +246,9 @@ int wargp_parse(struct wargp_option *wopts, int argc, char **argv, void *input)
 	if (error)
 		return error;
 
-	error = argp_parse(&argp, argc, argv, 0, NULL, &wargs);
+	/* A bad line should not kill the whole batch. */
+	error = argp_parse(&argp, argc, argv,
+			batch_is_running() ? ARGP_NO_EXIT : 0, NULL, &wargs);
 
 	if (opts)
 		free(opts);
@@ -5,6 +5,7 @@
 #include "usr/util/str_utils.h"
 #include "usr/nl/address.h"
 #include "usr/nl/core.h"
+#include "usr/argp/batch.h"
 #include "usr/argp/log.h"
 #include "usr/argp/requirements.h"
 #include "usr/argp/wargp.h"
@@ -189,7 +190,7 @@ int handle_address_query(char *iname, int argc, char **argv, void const *arg)
 		return requirement_print(reqs);
 	}
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -210,7 +211,7 @@ int handle_address_query(char *iname, int argc, char **argv, void const *arg)
 		break;
 	}
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -2,6 +2,7 @@
 
 #include <string.h>
 
+#include "usr/argp/batch.h"
 #include "usr/argp/dns.h"
 #include "usr/argp/log.h"
 #include "usr/argp/requirements.h"
@@ -66,7 +67,7 @@ int handle_bib_display(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -76,7 +77,7 @@ int handle_bib_display(char *iname, int argc, char **argv, void const *arg)
 	result = joolnl_bib_foreach(&sk, iname, dargs.proto.proto,
 			print_entry, &dargs);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -154,7 +155,7 @@ int handle_bib_add(char *iname, int argc, char **argv, void const *arg)
 		return requirement_print(reqs);
 	}
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -162,7 +163,7 @@ int handle_bib_add(char *iname, int argc, char **argv, void const *arg)
 			&aargs.taddrs.addr6, &aargs.taddrs.addr4,
 			aargs.proto.proto);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -209,7 +210,7 @@ int handle_bib_remove(char *iname, int argc, char **argv, void const *arg)
 		return requirement_print(reqs);
 	}
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -218,7 +219,7 @@ int handle_bib_remove(char *iname, int argc, char **argv, void const *arg)
 			rargs.taddrs.addr4_set ? &rargs.taddrs.addr4 : NULL,
 			rargs.proto.proto);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
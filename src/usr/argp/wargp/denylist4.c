@@ -1,5 +1,6 @@
 #include "usr/argp/wargp/denylist4.h"
 
+#include "usr/argp/batch.h"
 #include "usr/argp/log.h"
 #include "usr/argp/requirements.h"
 #include "usr/argp/userspace-types.h"
@@ -48,7 +49,7 @@ int handle_denylist4_display(char *iname, int argc, char **argv, void const *arg
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -65,7 +66,7 @@ int handle_denylist4_display(char *iname, int argc, char **argv, void const *arg
 
 	result = joolnl_denylist4_foreach(&sk, iname, print_entry, &dargs);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 
 	if (result.error)
 		return pr_result(&result);
@@ -121,13 +122,13 @@ int handle_denylist4_add(char *iname, int argc, char **argv, void const *arg)
 		return requirement_print(reqs);
 	}
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
 	result = joolnl_denylist4_add(&sk, iname, &aargs.prefix.prefix, aargs.force);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -175,13 +176,13 @@ int handle_denylist4_remove(char *iname, int argc, char **argv, void const *arg)
 		return requirement_print(reqs);
 	}
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
 	result = joolnl_denylist4_rm(&sk, iname, &rargs.prefix.prefix);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -205,13 +206,13 @@ int handle_denylist4_flush(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
 	result = joolnl_denylist4_flush(&sk, iname);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
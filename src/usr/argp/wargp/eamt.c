@@ -1,5 +1,6 @@
 #include "usr/argp/wargp/eamt.h"
 
+#include "usr/argp/batch.h"
 #include "usr/argp/log.h"
 #include "usr/argp/requirements.h"
 #include "usr/argp/userspace-types.h"
@@ -57,7 +58,7 @@ int handle_eamt_display(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -75,7 +76,7 @@ int handle_eamt_display(char *iname, int argc, char **argv, void const *arg)
 
 	result = joolnl_eamt_foreach(&sk, iname, print_entry, &dargs);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 
 	if (result.error)
 		return pr_result(&result);
@@ -156,7 +157,7 @@ int handle_eamt_add(char *iname, int argc, char **argv, void const *arg)
 		return requirement_print(reqs);
 	}
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -165,7 +166,7 @@ int handle_eamt_add(char *iname, int argc, char **argv, void const *arg)
 			&aargs.entry.value.prefix4,
 			aargs.force);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -207,7 +208,7 @@ int handle_eamt_remove(char *iname, int argc, char **argv, void const *arg)
 		return requirement_print(reqs);
 	}
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -215,7 +216,7 @@ int handle_eamt_remove(char *iname, int argc, char **argv, void const *arg)
 			rargs.entry.prefix6_set ? &rargs.entry.value.prefix6 : NULL,
 			rargs.entry.prefix4_set ? &rargs.entry.value.prefix4 : NULL);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -237,13 +238,13 @@ int handle_eamt_flush(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
 	result = joolnl_eamt_flush(&sk, iname);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -2,6 +2,7 @@
 
 #include <errno.h>
 
+#include "usr/argp/batch.h"
 #include "usr/argp/log.h"
 #include "usr/argp/requirements.h"
 #include "usr/argp/wargp.h"
@@ -9,14 +10,23 @@
 #include "usr/nl/core.h"
 #include "usr/nl/file.h"
 
+#define ARGP_DIFF 'd'
+
 struct update_args {
 	struct wargp_string file_name;
 	struct wargp_bool force;
+	struct wargp_bool diff;
 };
 
 static struct wargp_option update_opts[] = {
 	WARGP_FORCE(struct update_args, force),
 	{
+		.name = "diff",
+		.key = ARGP_DIFF,
+		.doc = "Only send the table entries that differ from the running configuration",
+		.offset = offsetof(struct update_args, diff),
+		.type = &wt_bool,
+	}, {
 		.name = "File name",
 		.key = ARGP_KEY_ARG,
 		.doc = "Path to a JSON file containing Jool's configuration.",
@@ -44,14 +54,14 @@ int handle_file_update(char *iname, int argc, char **argv, void const *arg)
 		return requirement_print(reqs);
 	}
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
 	result = joolnl_file_parse(&sk, xt_get(), iname, uargs.file_name.value,
-			uargs.force.value);
+			uargs.force.value, uargs.diff.value);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -1,5 +1,6 @@
 #include "usr/argp/wargp/global.h"
 
+#include "usr/argp/batch.h"
 #include "usr/argp/command.h"
 #include "usr/argp/log.h"
 #include "usr/argp/userspace-types.h"
@@ -45,7 +46,7 @@ int handle_global_display(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -55,7 +56,7 @@ int handle_global_display(char *iname, int argc, char **argv, void const *arg)
 	result = joolnl_global_foreach(&sk, iname, handle_display_response,
 			&dargs);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 
 	return pr_result(&result);
 }
@@ -97,11 +98,11 @@ static int handle_global_update(char *iname, int argc, char **argv, void const *
 		return -EINVAL;
 	}
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 	result = joolnl_global_update(&sk, iname, field, uargs.global_str.value, uargs.force.value);
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 
 	return pr_result(&result);
 }
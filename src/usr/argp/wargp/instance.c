@@ -3,6 +3,7 @@
 #include <inttypes.h>
 #include "common/config.h"
 #include "common/constants.h"
+#include "usr/argp/batch.h"
 #include "usr/argp/log.h"
 #include "usr/argp/requirements.h"
 #include "usr/argp/wargp.h"
@@ -124,7 +125,7 @@ int handle_instance_display(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -142,7 +143,7 @@ int handle_instance_display(char *iname, int argc, char **argv, void const *arg)
 
 	result = joolnl_instance_foreach(&sk, print_entry, &dargs);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 
 	if (result.error)
 		return pr_result(&result);
@@ -224,7 +225,7 @@ int handle_instance_add(char *iname, int argc, char **argv, void const *arg)
 	}
 #endif
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -232,7 +233,7 @@ int handle_instance_add(char *iname, int argc, char **argv, void const *arg)
 	result = joolnl_instance_add(&sk, xf, iname,
 			aargs.pool6.set ? &aargs.pool6.prefix : NULL);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -267,13 +268,13 @@ int handle_instance_remove(char *iname, int argc, char **argv, void const *arg)
 	if (!iname && rargs.iname.set)
 		iname = rargs.iname.value;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
 	result = joolnl_instance_rm(&sk, iname);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -298,13 +299,13 @@ int handle_instance_flush(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
 	result = joolnl_instance_flush(&sk);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -335,7 +336,7 @@ int handle_instance_status(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error == -ESRCH)
 		printf("%s", DEAD_MSG);
 	if (result.error)
@@ -359,7 +360,7 @@ int handle_instance_status(char *iname, int argc, char **argv, void const *arg)
 	}
 
 end:
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
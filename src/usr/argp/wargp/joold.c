@@ -1,6 +1,7 @@
 #include "usr/argp/wargp/joold.h"
 
 #include "usr/nl/joold.h"
+#include "usr/argp/batch.h"
 #include "usr/argp/log.h"
 #include "usr/argp/xlator_type.h"
 
@@ -9,13 +10,13 @@ int handle_joold_advertise(char *iname, int argc, char **argv, void const *arg)
 	struct joolnl_socket sk;
 	struct jool_result result;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
 	result = joolnl_joold_advertise(&sk, iname);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -3,6 +3,7 @@
 #include "usr/util/str_utils.h"
 #include "usr/nl/core.h"
 #include "usr/nl/pool4.h"
+#include "usr/argp/batch.h"
 #include "usr/argp/log.h"
 #include "usr/argp/requirements.h"
 #include "usr/argp/userspace-types.h"
@@ -120,7 +121,7 @@ int handle_pool4_display(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -139,7 +140,7 @@ int handle_pool4_display(char *iname, int argc, char **argv, void const *arg)
 	result = joolnl_pool4_foreach(&sk, iname, dargs.proto.proto,
 			handle_display_response, &dargs);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 
 	if (result.error)
 		return pr_result(&result);
@@ -276,13 +277,13 @@ int handle_pool4_add(char *iname, int argc, char **argv, void const *arg)
 
 	aargs.entry.meat.proto = aargs.proto.proto;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
 	result = joolnl_pool4_add(&sk, iname, &aargs.entry.meat);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -349,13 +350,13 @@ int handle_pool4_remove(char *iname, int argc, char **argv, void const *arg)
 
 	rargs.entry.meat.proto = rargs.proto.proto;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
 	result = joolnl_pool4_rm(&sk, iname, &rargs.entry.meat, rargs.quick);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -389,13 +390,13 @@ int handle_pool4_flush(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
 	result = joolnl_pool4_flush(&sk, iname, fargs.quick);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
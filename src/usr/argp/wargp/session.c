@@ -1,22 +1,90 @@
 #include "usr/argp/wargp/session.h"
 
+#include <endian.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
 #include "common/config.h"
 #include "common/constants.h"
 #include "common/session.h"
 #include "usr/util/str_utils.h"
 #include "usr/nl/core.h"
+#include "usr/nl/events.h"
+#include "usr/nl/export.h"
 #include "usr/nl/session.h"
+#include "usr/argp/batch.h"
 #include "usr/argp/dns.h"
 #include "usr/argp/log.h"
+#include "usr/argp/requirements.h"
 #include "usr/argp/userspace-types.h"
 #include "usr/argp/wargp.h"
 #include "usr/argp/xlator_type.h"
 
+#define ARGP_SRC6 4000
+#define ARGP_SRC4 4001
+#define ARGP_PORTS 4002
+#define ARGP_DST4 4003
+#define ARGP_STATE 4004
+#define ARGP_MIN_AGE 4005
+#define ARGP_GROUP_BY 4006
+
+struct filter_args {
+	struct wargp_prefix6 src6;
+	struct wargp_prefix4 src4;
+	struct wargp_string ports;
+	struct wargp_prefix4 dst4;
+	struct wargp_string state;
+	struct wargp_string min_age;
+};
+
+#define WARGP_FILTER(container) \
+	{ \
+		.name = "src6", \
+		.key = ARGP_SRC6, \
+		.doc = "Only sessions whose IPv6 remote address belongs to this prefix", \
+		.offset = offsetof(container, filter.src6), \
+		.type = &wt_prefix6, \
+	}, { \
+		.name = "src4", \
+		.key = ARGP_SRC4, \
+		.doc = "Only sessions whose IPv4 local address belongs to this prefix", \
+		.offset = offsetof(container, filter.src4), \
+		.type = &wt_prefix4, \
+	}, { \
+		.name = "ports", \
+		.key = ARGP_PORTS, \
+		.doc = "Only sessions whose IPv4 local port (or ICMP identifier) belongs to this range (eg. 1024-2047)", \
+		.offset = offsetof(container, filter.ports), \
+		.type = &wt_string, \
+	}, { \
+		.name = "dst4", \
+		.key = ARGP_DST4, \
+		.doc = "Only sessions whose IPv4 remote address belongs to this prefix", \
+		.offset = offsetof(container, filter.dst4), \
+		.type = &wt_prefix4, \
+	}, { \
+		.name = "state", \
+		.key = ARGP_STATE, \
+		.doc = "Only TCP sessions in this state (eg. ESTABLISHED)", \
+		.offset = offsetof(container, filter.state), \
+		.type = &wt_string, \
+	}, { \
+		.name = "min-age", \
+		.key = ARGP_MIN_AGE, \
+		.doc = "Only sessions created at least this long ago (HH:MM:SS)", \
+		.offset = offsetof(container, filter.min_age), \
+		.type = &wt_string, \
+	}
+
 struct display_args {
 	struct wargp_bool no_headers;
 	struct wargp_bool csv;
 	struct wargp_bool numeric;
 	struct wargp_l4proto proto;
+	struct filter_args filter;
 };
 
 static struct wargp_option display_opts[] = {
@@ -26,29 +94,70 @@ static struct wargp_option display_opts[] = {
 	WARGP_NO_HEADERS(struct display_args, no_headers),
 	WARGP_CSV(struct display_args, csv),
 	WARGP_NUMERIC(struct display_args, numeric),
+	WARGP_FILTER(struct display_args),
 	{ 0 },
 };
 
+static char *state_names[] = {
+	[ESTABLISHED] = "ESTABLISHED",
+	[V6_INIT] = "V6_INIT",
+	[V4_INIT] = "V4_INIT",
+	[V4_FIN_RCV] = "V4_FIN_RCV",
+	[V6_FIN_RCV] = "V6_FIN_RCV",
+	[V4_FIN_V6_FIN_RCV] = "V4_FIN_V6_FIN_RCV",
+	[TRANS] = "TRANS",
+};
+
 static char *tcp_state_to_string(tcp_state state)
 {
-	switch (state) {
-	case ESTABLISHED:
-		return "ESTABLISHED";
-	case V4_INIT:
-		return "V4_INIT";
-	case V6_INIT:
-		return "V6_INIT";
-	case V4_FIN_RCV:
-		return "V4_FIN_RCV";
-	case V6_FIN_RCV:
-		return "V6_FIN_RCV";
-	case V4_FIN_V6_FIN_RCV:
-		return "V4_FIN_V6_FIN_RCV";
-	case TRANS:
-		return "TRANS";
-	}
-
-	return "UNKNOWN";
+	return (state <= TRANS) ? state_names[state] : "UNKNOWN";
+}
+
+static int build_filter(struct filter_args *args, l4_protocol proto,
+		struct session_filter *filter)
+{
+	struct jool_result result;
+	unsigned int i;
+
+	memset(filter, 0, sizeof(*filter));
+	filter->ports.max = 65535;
+
+	filter->src6.set = args->src6.set;
+	filter->src6.prefix = args->src6.prefix;
+	filter->src4.set = args->src4.set;
+	filter->src4.prefix = args->src4.prefix;
+	filter->dst4.set = args->dst4.set;
+	filter->dst4.prefix = args->dst4.prefix;
+
+	if (args->ports.value) {
+		result = str_to_port_range(args->ports.value, &filter->ports);
+		if (result.error)
+			return pr_result(&result);
+	}
+
+	if (args->state.value) {
+		if (proto != L4PROTO_TCP) {
+			pr_err("Only TCP sessions have states.");
+			return -EINVAL;
+		}
+		for (i = 0; i <= TRANS; i++)
+			if (strcasecmp(args->state.value, state_names[i]) == 0)
+				break;
+		if (i > TRANS) {
+			pr_err("Unknown TCP state: '%s'", args->state.value);
+			return -EINVAL;
+		}
+		filter->state_set = true;
+		filter->state = i;
+	}
+
+	if (args->min_age.value) {
+		result = str_to_timeout(args->min_age.value, &filter->min_age);
+		if (result.error)
+			return pr_result(&result);
+	}
+
+	return 0;
 }
 
 static struct jool_result handle_display_response(
@@ -101,6 +210,7 @@ static struct jool_result handle_display_response(
 int handle_session_display(char *iname, int argc, char **argv, void const *arg)
 {
 	struct display_args dargs = { 0 };
+	struct session_filter filter;
 	struct joolnl_socket sk;
 	struct jool_result result;
 
@@ -108,7 +218,11 @@ int handle_session_display(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result.error = build_filter(&dargs.filter, dargs.proto.proto, &filter);
+	if (result.error)
+		return result.error;
+
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
@@ -124,9 +238,9 @@ int handle_session_display(char *iname, int argc, char **argv, void const *arg)
 	}
 
 	result = joolnl_session_foreach(&sk, iname, dargs.proto.proto,
-			handle_display_response, &dargs);
+			&filter, handle_display_response, &dargs);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 
 	return pr_result(&result);
 }
@@ -135,3 +249,368 @@ void autocomplete_session_display(void const *args)
 {
 	print_wargp_opts(display_opts);
 }
+
+struct count_args {
+	struct wargp_bool no_headers;
+	struct wargp_bool csv;
+	struct wargp_l4proto proto;
+	struct wargp_string group_by;
+	struct filter_args filter;
+};
+
+static struct wargp_option count_opts[] = {
+	WARGP_TCP(struct count_args, proto, "Count TCP sessions (default)"),
+	WARGP_UDP(struct count_args, proto, "Count UDP sessions"),
+	WARGP_ICMP(struct count_args, proto, "Count ICMP sessions"),
+	WARGP_NO_HEADERS(struct count_args, no_headers),
+	WARGP_CSV(struct count_args, csv),
+	{
+		.name = "group-by",
+		.key = ARGP_GROUP_BY,
+		.doc = "Count per 'src6' (/64), 'src4', 'state' or 'lifetime'",
+		.offset = offsetof(struct count_args, group_by),
+		.type = &wt_string,
+	},
+	WARGP_FILTER(struct count_args),
+	{ 0 },
+};
+
+static char *grouping_names[] = {
+	[SG_TOTAL] = "total",
+	[SG_SRC6] = "src6",
+	[SG_SRC4] = "src4",
+	[SG_STATE] = "state",
+	[SG_LIFETIME] = "lifetime",
+};
+
+struct count_print_args {
+	enum session_grouping grouping;
+	bool csv;
+	unsigned long long total;
+};
+
+static struct jool_result print_group(struct session_group_usr const *group,
+		void *_args)
+{
+	struct count_print_args *args = _args;
+	char key[INET6_ADDRSTRLEN + 4];
+	char timeout[TIMEOUT_BUFLEN];
+
+	switch (args->grouping) {
+	case SG_TOTAL:
+		args->total += group->sessions;
+		return result_success();
+	case SG_SRC6:
+		inet_ntop(AF_INET6, &group->key.prefix6.addr, key, sizeof(key));
+		sprintf(key + strlen(key), "/%u", group->key.prefix6.len);
+		break;
+	case SG_SRC4:
+		inet_ntop(AF_INET, &group->key.addr4, key, sizeof(key));
+		break;
+	case SG_STATE:
+		strcpy(key, tcp_state_to_string(group->key.value));
+		break;
+	case SG_LIFETIME:
+		timeout2str(group->key.value, timeout);
+		sprintf(key, ">= %s", timeout);
+		break;
+	}
+
+	printf(args->csv ? "%s,%u\n" : "%s\t%u\n", key, group->sessions);
+	args->total += group->sessions;
+	return result_success();
+}
+
+int handle_session_count(char *iname, int argc, char **argv, void const *arg)
+{
+	struct count_args cargs = { 0 };
+	struct count_print_args pargs = { 0 };
+	struct session_filter filter;
+	struct joolnl_socket sk;
+	struct jool_result result;
+	unsigned int i;
+
+	result.error = wargp_parse(count_opts, argc, argv, &cargs);
+	if (result.error)
+		return result.error;
+
+	result.error = build_filter(&cargs.filter, cargs.proto.proto, &filter);
+	if (result.error)
+		return result.error;
+
+	pargs.grouping = SG_TOTAL;
+	if (cargs.group_by.value) {
+		for (i = SG_SRC6; i <= SG_MAX; i++)
+			if (strcasecmp(cargs.group_by.value, grouping_names[i]) == 0)
+				break;
+		if (i > SG_MAX) {
+			pr_err("Unknown grouping: '%s'", cargs.group_by.value);
+			return -EINVAL;
+		}
+		pargs.grouping = i;
+	}
+	pargs.csv = cargs.csv.value;
+
+	result = cli_socket_setup(&sk);
+	if (result.error)
+		return pr_result(&result);
+
+	if (pargs.grouping != SG_TOTAL
+			&& show_csv_header(cargs.no_headers.value, cargs.csv.value))
+		printf("%s,Sessions\n", grouping_names[pargs.grouping]);
+
+	result = joolnl_session_query(&sk, iname, cargs.proto.proto, &filter,
+			pargs.grouping, print_group, &pargs);
+
+	cli_socket_teardown(&sk);
+
+	if (!result.error && pargs.grouping == SG_TOTAL)
+		printf("%llu\n", pargs.total);
+
+	return pr_result(&result);
+}
+
+void autocomplete_session_count(void const *args)
+{
+	print_wargp_opts(count_opts);
+}
+
+struct export_args {
+	struct wargp_string file_name;
+};
+
+static struct wargp_option export_opts[] = {
+	{
+		.name = "File name",
+		.key = ARGP_KEY_ARG,
+		.doc = "Path to the file the image will be written to. (\"-\" is standard output.)",
+		.offset = offsetof(struct export_args, file_name),
+		.type = &wt_string,
+	},
+	{ 0 },
+};
+
+struct export_state {
+	FILE *file;
+	unsigned long long bibs;
+	unsigned long long sessions;
+};
+
+static struct jool_result write_records(
+		struct table_image_record const *records, unsigned int count,
+		void *args)
+{
+	struct export_state *state = args;
+	unsigned int i;
+
+	if (fwrite(records, sizeof(*records), count, state->file) != count)
+		return result_from_error(errno, "Cannot write the image: %s",
+				strerror(errno));
+
+	for (i = 0; i < count; i++) {
+		if (records[i].type == TIR_BIB)
+			state->bibs++;
+		else
+			state->sessions++;
+	}
+
+	return result_success();
+}
+
+int handle_session_export(char *iname, int argc, char **argv, void const *arg)
+{
+	struct export_args eargs = { 0 };
+	struct export_state state = { 0 };
+	struct table_image_hdr hdr;
+	struct joolnl_socket sk;
+	bool is_stdout;
+	struct jool_result result;
+
+	result.error = wargp_parse(export_opts, argc, argv, &eargs);
+	if (result.error)
+		return result.error;
+
+	if (!eargs.file_name.value) {
+		struct requirement reqs[] = {
+				{ false, "a file name" },
+				{ 0 }
+		};
+		return requirement_print(reqs);
+	}
+
+	is_stdout = strcmp(eargs.file_name.value, "-") == 0;
+	state.file = is_stdout ? stdout : fopen(eargs.file_name.value, "wb");
+	if (!state.file) {
+		result.error = errno;
+		pr_err("Cannot open %s: %s", eargs.file_name.value,
+				strerror(result.error));
+		return result.error;
+	}
+	/* The image can be huge; don't hit the disk every 4 KB. */
+	setvbuf(state.file, NULL, _IOFBF, 1 << 20);
+
+	result = cli_socket_setup(&sk);
+	if (result.error)
+		goto end;
+
+	table_image_init_hdr(&hdr, time(NULL));
+	if (fwrite(&hdr, sizeof(hdr), 1, state.file) != 1) {
+		result = result_from_error(errno, "Cannot write the image: %s",
+				strerror(errno));
+		goto teardown;
+	}
+
+	result = joolnl_session_export(&sk, iname, write_records, &state);
+
+teardown:
+	cli_socket_teardown(&sk);
+end:
+	if (fflush(state.file) && !result.error)
+		result = result_from_error(errno, "Cannot write the image: %s",
+				strerror(errno));
+	if (!is_stdout)
+		fclose(state.file);
+
+	if (!result.error && !is_stdout)
+		printf("Exported %llu BIB entries and %llu sessions.\n",
+				state.bibs, state.sessions);
+	return pr_result(&result);
+}
+
+void autocomplete_session_export(void const *args)
+{
+	/* Do nothing; default to autocomplete directory path */
+}
+
+struct monitor_args {
+	struct wargp_bool no_headers;
+};
+
+static struct wargp_option monitor_opts[] = {
+	WARGP_NO_HEADERS(struct monitor_args, no_headers),
+	{ 0 },
+};
+
+static char *event_names[] = {
+	[BEV_BIB_ADD] = "BIB added",
+	[BEV_BIB_RM] = "BIB removed",
+	[BEV_SESSION_ADD] = "Session added",
+	[BEV_SESSION_RM] = "Session removed",
+};
+
+struct monitor_state {
+	/* Drop counter, as of the last batch. */
+	__u32 lost;
+};
+
+static void print_event(struct bib_event_record const *record)
+{
+	struct ipv6_transport_addr addr6;
+	struct ipv4_transport_addr addr4;
+	l4_protocol proto;
+	__u64 timestamp;
+	bool is_session;
+
+	timestamp = be64toh(record->timestamp);
+	proto = record->proto;
+	is_session = record->type == BEV_SESSION_ADD
+			|| record->type == BEV_SESSION_RM;
+
+	printf("%llu.%09llu,", timestamp / 1000000000ULL,
+			timestamp % 1000000000ULL);
+	printf("%s,", (record->type >= BEV_BIB_ADD
+			&& record->type <= BEV_SESSION_RM)
+			? event_names[record->type] : "Unknown");
+	printf("%s,", l4proto_to_string(proto));
+
+	addr6.l3 = record->src6;
+	addr6.l4 = ntohs(record->src6_port);
+	print_addr6(&addr6, true, ",", proto);
+	printf(",");
+	if (is_session) {
+		addr6.l3 = record->dst6;
+		addr6.l4 = ntohs(record->dst6_port);
+		print_addr6(&addr6, true, ",", proto);
+	} else {
+		printf(",");
+	}
+	printf(",");
+	addr4.l3 = record->src4;
+	addr4.l4 = ntohs(record->src4_port);
+	print_addr4(&addr4, true, ",", proto);
+	printf(",");
+	if (is_session) {
+		addr4.l3 = record->dst4;
+		addr4.l4 = ntohs(record->dst4_port);
+		print_addr4(&addr4, true, ",", proto);
+	} else {
+		printf(",");
+	}
+	printf("\n");
+}
+
+static struct jool_result print_events(struct joolnl_event_batch const *batch,
+		void *args)
+{
+	struct monitor_state *state = args;
+	unsigned int i;
+
+	if (batch->overrun) {
+		fprintf(stderr, "Fell behind; the socket dropped some events.\n");
+		return result_success();
+	}
+
+	if (batch->lost != state->lost) {
+		fprintf(stderr, "The kernel module dropped %u events.\n",
+				batch->lost - state->lost);
+		state->lost = batch->lost;
+	}
+
+	for (i = 0; i < batch->count; i++)
+		print_event(&batch->records[i]);
+	fflush(stdout);
+
+	return result_success();
+}
+
+int handle_session_monitor(char *iname, int argc, char **argv, void const *arg)
+{
+	struct monitor_args margs = { 0 };
+	struct monitor_state state = { 0 };
+	struct joolnl_socket sk;
+	struct jool_result result;
+
+	result.error = wargp_parse(monitor_opts, argc, argv, &margs);
+	if (result.error)
+		return result.error;
+
+	if (batch_is_running()) {
+		pr_err("The monitor never ends, so it cannot run in batch mode.");
+		return -EINVAL;
+	}
+
+	/* The stream does not share the socket; it would swallow the events. */
+	result = joolnl_setup(&sk, xt_get());
+	if (result.error)
+		return pr_result(&result);
+
+	if (show_csv_header(margs.no_headers.value, true)) {
+		printf("Time,Event,Protocol,");
+		printf("IPv6 Remote Address,IPv6 Remote L4-ID,");
+		printf("IPv6 Local Address,IPv6 Local L4-ID,");
+		printf("IPv4 Local Address,IPv4 Local L4-ID,");
+		printf("IPv4 Remote Address,IPv4 Remote L4-ID\n");
+		fflush(stdout);
+	}
+
+	/* The first batch reports the drops since the instance was created. */
+	result = joolnl_events_listen(&sk, iname, print_events, &state);
+
+	joolnl_teardown(&sk);
+	return pr_result(&result);
+}
+
+void autocomplete_session_monitor(void const *args)
+{
+	print_wargp_opts(monitor_opts);
+}
@@ -3,5 +3,11 @@
 
 int handle_session_display(char *iname, int argc, char **argv, void const *arg);
 void autocomplete_session_display(void const *args);
+int handle_session_count(char *iname, int argc, char **argv, void const *arg);
+void autocomplete_session_count(void const *args);
+int handle_session_export(char *iname, int argc, char **argv, void const *arg);
+void autocomplete_session_export(void const *args);
+int handle_session_monitor(char *iname, int argc, char **argv, void const *arg);
+void autocomplete_session_monitor(void const *args);
 
 #endif /* SRC_USR_ARGP_WARGP_SESSION_H_ */
@@ -1,7 +1,13 @@
 #include "usr/argp/wargp/stats.h"
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
 #include "usr/nl/core.h"
 #include "usr/nl/stats.h"
+#include "usr/argp/batch.h"
 #include "usr/argp/log.h"
 #include "usr/argp/userspace-types.h"
 #include "usr/argp/wargp.h"
@@ -12,6 +18,7 @@ struct display_args {
 	struct wargp_bool explain;
 	struct wargp_bool no_headers;
 	struct wargp_bool csv;
+	struct wargp_bool occupancy;
 };
 
 static struct wargp_option display_opts[] = {
@@ -30,6 +37,13 @@ static struct wargp_option display_opts[] = {
 	},
 	WARGP_NO_HEADERS(struct display_args, no_headers),
 	WARGP_CSV(struct display_args, csv),
+	{
+		.name = "occupancy",
+		.key = 'o',
+		.doc = "Print the number of BIB entries each pool4 address and mark is serving, instead of the counters",
+		.offset = offsetof(struct display_args, occupancy),
+		.type = &wt_bool,
+	},
 	{ 0 },
 };
 
@@ -54,6 +68,152 @@ static struct jool_result handle_jstat(struct joolnl_stat const *stat, void *arg
 	return result_success();
 }
 
+/* Growable array; the occupancy counters are collected into one of these. */
+struct array {
+	void *items;
+	size_t item_size;
+	unsigned int count;
+	unsigned int capacity;
+};
+
+static struct jool_result array_add(struct array *array, void const *item)
+{
+	void *items;
+
+	if (array->count == array->capacity) {
+		array->capacity = array->capacity ? (2 * array->capacity) : 64;
+		items = realloc(array->items,
+				array->capacity * array->item_size);
+		if (!items)
+			return result_from_enomem();
+		array->items = items;
+	}
+
+	memcpy((char *)array->items + array->count * array->item_size, item,
+			array->item_size);
+	array->count++;
+	return result_success();
+}
+
+static struct jool_result collect_occupancy(
+		struct joolnl_occupancy const *entry, void *args)
+{
+	return array_add(args, entry);
+}
+
+/* Do @a and @b count BIB entries of the same protocol and mark? */
+static bool same_mark(struct joolnl_occupancy const *a,
+		struct joolnl_occupancy const *b)
+{
+	return a->proto == b->proto && a->marked == b->marked
+			&& (!a->marked || a->mark == b->mark);
+}
+
+/* Has @index's mark already been printed? (ie. Is it in an earlier entry?) */
+static bool mark_seen(struct array *occupancy, unsigned int index)
+{
+	struct joolnl_occupancy *occs = occupancy->items;
+	unsigned int i;
+
+	for (i = 0; i < index; i++)
+		if (same_mark(&occs[i], &occs[index]))
+			return true;
+	return false;
+}
+
+static void print_occupancy(struct display_args *dargs, l4_protocol proto,
+		char const *mark, struct in_addr const *addr, __u32 bibs)
+{
+	char addr_str[INET_ADDRSTRLEN];
+
+	inet_ntop(AF_INET, addr, addr_str, sizeof(addr_str));
+	if (dargs->csv.value)
+		printf("%s,%s,%s,%u\n", l4proto_to_string(proto), mark,
+				addr_str, bibs);
+	else if (mark[0] == '\0')
+		printf("\t%s (%s): %u\n", addr_str, l4proto_to_string(proto),
+				bibs);
+	else
+		printf("\t%s: %u\n", addr_str, bibs);
+}
+
+/*
+ * The kernel attributes each BIB entry to the pool4 mark its address and port
+ * belonged to when the entry was added, so this only needs to group the
+ * counters.
+ */
+static void print_mark(struct display_args *dargs, struct array *occupancy,
+		struct joolnl_occupancy const *first)
+{
+	struct joolnl_occupancy *occs = occupancy->items;
+	char mark_str[16];
+	unsigned long long total;
+	unsigned int i;
+
+	snprintf(mark_str, sizeof(mark_str), "%u", first->mark);
+	if (!dargs->csv.value)
+		printf("%s, mark %s:\n", l4proto_to_string(first->proto),
+				mark_str);
+
+	total = 0;
+	for (i = 0; i < occupancy->count; i++) {
+		if (!same_mark(&occs[i], first))
+			continue;
+		print_occupancy(dargs, occs[i].proto, mark_str, &occs[i].addr,
+				occs[i].bibs);
+		total += occs[i].bibs;
+	}
+
+	if (!dargs->csv.value)
+		printf("\tTotal: %llu\n\n", total);
+}
+
+/* BIB entries that were not in pool4. (eg. Static ones outside of it.) */
+static void print_orphans(struct display_args *dargs, struct array *occupancy)
+{
+	struct joolnl_occupancy *occs = occupancy->items;
+	bool header = false;
+	unsigned int i;
+
+	for (i = 0; i < occupancy->count; i++) {
+		if (occs[i].marked)
+			continue;
+		if (!dargs->csv.value && !header) {
+			printf("Not in pool4:\n");
+			header = true;
+		}
+		print_occupancy(dargs, occs[i].proto, "", &occs[i].addr,
+				occs[i].bibs);
+	}
+}
+
+static struct jool_result display_occupancy(struct joolnl_socket *sk,
+		char *iname, struct display_args *dargs)
+{
+	struct array occupancy = { .item_size = sizeof(struct joolnl_occupancy) };
+	struct joolnl_occupancy *occs;
+	unsigned int i;
+	struct jool_result result;
+
+	result = joolnl_stats_occupancy(sk, iname, collect_occupancy,
+			&occupancy);
+	if (result.error)
+		goto end;
+
+	if (show_csv_header(dargs->no_headers.value, dargs->csv.value))
+		printf("Protocol,Mark,Address,BIB entries\n");
+
+	occs = occupancy.items;
+	for (i = 0; i < occupancy.count; i++)
+		if (occs[i].marked && !mark_seen(&occupancy, i))
+			print_mark(dargs, &occupancy, &occs[i]);
+	print_orphans(dargs, &occupancy);
+
+end:
+	free(occupancy.items);
+	return result;
+}
+
 int handle_stats_display(char *iname, int argc, char **argv, void const *arg)
 {
 	struct display_args dargs = { 0 };
@@ -64,10 +224,16 @@ int handle_stats_display(char *iname, int argc, char **argv, void const *arg)
 	if (result.error)
 		return result.error;
 
-	result = joolnl_setup(&sk, xt_get());
+	result = cli_socket_setup(&sk);
 	if (result.error)
 		return pr_result(&result);
 
+	if (dargs.occupancy.value) {
+		result = display_occupancy(&sk, iname, &dargs);
+		cli_socket_teardown(&sk);
+		return pr_result(&result);
+	}
+
 	if (show_csv_header(dargs.no_headers.value, dargs.csv.value)) {
 		printf("Stat,Value");
 		if (dargs.explain.value)
@@ -77,7 +243,7 @@ int handle_stats_display(char *iname, int argc, char **argv, void const *arg)
 
 	result = joolnl_stats_foreach(&sk, iname, handle_jstat, &dargs);
 
-	joolnl_teardown(&sk);
+	cli_socket_teardown(&sk);
 	return pr_result(&result);
 }
 
@@ -5,6 +5,7 @@
 #include <syslog.h>
 #include <netlink/genl/ctrl.h>
 #include <netlink/genl/genl.h>
+#include <netlink/msg.h>
 
 #include "usr/util/cJSON.h"
 #include "usr/util/file.h"
@@ -12,22 +13,84 @@
 #include "usr/joold/log.h"
 #include "usr/joold/netsocket.h"
 
+/*
+ * Maximum size of the requests we send to the kernel.
+ * Datagrams received from the network are coalesced into requests of up to
+ * this size. It needs to stay well below the socket's send buffer (which,
+ * by default, is around 200 KB), since that's what the kernel enforces.
+ */
+#define BATCH_SIZE (32 * 1024)
+
 static struct joolnl_socket jsocket;
 static char *iname;
 
-/* Called by the net socket whenever joold receives data from the network. */
+/*
+ * Request that is currently accumulating the sessions received from the
+ * network. Only touched by the network listener thread; needs no locking.
+ */
+static struct nl_msg *pending;
+static unsigned int pending_count;
+
+/* Sends the pending request (if any) to the kernel. Does not wait for it. */
+void modsocket_flush(void)
+{
+	struct jool_result result;
+
+	if (!pending)
+		return;
+
+	syslog(LOG_DEBUG, "Handing %u datagram(s) to the kernel.",
+			pending_count);
+	result = joolnl_joold_add_send(&jsocket, pending);
+	pending = NULL;
+	pending_count = 0;
+	pr_result(&result);
+}
+
+/*
+ * Called by the net socket whenever joold receives data from the network.
+ * The data is queued; it only reaches the kernel during the next
+ * modsocket_flush() (or once the request fills up).
+ */
 void modsocket_send(void *request, size_t request_len)
 {
 	struct jool_result result;
-	result = joolnl_joold_add(&jsocket, iname, request, request_len);
+
+	if (pending && nlmsg_hdr(pending)->nlmsg_len
+			+ nla_total_size(request_len) > BATCH_SIZE)
+		modsocket_flush();
+
+	if (!pending) {
+		result = joolnl_joold_add_init(&jsocket, iname, &pending);
+		if (result.error) {
+			pending = NULL;
+			pr_result(&result);
+			return;
+		}
+	}
+
+	result = joolnl_joold_add_put(pending, request, request_len);
+	if (result.error) {
+		pr_result(&result);
+		return;
+	}
+
+	pending_count++;
+}
+
+/* Asks the kernel to send its entire session database to the network. */
+void modsocket_advertise(void)
+{
+	struct jool_result result;
+	result = joolnl_joold_advertise(&jsocket, iname);
 	pr_result(&result);
 }
 
-static void do_ack(void)
+static void do_ack(__u32 const *seq)
 {
 	struct jool_result result;
 
-	result = joolnl_joold_ack(&jsocket, iname);
+	result = joolnl_joold_ack(&jsocket, iname, seq);
 	if (result.error)
 		pr_result(&result);
 }
@@ -43,9 +106,13 @@ static int updated_entries_cb(struct nl_msg *msg, void *arg)
 	struct genlmsghdr *ghdr;
 	struct joolnlhdr *jhdr;
 	struct nlattr *root;
+	struct nlattr *seq_attr;
+	__u32 seq;
+	__u32 *seqp;
 	struct jool_result result;
 
 	syslog(LOG_DEBUG, "Received a packet from kernelspace.");
+	seqp = NULL;
 
 	nhdr = nlmsg_hdr(msg);
 	if (!genlmsg_valid_hdr(nhdr, sizeof(struct joolnlhdr))) {
@@ -67,8 +134,27 @@ static int updated_entries_cb(struct nl_msg *msg, void *arg)
 		goto fail;
 	}
 
+	/* Advertisement conclusions carry no sessions, and are not ACKed. */
+	if (nla_find(genlmsg_attrdata(ghdr, sizeof(struct joolnlhdr)),
+			genlmsg_attrlen(ghdr, sizeof(struct joolnlhdr)),
+			JNLAR_JOOLD_AD_END)) {
+		syslog(LOG_DEBUG, "The kernel finished advertising.");
+		netsocket_ad_end();
+		return 0;
+	}
+
+	/* Older kernel modules do not number their packets. */
+	seq_attr = nla_find(genlmsg_attrdata(ghdr, sizeof(struct joolnlhdr)),
+			genlmsg_attrlen(ghdr, sizeof(struct joolnlhdr)),
+			JNLAR_JOOLD_SEQ);
+	if (seq_attr && nla_len(seq_attr) >= sizeof(__u32)) {
+		seq = nla_get_u32(seq_attr);
+		seqp = &seq;
+	}
+
 	root = genlmsg_attrdata(ghdr, sizeof(struct joolnlhdr));
-	if (nla_type(root) != JNLAR_SESSION_ENTRIES) {
+	if (nla_type(root) != JNLAR_SESSION_RECORDS
+			&& nla_type(root) != JNLAR_SESSION_ENTRIES) {
 		syslog(LOG_ERR, "Kernel sent invalid data: Message lacks a session container");
 		goto einval;
 	}
@@ -79,13 +165,13 @@ static int updated_entries_cb(struct nl_msg *msg, void *arg)
 	 * (See modsocket_send())
 	 */
 	netsocket_send(nla_data(root), nla_len(root));
-	do_ack();
+	do_ack(seqp);
 	return 0;
 
 einval:
 	result.error = -EINVAL;
 fail:
-	do_ack(); /* Tell kernel to flush the packet queue anyway. */
+	do_ack(seqp); /* Tell kernel to flush the packet queue anyway. */
 	return (result.error < 0) ? result.error : -result.error;
 }
 
@@ -136,6 +222,9 @@ static int create_socket(void)
 	int family_mc_grp;
 	struct jool_result result;
 
+	/* nlmsg_alloc() reserves this much room for every request. */
+	nlmsg_set_default_size(BATCH_SIZE);
+
 	result = joolnl_setup(&jsocket, XT_NAT64);
 	if (result.error)
 		return pr_result(&result);
@@ -196,6 +285,8 @@ void *modsocket_listen(void *arg)
 			syslog(LOG_ERR, "Error receiving packet from kernelspace: %s",
 					nl_geterror(error));
 		}
+		/* Everything we just received goes out in one burst. */
+		netsocket_flush();
 	} while (true);
 
 	return 0;
@@ -12,5 +12,7 @@ void modsocket_teardown(void);
 
 void *modsocket_listen(void *arg);
 void modsocket_send(void *buffer, size_t size);
+void modsocket_flush(void);
+void modsocket_advertise(void);
 
 #endif /* SRC_USR_JOOLD_MODSOCKET_H_ */
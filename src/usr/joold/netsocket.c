@@ -1,7 +1,9 @@
+#define _GNU_SOURCE /* recvmmsg(), sendmmsg() */
 #include "usr/joold/netsocket.h"
 
 #include <errno.h>
 #include <netdb.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,9 +12,11 @@
 #include <arpa/inet.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <sys/time.h>
 
 #include "log.h"
 #include "modsocket.h"
+#include "reliable.h"
 #include "common/config.h"
 #include "common/types.h"
 #include "usr/util/cJSON.h"
@@ -40,14 +44,36 @@ struct netsocket_config {
 
 	int ttl;
 	bool ttl_set;
+
+	/** Number, detect and recover lost datagrams? Defaults to true. */
+	bool reliable;
+	/** Ask a peer for its database during startup? Defaults to true. */
+	bool snapshot;
 };
 
+/* Maximum number of datagrams we read or write per system call. */
+#define MMSG_BATCH 32
+/* Seconds the listener waits for datagrams before doing its housekeeping. */
+#define TICK_INTERVAL 1
+#define DATAGRAM_SIZE (sizeof(struct jrl_hdr) + JOOLD_MAX_PAYLOAD)
+
 static int sk;
 /** Processed version of the configuration's hostname and service. */
 static struct addrinfo *addr_candidates;
 /** Candidate from @addr_candidates that we managed to bind the socket with. */
 static struct addrinfo *bound_address;
 
+/*
+ * Datagrams waiting for the next netsocket_flush().
+ * Both threads send (the module listener multicasts sessions, the network
+ * listener answers NACKs), so this needs @out_lock.
+ */
+static pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned char out_buffers[MMSG_BATCH][DATAGRAM_SIZE];
+static struct iovec out_iovs[MMSG_BATCH];
+static struct mmsghdr out_msgs[MMSG_BATCH];
+static unsigned int out_count;
+
 static struct in_addr *get_addr4(struct addrinfo *addr)
 {
 	return &((struct sockaddr_in *)addr->ai_addr)->sin_addr;
@@ -85,6 +111,8 @@ static int json_to_config(cJSON *json, struct netsocket_config *cfg)
 	int error;
 
 	memset(cfg, 0, sizeof(*cfg));
+	cfg->reliable = true;
+	cfg->snapshot = true;
 
 	child = cJSON_GetObjectItem(json, "multicast address");
 	if (!child) {
@@ -124,6 +152,36 @@ static int json_to_config(cJSON *json, struct netsocket_config *cfg)
 		cfg->ttl = child->valueint;
 	}
 
+	child = cJSON_GetObjectItem(json, "reliable");
+	if (child) {
+		switch (child->type) {
+		case cJSON_True:
+			cfg->reliable = true;
+			break;
+		case cJSON_False:
+			cfg->reliable = false;
+			break;
+		default:
+			syslog(LOG_ERR, "reliable is not a valid boolean.");
+			return -EINVAL;
+		}
+	}
+
+	child = cJSON_GetObjectItem(json, "snapshot");
+	if (child) {
+		switch (child->type) {
+		case cJSON_True:
+			cfg->snapshot = true;
+			break;
+		case cJSON_False:
+			cfg->snapshot = false;
+			break;
+		default:
+			syslog(LOG_ERR, "snapshot is not a valid boolean.");
+			return -EINVAL;
+		}
+	}
+
 	return 0;
 
 fail:
@@ -430,6 +488,20 @@ static int adjust_mcast_opts(struct netsocket_config *cfg)
 	return 1;
 }
 
+/* So the listener wakes up every now and then, even if nobody talks. */
+static int set_receive_timeout(void)
+{
+	struct timeval timeout = { .tv_sec = TICK_INTERVAL };
+
+	if (setsockopt(sk, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+			sizeof(timeout))) {
+		pr_perror("setsockopt(SO_RCVTIMEO) failed", errno);
+		return 1;
+	}
+
+	return 0;
+}
+
 int netsocket_setup(int argc, char **argv)
 {
 	cJSON *json;
@@ -449,13 +521,24 @@ int netsocket_setup(int argc, char **argv)
 		goto end;
 
 	error = adjust_mcast_opts(&cfg);
-	if (error) {
-		close(sk);
-		freeaddrinfo(addr_candidates);
-		goto end;
-	}
-	/* Fall through. */
+	if (error)
+		goto fail;
+
+	error = set_receive_timeout();
+	if (error)
+		goto fail;
+
+	error = reliable_setup(cfg.reliable, cfg.snapshot);
+	if (error)
+		goto fail;
+
+	cJSON_Delete(json);
+	return 0;
 
+fail:
+	close(sk);
+	freeaddrinfo(addr_candidates);
+	/* Fall through. */
 end:
 	cJSON_Delete(json);
 	return error;
@@ -463,27 +546,50 @@ end:
 
 void netsocket_teardown(void)
 {
+	reliable_teardown();
+	netsocket_flush();
 	close(sk);
 	freeaddrinfo(addr_candidates);
 }
 
 void *netsocket_listen(void *arg)
 {
-	char buffer[JOOLD_MAX_PAYLOAD];
-	int bytes;
+	static unsigned char buffers[MMSG_BATCH][DATAGRAM_SIZE];
+	struct iovec iovs[MMSG_BATCH];
+	struct mmsghdr msgs[MMSG_BATCH];
+	int count;
+	int i;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < MMSG_BATCH; i++) {
+		iovs[i].iov_base = buffers[i];
+		iovs[i].iov_len = DATAGRAM_SIZE;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
 
 	syslog(LOG_INFO, "Listening...");
 
 	do {
-		bytes = recv(sk, buffer, sizeof(buffer), 0);
-		if (bytes < 0) {
-			pr_perror("Error receiving packet from the network",
-					errno);
-			continue;
+		/* Block until there's one, then take whatever else is queued. */
+		count = recvmmsg(sk, msgs, MMSG_BATCH, MSG_WAITFORONE, NULL);
+		if (count < 0) {
+			/* SO_RCVTIMEO expired; it's just the tick. */
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				pr_perror("Error receiving packet from the network",
+						errno);
+			count = 0;
 		}
 
-		syslog(LOG_DEBUG, "Received %d bytes from the network.", bytes);
-		modsocket_send(buffer, bytes);
+		if (count)
+			syslog(LOG_DEBUG, "Received %d datagram(s) from the network.",
+					count);
+		for (i = 0; i < count; i++)
+			reliable_receive(buffers[i], msgs[i].msg_len);
+
+		reliable_tick();
+		modsocket_flush();
+		netsocket_flush();
 	} while (true);
 
 	return NULL;
@@ -491,14 +597,73 @@ void *netsocket_listen(void *arg)
 
 void netsocket_send(void *buffer, size_t size)
 {
-	int bytes;
-
-	syslog(LOG_DEBUG, "Sending %zu bytes to the network...", size);
-	bytes = sendto(sk, buffer, size, 0,
-			bound_address->ai_addr,
-			bound_address->ai_addrlen);
-	if (bytes < 0)
-		pr_perror("Could not send a packet to the network", errno);
-	else
-		syslog(LOG_DEBUG, "Sent %d bytes to the network.\n", bytes);
+	reliable_send(buffer, size);
+}
+
+void netsocket_ad_end(void)
+{
+	reliable_ad_end();
+}
+
+/* Call with @out_lock held. */
+static void __flush(void)
+{
+	unsigned int i;
+	int sent;
+
+	for (i = 0; i < out_count; i += sent) {
+		sent = sendmmsg(sk, &out_msgs[i], out_count - i, 0);
+		if (sent < 0) {
+			pr_perror("Could not send a packet to the network",
+					errno);
+			/* Skip the offending datagram; retrying won't help. */
+			sent = 1;
+			continue;
+		}
+		syslog(LOG_DEBUG, "Sent %d datagram(s) to the network.", sent);
+	}
+
+	out_count = 0;
+}
+
+/*
+ * Queues @buffer. It will be sent during the next netsocket_flush(), or
+ * sooner if the queue fills up.
+ */
+void netsocket_send_raw(void *buffer, size_t size)
+{
+	struct mmsghdr *msg;
+
+	if (size > DATAGRAM_SIZE) {
+		syslog(LOG_ERR, "Dropping a %zu-byte datagram; the maximum is %zu.",
+				size, DATAGRAM_SIZE);
+		return;
+	}
+
+	pthread_mutex_lock(&out_lock);
+
+	if (out_count >= MMSG_BATCH)
+		__flush();
+
+	memcpy(out_buffers[out_count], buffer, size);
+	out_iovs[out_count].iov_base = out_buffers[out_count];
+	out_iovs[out_count].iov_len = size;
+
+	msg = &out_msgs[out_count];
+	memset(msg, 0, sizeof(*msg));
+	msg->msg_hdr.msg_name = bound_address->ai_addr;
+	msg->msg_hdr.msg_namelen = bound_address->ai_addrlen;
+	msg->msg_hdr.msg_iov = &out_iovs[out_count];
+	msg->msg_hdr.msg_iovlen = 1;
+	out_count++;
+
+	pthread_mutex_unlock(&out_lock);
+}
+
+/* Sends everything netsocket_send_raw() queued, in few syscalls. */
+void netsocket_flush(void)
+{
+	pthread_mutex_lock(&out_lock);
+	__flush();
+	pthread_mutex_unlock(&out_lock);
 }
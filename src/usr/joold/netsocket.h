@@ -12,5 +12,10 @@ void netsocket_teardown(void);
 
 void *netsocket_listen(void *arg);
 void netsocket_send(void *buffer, size_t size);
+/* Like netsocket_send(), except it bypasses the reliable transport. */
+void netsocket_send_raw(void *buffer, size_t size);
+void netsocket_flush(void);
+/* The kernel finished an advertisement. */
+void netsocket_ad_end(void);
 
 #endif /* SRC_USR_JOOLD_NETSOCKET_H_ */
@@ -0,0 +1,816 @@
+#include "usr/joold/reliable.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/random.h>
+
+#include "common/config.h"
+#include "usr/joold/log.h"
+#include "usr/joold/modsocket.h"
+#include "usr/joold/netsocket.h"
+
+/* Maximum number of peers whose sequences we track at the same time. */
+#define MAX_PEERS 32
+/* Minimum seconds between repeated NACKs aimed at the same peer. */
+#define NACK_INTERVAL 1
+/* Minimum seconds between resyncs. */
+#define RESYNC_INTERVAL 5
+/* Minimum seconds between statistic dumps. */
+#define STATS_INTERVAL 10
+/* Seconds between snapshot requests, while nobody answers them. */
+#define SNAPSHOT_RETRY 2
+/* Snapshot requests we send before giving up and starting empty. */
+#define SNAPSHOT_ATTEMPTS 5
+/* Seconds a snapshot can go without progress before it is abandoned. */
+#define SNAPSHOT_TIMEOUT 30
+/* Datagrams from other peers we hold back while a snapshot is in progress. */
+#define SNAPSHOT_HOLD 1024
+
+struct replay_slot {
+	__u32 seq;
+	/* Zero means the slot has never been used. */
+	size_t size;
+	unsigned char datagram[sizeof(struct jrl_hdr) + JOOLD_MAX_PAYLOAD];
+};
+
+struct peer {
+	/* Zero means the slot is unused. */
+	__u32 id;
+	/* Sequence number we expect to receive next from this peer. */
+	__u32 next;
+	/*
+	 * Bit i is set if datagram (@next - 1 - i) has not arrived yet.
+	 * (Bit 0 is only set when a SNAPSHOT_END reveals that the newest
+	 * datagrams of a snapshot were lost.)
+	 */
+	__u64 missing;
+	time_t last_seen;
+	time_t last_nack;
+};
+
+struct reliable_stats {
+	/* Datagrams that fell out of the window before they could be filled. */
+	unsigned long long lost;
+	/* Holes that were filled by a retransmission. */
+	unsigned long long recovered;
+	/* Datagrams we resent because a peer asked for them. */
+	unsigned long long retransmitted;
+	/* Datagrams we received more than once. */
+	unsigned long long duplicate;
+	/* Advertisements we requested because a NACK fell out of our buffer. */
+	unsigned long long resyncs;
+};
+
+enum snapshot_state {
+	SNAP_IDLE,
+	/* We sent a request, and nobody has answered yet. */
+	SNAP_WAITING,
+	/* Some peer is sending us its database. */
+	SNAP_RECEIVING,
+};
+
+/* A datagram we postponed until the snapshot is done. */
+struct held_datagram {
+	size_t size;
+	unsigned char payload[];
+};
+
+/* The snapshot we are receiving. */
+struct snapshot_rx {
+	enum snapshot_state state;
+	unsigned int attempts;
+	/* Last time we sent a request, or the snapshot made progress. */
+	time_t last_event;
+
+	/* The peer that is sending the snapshot. */
+	__u32 source;
+	/* Sequence number of the snapshot's first datagram. */
+	__u32 first;
+	/* Datagrams of the snapshot received so far, and their checksum. */
+	__u32 received;
+	__u32 sum;
+	/* What SNAPSHOT_END promised. Only meaningful if @end_known. */
+	bool end_known;
+	__u32 count;
+	__u32 expected_sum;
+
+	/* Updates from other peers, applied once the snapshot is done. */
+	struct held_datagram *held[SNAPSHOT_HOLD];
+	unsigned int held_count;
+	/* We ran out of room in @held, and gave up on postponing. */
+	bool overflow;
+};
+
+/* The snapshot we are serving. */
+struct snapshot_tx {
+	bool active;
+	__u32 requester;
+	__u32 first;
+	__u32 sum;
+	time_t started;
+};
+
+static bool enabled;
+/* Our ID. Peers use it to tell our sequence apart from everyone else's. */
+static __u32 self;
+
+/* Protects everything below, up to (and excluding) @peers. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static __u32 next_seq;
+static struct replay_slot replay[JRL_WINDOW];
+static struct reliable_stats stats;
+static struct reliable_stats logged;
+static time_t last_stats;
+static time_t last_resync;
+static struct snapshot_tx tx;
+
+/* Only touched by the network listener thread; needs no locking. */
+static struct peer peers[MAX_PEERS];
+static struct snapshot_rx rx;
+
+static time_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/* Serial number arithmetic (RFC 1982), so wraparound does not confuse us. */
+static bool seq_before(__u32 seq1, __u32 seq2)
+{
+	return ((__s32)(seq1 - seq2)) < 0;
+}
+
+static void init_hdr(struct jrl_hdr *hdr, enum jrl_type type, __u32 target,
+		__u32 seq, __u32 count)
+{
+	hdr->magic[0] = JRL_MAGIC0;
+	hdr->magic[1] = JRL_MAGIC1;
+	hdr->version = JRL_VERSION;
+	hdr->type = type;
+	hdr->sender = htonl(self);
+	hdr->target = htonl(target);
+	hdr->seq = htonl(seq);
+	hdr->count = htonl(count);
+}
+
+/*
+ * Plain bitwise CRC32 (the one from Ethernet and zlib). Snapshots are rare,
+ * and the datagrams are small, so a table would not be worth its memory.
+ */
+static __u32 crc32(void *buffer, size_t size)
+{
+	unsigned char *bytes = buffer;
+	__u32 crc;
+	size_t i;
+	int bit;
+
+	crc = 0xFFFFFFFFu;
+	for (i = 0; i < size; i++) {
+		crc ^= bytes[i];
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+	}
+
+	return ~crc;
+}
+
+/* Call with @lock held. */
+static void log_stats(bool force)
+{
+	time_t t;
+
+	t = now();
+	if (!force) {
+		if (!memcmp(&stats, &logged, sizeof(stats)))
+			return;
+		if (t - last_stats < STATS_INTERVAL)
+			return;
+	}
+
+	syslog(LOG_INFO, "Sync stats: %llu lost, %llu recovered, %llu retransmitted, %llu duplicate, %llu resyncs.",
+			stats.lost, stats.recovered, stats.retransmitted,
+			stats.duplicate, stats.resyncs);
+	logged = stats;
+	last_stats = t;
+}
+
+int reliable_setup(bool enable, bool snapshot)
+{
+	enabled = enable;
+
+	/* Receivers need an ID too, so their NACKs are not mistaken. */
+	do {
+		if (getrandom(&self, sizeof(self), 0) != sizeof(self)) {
+			pr_perror("getrandom() failed", errno);
+			return 1;
+		}
+	} while (self == 0);
+
+	if (enabled)
+		syslog(LOG_INFO, "Reliable transport enabled. My ID is %08x.",
+				self);
+	else
+		syslog(LOG_INFO, "Reliable transport disabled.");
+
+	if (snapshot && !enabled)
+		syslog(LOG_WARNING, "Snapshots need the reliable transport; I will not request one.");
+	/* The request itself is sent by the first reliable_tick(). */
+	if (snapshot && enabled)
+		rx.state = SNAP_WAITING;
+
+	return 0;
+}
+
+/* Empties @rx's hold, handing everything to the kernel. */
+static void release_held(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < rx.held_count; i++) {
+		modsocket_send(rx.held[i]->payload, rx.held[i]->size);
+		free(rx.held[i]);
+	}
+	rx.held_count = 0;
+}
+
+void reliable_teardown(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < rx.held_count; i++)
+		free(rx.held[i]);
+	rx.held_count = 0;
+
+	pthread_mutex_lock(&lock);
+	log_stats(true);
+	pthread_mutex_unlock(&lock);
+}
+
+void reliable_send(void *payload, size_t size)
+{
+	struct replay_slot *slot;
+	struct jrl_hdr hdr;
+
+	if (!enabled) {
+		netsocket_send_raw(payload, size);
+		return;
+	}
+
+	if (size > JOOLD_MAX_PAYLOAD) {
+		syslog(LOG_ERR, "Dropping a %zu-byte payload; the maximum is %u.",
+				size, JOOLD_MAX_PAYLOAD);
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+
+	slot = &replay[next_seq % JRL_WINDOW];
+	init_hdr(&hdr, JRL_DATA, 0, next_seq, 0);
+	memcpy(slot->datagram, &hdr, sizeof(hdr));
+	memcpy(slot->datagram + sizeof(hdr), payload, size);
+	slot->seq = next_seq;
+	slot->size = sizeof(hdr) + size;
+	next_seq++;
+	if (tx.active)
+		tx.sum += crc32(payload, size);
+
+	netsocket_send_raw(slot->datagram, slot->size);
+	log_stats(false);
+
+	pthread_mutex_unlock(&lock);
+}
+
+/* Call with @lock held. Returns whether the caller should advertise. */
+static bool should_resync(void)
+{
+	time_t t;
+
+	t = now();
+	if (t - last_resync < RESYNC_INTERVAL)
+		return false;
+
+	last_resync = t;
+	stats.resyncs++;
+	return true;
+}
+
+static void handle_nack(struct jrl_hdr *hdr)
+{
+	struct replay_slot *slot;
+	__u32 seq, count, i;
+	bool resync;
+
+	if (!enabled || ntohl(hdr->target) != self)
+		return;
+
+	seq = ntohl(hdr->seq);
+	count = ntohl(hdr->count);
+	if (count == 0)
+		return;
+
+	syslog(LOG_DEBUG, "Peer %08x wants %u datagram(s) starting at #%u.",
+			ntohl(hdr->sender), count, seq);
+
+	pthread_mutex_lock(&lock);
+
+	resync = true;
+	if (count > JRL_WINDOW)
+		goto end;
+	/* All or nothing; a partial retransmission would not fix the gap. */
+	for (i = 0; i < count; i++) {
+		slot = &replay[(seq + i) % JRL_WINDOW];
+		if (slot->size == 0 || slot->seq != seq + i)
+			goto end;
+	}
+
+	for (i = 0; i < count; i++) {
+		slot = &replay[(seq + i) % JRL_WINDOW];
+		netsocket_send_raw(slot->datagram, slot->size);
+	}
+	stats.retransmitted += count;
+	resync = false;
+	/* Fall through. */
+
+end:
+	if (resync)
+		resync = should_resync();
+	log_stats(false);
+	pthread_mutex_unlock(&lock);
+
+	/*
+	 * The kernel answers by queuing its entire database, which then comes
+	 * back to us through reliable_send(). So we must not hold @lock.
+	 */
+	if (resync) {
+		syslog(LOG_INFO, "Peer %08x lost datagrams I no longer have; resynchronizing.",
+				ntohl(hdr->sender));
+		modsocket_advertise();
+	}
+}
+
+static void handle_snapshot_req(struct jrl_hdr *hdr)
+{
+	struct jrl_hdr begin;
+	__u32 requester;
+	__u32 target;
+	bool start;
+
+	target = ntohl(hdr->target);
+	if (!enabled || (target != 0 && target != self))
+		return;
+	requester = ntohl(hdr->sender);
+
+	pthread_mutex_lock(&lock);
+
+	/* One snapshot at a time; whoever else asked will ask again. */
+	start = !tx.active || now() - tx.started >= SNAPSHOT_TIMEOUT;
+	if (start) {
+		tx.active = true;
+		tx.requester = requester;
+		tx.first = next_seq;
+		tx.sum = 0;
+		tx.started = now();
+		init_hdr(&begin, JRL_SNAPSHOT_BEGIN, requester, tx.first, 0);
+		netsocket_send_raw(&begin, sizeof(begin));
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	if (!start) {
+		syslog(LOG_DEBUG, "Peer %08x wants a snapshot, but I'm already serving one.",
+				requester);
+		return;
+	}
+
+	/* Same as handle_nack(): the advertisement comes back through us. */
+	syslog(LOG_INFO, "Peer %08x requested a snapshot; advertising.",
+			requester);
+	modsocket_advertise();
+}
+
+void reliable_ad_end(void)
+{
+	unsigned char end[sizeof(struct jrl_hdr) + sizeof(__be32)];
+	struct jrl_hdr hdr;
+	__be32 sum;
+	__u32 requester;
+	__u32 count;
+
+	pthread_mutex_lock(&lock);
+
+	if (!tx.active) {
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+
+	requester = tx.requester;
+	count = next_seq - tx.first;
+	init_hdr(&hdr, JRL_SNAPSHOT_END, requester, tx.first, count);
+	sum = htonl(tx.sum);
+	memcpy(end, &hdr, sizeof(hdr));
+	memcpy(end + sizeof(hdr), &sum, sizeof(sum));
+	netsocket_send_raw(end, sizeof(end));
+	tx.active = false;
+
+	pthread_mutex_unlock(&lock);
+
+	syslog(LOG_INFO, "Snapshot for peer %08x sent: %u datagram(s).",
+			requester, count);
+}
+
+static struct peer *get_peer(__u32 id, __u32 seq)
+{
+	struct peer *victim;
+	unsigned int i;
+
+	/* Prefer unused slots; otherwise evict whoever went quiet first. */
+	victim = NULL;
+	for (i = 0; i < MAX_PEERS; i++) {
+		if (peers[i].id == id)
+			return &peers[i];
+		if (!victim || (victim->id != 0 && (peers[i].id == 0
+				|| peers[i].last_seen < victim->last_seen)))
+			victim = &peers[i];
+	}
+
+	/*
+	 * New peer, or one that restarted. We cannot know what it sent before
+	 * we heard from it, so start tracking it from here.
+	 */
+	syslog(LOG_INFO, "Now tracking peer %08x.", id);
+	memset(victim, 0, sizeof(*victim));
+	victim->id = id;
+	victim->next = seq;
+	return victim;
+}
+
+static void send_nack(struct peer *peer, __u32 seq, __u32 count, time_t t)
+{
+	struct jrl_hdr hdr;
+
+	syslog(LOG_DEBUG, "Asking peer %08x for %u datagram(s) starting at #%u.",
+			peer->id, count, seq);
+	init_hdr(&hdr, JRL_NACK, peer->id, seq, count);
+	netsocket_send_raw(&hdr, sizeof(hdr));
+	peer->last_nack = t;
+}
+
+/*
+ * Moves @peer's window so @seq is its newest datagram. Marks everything in
+ * between as missing. Returns the number of datagrams that were left behind
+ * by the window.
+ */
+static unsigned int advance(struct peer *peer, __u32 seq)
+{
+	__u32 gap;
+	unsigned int lost;
+
+	gap = seq - peer->next;
+	if (gap + 1 >= 64) {
+		lost = __builtin_popcountll(peer->missing);
+		peer->missing = 0;
+	} else {
+		lost = __builtin_popcountll(peer->missing >> (63 - gap));
+		peer->missing <<= gap + 1;
+	}
+
+	if (gap > 63) {
+		lost += gap - 63;
+		gap = 63;
+	}
+	if (gap)
+		peer->missing |= ((1ULL << gap) - 1) << 1;
+
+	peer->next = seq + 1;
+	return lost;
+}
+
+/* Returns whether @seq was a hole in @peer's window (and fills it). */
+static bool fill_hole(struct peer *peer, __u32 seq)
+{
+	__u32 index;
+
+	index = peer->next - 1 - seq;
+	if (index >= 64 || !(peer->missing & (1ULL << index)))
+		return false;
+
+	peer->missing &= ~(1ULL << index);
+	return true;
+}
+
+/* Asks again for every hole that is still open in @peer's window. */
+static void renack(struct peer *peer, time_t t)
+{
+	int i, first;
+
+	if (!peer->missing || t - peer->last_nack < NACK_INTERVAL)
+		return;
+
+	/* Oldest first. */
+	for (i = 63; i >= 0; i--) {
+		if (!(peer->missing & (1ULL << i)))
+			continue;
+		for (first = i; i >= 0 && (peer->missing & (1ULL << i)); i--)
+			;
+		send_nack(peer, peer->next - 1 - first, first - i, t);
+	}
+}
+
+/*
+ * Returns the peer we heard from most recently, or zero if we have not heard
+ * from anyone. Asking someone specific keeps the rest of the cluster from
+ * answering as well.
+ */
+static __u32 pick_source(void)
+{
+	struct peer *best;
+	unsigned int i;
+
+	best = NULL;
+	for (i = 0; i < MAX_PEERS; i++)
+		if (peers[i].id != 0
+				&& (!best || peers[i].last_seen > best->last_seen))
+			best = &peers[i];
+
+	return best ? best->id : 0;
+}
+
+static void request_snapshot(time_t t)
+{
+	struct jrl_hdr hdr;
+	__u32 target;
+
+	if (rx.attempts >= SNAPSHOT_ATTEMPTS) {
+		syslog(LOG_INFO, "Nobody sent me a snapshot; starting with whatever the network brings.");
+		rx.state = SNAP_IDLE;
+		return;
+	}
+
+	rx.state = SNAP_WAITING;
+	rx.attempts++;
+	rx.last_event = t;
+
+	/* Alternate with open requests, in case our favorite peer is gone. */
+	target = (rx.attempts % 2) ? pick_source() : 0;
+	syslog(LOG_INFO, "Requesting a session snapshot from %08x (attempt %u of %u).",
+			target, rx.attempts, SNAPSHOT_ATTEMPTS);
+	init_hdr(&hdr, JRL_SNAPSHOT_REQ, target, 0, 0);
+	netsocket_send_raw(&hdr, sizeof(hdr));
+}
+
+/* Concludes the current snapshot, if everything it promised has arrived. */
+static void check_snapshot(void)
+{
+	if (rx.state != SNAP_RECEIVING || !rx.end_known)
+		return;
+	if (rx.received < rx.count)
+		return;
+
+	release_held();
+
+	if (rx.sum != rx.expected_sum) {
+		syslog(LOG_ERR, "Snapshot from peer %08x failed its checksum; requesting another one.",
+				rx.source);
+		request_snapshot(now());
+		return;
+	}
+
+	syslog(LOG_INFO, "Snapshot from peer %08x complete: %u datagram(s).",
+			rx.source, rx.count);
+	rx.state = SNAP_IDLE;
+}
+
+static void handle_snapshot_begin(struct jrl_hdr *hdr)
+{
+	if (rx.state != SNAP_WAITING || ntohl(hdr->target) != self)
+		return;
+
+	rx.state = SNAP_RECEIVING;
+	rx.last_event = now();
+	rx.source = ntohl(hdr->sender);
+	rx.first = ntohl(hdr->seq);
+	rx.received = 0;
+	rx.sum = 0;
+	rx.end_known = false;
+	rx.overflow = false;
+
+	/* So a lost first datagram is still recognized as a hole. */
+	get_peer(rx.source, rx.first);
+	syslog(LOG_INFO, "Receiving a snapshot from peer %08x.", rx.source);
+}
+
+static void handle_snapshot_end(struct jrl_hdr *hdr, void *payload,
+		size_t size)
+{
+	struct peer *peer;
+	__be32 sum;
+	__u32 end;
+	unsigned int lost;
+	time_t t;
+
+	if (rx.state != SNAP_RECEIVING || ntohl(hdr->sender) != rx.source)
+		return;
+	if (ntohl(hdr->seq) != rx.first || size < sizeof(sum))
+		return;
+
+	t = now();
+	memcpy(&sum, payload, sizeof(sum));
+	rx.end_known = true;
+	rx.count = ntohl(hdr->count);
+	rx.expected_sum = ntohl(sum);
+	rx.last_event = t;
+
+	/*
+	 * If the snapshot's tail got lost, nothing else would tell us, since
+	 * there are no later datagrams to reveal the gap.
+	 */
+	peer = get_peer(rx.source, rx.first);
+	end = rx.first + rx.count;
+	if (rx.count && seq_before(peer->next, end)) {
+		lost = advance(peer, end - 1);
+		peer->missing |= 1;
+		if (lost) {
+			pthread_mutex_lock(&lock);
+			stats.lost += lost;
+			pthread_mutex_unlock(&lock);
+		}
+		peer->last_nack = 0;
+		renack(peer, t);
+	}
+
+	check_snapshot();
+}
+
+/*
+ * Accounts for a datagram we are about to deliver, if it belongs to the
+ * snapshot. Returns true if the datagram was postponed instead.
+ */
+static bool snapshot_filter(__u32 sender, __u32 seq, void *payload,
+		size_t size)
+{
+	struct held_datagram *held;
+
+	if (rx.state != SNAP_RECEIVING)
+		return false;
+
+	if (sender == rx.source) {
+		if (seq_before(seq, rx.first))
+			return false;
+		if (rx.end_known && seq - rx.first >= rx.count)
+			return false;
+		rx.received++;
+		rx.sum += crc32(payload, size);
+		rx.last_event = now();
+		return false;
+	}
+
+	if (rx.overflow)
+		return false;
+	if (rx.held_count >= SNAPSHOT_HOLD) {
+		syslog(LOG_WARNING, "Too many updates arrived during the snapshot; applying them out of order.");
+		release_held();
+		rx.overflow = true;
+		return false;
+	}
+
+	held = malloc(sizeof(*held) + size);
+	if (!held)
+		return false;
+	held->size = size;
+	memcpy(held->payload, payload, size);
+	rx.held[rx.held_count++] = held;
+	return true;
+}
+
+void reliable_tick(void)
+{
+	unsigned int i;
+	time_t t;
+
+	t = now();
+
+	switch (rx.state) {
+	case SNAP_IDLE:
+		break;
+	case SNAP_WAITING:
+		if (rx.attempts == 0 || t - rx.last_event >= SNAPSHOT_RETRY)
+			request_snapshot(t);
+		break;
+	case SNAP_RECEIVING:
+		if (t - rx.last_event >= SNAPSHOT_TIMEOUT) {
+			syslog(LOG_ERR, "Snapshot from peer %08x stalled.",
+					rx.source);
+			release_held();
+			request_snapshot(t);
+		}
+		break;
+	}
+
+	/* In case the retransmissions were lost too. */
+	for (i = 0; i < MAX_PEERS; i++)
+		if (peers[i].id != 0)
+			renack(&peers[i], t);
+
+	pthread_mutex_lock(&lock);
+	log_stats(false);
+	pthread_mutex_unlock(&lock);
+}
+
+static void handle_data(struct jrl_hdr *hdr, void *payload, size_t size)
+{
+	struct peer *peer;
+	__u32 seq;
+	__u32 expected;
+	unsigned int lost;
+	bool deliver;
+	time_t t;
+
+	t = now();
+	seq = ntohl(hdr->seq);
+	peer = get_peer(ntohl(hdr->sender), seq);
+	peer->last_seen = t;
+
+	expected = peer->next;
+	if (seq_before(seq, expected)) {
+		deliver = fill_hole(peer, seq);
+		pthread_mutex_lock(&lock);
+		if (deliver)
+			stats.recovered++;
+		else
+			stats.duplicate++;
+		log_stats(false);
+		pthread_mutex_unlock(&lock);
+		if (!deliver)
+			return;
+
+	} else {
+		lost = advance(peer, seq);
+		if (lost) {
+			pthread_mutex_lock(&lock);
+			stats.lost += lost;
+			pthread_mutex_unlock(&lock);
+		}
+		if (seq != expected)
+			send_nack(peer, expected, seq - expected, t);
+	}
+
+	if (!snapshot_filter(peer->id, seq, payload, size))
+		modsocket_send(payload, size);
+	renack(peer, t);
+	check_snapshot();
+}
+
+void reliable_receive(void *datagram, size_t size)
+{
+	struct jrl_hdr hdr;
+
+	/*
+	 * Unframed payloads start with either the session record magic or a
+	 * Netlink attribute length. The latter would have to be absurdly large
+	 * to collide with our magic.
+	 */
+	if (size < sizeof(hdr)
+			|| ((__u8 *)datagram)[0] != JRL_MAGIC0
+			|| ((__u8 *)datagram)[1] != JRL_MAGIC1) {
+		modsocket_send(datagram, size);
+		return;
+	}
+
+	memcpy(&hdr, datagram, sizeof(hdr));
+	if (hdr.version != JRL_VERSION) {
+		syslog(LOG_DEBUG, "Dropping datagram with unknown version %u.",
+				hdr.version);
+		return;
+	}
+	if (ntohl(hdr.sender) == self)
+		return;
+
+	switch (hdr.type) {
+	case JRL_DATA:
+		handle_data(&hdr, (__u8 *)datagram + sizeof(hdr),
+				size - sizeof(hdr));
+		return;
+	case JRL_NACK:
+		handle_nack(&hdr);
+		return;
+	case JRL_SNAPSHOT_REQ:
+		handle_snapshot_req(&hdr);
+		return;
+	case JRL_SNAPSHOT_BEGIN:
+		handle_snapshot_begin(&hdr);
+		return;
+	case JRL_SNAPSHOT_END:
+		handle_snapshot_end(&hdr, (__u8 *)datagram + sizeof(hdr),
+				size - sizeof(hdr));
+		return;
+	}
+
+	syslog(LOG_DEBUG, "Dropping datagram with unknown type %u.", hdr.type);
+}
@@ -0,0 +1,89 @@
+#ifndef SRC_USR_JOOLD_RELIABLE_H_
+#define SRC_USR_JOOLD_RELIABLE_H_
+
+/**
+ * Loss detection and recovery for the traffic exchanged between joolds.
+ *
+ * Every datagram we multicast is prefixed with a struct jrl_hdr, which
+ * numbers it within a sequence that belongs to the sending daemon. Receivers
+ * track the sequence of each peer, and multicast a NACK whenever they notice
+ * a gap. The sender answers NACKs from a small replay buffer of its most
+ * recent datagrams; if the requested datagrams are no longer there, it falls
+ * back to asking its kernel module to advertise its sessions again.
+ *
+ * Datagrams that do not start with the magic are assumed to come from older
+ * joolds, and are handed to the kernel untouched.
+ *
+ * The same framing also bootstraps freshly started daemons: they multicast a
+ * snapshot request, and one of their peers answers by advertising its entire
+ * database. The peer closes the snapshot with the number of datagrams it
+ * comprised and their checksum, so the requester can tell whether it got all
+ * of it. Meanwhile, the requester holds back the updates it receives from
+ * everyone else, so the snapshot cannot overwrite them with older data.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/types.h>
+
+#define JRL_MAGIC0 'J'
+#define JRL_MAGIC1 'R'
+#define JRL_VERSION 1
+
+/**
+ * Number of datagrams the sender remembers, and also the size of the window
+ * in which receivers can still fill holes. Gaps wider than this force a
+ * resync.
+ */
+#define JRL_WINDOW 64
+
+enum jrl_type {
+	/* Session payload. @seq is its number. */
+	JRL_DATA = 1,
+	/* Retransmission request for [@seq, @seq + @count), aimed at @target. */
+	JRL_NACK = 2,
+	/* Request for a snapshot, aimed at @target. (Zero means anyone.) */
+	JRL_SNAPSHOT_REQ = 3,
+	/* Snapshot for @target starts with datagram @seq. */
+	JRL_SNAPSHOT_BEGIN = 4,
+	/*
+	 * The snapshot that started at @seq comprised @count datagrams.
+	 * Followed by a __be32: the sum of the CRC32s of their payloads.
+	 */
+	JRL_SNAPSHOT_END = 5,
+};
+
+/* All fields are in network byte order. */
+struct jrl_hdr {
+	__u8 magic[2];
+	__u8 version;
+	/* enum jrl_type */
+	__u8 type;
+	/* Random ID the sending daemon picked during startup. */
+	__be32 sender;
+	/* NACK and snapshots only: ID of the daemon the message is aimed at. */
+	__be32 target;
+	__be32 seq;
+	/* NACK and SNAPSHOT_END only: number of datagrams. */
+	__be32 count;
+};
+
+int reliable_setup(bool enabled, bool snapshot);
+void reliable_teardown(void);
+
+/*
+ * Frames @payload, remembers the result in the replay buffer and sends it.
+ * (Or sends @payload naked, if the layer is disabled.)
+ */
+void reliable_send(void *payload, size_t size);
+/* Handles a datagram received from the network. */
+void reliable_receive(void *datagram, size_t size);
+/* The kernel finished advertising its sessions; closes the snapshot, if any. */
+void reliable_ad_end(void);
+/*
+ * Housekeeping: retries NACKs and snapshot requests, gives up on stalled
+ * snapshots. Call it regularly from the network listener thread.
+ */
+void reliable_tick(void);
+
+#endif /* SRC_USR_JOOLD_RELIABLE_H_ */
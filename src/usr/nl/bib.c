@@ -8,10 +8,9 @@
 struct foreach_args {
 	joolnl_bib_foreach_cb cb;
 	void *args;
-	bool done;
-	struct bib_entry last;
 };
 
+/* Called once per packet of the dump. */
 static struct jool_result handle_foreach_response(struct nl_msg *response,
 		void *arg)
 {
@@ -19,9 +18,11 @@ static struct jool_result handle_foreach_response(struct nl_msg *response,
 	struct nlattr *attr;
 	int rem;
 	struct bib_entry entry;
+	bool done;
 	struct jool_result result;
 
-	result = joolnl_init_foreach_list(response, "bib", &args->done);
+	/* Netlink itself tells us when the dump is over; ignore @done. */
+	result = joolnl_init_foreach_list(response, "bib", &done);
 	if (result.error)
 		return result;
 
@@ -33,8 +34,6 @@ static struct jool_result handle_foreach_response(struct nl_msg *response,
 		result = args->cb(&entry, args->args);
 		if (result.error)
 			return result;
-
-		memcpy(&args->last, &entry, sizeof(entry));
 	}
 
 	return result_success();
@@ -46,38 +45,20 @@ struct jool_result joolnl_bib_foreach(struct joolnl_socket *sk, char const *inam
 	struct nl_msg *msg;
 	struct foreach_args args;
 	struct jool_result result;
-	bool first_request;
 
 	args.cb = cb;
 	args.args = _args;
-	args.done = true;
-	memset(&args.last, 0, sizeof(args.last));
-	first_request = true;
-
-	do {
-		result = joolnl_alloc_msg(sk, iname, JNLOP_BIB_FOREACH, 0, &msg);
-		if (result.error)
-			return result;
-
-		if (first_request) {
-			if (nla_put_u8(msg, JNLAR_PROTO, proto) < 0)
-				goto cancel;
-			first_request = false;
 
-		} else if (nla_put_bib(msg, JNLAR_OFFSET, &args.last) < 0) {
-			goto cancel;
-		}
-
-		result = joolnl_request(sk, msg, handle_foreach_response, &args);
-		if (result.error)
-			return result;
-	} while (!args.done);
+	result = joolnl_alloc_msg(sk, iname, JNLOP_BIB_FOREACH, 0, &msg);
+	if (result.error)
+		return result;
 
-	return result_success();
+	if (nla_put_u8(msg, JNLAR_PROTO, proto) < 0) {
+		nlmsg_free(msg);
+		return joolnl_err_msgsize();
+	}
 
-cancel:
-	nlmsg_free(msg);
-	return joolnl_err_msgsize();
+	return joolnl_dump(sk, msg, handle_foreach_response, &args);
 }
 
 static struct jool_result __update(struct joolnl_socket *sk, char const *iname,
@@ -119,3 +100,31 @@ struct jool_result joolnl_bib_rm(struct joolnl_socket *sk,
 {
 	return __update(sk, iname, JNLOP_BIB_RM, a6, a4, proto);
 }
+
+static int put_bib(struct nl_msg *msg, int attrtype, void const *entry)
+{
+	return nla_put_bib(msg, attrtype, entry);
+}
+
+/* See joolnl_bulk_request(). */
+struct jool_result joolnl_bib_add_many(struct joolnl_socket *sk,
+		char const *iname, struct bib_entry const *entries,
+		unsigned int count, __u16 *results)
+{
+	return joolnl_bulk_request(sk, iname, JNLOP_BIB_ADD, 0,
+			JNLAR_BIB_ENTRIES, entries, sizeof(*entries), count,
+			put_bib, results);
+}
+
+/*
+ * See joolnl_bulk_request().
+ * Unlike joolnl_bib_rm(), both transport addresses of every entry must match.
+ */
+struct jool_result joolnl_bib_rm_many(struct joolnl_socket *sk,
+		char const *iname, struct bib_entry const *entries,
+		unsigned int count, __u16 *results)
+{
+	return joolnl_bulk_request(sk, iname, JNLOP_BIB_RM, 0,
+			JNLAR_BIB_ENTRIES, entries, sizeof(*entries), count,
+			put_bib, results);
+}
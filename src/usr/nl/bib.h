@@ -32,4 +32,20 @@ struct jool_result joolnl_bib_rm(
 	l4_protocol proto
 );
 
+struct jool_result joolnl_bib_add_many(
+	struct joolnl_socket *sk,
+	char const *iname,
+	struct bib_entry const *entries,
+	unsigned int count,
+	__u16 *results
+);
+
+struct jool_result joolnl_bib_rm_many(
+	struct joolnl_socket *sk,
+	char const *iname,
+	struct bib_entry const *entries,
+	unsigned int count,
+	__u16 *results
+);
+
 #endif /* SRC_USR_NL_BIB_H_ */
@@ -1,5 +1,8 @@
 #include "usr/nl/common.h"
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <netlink/errno.h>
 #include <netlink/msg.h>
 #include <netlink/genl/genl.h>
@@ -53,3 +56,131 @@ struct jool_result joolnl_init_foreach_list(struct nl_msg *msg,
 		joolnl_struct_list_policy
 	);
 }
+
+/*
+ * Size of the bulk request messages. libnl's default send buffer (which the
+ * kernel doubles) always fits this many bytes.
+ */
+#define BULK_MSG_SIZE (32 * 1024)
+
+struct bulk_args {
+	/* Where the results of the current request go */
+	__u16 *results;
+	/* Number of entries in the current request */
+	unsigned int count;
+};
+
+static struct jool_result handle_bulk_response(struct nl_msg *response,
+		void *arg)
+{
+	struct bulk_args *args = arg;
+	struct genlmsghdr *ghdr;
+	struct nlattr *attr;
+
+	ghdr = genlmsg_hdr(nlmsg_hdr(response));
+	attr = nla_find(genlmsg_attrdata(ghdr, sizeof(struct joolnlhdr)),
+			genlmsg_attrlen(ghdr, sizeof(struct joolnlhdr)),
+			JNLAR_BULK_RESULTS);
+	if (!attr || nla_len(attr) != (int)(args->count * sizeof(__u16))) {
+		return result_from_error(
+			-EINVAL,
+			"The kernel module's bulk response is malformed."
+		);
+	}
+
+	memcpy(args->results, nla_data(attr), nla_len(attr));
+	return result_success();
+}
+
+static struct jool_result bulk_failure(unsigned int index, __u16 code)
+{
+	return result_from_error(
+		-code,
+		"Entry #%u could not be applied: %s",
+		index + 1, strerror(code)
+	);
+}
+
+/**
+ * Sends the @count entries from @entries (whose size is @entry_size each) to
+ * the kernel, as few requests as possible, as the @attrtype list of @op
+ * requests. @put serializes an entry.
+ *
+ * The entries are independent; one failing does not prevent the others from
+ * being applied. The error code of @entries[i] (zero if it was applied) is
+ * written in @results[i]. If @results is NULL, the function returns the error
+ * of the first entry that failed instead.
+ *
+ * The kernel applies each request while holding the table's lock once, so
+ * this is much faster than adding or removing the entries one by one.
+ */
+struct jool_result joolnl_bulk_request(struct joolnl_socket *sk,
+		char const *iname, enum joolnl_operation op, __u8 flags,
+		int attrtype, void const *entries, size_t entry_size,
+		unsigned int count, joolnl_bulk_put_cb put, __u16 *results)
+{
+	struct nl_msg *msg;
+	struct nlattr *root;
+	struct bulk_args args;
+	__u16 *buffer;
+	unsigned int first;
+	unsigned int i;
+	struct jool_result result;
+
+	buffer = NULL;
+	if (!results) {
+		buffer = malloc(JNL_BULK_MAX * sizeof(__u16));
+		if (!buffer)
+			return result_from_enomem();
+	}
+
+	first = 0;
+	while (first < count) {
+		result = joolnl_alloc_msg_size(sk, iname, op, flags,
+				BULK_MSG_SIZE, &msg);
+		if (result.error)
+			goto end;
+
+		root = jnla_nest_start(msg, attrtype);
+		if (!root)
+			goto too_small;
+
+		args.count = 0;
+		while (first + args.count < count && args.count < JNL_BULK_MAX) {
+			if (put(msg, JNLAL_ENTRY, (char const *)entries
+					+ (first + args.count) * entry_size) < 0)
+				break;
+			args.count++;
+		}
+		if (args.count == 0)
+			goto too_small;
+		nla_nest_end(msg, root);
+
+		args.results = results ? (results + first) : buffer;
+		result = joolnl_request(sk, msg, handle_bulk_response, &args);
+		if (result.error)
+			goto end;
+
+		if (!results) {
+			for (i = 0; i < args.count; i++) {
+				if (buffer[i]) {
+					result = bulk_failure(first + i,
+							buffer[i]);
+					goto end;
+				}
+			}
+		}
+
+		first += args.count;
+	}
+
+	result = result_success();
+	goto end;
+
+too_small:
+	nlmsg_free(msg);
+	result = joolnl_err_msgsize();
+end:
+	free(buffer);
+	return result;
+}
@@ -3,6 +3,7 @@
 
 #include <netlink/msg.h>
 #include "usr/util/result.h"
+#include "usr/nl/core.h"
 
 struct jool_result joolnl_err_msgsize(void);
 
@@ -10,4 +11,10 @@ struct jool_result joolnl_init_foreach(struct nl_msg *response, bool *done);
 struct jool_result joolnl_init_foreach_list(struct nl_msg *msg,
 		char const *what, bool *done);
 
+typedef int (*joolnl_bulk_put_cb)(struct nl_msg *, int, void const *);
+struct jool_result joolnl_bulk_request(struct joolnl_socket *sk,
+		char const *iname, enum joolnl_operation op, __u8 flags,
+		int attrtype, void const *entries, size_t entry_size,
+		unsigned int count, joolnl_bulk_put_cb put, __u16 *results);
+
 #endif /* SRC_USR_NL_COMMON_H_ */
@@ -33,6 +33,17 @@ struct response_cb {
 struct jool_result joolnl_alloc_msg(struct joolnl_socket *socket,
 		char const *iname, enum joolnl_operation op, __u8 flags,
 		struct nl_msg **out)
+{
+	return joolnl_alloc_msg_size(socket, iname, op, flags, 0, out);
+}
+
+/**
+ * Like joolnl_alloc_msg(), except the message can hold @size bytes instead of
+ * libnl's default (one page). Zero means the default.
+ */
+struct jool_result joolnl_alloc_msg_size(struct joolnl_socket *socket,
+		char const *iname, enum joolnl_operation op, __u8 flags,
+		size_t size, struct nl_msg **out)
 {
 	struct nl_msg *msg;
 	struct joolnlhdr *hdr;
@@ -42,7 +53,7 @@ struct jool_result joolnl_alloc_msg(struct joolnl_socket *socket,
 	if (error)
 		return result_from_error(error, INAME_VALIDATE_ERRMSG);
 
-	msg = nlmsg_alloc();
+	msg = size ? nlmsg_alloc_size(size) : nlmsg_alloc();
 	if (!msg)
 		return result_from_enomem();
 
@@ -211,18 +222,137 @@ end:
 	return (error < 0) ? error : -error;
 }
 
+static struct jool_result __send(struct joolnl_socket *socket,
+		struct nl_msg *msg)
+{
+	int error;
+
+	error = nl_send_auto(socket->sk, msg);
+	nlmsg_free(msg);
+	if (error < 0) {
+		return result_from_error(
+			error,
+			"Could not dispatch the request to kernelspace: %s",
+			nl_geterror(error)
+		);
+	}
+
+	return result_success();
+}
+
+/* Collects the oldest pending response of @socket's batch. */
+static void batch_collect(struct joolnl_socket *socket)
+{
+	struct joolnl_batch *batch = socket->batch;
+	struct jool_result result;
+	unsigned int tag;
+
+	tag = batch->tags[batch->first];
+	batch->first = (batch->first + 1) % JOOLNL_BATCH_WINDOW;
+	batch->count--;
+
+	result = joolnl_recv(socket, NULL, NULL);
+	batch->cb(tag, &result, batch->arg);
+}
+
+/* Consumes @msg, even on error. */
+static struct jool_result batch_send(struct joolnl_socket *socket,
+		struct nl_msg *msg)
+{
+	struct joolnl_batch *batch = socket->batch;
+	struct jool_result result;
+
+	if (batch->count >= JOOLNL_BATCH_WINDOW)
+		batch_collect(socket);
+
+	result = __send(socket, msg);
+	if (result.error)
+		return result;
+
+	batch->tags[(batch->first + batch->count) % JOOLNL_BATCH_WINDOW]
+			= batch->tag;
+	batch->count++;
+	return result_success();
+}
+
+/**
+ * Puts @socket in batch mode. (See struct joolnl_batch.) @batch needs to
+ * survive until joolnl_batch_end().
+ */
+void joolnl_batch_start(struct joolnl_socket *socket,
+		struct joolnl_batch *batch, joolnl_batch_cb cb, void *arg)
+{
+	memset(batch, 0, sizeof(*batch));
+	batch->cb = cb;
+	batch->arg = arg;
+	socket->batch = batch;
+}
+
+/* Collects every pending response. */
+void joolnl_batch_flush(struct joolnl_socket *socket)
+{
+	if (!socket->batch)
+		return;
+	while (socket->batch->count > 0)
+		batch_collect(socket);
+}
+
+void joolnl_batch_end(struct joolnl_socket *socket)
+{
+	joolnl_batch_flush(socket);
+	socket->batch = NULL;
+}
+
 /**
  * @iname can be NULL. The kernel module will assume that the instance name is
  * "" (empty string).
  *
  * Consumes @msg, even on error.
  *
+ * In batch mode, if @cb is NULL, the request is only sent; its result will be
+ * reported to the batch's callback.
+ *
  * WARNING: This function is essentially userspace client boilerplate. It
  * assumes nobody else is editing the socket's callback handlers, and it waits
  * for an ACK. In particular, never use it from joold code.
  */
 struct jool_result joolnl_request(struct joolnl_socket *socket,
 		struct nl_msg *msg, joolnl_response_cb cb, void *cb_arg)
+{
+	struct jool_result result;
+
+	if (socket->batch && !cb)
+		return batch_send(socket, msg);
+
+	result = joolnl_send(socket, msg);
+	if (result.error)
+		return result;
+
+	return joolnl_recv(socket, cb, cb_arg);
+}
+
+/**
+ * First half of joolnl_request(): Sends @msg, but does not wait for the
+ * response. Every successful joolnl_send() must eventually be paired with a
+ * joolnl_recv(); responses arrive in the same order as their requests.
+ *
+ * If the socket is in batch mode, the batch's pending responses are collected
+ * first, so they don't get mixed up with the caller's.
+ *
+ * Consumes @msg, even on error.
+ */
+struct jool_result joolnl_send(struct joolnl_socket *socket, struct nl_msg *msg)
+{
+	joolnl_batch_flush(socket);
+	return __send(socket, msg);
+}
+
+/**
+ * Second half of joolnl_request(): Waits for the response to the oldest
+ * request that has not been collected yet.
+ */
+struct jool_result joolnl_recv(struct joolnl_socket *socket,
+		joolnl_response_cb cb, void *cb_arg)
 {
 	struct response_cb callback;
 	int error;
@@ -236,7 +366,6 @@ struct jool_result joolnl_request(struct joolnl_socket *socket,
 	error = nl_socket_modify_cb(socket->sk, NL_CB_MSG_IN, NL_CB_CUSTOM,
 			response_handler, &callback);
 	if (error < 0) {
-		nlmsg_free(msg);
 		return result_from_error(
 			error,
 			"Could not register response handler: %s\n",
@@ -244,16 +373,6 @@ struct jool_result joolnl_request(struct joolnl_socket *socket,
 		);
 	}
 
-	error = nl_send_auto(socket->sk, msg);
-	nlmsg_free(msg);
-	if (error < 0) {
-		return result_from_error(
-			error,
-			"Could not dispatch the request to kernelspace: %s",
-			nl_geterror(error)
-		);
-	}
-
 	error = nl_recvmsgs_default(socket->sk);
 	if (error < 0) {
 		if ((callback.result.flags & JRF_INITIALIZED)
@@ -273,6 +392,88 @@ struct jool_result joolnl_request(struct joolnl_socket *socket,
 	return result_success();
 }
 
+/*
+ * Largest packet the kernel will fill during a dump. (The kernel sizes dump
+ * packets after the largest buffer we have offered to recvmsg(), up to 32 KB.)
+ */
+#define DUMP_BUFSIZE (32 * 1024)
+
+/**
+ * Like joolnl_request(), except the request is sent as a Netlink dump
+ * (NLM_F_DUMP). The kernel keeps the cursor, and streams as many packets as
+ * needed; @cb is called once per packet.
+ *
+ * Consumes @msg, even on error.
+ */
+struct jool_result joolnl_dump(struct joolnl_socket *socket,
+		struct nl_msg *msg, joolnl_response_cb cb, void *cb_arg)
+{
+	struct response_cb callback;
+	struct jool_result result;
+	int error;
+
+	joolnl_batch_flush(socket);
+
+	callback.xt = socket->xt;
+	callback.cb = cb;
+	callback.arg = cb_arg;
+	memset(&callback.result, 0, sizeof(callback.result));
+
+	nlmsg_hdr(msg)->nlmsg_flags |= NLM_F_DUMP;
+
+	/*
+	 * NL_CB_MSG_IN would also see the NLMSG_DONE, so use NL_CB_VALID
+	 * instead, and let libnl handle the end of the dump.
+	 */
+	error = nl_socket_modify_cb(socket->sk, NL_CB_MSG_IN, NL_CB_DEFAULT,
+			NULL, NULL);
+	if (error >= 0)
+		error = nl_socket_modify_cb(socket->sk, NL_CB_VALID,
+				NL_CB_CUSTOM, response_handler, &callback);
+	if (error < 0) {
+		nlmsg_free(msg);
+		return result_from_error(
+			error,
+			"Could not register response handler: %s\n",
+			nl_geterror(error)
+		);
+	}
+
+	nl_socket_set_msg_buf_size(socket->sk, DUMP_BUFSIZE);
+
+	error = nl_send_auto(socket->sk, msg);
+	nlmsg_free(msg);
+	if (error < 0) {
+		result = result_from_error(
+			error,
+			"Could not dispatch the request to kernelspace: %s",
+			nl_geterror(error)
+		);
+		goto end;
+	}
+
+	error = nl_recvmsgs_default(socket->sk);
+	if (error >= 0) {
+		result = result_success();
+	} else if ((callback.result.flags & JRF_INITIALIZED)
+			&& callback.result.error) {
+		/* nl_recvmsgs_default() failed during our callback */
+		result = callback.result;
+	} else {
+		result = result_from_error(
+			error,
+			"Error receiving the kernel module's response: %s",
+			nl_geterror(error)
+		);
+	}
+	/* Fall through. */
+
+end:
+	/* @callback is about to go out of scope. */
+	nl_socket_modify_cb(socket->sk, NL_CB_VALID, NL_CB_DEFAULT, NULL, NULL);
+	return result;
+}
+
 /**
  * Contract: The result will contain 0 on success, -ESRCH on module likely not
  * modprobed, else -EINVAL.
@@ -315,6 +516,7 @@ struct jool_result joolnl_setup(struct joolnl_socket *socket, xlator_type xt)
 	}
 
 	socket->xt = xt;
+	socket->batch = NULL;
 	socket->genl_family = genl_ctrl_resolve(socket->sk, JOOLNL_FAMILY);
 	if (socket->genl_family < 0) {
 		nl_socket_free(socket->sk);
@@ -9,18 +9,62 @@ struct joolnl_socket {
 	struct nl_sock *sk;
 	xlator_type xt;
 	int genl_family;
+	/* NULL unless the socket is in batch mode. */
+	struct joolnl_batch *batch;
+};
+
+/* Maximum number of batched requests that can be waiting for a response. */
+#define JOOLNL_BATCH_WINDOW 64
+
+/* Owns @result. */
+typedef void (*joolnl_batch_cb)(unsigned int tag, struct jool_result *result,
+		void *arg);
+
+/**
+ * Batch mode: While a socket is in batch mode, the requests that only expect
+ * a success/error response (ie. the joolnl_request()s that have no callback)
+ * are sent without waiting for their responses. The responses are collected
+ * later, and handed to @cb along with the @tag the batch had when the request
+ * was sent.
+ *
+ * Any other kind of request collects the pending responses first.
+ */
+struct joolnl_batch {
+	/* Set this before sending requests; it identifies their responses. */
+	unsigned int tag;
+
+	/* Ring of the tags of the requests that are waiting for a response. */
+	unsigned int tags[JOOLNL_BATCH_WINDOW];
+	unsigned int first;
+	unsigned int count;
+
+	joolnl_batch_cb cb;
+	void *arg;
 };
 
 struct jool_result joolnl_setup(struct joolnl_socket *socket, xlator_type xt);
 void joolnl_teardown(struct joolnl_socket *socket);
 
+void joolnl_batch_start(struct joolnl_socket *socket,
+		struct joolnl_batch *batch, joolnl_batch_cb cb, void *arg);
+void joolnl_batch_flush(struct joolnl_socket *socket);
+void joolnl_batch_end(struct joolnl_socket *socket);
+
 struct jool_result joolnl_alloc_msg(struct joolnl_socket *socket,
 		char const *iname, enum joolnl_operation op, __u8 flags,
 		struct nl_msg **out);
+struct jool_result joolnl_alloc_msg_size(struct joolnl_socket *socket,
+		char const *iname, enum joolnl_operation op, __u8 flags,
+		size_t size, struct nl_msg **out);
 
 typedef struct jool_result (*joolnl_response_cb)(struct nl_msg *, void *);
 struct jool_result joolnl_request(struct joolnl_socket *sk, struct nl_msg *msg,
 		joolnl_response_cb cb, void *cb_arg);
+struct jool_result joolnl_send(struct joolnl_socket *sk, struct nl_msg *msg);
+struct jool_result joolnl_recv(struct joolnl_socket *sk,
+		joolnl_response_cb cb, void *cb_arg);
+struct jool_result joolnl_dump(struct joolnl_socket *sk, struct nl_msg *msg,
+		joolnl_response_cb cb, void *cb_arg);
 
 struct jool_result validate_joolnlhdr(struct joolnlhdr *hdr, xlator_type xt);
 struct jool_result joolnl_msg2result(struct nl_msg *response);
@@ -107,6 +107,32 @@ struct jool_result joolnl_denylist4_rm(struct joolnl_socket *sk,
 	return __update(sk, iname, JNLOP_BL4_RM, prefix, 0);
 }
 
+static int put_prefix4(struct nl_msg *msg, int attrtype, void const *entry)
+{
+	return nla_put_prefix4(msg, attrtype, entry);
+}
+
+/* See joolnl_bulk_request(). */
+struct jool_result joolnl_denylist4_add_many(struct joolnl_socket *sk,
+		char const *iname, struct ipv4_prefix const *prefixes,
+		unsigned int count, bool force, __u16 *results)
+{
+	return joolnl_bulk_request(sk, iname, JNLOP_BL4_ADD,
+			force ? JOOLNLHDR_FLAGS_FORCE : 0, JNLAR_BL4_ENTRIES,
+			prefixes, sizeof(*prefixes), count, put_prefix4,
+			results);
+}
+
+/* See joolnl_bulk_request(). */
+struct jool_result joolnl_denylist4_rm_many(struct joolnl_socket *sk,
+		char const *iname, struct ipv4_prefix const *prefixes,
+		unsigned int count, __u16 *results)
+{
+	return joolnl_bulk_request(sk, iname, JNLOP_BL4_RM, 0,
+			JNLAR_BL4_ENTRIES, prefixes, sizeof(*prefixes), count,
+			put_prefix4, results);
+}
+
 struct jool_result joolnl_denylist4_flush(struct joolnl_socket *sk,
 		char const *iname)
 {
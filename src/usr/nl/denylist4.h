@@ -28,6 +28,23 @@ struct jool_result joolnl_denylist4_rm(
 	struct ipv4_prefix const *addrs
 );
 
+struct jool_result joolnl_denylist4_add_many(
+	struct joolnl_socket *sk,
+	char const *iname,
+	struct ipv4_prefix const *prefixes,
+	unsigned int count,
+	bool force,
+	__u16 *results
+);
+
+struct jool_result joolnl_denylist4_rm_many(
+	struct joolnl_socket *sk,
+	char const *iname,
+	struct ipv4_prefix const *prefixes,
+	unsigned int count,
+	__u16 *results
+);
+
 struct jool_result joolnl_denylist4_flush(
 	struct joolnl_socket *sk,
 	char const *iname
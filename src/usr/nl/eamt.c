@@ -119,6 +119,34 @@ struct jool_result joolnl_eamt_rm(struct joolnl_socket *sk, char const *iname,
 	return __update(sk, iname, JNLOP_EAMT_RM, p6, p4, 0);
 }
 
+static int put_eam(struct nl_msg *msg, int attrtype, void const *entry)
+{
+	return nla_put_eam(msg, attrtype, entry);
+}
+
+/* See joolnl_bulk_request(). */
+struct jool_result joolnl_eamt_add_many(struct joolnl_socket *sk,
+		char const *iname, struct eamt_entry const *entries,
+		unsigned int count, bool force, __u16 *results)
+{
+	return joolnl_bulk_request(sk, iname, JNLOP_EAMT_ADD,
+			force ? JOOLNLHDR_FLAGS_FORCE : 0, JNLAR_EAMT_ENTRIES,
+			entries, sizeof(*entries), count, put_eam, results);
+}
+
+/*
+ * See joolnl_bulk_request().
+ * Unlike joolnl_eamt_rm(), both prefixes of every entry must match.
+ */
+struct jool_result joolnl_eamt_rm_many(struct joolnl_socket *sk,
+		char const *iname, struct eamt_entry const *entries,
+		unsigned int count, __u16 *results)
+{
+	return joolnl_bulk_request(sk, iname, JNLOP_EAMT_RM, 0,
+			JNLAR_EAMT_ENTRIES, entries, sizeof(*entries), count,
+			put_eam, results);
+}
+
 struct jool_result joolnl_eamt_flush(struct joolnl_socket *sk, char const *iname)
 {
 	struct nl_msg *msg;
@@ -30,6 +30,23 @@ struct jool_result joolnl_eamt_rm(
 	struct ipv4_prefix const *p4
 );
 
+struct jool_result joolnl_eamt_add_many(
+	struct joolnl_socket *sk,
+	char const *iname,
+	struct eamt_entry const *entries,
+	unsigned int count,
+	bool force,
+	__u16 *results
+);
+
+struct jool_result joolnl_eamt_rm_many(
+	struct joolnl_socket *sk,
+	char const *iname,
+	struct eamt_entry const *entries,
+	unsigned int count,
+	__u16 *results
+);
+
 struct jool_result joolnl_eamt_flush(
 	struct joolnl_socket *sk,
 	char const *iname
@@ -0,0 +1,152 @@
+#include "usr/nl/events.h"
+
+#include <errno.h>
+#include <string.h>
+#include <netlink/genl/ctrl.h>
+#include <netlink/genl/genl.h>
+
+/*
+ * Receive buffer of the socket. Events can arrive much faster than they can be
+ * printed, so give the listener some slack.
+ */
+#define EVENTS_RCVBUF (4 << 20)
+
+struct events_args {
+	char const *iname;
+	joolnl_events_cb cb;
+	void *args;
+	struct jool_result result;
+};
+
+static int events_handler(struct nl_msg *msg, void *arg)
+{
+	struct events_args *args = arg;
+	struct nlattr *attrs[JNLAR_COUNT];
+	struct genlmsghdr *ghdr;
+	struct joolnlhdr *jhdr;
+	struct joolnl_event_batch batch;
+	int error;
+
+	ghdr = genlmsg_hdr(nlmsg_hdr(msg));
+	jhdr = genlmsg_user_hdr(ghdr);
+
+	args->result = validate_joolnlhdr(jhdr, XT_NAT64);
+	if (args->result.error)
+		return NL_STOP;
+	if (strncmp(jhdr->iname, args->iname, INAME_MAX_SIZE) != 0)
+		return NL_OK; /* Another instance's */
+
+	error = genlmsg_parse(nlmsg_hdr(msg), sizeof(struct joolnlhdr), attrs,
+			JNLAR_MAX, NULL);
+	if (error)
+		goto bad_msg;
+	if (!attrs[JNLAR_EVENT_RECORDS] || !attrs[JNLAR_EVENT_SEQ]
+			|| !attrs[JNLAR_EVENT_LOST])
+		goto bad_msg;
+	if (nla_len(attrs[JNLAR_EVENT_RECORDS])
+			% sizeof(struct bib_event_record))
+		goto bad_msg;
+
+	batch.records = nla_data(attrs[JNLAR_EVENT_RECORDS]);
+	batch.count = nla_len(attrs[JNLAR_EVENT_RECORDS])
+			/ sizeof(struct bib_event_record);
+	batch.seq = nla_get_u32(attrs[JNLAR_EVENT_SEQ]);
+	batch.lost = nla_get_u32(attrs[JNLAR_EVENT_LOST]);
+	batch.overrun = false;
+
+	args->result = args->cb(&batch, args->args);
+	return args->result.error ? NL_STOP : NL_OK;
+
+bad_msg:
+	args->result = result_from_error(
+		-EINVAL,
+		"The kernel module's event message is malformed."
+	);
+	return NL_STOP;
+}
+
+static struct jool_result report_overrun(struct events_args *args)
+{
+	struct joolnl_event_batch batch;
+
+	memset(&batch, 0, sizeof(batch));
+	batch.overrun = true;
+	return args->cb(&batch, args->args);
+}
+
+/**
+ * Subscribes @sk to the event stream, and hands @iname's events to @cb, until
+ * @cb fails.
+ *
+ * @sk should not be used for anything else afterwards.
+ */
+struct jool_result joolnl_events_listen(struct joolnl_socket *sk,
+		char const *iname, joolnl_events_cb cb, void *args)
+{
+	struct events_args eargs;
+	int group;
+	int error;
+
+	eargs.iname = iname ? iname : "default";
+	eargs.cb = cb;
+	eargs.args = args;
+	eargs.result = result_success();
+
+	group = genl_ctrl_resolve_grp(sk->sk, JOOLNL_FAMILY,
+			JOOLNL_EVENTS_GRP_NAME);
+	if (group < 0) {
+		return result_from_error(
+			group,
+			"Unable to resolve the event multicast group: %s\n"
+			"(Maybe the kernel module is too old?)",
+			nl_geterror(group)
+		);
+	}
+
+	/* Multicast messages are not replies; they carry no sequence number. */
+	nl_socket_disable_seq_check(sk->sk);
+	/* Not fatal; the default buffer will simply overflow sooner. */
+	nl_socket_set_buffer_size(sk->sk, EVENTS_RCVBUF, 0);
+
+	error = nl_socket_modify_cb(sk->sk, NL_CB_VALID, NL_CB_CUSTOM,
+			events_handler, &eargs);
+	if (error < 0) {
+		return result_from_error(
+			error,
+			"Could not register the event handler: %s",
+			nl_geterror(error)
+		);
+	}
+
+	error = nl_socket_add_membership(sk->sk, group);
+	if (error < 0) {
+		return result_from_error(
+			error,
+			"Cannot join the event multicast group: %s",
+			nl_geterror(error)
+		);
+	}
+
+	do {
+		error = nl_recvmsgs_default(sk->sk);
+		if (eargs.result.error)
+			break;
+		if (error == -NLE_NOMEM) {
+			/* ENOBUFS: We fell behind, and the kernel dropped some. */
+			eargs.result = report_overrun(&eargs);
+			if (eargs.result.error)
+				break;
+		} else if (error < 0) {
+			eargs.result = result_from_error(
+				error,
+				"Error receiving events from the kernel module: %s",
+				nl_geterror(error)
+			);
+			break;
+		}
+	} while (true);
+
+	nl_socket_drop_membership(sk->sk, group);
+	nl_socket_modify_cb(sk->sk, NL_CB_VALID, NL_CB_DEFAULT, NULL, NULL);
+	return eargs.result;
+}
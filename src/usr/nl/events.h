@@ -0,0 +1,43 @@
+#ifndef SRC_USR_NL_EVENTS_H_
+#define SRC_USR_NL_EVENTS_H_
+
+/**
+ * @file
+ * Listener of the kernel module's BIB/session event stream. (See struct
+ * bib_event_record.) The kernel only sends events while logging-netlink is
+ * enabled.
+ */
+
+#include <stdbool.h>
+#include "common/config.h"
+#include "usr/nl/core.h"
+
+struct joolnl_event_batch {
+	/* In network byte order, exactly as the kernel sent them. */
+	struct bib_event_record const *records;
+	unsigned int count;
+	/* Sequence number of the message that contained the batch. */
+	__u32 seq;
+	/* Number of records the kernel had dropped before this batch. */
+	__u32 lost;
+	/*
+	 * The socket's buffer overflowed, so an unknown number of batches were
+	 * dropped before this one. (If this is set, @count is zero.)
+	 */
+	bool overrun;
+};
+
+/* Returning an error stops the listener. */
+typedef struct jool_result (*joolnl_events_cb)(
+	struct joolnl_event_batch const *batch,
+	void *args
+);
+
+struct jool_result joolnl_events_listen(
+	struct joolnl_socket *sk,
+	char const *iname,
+	joolnl_events_cb cb,
+	void *args
+);
+
+#endif /* SRC_USR_NL_EVENTS_H_ */
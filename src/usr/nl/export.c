@@ -0,0 +1,199 @@
+#include "usr/nl/export.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <endian.h>
+#include <netlink/genl/genl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "usr/nl/common.h"
+
+struct export_args {
+	joolnl_export_cb cb;
+	void *args;
+};
+
+static struct jool_result export_response(struct nl_msg *response, void *arg)
+{
+	struct export_args *args = arg;
+	struct genlmsghdr *ghdr;
+	struct nlattr *attr;
+	int len, rem;
+	bool done;
+	struct jool_result result;
+
+	result = joolnl_init_foreach(response, &done);
+	if (result.error)
+		return result;
+
+	ghdr = genlmsg_hdr(nlmsg_hdr(response));
+	nla_for_each_attr(attr,
+			genlmsg_attrdata(ghdr, sizeof(struct joolnlhdr)),
+			genlmsg_attrlen(ghdr, sizeof(struct joolnlhdr)),
+			rem) {
+		len = nla_len(attr);
+		if (nla_type(attr) != JNLAR_TABLE_IMAGE
+				|| len % sizeof(struct table_image_record))
+			goto bad_attr;
+
+		result = args->cb(nla_data(attr),
+				len / sizeof(struct table_image_record),
+				args->args);
+		if (result.error)
+			return result;
+	}
+
+	return result_success();
+
+bad_attr:
+	return result_from_error(
+		-EINVAL,
+		"The kernel module's table image is malformed."
+	);
+}
+
+struct jool_result joolnl_session_export(struct joolnl_socket *sk,
+		char const *iname, joolnl_export_cb cb, void *args)
+{
+	struct nl_msg *msg;
+	struct export_args eargs;
+	struct jool_result result;
+
+	eargs.cb = cb;
+	eargs.args = args;
+
+	result = joolnl_alloc_msg(sk, iname, JNLOP_SESSION_EXPORT, 0, &msg);
+	if (result.error)
+		return result;
+
+	return joolnl_dump(sk, msg, export_response, &eargs);
+}
+
+void table_image_init_hdr(struct table_image_hdr *hdr, time_t timestamp)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, TABLE_IMAGE_MAGIC, sizeof(hdr->magic));
+	hdr->version = htonl(TABLE_IMAGE_VERSION);
+	hdr->record_size = htons(sizeof(struct table_image_record));
+	hdr->timestamp = htobe64(timestamp);
+}
+
+static struct jool_result validate_hdr(struct table_image *image,
+		char const *path)
+{
+	struct table_image_hdr const *hdr = image->map;
+
+	if (image->size < sizeof(*hdr)
+			|| memcmp(hdr->magic, TABLE_IMAGE_MAGIC, sizeof(hdr->magic)))
+		return result_from_error(-EINVAL,
+				"%s is not a Jool table image.", path);
+
+	if (ntohl(hdr->version) != TABLE_IMAGE_VERSION)
+		return result_from_error(-EINVAL,
+				"%s's table image version (%u) is unsupported.",
+				path, ntohl(hdr->version));
+
+	image->record_size = ntohs(hdr->record_size);
+	if (image->record_size < sizeof(struct table_image_record))
+		return result_from_error(-EINVAL,
+				"%s's records are too small (%zu bytes).",
+				path, image->record_size);
+
+	if ((image->size - sizeof(*hdr)) % image->record_size)
+		return result_from_error(-EINVAL,
+				"%s seems to be truncated.", path);
+
+	image->count = (image->size - sizeof(*hdr)) / image->record_size;
+	image->timestamp = be64toh(hdr->timestamp);
+	return result_success();
+}
+
+/*
+ * Maps the table image stored in @path into memory.
+ * Release it with table_image_close().
+ */
+struct jool_result table_image_open(char const *path,
+		struct table_image *image)
+{
+	struct stat st;
+	int fd;
+	int error;
+	struct jool_result result;
+
+	memset(image, 0, sizeof(*image));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		error = errno;
+		return result_from_error(error, "Cannot open %s: %s", path,
+				strerror(error));
+	}
+
+	if (fstat(fd, &st) < 0) {
+		error = errno;
+		result = result_from_error(error, "Cannot stat %s: %s", path,
+				strerror(error));
+		goto end;
+	}
+
+	image->size = st.st_size;
+	if (image->size == 0) {
+		result = result_from_error(-EINVAL, "%s is empty.", path);
+		goto end;
+	}
+
+	image->map = mmap(NULL, image->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (image->map == MAP_FAILED) {
+		error = errno;
+		image->map = NULL;
+		result = result_from_error(error, "Cannot map %s: %s", path,
+				strerror(error));
+		goto end;
+	}
+
+	result = validate_hdr(image, path);
+	if (result.error)
+		table_image_close(image);
+	/* Fall through. */
+
+end:
+	close(fd);
+	return result;
+}
+
+/* Decodes the @index'th record of @image. */
+void table_image_get(struct table_image const *image, size_t index,
+		struct table_image_entry *result)
+{
+	struct table_image_record const *record;
+
+	record = (struct table_image_record const *)((char *)image->map
+			+ sizeof(struct table_image_hdr)
+			+ index * image->record_size);
+
+	result->type = record->type;
+	result->proto = record->proto;
+	result->state = record->state;
+	result->is_static = record->flags & TIRF_STATIC;
+	result->src6.l3 = record->src6;
+	result->src6.l4 = ntohs(record->src6_port);
+	result->dst6.l3 = record->dst6;
+	result->dst6.l4 = ntohs(record->dst6_port);
+	result->src4.l3 = record->src4;
+	result->src4.l4 = ntohs(record->src4_port);
+	result->dst4.l3 = record->dst4;
+	result->dst4.l4 = ntohs(record->dst4_port);
+	result->idle = ntohl(record->idle);
+	result->age = ntohl(record->age);
+	result->expires = ntohl(record->expires);
+}
+
+void table_image_close(struct table_image *image)
+{
+	if (image->map)
+		munmap(image->map, image->size);
+	image->map = NULL;
+}
@@ -0,0 +1,69 @@
+#ifndef SRC_USR_NL_EXPORT_H_
+#define SRC_USR_NL_EXPORT_H_
+
+/**
+ * @file
+ * Binary images of the BIB and session tables. (See struct table_image_hdr.)
+ *
+ * joolnl_session_export() downloads the records from the kernel module, and
+ * the table_image_* functions read the files `jool session export` writes
+ * out of them.
+ */
+
+#include <stddef.h>
+#include <time.h>
+#include "common/config.h"
+#include "common/session.h"
+#include "usr/nl/core.h"
+
+/*
+ * @records is a batch of @count records, exactly as the kernel sent them.
+ * (ie. In network byte order.)
+ */
+typedef struct jool_result (*joolnl_export_cb)(
+	struct table_image_record const *records,
+	unsigned int count,
+	void *args
+);
+
+struct jool_result joolnl_session_export(
+	struct joolnl_socket *sk,
+	char const *iname,
+	joolnl_export_cb cb,
+	void *args
+);
+
+void table_image_init_hdr(struct table_image_hdr *hdr, time_t timestamp);
+
+/** An image file, mapped into memory. */
+struct table_image {
+	void *map;
+	size_t size;
+	size_t record_size;
+	/** Number of records. */
+	size_t count;
+	time_t timestamp;
+};
+
+/** A record from a table image, in host byte order. */
+struct table_image_entry {
+	enum table_image_type type;
+	l4_protocol proto;
+	tcp_state state;
+	bool is_static;
+	struct ipv6_transport_addr src6;
+	struct ipv6_transport_addr dst6;
+	struct ipv4_transport_addr src4;
+	struct ipv4_transport_addr dst4;
+	__u32 idle;
+	__u32 age;
+	__u32 expires;
+};
+
+struct jool_result table_image_open(char const *path,
+		struct table_image *image);
+void table_image_get(struct table_image const *image, size_t index,
+		struct table_image_entry *result);
+void table_image_close(struct table_image *image);
+
+#endif /* SRC_USR_NL_EXPORT_H_ */
@@ -1,16 +1,20 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <netlink/msg.h>
 
 #include "common/config.h"
 #include "common/constants.h"
 #include "file.h"
 #include "usr/util/cJSON.h"
-#include "usr/util/file.h"
+#include "usr/util/json_stream.h"
 #include "usr/util/str_utils.h"
 #include "usr/nl/attribute.h"
+#include "usr/nl/bib.h"
 #include "usr/nl/common.h"
+#include "usr/nl/denylist4.h"
+#include "usr/nl/eamt.h"
 #include "usr/nl/global.h"
 #include "usr/nl/json.h"
 
@@ -24,11 +28,28 @@
 #define OPTNAME_BIB			"bib"
 #define OPTNAME_MAX_ITERATIONS		"max-iterations"
 
+/*
+ * Ceiling of the size of the messages that carry the database entries.
+ * (It's further limited by the socket's send buffer.)
+ * Each message is one kernel mutex acquisition and one syscall, so the fewer,
+ * the better. Also, this is roughly 5000 EAMT entries per message.
+ */
+#define BULK_MAX_SIZE (256 * 1024)
+/*
+ * Number of requests that can be sent before their responses are collected.
+ * The responses are small, so this many always fits in the receive buffer.
+ */
+#define MAX_IN_FLIGHT 16
+
 /* TODO (warning) These variables prevent this module from being thread-safe. */
 static struct joolnl_socket sk;
 static char const *iname;
+static char iname_buffer[INAME_MAX_SIZE];
 static xlator_flags flags;
 static __u8 force;
+static size_t bulk_size;
+static unsigned int in_flight;
+static bool diff;
 
 struct json_meta {
 	char const *name; /* This being NULL signals the end of the array. */
@@ -40,6 +61,19 @@ struct json_meta {
 	bool already_found;
 };
 
+/* Like json_meta, except for the tags of the root object, which is streamed. */
+struct root_meta {
+	char const *name; /* This being NULL signals the end of the array. */
+	/* Tags that can be huge; they read their value from the stream. */
+	struct jool_result (*stream_handler)(struct json_stream *);
+	/* Tags that are small enough to be loaded as a cJSON tree first. */
+	struct jool_result (*tree_handler)(cJSON *, void const *, void *);
+	void const *arg; /* Second argument of @tree_handler */
+	bool mandatory;
+	bool already_found;
+	/* (If both handlers are NULL, the value is skipped.) */
+};
+
 /*
  * =================================
  * ======== Error functions ========
@@ -79,6 +113,316 @@ static bool tagname_equals(cJSON const *json, char const *name)
 	return strcasecmp(json->string, name) == 0;
 }
 
+/*
+ * Makes the database messages as large as the socket allows, up to
+ * BULK_MAX_SIZE. Returns zero (libnl's default size) if this isn't possible.
+ */
+static size_t compute_bulk_size(void)
+{
+	int sndbuf;
+	socklen_t len;
+
+	/* The kernel might shrink this; see below. */
+	nl_socket_set_buffer_size(sk.sk, 0, BULK_MAX_SIZE);
+
+	len = sizeof(sndbuf);
+	if (getsockopt(nl_socket_get_fd(sk.sk), SOL_SOCKET, SO_SNDBUF, &sndbuf,
+			&len) || sndbuf <= 0)
+		return 0;
+
+	/*
+	 * The kernel doubles SO_SNDBUF to account for its own overhead, and
+	 * rejects messages that don't fit in the result.
+	 */
+	sndbuf /= 2;
+	return (sndbuf < BULK_MAX_SIZE) ? sndbuf : BULK_MAX_SIZE;
+}
+
+/*
+ * ==================================
+ * ======= Differential mode ========
+ * ==================================
+ *
+ * In differential mode, the EAMT, denylist4 and static BIB of the running
+ * instance are downloaded first. The file's entries that are found there are
+ * not sent; the rest are sent as additions. The running entries that are never
+ * found are then sent as removals.
+ *
+ * (pool4 is always sent in full; the kernel module compares it by itself.)
+ */
+
+struct running_table {
+	char *entries; /* Sorted, once the download ends */
+	bool *found;
+	size_t entry_size;
+	unsigned int count;
+	unsigned int capacity;
+
+	int (*compare)(void const *, void const *);
+	int (*put)(struct nl_msg *, int, void const *);
+};
+
+static struct running_table running_eamt;
+static struct running_table running_denylist4;
+static struct running_table running_bib;
+
+static int compare_prefix4(struct ipv4_prefix const *p1,
+		struct ipv4_prefix const *p2)
+{
+	int gap;
+
+	gap = memcmp(&p1->addr, &p2->addr, sizeof(p1->addr));
+	return gap ? gap : ((int)p1->len - (int)p2->len);
+}
+
+static int compare_eam(void const *arg1, void const *arg2)
+{
+	struct eamt_entry const *eam1 = arg1;
+	struct eamt_entry const *eam2 = arg2;
+	int gap;
+
+	gap = memcmp(&eam1->prefix6.addr, &eam2->prefix6.addr,
+			sizeof(eam1->prefix6.addr));
+	if (gap)
+		return gap;
+	gap = (int)eam1->prefix6.len - (int)eam2->prefix6.len;
+	if (gap)
+		return gap;
+	return compare_prefix4(&eam1->prefix4, &eam2->prefix4);
+}
+
+static int compare_denylist4(void const *arg1, void const *arg2)
+{
+	return compare_prefix4(arg1, arg2);
+}
+
+static int compare_bib(void const *arg1, void const *arg2)
+{
+	struct bib_entry const *bib1 = arg1;
+	struct bib_entry const *bib2 = arg2;
+	int gap;
+
+	gap = (int)bib1->l4_proto - (int)bib2->l4_proto;
+	if (gap)
+		return gap;
+	gap = memcmp(&bib1->addr6.l3, &bib2->addr6.l3, sizeof(bib1->addr6.l3));
+	if (gap)
+		return gap;
+	gap = (int)bib1->addr6.l4 - (int)bib2->addr6.l4;
+	if (gap)
+		return gap;
+	gap = memcmp(&bib1->addr4.l3, &bib2->addr4.l3, sizeof(bib1->addr4.l3));
+	if (gap)
+		return gap;
+	return (int)bib1->addr4.l4 - (int)bib2->addr4.l4;
+}
+
+static int put_eam(struct nl_msg *msg, int attrtype, void const *entry)
+{
+	return nla_put_eam(msg, attrtype, entry);
+}
+
+static int put_denylist4(struct nl_msg *msg, int attrtype, void const *entry)
+{
+	return nla_put_prefix4(msg, attrtype, entry);
+}
+
+static int put_bib(struct nl_msg *msg, int attrtype, void const *entry)
+{
+	return nla_put_bib(msg, attrtype, entry);
+}
+
+static void running_init(struct running_table *table, size_t entry_size,
+		int (*compare)(void const *, void const *),
+		int (*put)(struct nl_msg *, int, void const *))
+{
+	memset(table, 0, sizeof(*table));
+	table->entry_size = entry_size;
+	table->compare = compare;
+	table->put = put;
+}
+
+static void running_destroy(struct running_table *table)
+{
+	free(table->entries);
+	free(table->found);
+	table->entries = NULL;
+	table->found = NULL;
+	table->count = 0;
+}
+
+static void *running_get(struct running_table *table, unsigned int i)
+{
+	return table->entries + i * table->entry_size;
+}
+
+static struct jool_result running_append(struct running_table *table,
+		void const *entry)
+{
+	unsigned int capacity;
+	char *tmp;
+
+	if (table->count >= table->capacity) {
+		capacity = table->capacity ? (2 * table->capacity) : 256;
+		tmp = realloc(table->entries, capacity * table->entry_size);
+		if (!tmp)
+			return result_from_enomem();
+		table->entries = tmp;
+		table->capacity = capacity;
+	}
+
+	memcpy(running_get(table, table->count), entry, table->entry_size);
+	table->count++;
+	return result_success();
+}
+
+static struct jool_result running_sort(struct running_table *table)
+{
+	if (table->count == 0)
+		return result_success();
+
+	qsort(table->entries, table->count, table->entry_size, table->compare);
+	table->found = calloc(table->count, sizeof(bool));
+	return table->found ? result_success() : result_from_enomem();
+}
+
+/*
+ * Returns true if @entry exists in the running instance, and therefore does not
+ * need to be sent. (Always false outside of differential mode.)
+ */
+static bool running_find(struct running_table *table, void const *entry)
+{
+	char *found;
+
+	if (!diff || table->count == 0)
+		return false;
+
+	found = bsearch(entry, table->entries, table->count, table->entry_size,
+			table->compare);
+	if (!found)
+		return false;
+
+	table->found[(found - table->entries) / table->entry_size] = true;
+	return true;
+}
+
+static struct jool_result store_eam(struct eamt_entry const *entry, void *arg)
+{
+	return running_append(arg, entry);
+}
+
+static struct jool_result store_denylist4(struct ipv4_prefix const *entry,
+		void *arg)
+{
+	return running_append(arg, entry);
+}
+
+static struct jool_result store_bib(struct bib_entry const *entry, void *arg)
+{
+	/* Dynamic entries are not part of the configuration. */
+	return entry->is_static ? running_append(arg, entry) : result_success();
+}
+
+static struct jool_result download_running(void)
+{
+	l4_protocol proto;
+	struct jool_result result;
+
+	switch (xlator_flags2xt(flags)) {
+	case XT_SIIT:
+		result = joolnl_eamt_foreach(&sk, iname, store_eam,
+				&running_eamt);
+		if (result.error)
+			return result;
+		result = running_sort(&running_eamt);
+		if (result.error)
+			return result;
+
+		result = joolnl_denylist4_foreach(&sk, iname, store_denylist4,
+				&running_denylist4);
+		if (result.error)
+			return result;
+		return running_sort(&running_denylist4);
+
+	case XT_NAT64:
+		for (proto = L4PROTO_TCP; proto <= L4PROTO_ICMP; proto++) {
+			result = joolnl_bib_foreach(&sk, iname, proto,
+					store_bib, &running_bib);
+			if (result.error)
+				return result;
+		}
+		return running_sort(&running_bib);
+	}
+
+	return result_from_error(
+		-EINVAL,
+		"Invalid translator type: %d", xlator_flags2xt(flags)
+	);
+}
+
+/*
+ * ==================================
+ * ======== Request pipeline ========
+ * ==================================
+ *
+ * The requests of a file are sent without waiting for their responses, up to
+ * MAX_IN_FLIGHT of them. This is safe because the kernel handles them in order,
+ * and if one fails, it drops the whole candidate, which makes the rest of them
+ * (including ATOMIC_END) fail as well.
+ */
+
+static void pipeline_discard(void)
+{
+	struct jool_result result;
+
+	for (; in_flight > 0; in_flight--) {
+		result = joolnl_recv(&sk, NULL, NULL);
+		result_cleanup(&result);
+	}
+}
+
+/* Collects the oldest response. */
+static struct jool_result pipeline_collect(void)
+{
+	struct jool_result result;
+
+	in_flight--;
+	result = joolnl_recv(&sk, NULL, NULL);
+	if (result.error) {
+		/* Whatever comes next is fallout of this error. */
+		pipeline_discard();
+	}
+
+	return result;
+}
+
+/* Consumes @msg, even on error. */
+static struct jool_result pipeline_send(struct nl_msg *msg)
+{
+	struct jool_result result;
+
+	result = joolnl_send(&sk, msg);
+	if (result.error)
+		return result;
+
+	in_flight++;
+	return (in_flight >= MAX_IN_FLIGHT) ? pipeline_collect() : result;
+}
+
+/* Collects every pending response; returns the first error. */
+static struct jool_result pipeline_flush(void)
+{
+	struct jool_result result;
+
+	while (in_flight > 0) {
+		result = pipeline_collect();
+		if (result.error)
+			return result;
+	}
+
+	return result_success();
+}
+
 /*
  * ==================================
  * ===== Generic object handlers ====
@@ -127,59 +471,158 @@ static struct jool_result handle_object(cJSON *obj, struct json_meta *metadata)
 	return result_success();
 }
 
-static struct jool_result handle_array(cJSON *json, int attrtype, char *name,
+/*
+ * Each element is parsed and serialized on its own, so memory usage does not
+ * depend on the size of the array.
+ */
+static struct jool_result handle_array(struct json_stream *js, int attrtype,
+		char *name,
 		struct jool_result (*entry_handler)(cJSON *, struct nl_msg *))
 {
 	struct nl_msg *msg;
 	struct nlattr *root;
 	unsigned int entries_written;
+	__u32 len;
+	cJSON *json;
+	bool more;
 	struct jool_result result;
 
-	if (json->type != cJSON_Array)
-		return type_mismatch(name, json, "Array");
+	if (json_stream_peek(js) != '[') {
+		return result_from_error(
+			-EINVAL,
+			"%s, line %u: '%s' is supposed to be an array.",
+			js->file_name, js->line, name
+		);
+	}
+
+	result = json_stream_array_begin(js);
+	if (result.error)
+		return result;
 
 	msg = NULL;
 	root = NULL;
+	json = NULL;
 	entries_written = 0;
-	for (json = json->child; json; json = json->next) {
+	do {
+		result = json_stream_array_next(js, &more);
+		if (result.error)
+			goto revert_msg;
+		if (!more)
+			break;
+
+		result = json_stream_read(js, &json);
+		if (result.error)
+			goto revert_msg;
+
+retry:
 		if (msg == NULL) {
-			result = joolnl_alloc_msg(&sk, iname, JNLOP_FILE_HANDLE,
-					force, &msg);
+			result = joolnl_alloc_msg_size(&sk, iname,
+					JNLOP_FILE_HANDLE, force, bulk_size,
+					&msg);
 			if (result.error)
-				return result;
+				goto revert_json;
 
 			root = jnla_nest_start(msg, attrtype);
 			if (!root)
 				goto too_small;
 		}
 
+		len = nlmsg_hdr(msg)->nlmsg_len;
 		result = entry_handler(json, msg);
 		if (result.error) {
 			if (result.error != -NLE_NOMEM)
-				return result;
+				goto revert_json;
 			result_cleanup(&result);
 
 			if (entries_written == 0)
 				goto too_small;
 
 			nla_nest_end(msg, root);
-			result = joolnl_request(&sk, msg, NULL, NULL);
+			result = pipeline_send(msg);
+			msg = NULL;
+			entries_written = 0;
+			if (result.error)
+				goto revert_json;
+
+			goto retry;
+		}
+
+		/* (Differential mode skips the entries that didn't change.) */
+		if (nlmsg_hdr(msg)->nlmsg_len != len)
+			entries_written++;
+		cJSON_Delete(json);
+		json = NULL;
+	} while (true);
+
+	if (entries_written == 0) {
+		nlmsg_free(msg);
+		return result_success();
+	}
+
+	nla_nest_end(msg, root);
+	return pipeline_send(msg);
+
+too_small:
+	result = joolnl_err_msgsize();
+revert_json:
+	cJSON_Delete(json);
+revert_msg:
+	nlmsg_free(msg);
+	return result;
+}
+
+/* Sends the entries from @table the file did not mention, as removals. */
+static struct jool_result send_removals(struct running_table *table,
+		int attrtype)
+{
+	struct nl_msg *msg;
+	struct nlattr *root;
+	unsigned int entries_written;
+	unsigned int i;
+	struct jool_result result;
+
+	msg = NULL;
+	root = NULL;
+	entries_written = 0;
+	for (i = 0; i < table->count; i++) {
+		if (table->found[i])
+			continue;
+
+retry:
+		if (msg == NULL) {
+			result = joolnl_alloc_msg_size(&sk, iname,
+					JNLOP_FILE_HANDLE, force, bulk_size,
+					&msg);
 			if (result.error)
 				return result;
 
+			root = jnla_nest_start(msg, attrtype);
+			if (!root)
+				goto too_small;
+		}
+
+		if (table->put(msg, JNLAL_RM_ENTRY, running_get(table, i)) < 0) {
+			if (entries_written == 0)
+				goto too_small;
+
+			nla_nest_end(msg, root);
+			result = pipeline_send(msg);
 			msg = NULL;
-			json = json->prev;
 			entries_written = 0;
-		} else {
-			entries_written++;
+			if (result.error)
+				return result;
+
+			goto retry;
 		}
+
+		entries_written++;
 	}
 
 	if (entries_written == 0)
 		return result_success();
 
 	nla_nest_end(msg, root);
-	return joolnl_request(&sk, msg, NULL, NULL);
+	return pipeline_send(msg);
 
 too_small:
 	nlmsg_free(msg);
@@ -244,7 +687,7 @@ static struct jool_result handle_global(cJSON *json)
 
 	nla_nest_end(msg, root);
 	free(meta);
-	return joolnl_request(&sk, msg, NULL, NULL);
+	return pipeline_send(msg);
 
 revert_meta:
 	free(meta);
@@ -382,6 +825,8 @@ static struct jool_result handle_eam_entry(cJSON *json, struct nl_msg *msg)
 	result = handle_object(json, meta);
 	if (result.error)
 		return result;
+	if (running_find(&running_eamt, &eam))
+		return result_success();
 
 	return (nla_put_eam(msg, JNLAL_ENTRY, &eam) < 0)
 			? joolnl_err_msgsize()
@@ -399,6 +844,8 @@ static struct jool_result handle_denylist_entry(cJSON *json, struct nl_msg *msg)
 	result = str_to_prefix4(json->valuestring, &prefix);
 	if (result.error)
 		return result;
+	if (running_find(&running_denylist4, &prefix))
+		return result_success();
 
 	return (nla_put_prefix4(msg, JNLAL_ENTRY, &prefix) < 0)
 			? joolnl_err_msgsize()
@@ -449,6 +896,8 @@ static struct jool_result handle_bib_entry(cJSON *json, struct nl_msg *msg)
 	result = handle_object(json, meta);
 	if (result.error)
 		return result;
+	if (running_find(&running_bib, &entry))
+		return result_success();
 
 	return (nla_put_bib(msg, JNLAL_ENTRY, &entry) < 0)
 			? joolnl_err_msgsize()
@@ -461,39 +910,121 @@ static struct jool_result handle_bib_entry(cJSON *json, struct nl_msg *msg)
  * ==========================================
  */
 
-static struct jool_result do_nothing(cJSON *json, void const *arg1, void *arg2)
+static struct jool_result handle_global_tag(cJSON *json, void const *arg1, void *arg2)
 {
-	return result_success();
+	return handle_global(json);
 }
 
-static struct jool_result handle_global_tag(cJSON *json, void const *arg1, void *arg2)
+static struct jool_result handle_eamt_tag(struct json_stream *js)
 {
-	return handle_global(json);
+	return handle_array(js, JNLAR_EAMT_ENTRIES, OPTNAME_EAMT, handle_eam_entry);
 }
 
-static struct jool_result handle_eamt_tag(cJSON *json, void const *arg1, void *arg2)
+static struct jool_result handle_bl4_tag(struct json_stream *js)
 {
-	return handle_array(json, JNLAR_EAMT_ENTRIES, OPTNAME_EAMT, handle_eam_entry);
+	return handle_array(js, JNLAR_BL4_ENTRIES, OPTNAME_BLACKLIST, handle_denylist_entry);
 }
 
-static struct jool_result handle_bl4_tag(cJSON *json, void const *arg1, void *arg2)
+static struct jool_result handle_dl4_tag(struct json_stream *js)
 {
-	return handle_array(json, JNLAR_BL4_ENTRIES, OPTNAME_BLACKLIST, handle_denylist_entry);
+	return handle_array(js, JNLAR_BL4_ENTRIES, OPTNAME_DENYLIST, handle_denylist_entry);
 }
 
-static struct jool_result handle_dl4_tag(cJSON *json, void const *arg1, void *arg2)
+static struct jool_result handle_pool4_tag(struct json_stream *js)
 {
-	return handle_array(json, JNLAR_BL4_ENTRIES, OPTNAME_DENYLIST, handle_denylist_entry);
+	return handle_array(js, JNLAR_POOL4_ENTRIES, OPTNAME_POOL4, handle_pool4_entry);
 }
 
-static struct jool_result handle_pool4_tag(cJSON *json, void const *arg1, void *arg2)
+static struct jool_result handle_bib_tag(struct json_stream *js)
 {
-	return handle_array(json, JNLAR_POOL4_ENTRIES, OPTNAME_POOL4, handle_pool4_entry);
+	return handle_array(js, JNLAR_BIB_ENTRIES, OPTNAME_BIB, handle_bib_entry);
 }
 
-static struct jool_result handle_bib_tag(cJSON *json, void const *arg1, void *arg2)
+/*
+ * ==================================
+ * ======== Root tag handler ========
+ * ==================================
+ */
+
+static struct jool_result handle_root_tag(struct json_stream *js,
+		struct root_meta *meta)
 {
-	return handle_array(json, JNLAR_BIB_ENTRIES, OPTNAME_BIB, handle_bib_entry);
+	cJSON *json;
+	struct jool_result result;
+
+	if (meta->stream_handler)
+		return meta->stream_handler(js);
+	if (!meta->tree_handler)
+		return json_stream_skip(js);
+
+	result = json_stream_read(js, &json);
+	if (result.error)
+		return result;
+
+	/* The handlers want to know the tag's name, for error messages. */
+	json->string = strdup(meta->name);
+	if (!json->string) {
+		cJSON_Delete(json);
+		return result_from_enomem();
+	}
+
+	result = meta->tree_handler(json, meta->arg, NULL);
+	cJSON_Delete(json);
+	return result;
+}
+
+static struct jool_result handle_root(struct json_stream *js,
+		struct root_meta *metadata)
+{
+	struct root_meta *meta;
+	char const *key;
+	struct jool_result result;
+
+	if (json_stream_peek(js) != '{') {
+		return result_from_error(
+			-EINVAL,
+			"%s: The root of the file is supposed to be an object.",
+			js->file_name
+		);
+	}
+
+	result = json_stream_object_begin(js);
+	if (result.error)
+		return result;
+
+	do {
+		result = json_stream_object_next(js, &key);
+		if (result.error)
+			return result;
+		if (!key)
+			break;
+
+		if (strcasecmp(key, "comment") == 0) {
+			result = json_stream_skip(js);
+			if (result.error)
+				return result;
+			continue;
+		}
+
+		for (meta = metadata; meta->name; meta++)
+			if (strcasecmp(key, meta->name) == 0)
+				break;
+		if (!meta->name)
+			return result_from_error(-EINVAL, "Unknown tag: '%s'", key);
+		if (meta->already_found)
+			return duplicates_found(meta->name);
+		meta->already_found = true;
+
+		result = handle_root_tag(js, meta);
+		if (result.error)
+			return result;
+	} while (true);
+
+	for (meta = metadata; meta->name; meta++)
+		if (meta->mandatory && !meta->already_found)
+			return missing_tag(NULL, meta->name);
+
+	return result_success();
 }
 
 /*
@@ -502,35 +1033,35 @@ static struct jool_result handle_bib_tag(cJSON *json, void const *arg1, void *ar
  * ==================================
  */
 
-static struct jool_result parse_siit_json(cJSON *json)
+static struct jool_result parse_siit_json(struct json_stream *js)
 {
-	struct json_meta meta[] = {
+	struct root_meta meta[] = {
 		/* instance and framework were already handled. */
-		{ OPTNAME_INAME, do_nothing, NULL, NULL, true },
-		{ OPTNAME_FW, do_nothing, NULL, NULL, true },
-		{ OPTNAME_GLOBAL, handle_global_tag, NULL, NULL, false },
+		{ OPTNAME_INAME, NULL, NULL, NULL, true },
+		{ OPTNAME_FW, NULL, NULL, NULL, true },
+		{ OPTNAME_GLOBAL, NULL, handle_global_tag, NULL, false },
 		{ OPTNAME_EAMT, handle_eamt_tag, NULL, NULL, false },
 		{ OPTNAME_BLACKLIST, handle_bl4_tag, NULL, NULL, false },
 		{ OPTNAME_DENYLIST, handle_dl4_tag, NULL, NULL, false },
 		{ NULL },
 	};
 
-	return handle_object(json, meta);
+	return handle_root(js, meta);
 }
 
-static struct jool_result parse_nat64_json(cJSON *json)
+static struct jool_result parse_nat64_json(struct json_stream *js)
 {
-	struct json_meta meta[] = {
+	struct root_meta meta[] = {
 		/* instance and framework were already handled. */
-		{ OPTNAME_INAME, do_nothing, NULL, NULL, true },
-		{ OPTNAME_FW, do_nothing, NULL, NULL, true },
-		{ OPTNAME_GLOBAL, handle_global_tag, NULL, NULL, false },
+		{ OPTNAME_INAME, NULL, NULL, NULL, true },
+		{ OPTNAME_FW, NULL, NULL, NULL, true },
+		{ OPTNAME_GLOBAL, NULL, handle_global_tag, NULL, false },
 		{ OPTNAME_POOL4, handle_pool4_tag, NULL, NULL, false },
 		{ OPTNAME_BIB, handle_bib_tag, NULL, NULL, false },
 		{ NULL },
 	};
 
-	return handle_object(json, meta);
+	return handle_root(js, meta);
 }
 
 /*
@@ -559,7 +1090,9 @@ static struct jool_result handle_instance_tag(cJSON *json, void const *_iname,
 		);
 	}
 
-	iname = json->valuestring;
+	/* @json will die soon. */
+	strcpy(iname_buffer, json->valuestring);
+	iname = iname_buffer;
 	return result_success();
 }
 
@@ -590,20 +1123,21 @@ static struct jool_result handle_framework_tag(cJSON *json,
  */
 
 /*
- * Sets the @iname and @flags global variables according to @_iname and @json.
+ * Sets the @iname and @flags global variables according to @_iname and @js.
  */
-static struct jool_result prepare_instance(char const *_iname, cJSON *json)
+static struct jool_result prepare_instance(char const *_iname,
+		struct json_stream *js)
 {
-	struct json_meta meta[] = {
-		{ OPTNAME_INAME, handle_instance_tag, _iname, NULL, false },
-		{ OPTNAME_FW, handle_framework_tag, NULL, NULL, true },
+	struct root_meta meta[] = {
+		{ OPTNAME_INAME, NULL, handle_instance_tag, _iname, false },
+		{ OPTNAME_FW, NULL, handle_framework_tag, NULL, true },
 		/* The rest will be handled later. */
-		{ OPTNAME_GLOBAL, do_nothing },
-		{ OPTNAME_EAMT, do_nothing },
-		{ OPTNAME_BLACKLIST, do_nothing },
-		{ OPTNAME_DENYLIST, do_nothing },
-		{ OPTNAME_POOL4, do_nothing },
-		{ OPTNAME_BIB, do_nothing },
+		{ OPTNAME_GLOBAL },
+		{ OPTNAME_EAMT },
+		{ OPTNAME_BLACKLIST },
+		{ OPTNAME_DENYLIST },
+		{ OPTNAME_POOL4 },
+		{ OPTNAME_BIB },
 		{ NULL },
 	};
 	struct jool_result result;
@@ -622,7 +1156,7 @@ static struct jool_result prepare_instance(char const *_iname, cJSON *json)
 	if (result.error)
 		return result_from_error(result.error, INAME_VALIDATE_ERRMSG);
 
-	result = handle_object(json, meta);
+	result = handle_root(js, meta);
 	if (result.error)
 		return result;
 
@@ -649,50 +1183,51 @@ static struct jool_result send_ctrl_msg(bool init)
 	if (result.error)
 		return result;
 
-	if (init)
+	if (init) {
 		NLA_PUT_U8(msg, JNLAR_ATOMIC_INIT, xlator_flags2xf(flags));
-	else
+		if (diff)
+			NLA_PUT_FLAG(msg, JNLAR_ATOMIC_DIFF);
+	} else
 		NLA_PUT(msg, JNLAR_ATOMIC_END, 0, NULL);
 
-	result = joolnl_request(&sk, msg, NULL, NULL);
-	if (result.error)
-		return result;
-
-	return result_success();
+	return pipeline_send(msg);
 
 nla_put_failure:
 	nlmsg_free(msg);
 	return result;
 }
 
-static struct jool_result do_parsing(char const *iname, char *buffer)
+static struct jool_result do_parsing(char const *iname, struct json_stream *js)
 {
-	cJSON *json;
 	struct jool_result result;
+	struct jool_result pending;
 
-	json = cJSON_Parse(buffer);
-	if (!json) {
-		return result_from_error(
-			-EINVAL,
-			"The JSON parser got confused around the beginning of this string:\n"
-			"%s", cJSON_GetErrorPtr()
-		);
-	}
+	/* First pass: Only the instance and framework tags */
+	result = prepare_instance(iname, js);
+	if (result.error)
+		return result;
 
-	result = prepare_instance(iname, json);
+	result = json_stream_rewind(js);
 	if (result.error)
-		goto fail;
+		return result;
+
+	if (diff) {
+		result = download_running();
+		if (result.error)
+			return result;
+	}
 
+	/* Second pass: Everything else */
 	result = send_ctrl_msg(true);
 	if (result.error)
 		goto fail;
 
 	switch (xlator_flags2xt(flags)) {
 	case XT_SIIT:
-		result = parse_siit_json(json);
+		result = parse_siit_json(js);
 		break;
 	case XT_NAT64:
-		result = parse_nat64_json(json);
+		result = parse_nat64_json(js);
 		break;
 	default:
 		result = result_from_error(
@@ -704,53 +1239,120 @@ static struct jool_result do_parsing(char const *iname, char *buffer)
 	if (result.error)
 		goto fail;
 
-	/*
-	 * Send the control message before deleting, because @iname might point
-	 * to the json object, and send_ctrl_msg() needs @iname.
-	 */
+	if (diff) {
+		result = send_removals(&running_eamt, JNLAR_EAMT_ENTRIES);
+		if (result.error)
+			goto fail;
+		result = send_removals(&running_denylist4, JNLAR_BL4_ENTRIES);
+		if (result.error)
+			goto fail;
+		result = send_removals(&running_bib, JNLAR_BIB_ENTRIES);
+		if (result.error)
+			goto fail;
+	}
+
 	result = send_ctrl_msg(false);
-	cJSON_Delete(json);
-	return result;
+	if (result.error)
+		goto fail;
+
+	return pipeline_flush();
 
 fail:
-	cJSON_Delete(json);
+	/*
+	 * The requests still in flight precede the error, so if one of them
+	 * failed, that's the one the user needs to hear about.
+	 */
+	pending = pipeline_flush();
+	if (pending.error) {
+		result_cleanup(&result);
+		return pending;
+	}
 	return result;
 }
 
+/*
+ * If @_diff, only the table entries that differ from the running instance's
+ * are sent. (See "Differential mode" above.)
+ */
 struct jool_result joolnl_file_parse(struct joolnl_socket *_sk, xlator_type xt,
-		char const *iname, char const *file_name, bool _force)
+		char const *iname, char const *file_name, bool _force, bool _diff)
 {
-	char *buffer;
+	struct json_stream js;
 	struct jool_result result;
 
 	sk = *_sk;
 	flags = xt;
 	force = _force ? JOOLNLHDR_FLAGS_FORCE : 0;
-
-	result = file_to_string(file_name, &buffer);
+	diff = _diff;
+	in_flight = 0;
+	running_init(&running_eamt, sizeof(struct eamt_entry), compare_eam,
+			put_eam);
+	running_init(&running_denylist4, sizeof(struct ipv4_prefix),
+			compare_denylist4, put_denylist4);
+	running_init(&running_bib, sizeof(struct bib_entry), compare_bib,
+			put_bib);
+
+	result = json_stream_open(&js, file_name);
 	if (result.error)
 		return result;
 
-	result = do_parsing(iname, buffer);
-	free(buffer);
+	bulk_size = compute_bulk_size();
+	result = do_parsing(iname, &js);
+	json_stream_close(&js);
+	running_destroy(&running_eamt);
+	running_destroy(&running_denylist4);
+	running_destroy(&running_bib);
 	return result;
 }
 
-static struct jool_result __json_get_iname(cJSON *root, char **out)
+static struct jool_result __json_get_iname(struct json_stream *js, char **out)
 {
-	cJSON *child;
+	char const *key;
+	cJSON *json;
+	struct jool_result result;
+
+	if (json_stream_peek(js) != '{') {
+		return result_from_error(
+			-EINVAL,
+			"%s: The root of the file is supposed to be an object.",
+			js->file_name
+		);
+	}
+
+	result = json_stream_object_begin(js);
+	if (result.error)
+		return result;
+
+	do {
+		result = json_stream_object_next(js, &key);
+		if (result.error)
+			return result;
+		if (!key)
+			break;
 
-	if (root->type != cJSON_Object)
-		return type_mismatch("root", root, "Object");
+		if (strcasecmp(key, OPTNAME_INAME) != 0) {
+			result = json_stream_skip(js);
+			if (result.error)
+				return result;
+			continue;
+		}
 
-	for (child = root->child; child; child = child->next) {
-		if (tagname_equals(child, OPTNAME_INAME)) {
-			*out = strdup(child->valuestring);
-			return ((*out) != NULL)
+		result = json_stream_read(js, &json);
+		if (result.error)
+			return result;
+
+		if (json->type != cJSON_String) {
+			result = string_expected(OPTNAME_INAME, json);
+		} else {
+			*out = strdup(json->valuestring);
+			result = ((*out) != NULL)
 					? result_success()
 					: result_from_enomem();
 		}
-	}
+
+		cJSON_Delete(json);
+		return result;
+	} while (true);
 
 	return result_from_error(
 		-EINVAL,
@@ -760,28 +1362,15 @@ static struct jool_result __json_get_iname(cJSON *root, char **out)
 
 struct jool_result joolnl_file_get_iname(char const *file_name, char **out)
 {
-	char *json_string;
-	cJSON *json;
+	struct json_stream js;
 	struct jool_result result;
 
-	result = file_to_string(file_name, &json_string);
+	result = json_stream_open(&js, file_name);
 	if (result.error)
 		return result;
 
-	json = cJSON_Parse(json_string);
-
-	free(json_string);
-
-	if (!json) {
-		return result_from_error(
-			-EINVAL,
-			"The JSON parser got confused around the beginning of this string:\n"
-			"%s", cJSON_GetErrorPtr()
-		);
-	}
-
-	result = __json_get_iname(json, out);
+	result = __json_get_iname(&js, out);
 
-	cJSON_Delete(json);
+	json_stream_close(&js);
 	return result;
 }
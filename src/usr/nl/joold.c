@@ -22,31 +22,81 @@ static struct jool_result send_to_kernel(struct joolnl_socket *sk,
 	return result_success();
 }
 
+/*
+ * Were the sessions serialized as records (as opposed to the legacy nested
+ * attributes)? See struct joold_records_hdr.
+ */
+static bool is_records(void const *data, size_t data_len)
+{
+	unsigned char const *bytes = data;
+
+	return data_len >= JOOLD_RECORDS_HDRLEN
+			&& bytes[0] == JOOLD_RECORDS_MAGIC
+			&& bytes[1] == JOOLD_RECORDS_MAGIC;
+}
+
+/* Starts a JNLOP_JOOLD_ADD request. Fill it with joolnl_joold_add_put(). */
+struct jool_result joolnl_joold_add_init(struct joolnl_socket *sk,
+		char const *iname, struct nl_msg **out)
+{
+	return joolnl_alloc_msg(sk, iname, JNLOP_JOOLD_ADD, 0, out);
+}
+
+/*
+ * Appends the sessions contained in one joold datagram to @msg.
+ * The kernel walks every container, so this can be called repeatedly as long
+ * as the message has room.
+ */
+struct jool_result joolnl_joold_add_put(struct nl_msg *msg,
+		void const *data, size_t data_len)
+{
+	int error;
+
+	error = nla_put(msg, is_records(data, data_len)
+			? JNLAR_SESSION_RECORDS
+			: (NLA_F_NESTED | JNLAR_SESSION_ENTRIES),
+			data_len, data);
+	if (error < 0) {
+		return result_from_error(
+			error,
+			"Can't send joold sessions to kernel: Packet too small."
+		);
+	}
+
+	return result_success();
+}
+
+/*
+ * Sends and releases @msg. Does not wait for a response; the kernel only
+ * answers if something went wrong.
+ */
+struct jool_result joolnl_joold_add_send(struct joolnl_socket *sk,
+		struct nl_msg *msg)
+{
+	return send_to_kernel(sk, msg);
+}
+
 struct jool_result joolnl_joold_add(struct joolnl_socket *sk, char const *iname,
 		void const *data, size_t data_len)
 {
 	struct nl_msg *msg;
 	struct jool_result result;
 
-	result = joolnl_alloc_msg(sk, iname, JNLOP_JOOLD_ADD, 0, &msg);
+	result = joolnl_joold_add_init(sk, iname, &msg);
 	if (result.error)
 		return result;
 
-	result.error = nla_put(msg, NLA_F_NESTED | JNLAR_SESSION_ENTRIES,
-			data_len, data);
-	if (result.error < 0) {
+	/*
+	 * This is fine as long as page size > 1500.
+	 * But admittedly, it's not the most elegant implementation.
+	 */
+	result = joolnl_joold_add_put(msg, data, data_len);
+	if (result.error) {
 		nlmsg_free(msg);
-		/*
-		 * This is fine as long as page size > 1500.
-		 * But admittedly, it's not the most elegant implementation.
-		 */
-		return result_from_error(
-			result.error,
-			"Can't send joold sessions to kernel: Packet too small."
-		);
+		return result;
 	}
 
-	return send_to_kernel(sk, msg);
+	return joolnl_joold_add_send(sk, msg);
 }
 
 struct jool_result joolnl_joold_advertise(struct joolnl_socket *sk,
@@ -62,7 +112,12 @@ struct jool_result joolnl_joold_advertise(struct joolnl_socket *sk,
 	return send_to_kernel(sk, msg);
 }
 
-struct jool_result joolnl_joold_ack(struct joolnl_socket *sk, char const *iname)
+/*
+ * @seq is the sequence number of the last packet received from the kernel.
+ * NULL acknowledges everything.
+ */
+struct jool_result joolnl_joold_ack(struct joolnl_socket *sk, char const *iname,
+		__u32 const *seq)
 {
 	struct nl_msg *msg;
 	struct jool_result result;
@@ -71,5 +126,16 @@ struct jool_result joolnl_joold_ack(struct joolnl_socket *sk, char const *iname)
 	if (result.error)
 		return result;
 
+	if (seq) {
+		result.error = nla_put_u32(msg, JNLAR_JOOLD_SEQ, *seq);
+		if (result.error < 0) {
+			nlmsg_free(msg);
+			return result_from_error(
+				result.error,
+				"Can't ACK the kernel's sessions: Packet too small."
+			);
+		}
+	}
+
 	return send_to_kernel(sk, msg);
 }
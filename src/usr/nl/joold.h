@@ -10,6 +10,21 @@ struct jool_result joolnl_joold_add(
 	size_t data_len
 );
 
+struct jool_result joolnl_joold_add_init(
+	struct joolnl_socket *sk,
+	char const *iname,
+	struct nl_msg **out
+);
+struct jool_result joolnl_joold_add_put(
+	struct nl_msg *msg,
+	void const *data,
+	size_t data_len
+);
+struct jool_result joolnl_joold_add_send(
+	struct joolnl_socket *sk,
+	struct nl_msg *msg
+);
+
 struct jool_result joolnl_joold_advertise(
 	struct joolnl_socket *sk,
 	char const *iname
@@ -17,7 +32,8 @@ struct jool_result joolnl_joold_advertise(
 
 struct jool_result joolnl_joold_ack(
 	struct joolnl_socket *sk,
-	char const *iname
+	char const *iname,
+	__u32 const *seq
 );
 
 #endif /* SRC_USR_NL_JOOLD_H_ */
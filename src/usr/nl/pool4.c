@@ -112,6 +112,31 @@ struct jool_result joolnl_pool4_rm(struct joolnl_socket *sk, char const *iname,
 	return __update(sk, iname, JNLOP_POOL4_RM, entry, quick);
 }
 
+static int put_pool4(struct nl_msg *msg, int attrtype, void const *entry)
+{
+	return nla_put_pool4(msg, attrtype, entry);
+}
+
+/* See joolnl_bulk_request(). */
+struct jool_result joolnl_pool4_add_many(struct joolnl_socket *sk,
+		char const *iname, struct pool4_entry const *entries,
+		unsigned int count, __u16 *results)
+{
+	return joolnl_bulk_request(sk, iname, JNLOP_POOL4_ADD, 0,
+			JNLAR_POOL4_ENTRIES, entries, sizeof(*entries), count,
+			put_pool4, results);
+}
+
+/* See joolnl_bulk_request(). */
+struct jool_result joolnl_pool4_rm_many(struct joolnl_socket *sk,
+		char const *iname, struct pool4_entry const *entries,
+		unsigned int count, bool quick, __u16 *results)
+{
+	return joolnl_bulk_request(sk, iname, JNLOP_POOL4_RM,
+			quick ? JOOLNLHDR_FLAGS_QUICK : 0, JNLAR_POOL4_ENTRIES,
+			entries, sizeof(*entries), count, put_pool4, results);
+}
+
 struct jool_result joolnl_pool4_flush(struct joolnl_socket *sk,
 		char const *iname, bool quick)
 {
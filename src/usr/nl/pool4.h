@@ -29,6 +29,23 @@ struct jool_result joolnl_pool4_rm(
 	bool quick
 );
 
+struct jool_result joolnl_pool4_add_many(
+	struct joolnl_socket *sk,
+	char const *iname,
+	struct pool4_entry const *entries,
+	unsigned int count,
+	__u16 *results
+);
+
+struct jool_result joolnl_pool4_rm_many(
+	struct joolnl_socket *sk,
+	char const *iname,
+	struct pool4_entry const *entries,
+	unsigned int count,
+	bool quick,
+	__u16 *results
+);
+
 struct jool_result joolnl_pool4_flush(
 	struct joolnl_socket *sk,
 	char const *iname,
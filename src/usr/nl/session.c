@@ -1,6 +1,7 @@
 #include "usr/nl/session.h"
 
 #include <errno.h>
+#include <string.h>
 #include <netlink/genl/genl.h>
 #include "usr/nl/attribute.h"
 #include "usr/nl/common.h"
@@ -8,10 +9,9 @@
 struct foreach_args {
 	joolnl_session_foreach_cb cb;
 	void *args;
-	bool done;
-	struct session_entry_usr last;
 };
 
+/* Called once per packet of the dump. */
 static struct jool_result handle_foreach_response(struct nl_msg *response,
 		void *arg)
 {
@@ -19,9 +19,11 @@ static struct jool_result handle_foreach_response(struct nl_msg *response,
 	struct nlattr *attr;
 	int rem;
 	struct session_entry_usr entry;
+	bool done;
 	struct jool_result result;
 
-	result = joolnl_init_foreach_list(response, "session", &args->done);
+	/* Netlink itself tells us when the dump is over; ignore @done. */
+	result = joolnl_init_foreach_list(response, "session", &done);
 	if (result.error)
 		return result;
 
@@ -33,50 +35,196 @@ static struct jool_result handle_foreach_response(struct nl_msg *response,
 		result = args->cb(&entry, args->args);
 		if (result.error)
 			return result;
-
-		memcpy(&args->last, &entry, sizeof(entry));
 	}
 
 	return result_success();
 }
 
+static int put_filter(struct nl_msg *msg, struct session_filter const *filter)
+{
+	struct nlattr *root;
+
+	root = jnla_nest_start(msg, JNLAR_SESSION_FILTER);
+	if (!root)
+		return -NLE_NOMEM;
+
+	if (filter->src6.set && nla_put_prefix6(msg, JNLASF_SRC6,
+			&filter->src6.prefix) < 0)
+		goto cancel;
+	if (filter->src4.set && nla_put_prefix4(msg, JNLASF_SRC4,
+			&filter->src4.prefix) < 0)
+		goto cancel;
+	if (nla_put_u16(msg, JNLASF_PORT_MIN, filter->ports.min) < 0)
+		goto cancel;
+	if (nla_put_u16(msg, JNLASF_PORT_MAX, filter->ports.max) < 0)
+		goto cancel;
+	if (filter->dst4.set && nla_put_prefix4(msg, JNLASF_DST4,
+			&filter->dst4.prefix) < 0)
+		goto cancel;
+	if (filter->state_set && nla_put_u8(msg, JNLASF_STATE,
+			filter->state) < 0)
+		goto cancel;
+	if (filter->min_age && nla_put_u32(msg, JNLASF_MIN_AGE,
+			filter->min_age) < 0)
+		goto cancel;
+
+	nla_nest_end(msg, root);
+	return 0;
+
+cancel:
+	nla_nest_cancel(msg, root);
+	return -NLE_NOMEM;
+}
+
+static struct jool_result alloc_request(struct joolnl_socket *sk,
+		char const *iname, enum joolnl_operation op, l4_protocol proto,
+		struct session_filter const *filter, struct nl_msg **out)
+{
+	struct nl_msg *msg;
+	struct jool_result result;
+
+	result = joolnl_alloc_msg(sk, iname, op, 0, &msg);
+	if (result.error)
+		return result;
+
+	if (nla_put_u8(msg, JNLAR_PROTO, proto) < 0)
+		goto too_big;
+	if (filter && put_filter(msg, filter) < 0)
+		goto too_big;
+
+	*out = msg;
+	return result_success();
+
+too_big:
+	nlmsg_free(msg);
+	return joolnl_err_msgsize();
+}
+
 struct jool_result joolnl_session_foreach(struct joolnl_socket *sk,
 		char const *iname, l4_protocol proto,
+		struct session_filter const *filter,
 		joolnl_session_foreach_cb cb, void *_args)
 {
 	struct nl_msg *msg;
 	struct foreach_args args;
 	struct jool_result result;
-	bool first_request;
 
 	args.cb = cb;
 	args.args = _args;
-	args.done = true;
-	memset(&args.last, 0, sizeof(args.last));
-	first_request = true;
 
-	do {
-		result = joolnl_alloc_msg(sk, iname, JNLOP_SESSION_FOREACH, 0, &msg);
+	result = alloc_request(sk, iname, JNLOP_SESSION_FOREACH, proto, filter,
+			&msg);
+	if (result.error)
+		return result;
+
+	return joolnl_dump(sk, msg, handle_foreach_response, &args);
+}
+
+struct query_args {
+	enum session_grouping grouping;
+	joolnl_session_query_cb cb;
+	void *args;
+};
+
+static struct jool_result nla_get_group(struct nlattr *root,
+		enum session_grouping grouping, struct session_group_usr *out)
+{
+	struct nlattr *attrs[JNLASG_COUNT];
+	struct jool_result result;
+
+	result = jnla_parse_nested(attrs, JNLASG_MAX, root,
+			joolnl_session_group_policy);
+	if (result.error)
+		return result;
+
+	memset(out, 0, sizeof(*out));
+
+	switch (grouping) {
+	case SG_TOTAL:
+		break;
+	case SG_SRC6:
+		if (!attrs[JNLASG_PREFIX6])
+			goto missing;
+		result = nla_get_prefix6(attrs[JNLASG_PREFIX6],
+				&out->key.prefix6);
 		if (result.error)
 			return result;
+		break;
+	case SG_SRC4:
+		if (!attrs[JNLASG_ADDR4])
+			goto missing;
+		nla_get_addr4(attrs[JNLASG_ADDR4], &out->key.addr4);
+		break;
+	case SG_STATE:
+	case SG_LIFETIME:
+		if (!attrs[JNLASG_VALUE])
+			goto missing;
+		out->key.value = nla_get_u32(attrs[JNLASG_VALUE]);
+		break;
+	}
+
+	if (!attrs[JNLASG_SESSIONS])
+		goto missing;
+	out->sessions = nla_get_u32(attrs[JNLASG_SESSIONS]);
+	return result_success();
+
+missing:
+	return result_from_error(
+		-EINVAL,
+		"The kernel's response lacks a session group's key or count."
+	);
+}
 
-		if (nla_put_u8(msg, JNLAR_PROTO, proto) < 0)
-			goto cancel;
+static struct jool_result handle_query_response(struct nl_msg *response,
+		void *arg)
+{
+	struct query_args *args = arg;
+	struct nlattr *attr;
+	int rem;
+	struct session_group_usr group;
+	bool done;
+	struct jool_result result;
 
-		if (first_request)
-			first_request = false;
-		else if (nla_put_session(msg, JNLAR_OFFSET, &args.last) < 0)
-			goto cancel;
+	result = joolnl_init_foreach_list(response, "session group", &done);
+	if (result.error)
+		return result;
 
-		result = joolnl_request(sk, msg, handle_foreach_response, &args);
+	foreach_entry(attr, genlmsg_hdr(nlmsg_hdr(response)), rem) {
+		result = nla_get_group(attr, args->grouping, &group);
 		if (result.error)
 			return result;
-	} while (!args.done);
 
-	return result_success();
+		result = args->cb(&group, args->args);
+		if (result.error)
+			return result;
+	}
 
-cancel:
-	nlmsg_free(msg);
-	return joolnl_err_msgsize();
+	return result_success();
 }
 
+struct jool_result joolnl_session_query(struct joolnl_socket *sk,
+		char const *iname, l4_protocol proto,
+		struct session_filter const *filter,
+		enum session_grouping grouping,
+		joolnl_session_query_cb cb, void *_args)
+{
+	struct nl_msg *msg;
+	struct query_args args;
+	struct jool_result result;
+
+	args.grouping = grouping;
+	args.cb = cb;
+	args.args = _args;
+
+	result = alloc_request(sk, iname, JNLOP_SESSION_QUERY, proto, filter,
+			&msg);
+	if (result.error)
+		return result;
+
+	if (nla_put_u8(msg, JNLAR_SESSION_GROUPING, grouping) < 0) {
+		nlmsg_free(msg);
+		return joolnl_err_msgsize();
+	}
+
+	return joolnl_dump(sk, msg, handle_query_response, &args);
+}
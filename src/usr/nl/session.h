@@ -26,12 +26,46 @@ typedef struct jool_result (*joolnl_session_foreach_cb)(
 	struct session_entry_usr const *entry, void *args
 );
 
+/* @filter can be NULL. */
 struct jool_result joolnl_session_foreach(
 	struct joolnl_socket *sk,
 	char const *iname,
 	l4_protocol proto,
+	struct session_filter const *filter,
 	joolnl_session_foreach_cb cb,
 	void *args
 );
 
+/** A row of a session query's result. */
+struct session_group_usr {
+	union {
+		/** SG_SRC6 */
+		struct ipv6_prefix prefix6;
+		/** SG_SRC4 */
+		struct in_addr addr4;
+		/** SG_STATE (tcp_state), SG_LIFETIME (milliseconds) */
+		__u32 value;
+	} key;
+	__u32 sessions;
+};
+
+typedef struct jool_result (*joolnl_session_query_cb)(
+	struct session_group_usr const *group, void *args
+);
+
+/*
+ * Has the kernel count the sessions that match @filter (which can be NULL),
+ * aggregated as @grouping says.
+ * Groups that would be empty are not reported.
+ */
+struct jool_result joolnl_session_query(
+	struct joolnl_socket *sk,
+	char const *iname,
+	l4_protocol proto,
+	struct session_filter const *filter,
+	enum session_grouping grouping,
+	joolnl_session_query_cb cb,
+	void *args
+);
+
 #endif /* SRC_USR_NL_SESSION_H_ */
@@ -89,6 +89,25 @@ static struct joolnl_stat_metadata const jstat_metadatas[] = {
 	DEFINE_STAT(JSTAT_ICMP4ERR_SUCCESS, "ICMPv4 errors (created by Jool, not translated) sent successfully."),
 	DEFINE_STAT(JSTAT_ICMP4ERR_FAILURE, "ICMPv4 errors (created by Jool, not translated) that could not be sent."),
 	DEFINE_STAT(JSTAT_ICMPEXT_BIG, "Illegal ICMP header length. (Exceeds available payload in packet.)"),
+	DEFINE_STAT(JSTAT_JOOLD_FILTERED, "Session updates that were not synchronized because of the --ss-sync-*, --ss-established-only, --ss-min-session-age or --ss-mark-* filters."),
+	DEFINE_STAT(JSTAT_JOOLD_RATELIMIT, "Session updates that were not synchronized because of --ss-max-rate."),
+	DEFINE_STAT(JSTAT_JOOLD_FOREIGN, "Sessions received from joold that were dropped because they belong to a shard this node neither owns nor backs up. (--ss-shard-*)"),
+	DEFINE_STAT(JSTAT_BIB_EVENTS_LOST, "BIB and session events (--logging-netlink) that were dropped, because they could not be queued or a listener could not keep up."),
+	DEFINE_STAT(JSTAT_TCP_BIB_ENTRIES, "Number of BIB entries currently held in the TCP table."),
+	DEFINE_STAT(JSTAT_UDP_BIB_ENTRIES, "Number of BIB entries currently held in the UDP table."),
+	DEFINE_STAT(JSTAT_ICMP_BIB_ENTRIES, "Number of BIB entries currently held in the ICMP table."),
+	DEFINE_STAT(JSTAT_TCP_SESSIONS, "Number of session entries currently held in the TCP table."),
+	DEFINE_STAT(JSTAT_UDP_SESSIONS, "Number of session entries currently held in the UDP table."),
+	DEFINE_STAT(JSTAT_ICMP_SESSIONS, "Number of session entries currently held in the ICMP table."),
+	DEFINE_STAT(JSTAT_TCP_ESTABLISHED, "Number of TCP sessions currently in state ESTABLISHED."),
+	DEFINE_STAT(JSTAT_TCP_V6_INIT, "Number of TCP sessions currently in state V6_INIT."),
+	DEFINE_STAT(JSTAT_TCP_V4_INIT, "Number of TCP sessions currently in state V4_INIT."),
+	DEFINE_STAT(JSTAT_TCP_V4_FIN_RCV, "Number of TCP sessions currently in state V4_FIN_RCV."),
+	DEFINE_STAT(JSTAT_TCP_V6_FIN_RCV, "Number of TCP sessions currently in state V6_FIN_RCV."),
+	DEFINE_STAT(JSTAT_TCP_V4_FIN_V6_FIN_RCV, "Number of TCP sessions currently in state V4_FIN_V6_FIN_RCV."),
+	DEFINE_STAT(JSTAT_TCP_TRANS, "Number of TCP sessions currently in state TRANS."),
+	DEFINE_STAT(JSTAT_ICMPERR_RATELIMIT, "ICMP errors (created by Jool, not translated) that were not sent because of --icmp-errors-rate."),
+	DEFINE_STAT(JSTAT_JOOLD_RING_FULL, "Session updates that were not synchronized, because the packet path produced them faster than joold could queue them."),
 	DEFINE_STAT(JSTAT_UNKNOWN, TC "Programming error found. The module recovered, but the packet was dropped."),
 	DEFINE_STAT(JSTAT_PADDING, "Dummy; ignore this one."),
 };
@@ -195,3 +214,78 @@ struct jool_result joolnl_stats_foreach(struct joolnl_socket *sk,
 
 	return result_success();
 }
+
+struct occupancy_args {
+	joolnl_occupancy_foreach_cb cb;
+	void *args;
+};
+
+static struct jool_result nla_get_occupancy(struct nlattr *root,
+		struct joolnl_occupancy *out)
+{
+	struct nlattr *attrs[JNLAO_COUNT];
+	struct jool_result result;
+
+	result = jnla_parse_nested(attrs, JNLAO_MAX, root,
+			joolnl_occupancy_policy);
+	if (result.error)
+		return result;
+
+	if (!attrs[JNLAO_PROTO] || !attrs[JNLAO_ADDR4] || !attrs[JNLAO_BIBS]) {
+		return result_from_error(
+			-EINVAL,
+			"The kernel's response lacks an occupancy field."
+		);
+	}
+
+	out->proto = nla_get_u8(attrs[JNLAO_PROTO]);
+	nla_get_addr4(attrs[JNLAO_ADDR4], &out->addr);
+	out->bibs = nla_get_u32(attrs[JNLAO_BIBS]);
+	out->marked = !!attrs[JNLAO_MARK];
+	out->mark = out->marked ? nla_get_u32(attrs[JNLAO_MARK]) : 0;
+	return result_success();
+}
+
+static struct jool_result occupancy_response(struct nl_msg *response,
+		void *arg)
+{
+	struct occupancy_args *args = arg;
+	struct nlattr *attr;
+	int rem;
+	struct joolnl_occupancy entry;
+	bool done;
+	struct jool_result result;
+
+	result = joolnl_init_foreach_list(response, "occupancy", &done);
+	if (result.error)
+		return result;
+
+	foreach_entry(attr, genlmsg_hdr(nlmsg_hdr(response)), rem) {
+		result = nla_get_occupancy(attr, &entry);
+		if (result.error)
+			return result;
+
+		result = args->cb(&entry, args->args);
+		if (result.error)
+			return result;
+	}
+
+	return result_success();
+}
+
+struct jool_result joolnl_stats_occupancy(struct joolnl_socket *sk,
+		char const *iname, joolnl_occupancy_foreach_cb cb, void *args)
+{
+	struct nl_msg *msg;
+	struct occupancy_args oargs;
+	struct jool_result result;
+
+	oargs.cb = cb;
+	oargs.args = args;
+
+	result = joolnl_alloc_msg(sk, iname, JNLOP_STATS_OCCUPANCY, 0, &msg);
+	if (result.error)
+		return result;
+
+	return joolnl_dump(sk, msg, occupancy_response, &oargs);
+}
@@ -25,4 +25,26 @@ struct jool_result joolnl_stats_foreach(
 	void *args
 );
 
+/*
+ * Number of BIB entries some pool4 address is serving, for one mark.
+ * (@marked is false for the entries that did not belong to pool4.)
+ */
+struct joolnl_occupancy {
+	l4_protocol proto;
+	struct in_addr addr;
+	bool marked;
+	__u32 mark;
+	__u32 bibs;
+};
+
+typedef struct jool_result (*joolnl_occupancy_foreach_cb)(
+	struct joolnl_occupancy const *entry, void *args
+);
+struct jool_result joolnl_stats_occupancy(
+	struct joolnl_socket *sk,
+	char const *iname,
+	joolnl_occupancy_foreach_cb cb,
+	void *args
+);
+
 #endif /* SRC_USR_NL_STATS_H_ */
@@ -0,0 +1,398 @@
+#include "usr/util/json_stream.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Size of the stdio buffer. The file is read sequentially, so a large buffer
+ * keeps the number of read(2)s low.
+ */
+#define FILE_BUFSIZE (1 << 20)
+
+static struct jool_result syntax_error(struct json_stream *js,
+		char const *expected, int found)
+{
+	if (found == EOF) {
+		return result_from_error(
+			-EINVAL,
+			"%s, line %u: Expected %s, but the file ended.",
+			js->file_name, js->line, expected
+		);
+	}
+
+	return result_from_error(
+		-EINVAL,
+		"%s, line %u: Expected %s, found '%c'.",
+		js->file_name, js->line, expected, found
+	);
+}
+
+static int next_char(struct json_stream *js)
+{
+	int c;
+
+	c = getc(js->file);
+	if (c == '\n')
+		js->line++;
+	return c;
+}
+
+static void unread_char(struct json_stream *js, int c)
+{
+	if (c == EOF)
+		return;
+	if (c == '\n')
+		js->line--;
+	ungetc(c, js->file);
+}
+
+static int skip_whitespace(struct json_stream *js)
+{
+	int c;
+
+	do {
+		c = next_char(js);
+	} while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+
+	return c;
+}
+
+int json_stream_peek(struct json_stream *js)
+{
+	int c;
+
+	c = skip_whitespace(js);
+	unread_char(js, c);
+	return c;
+}
+
+struct jool_result json_stream_open(struct json_stream *js,
+		char const *file_name)
+{
+	int error;
+
+	memset(js, 0, sizeof(*js));
+	js->file_name = file_name;
+	js->line = 1;
+
+	js->file = fopen(file_name, "rb");
+	if (!js->file) {
+		error = errno;
+		return result_from_error(
+			error,
+			"Could not open file \"%s\": %s",
+			file_name, strerror(error)
+		);
+	}
+
+	/* Not fatal; stdio will simply use its default buffer. */
+	setvbuf(js->file, NULL, _IOFBF, FILE_BUFSIZE);
+	return result_success();
+}
+
+struct jool_result json_stream_rewind(struct json_stream *js)
+{
+	int error;
+
+	if (fseek(js->file, 0, SEEK_SET)) {
+		error = errno;
+		return result_from_error(
+			error,
+			"Could not fseek on file \"%s\": %s",
+			js->file_name, strerror(error)
+		);
+	}
+
+	js->line = 1;
+	js->comma_expected = false;
+	return result_success();
+}
+
+void json_stream_close(struct json_stream *js)
+{
+	fclose(js->file);
+	free(js->value);
+	free(js->key);
+}
+
+static struct jool_result append(char **buffer, size_t *len, size_t *size,
+		int c)
+{
+	char *tmp;
+
+	if (*len + 1 >= *size) {
+		tmp = realloc(*buffer, (*size) ? (2 * (*size)) : 256);
+		if (!tmp)
+			return result_from_enomem();
+		*buffer = tmp;
+		*size = (*size) ? (2 * (*size)) : 256;
+	}
+
+	(*buffer)[(*len)++] = c;
+	(*buffer)[*len] = '\0';
+	return result_success();
+}
+
+static struct jool_result store(struct json_stream *js, bool storing, int c)
+{
+	return storing
+			? append(&js->value, &js->value_len, &js->value_size, c)
+			: result_success();
+}
+
+/*
+ * Consumes the separator that precedes the next member or element, as well as
+ * the container's closing character, if that's what comes next.
+ * Sets @ended if the container ended.
+ */
+static struct jool_result next_member(struct json_stream *js, int closer,
+		bool *ended)
+{
+	int c;
+
+	c = skip_whitespace(js);
+	if (c == closer) {
+		*ended = true;
+		js->comma_expected = true;
+		return result_success();
+	}
+
+	if (js->comma_expected) {
+		if (c != ',')
+			return syntax_error(js, (closer == '}')
+					? "',' or '}'" : "',' or ']'", c);
+		js->comma_expected = false;
+	} else {
+		unread_char(js, c);
+	}
+
+	*ended = false;
+	return result_success();
+}
+
+static struct jool_result begin(struct json_stream *js, int opener,
+		char const *expected)
+{
+	int c;
+
+	c = skip_whitespace(js);
+	if (c != opener)
+		return syntax_error(js, expected, c);
+
+	js->comma_expected = false;
+	return result_success();
+}
+
+struct jool_result json_stream_object_begin(struct json_stream *js)
+{
+	return begin(js, '{', "an object");
+}
+
+struct jool_result json_stream_array_begin(struct json_stream *js)
+{
+	return begin(js, '[', "an array");
+}
+
+/**
+ * Moves on to the next member of the current object, and returns its name in
+ * @key. (The caller must then consume the value.)
+ * If the object ended, @key will be NULL.
+ *
+ * @key is only valid until the next call.
+ */
+struct jool_result json_stream_object_next(struct json_stream *js,
+		char const **key)
+{
+	size_t key_len;
+	bool ended = false;
+	int c;
+	struct jool_result result;
+
+	result = next_member(js, '}', &ended);
+	if (result.error)
+		return result;
+	if (ended) {
+		*key = NULL;
+		return result_success();
+	}
+
+	c = skip_whitespace(js);
+	if (c != '"')
+		return syntax_error(js, "a member name", c);
+
+	/* Make sure @key is a valid string, even if the name is empty. */
+	key_len = 0;
+	result = append(&js->key, &key_len, &js->key_size, '\0');
+	if (result.error)
+		return result;
+	key_len = 0;
+	js->key[0] = '\0';
+
+	/* Escapes are only collapsed. (Nobody needs \u in a tag name.) */
+	while ((c = next_char(js)) != '"') {
+		if (c == '\\')
+			c = next_char(js);
+		if (c == EOF || c == '\n')
+			return syntax_error(js, "'\"'", c);
+		result = append(&js->key, &key_len, &js->key_size, c);
+		if (result.error)
+			return result;
+	}
+
+	c = skip_whitespace(js);
+	if (c != ':')
+		return syntax_error(js, "':'", c);
+
+	*key = js->key;
+	return result_success();
+}
+
+/**
+ * Moves on to the next element of the current array. (The caller must then
+ * consume it.) If the array ended, @more will be false.
+ */
+struct jool_result json_stream_array_next(struct json_stream *js, bool *more)
+{
+	bool ended = false;
+	struct jool_result result;
+
+	result = next_member(js, ']', &ended);
+	if (result.error)
+		return result;
+
+	*more = !ended;
+	return result;
+}
+
+static struct jool_result scan_string(struct json_stream *js, bool storing)
+{
+	int c;
+	struct jool_result result;
+
+	/* The opening quote was already stored. */
+	do {
+		c = next_char(js);
+		if (c == EOF)
+			return syntax_error(js, "'\"'", c);
+		result = store(js, storing, c);
+		if (result.error)
+			return result;
+
+		if (c == '\\') {
+			c = next_char(js);
+			if (c == EOF)
+				return syntax_error(js, "'\"'", c);
+			result = store(js, storing, c);
+			if (result.error)
+				return result;
+			c = 0; /* Do not mistake an escaped quote for the end */
+		}
+	} while (c != '"');
+
+	return result_success();
+}
+
+static bool is_delimiter(int c)
+{
+	switch (c) {
+	case ',':
+	case '}':
+	case ']':
+	case ' ':
+	case '\t':
+	case '\n':
+	case '\r':
+		return true;
+	}
+	return false;
+}
+
+/* Reads the next value, whatever its type, without interpreting it. */
+static struct jool_result scan_value(struct json_stream *js, bool storing)
+{
+	unsigned int depth;
+	int c;
+	struct jool_result result;
+
+	js->value_len = 0;
+
+	c = skip_whitespace(js);
+	if (c == EOF || c == ':' || is_delimiter(c))
+		return syntax_error(js, "a value", c);
+
+	depth = 0;
+	do {
+		if (c == EOF) {
+			if (depth > 0)
+				return syntax_error(js, "'}' or ']'", c);
+			break; /* Scalar at the end of the file */
+		}
+		if (depth == 0 && is_delimiter(c)) {
+			/* End of a scalar */
+			unread_char(js, c);
+			break;
+		}
+
+		result = store(js, storing, c);
+		if (result.error)
+			return result;
+
+		if (c == '"') {
+			result = scan_string(js, storing);
+			if (result.error)
+				return result;
+		} else if (c == '{' || c == '[') {
+			depth++;
+		} else if (c == '}' || c == ']') {
+			depth--;
+		}
+
+		if (depth == 0 && (c == '"' || c == '}' || c == ']'))
+			break;
+
+		c = next_char(js);
+	} while (true);
+
+	js->comma_expected = true;
+	return result_success();
+}
+
+/**
+ * Parses the next value into a cJSON tree. (The tree is nameless, even if the
+ * value is the member of an object.)
+ *
+ * Remember to cJSON_Delete() @result when you're done.
+ */
+struct jool_result json_stream_read(struct json_stream *js, cJSON **result)
+{
+	unsigned int line;
+	cJSON *json;
+	struct jool_result jresult;
+
+	json_stream_peek(js); /* Skip whitespace, so @line is accurate */
+	line = js->line;
+	jresult = scan_value(js, true);
+	if (jresult.error)
+		return jresult;
+
+	json = cJSON_Parse(js->value);
+	if (!json) {
+		return result_from_error(
+			-EINVAL,
+			"%s, line %u: The JSON parser got confused around the beginning of this string:\n"
+			"%s", js->file_name, line, cJSON_GetErrorPtr()
+		);
+	}
+
+	*result = json;
+	return result_success();
+}
+
+/**
+ * Consumes the next value, without parsing it.
+ */
+struct jool_result json_stream_skip(struct json_stream *js)
+{
+	return scan_value(js, false);
+}
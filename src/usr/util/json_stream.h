@@ -0,0 +1,61 @@
+#ifndef SRC_USR_UTIL_JSON_STREAM_H_
+#define SRC_USR_UTIL_JSON_STREAM_H_
+
+/**
+ * @file
+ * Incremental reader for large JSON files.
+ *
+ * cJSON needs the entire document in memory, twice. (The text and the tree.)
+ * This module walks the outer containers of the document itself, reading the
+ * file sequentially, and only hands individual values to cJSON. So as long as
+ * the caller iterates over the big arrays one element at a time, memory usage
+ * does not depend on the size of the file.
+ *
+ * Usage:
+ *
+ *	json_stream_object_begin(js);
+ *	while (json_stream_object_next(js, &key) succeeds and @key != NULL)
+ *		json_stream_read(js, &value) (or _skip(), or another _begin())
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "usr/util/cJSON.h"
+#include "usr/util/result.h"
+
+struct json_stream {
+	char const *file_name;
+	FILE *file;
+	/* Current line, for error messages. */
+	unsigned int line;
+	/* Does the next element or member need to be preceded by a comma? */
+	bool comma_expected;
+
+	/* Raw text of the value being read by json_stream_read(). */
+	char *value;
+	size_t value_len;
+	size_t value_size;
+
+	/* Name of the last member returned by json_stream_object_next(). */
+	char *key;
+	size_t key_size;
+};
+
+struct jool_result json_stream_open(struct json_stream *js,
+		char const *file_name);
+struct jool_result json_stream_rewind(struct json_stream *js);
+void json_stream_close(struct json_stream *js);
+
+/* Returns the first character of the next value, without consuming it. */
+int json_stream_peek(struct json_stream *js);
+
+struct jool_result json_stream_object_begin(struct json_stream *js);
+struct jool_result json_stream_object_next(struct json_stream *js,
+		char const **key);
+struct jool_result json_stream_array_begin(struct json_stream *js);
+struct jool_result json_stream_array_next(struct json_stream *js, bool *more);
+
+struct jool_result json_stream_read(struct json_stream *js, cJSON **result);
+struct jool_result json_stream_skip(struct json_stream *js);
+
+#endif /* SRC_USR_UTIL_JSON_STREAM_H_ */
@@ -0,0 +1,326 @@
+#include <linux/module.h>
+#include <linux/printk.h>
+
+#include "framework/unit_test.h"
+#include "mod/common/atomic_config.c"
+
+MODULE_LICENSE(JOOL_LICENSE);
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("Atomic configuration module test.");
+
+static struct config_candidate candidate;
+static struct pool4 *running_pool4;
+
+/* What commit_diff() did to (and what it got from) xlator_replace_clone(). */
+static struct {
+	bool called;
+	bool check_bib;
+	/* Returned instead of the validation result, if nonzero. */
+	int error;
+	/* If not NULL, removed from the BIB behind commit_diff()'s back. */
+	struct bib_entry *sabotage;
+} replace;
+
+static int check_pool4(struct bib_entry const *bib, void *arg)
+{
+	struct xlator *jool = arg;
+
+	return pool4db_contains(jool->nat64.pool4, jool->ns, bib->l4_proto,
+			&bib->addr4) ? 0 : -EINVAL;
+}
+
+/* Stands in for xlator.c's version; only performs the BIB validation. */
+int xlator_replace_clone(struct xlator *jool, bool check_bib)
+{
+	replace.called = true;
+	replace.check_bib = check_bib;
+
+	if (replace.sabotage)
+		bib_rm(jool, replace.sabotage);
+	if (replace.error)
+		return replace.error;
+	if (check_bib && bib_foreach(jool->nat64.bib, L4PROTO_TCP, check_pool4,
+			jool, NULL))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int add_pool4(struct pool4 *pool, char *addr)
+{
+	struct pool4_entry entry;
+	int error;
+
+	entry.mark = 0;
+	entry.iterations = 0;
+	entry.flags = ITERATIONS_SET | ITERATIONS_INFINITE;
+	entry.proto = L4PROTO_TCP;
+	error = str_to_addr4(addr, &entry.range.prefix.addr);
+	if (error)
+		return error;
+	entry.range.prefix.len = 32;
+	entry.range.ports.min = 1000;
+	entry.range.ports.max = 2000;
+
+	return pool4db_add(pool, &entry);
+}
+
+static void init_bib(struct bib_entry *bib, char *addr6, u16 port6,
+		char *addr4, u16 port4)
+{
+	str_to_addr6(addr6, &bib->addr6.l3);
+	bib->addr6.l4 = port6;
+	str_to_addr4(addr4, &bib->addr4.l3);
+	bib->addr4.l4 = port4;
+	bib->l4_proto = L4PROTO_TCP;
+	bib->is_static = true;
+}
+
+static int queue_bib(struct list_head *changes, struct bib_entry *bib)
+{
+	struct config_change *change;
+
+	change = wkmalloc(struct config_change, GFP_KERNEL);
+	if (!change)
+		return -ENOMEM;
+
+	change->type = CHANGE_BIB;
+	change->force = false;
+	change->bib = *bib;
+	list_add_tail(&change->list_hook, changes);
+	return 0;
+}
+
+static bool assert_bib(bool expected, struct bib_entry *bib, char *test_name)
+{
+	struct bib_entry found;
+	int error;
+
+	error = bib_find6(candidate.xlator.nat64.bib, bib->l4_proto,
+			&bib->addr6, &found);
+	if (!expected)
+		return ASSERT_INT(-ESRCH, error, "%s", test_name);
+
+	return ASSERT_INT(0, error, "%s", test_name)
+			&& ASSERT_BIB(bib, &found, test_name);
+}
+
+/*
+ * Running instance: pool4 is 192.0.2.1#1000-2000, BIB is @a and @b.
+ * Candidate: pool4 is the same unless the test changes it.
+ */
+static struct bib_entry a;
+static struct bib_entry b;
+
+static int init(void)
+{
+	struct xlator *jool = &candidate.xlator;
+	int error;
+
+	memset(&candidate, 0, sizeof(candidate));
+	memset(&replace, 0, sizeof(replace));
+
+	error = xlator_init(jool, NULL, INAME_DEFAULT,
+			XF_NETFILTER | XT_NAT64, NULL);
+	if (error)
+		return error;
+
+	candidate.diff = true;
+	INIT_LIST_HEAD(&candidate.removals);
+	INIT_LIST_HEAD(&candidate.additions);
+
+	running_pool4 = pool4db_alloc();
+	candidate.pool4 = pool4db_alloc();
+	if (!running_pool4 || !candidate.pool4) {
+		error = -ENOMEM;
+		goto fail;
+	}
+	jool->nat64.pool4 = running_pool4;
+
+	error = add_pool4(running_pool4, "192.0.2.1");
+	if (error)
+		goto fail;
+
+	init_bib(&a, "2001:db8::1", 1001, "192.0.2.1", 1001);
+	init_bib(&b, "2001:db8::2", 1002, "192.0.2.1", 1002);
+	error = bib_add_static(jool, &a);
+	if (error)
+		goto fail;
+	error = bib_add_static(jool, &b);
+	if (error)
+		goto fail;
+
+	return 0;
+
+fail:
+	if (candidate.pool4)
+		pool4db_put(candidate.pool4);
+	if (running_pool4)
+		pool4db_put(running_pool4);
+	xlator_put(jool);
+	return error;
+}
+
+static void end(void)
+{
+	destroy_changes(&candidate.removals);
+	destroy_changes(&candidate.additions);
+	/* Whichever way they ended up swapped, both need to go. */
+	pool4db_put(candidate.pool4);
+	pool4db_put(candidate.xlator.nat64.pool4);
+	xlator_put(&candidate.xlator);
+}
+
+/*
+ * A failing addition rolls back the additions that preceded it, as well as
+ * all the removals.
+ */
+static bool test_failed_addition(void)
+{
+	struct bib_entry c;
+	struct bib_entry d;
+	bool success = true;
+
+	if (init())
+		return false;
+
+	init_bib(&c, "2001:db8::3", 1003, "192.0.2.1", 1003);
+	init_bib(&d, "2001:db8::4", 1004, "203.0.113.1", 1004); /* No pool4 */
+	success &= ASSERT_INT(0, add_pool4(candidate.pool4, "192.0.2.1"),
+			"pool4");
+	success &= ASSERT_INT(0, queue_bib(&candidate.removals, &a), "rm a");
+	success &= ASSERT_INT(0, queue_bib(&candidate.removals, &b), "rm b");
+	success &= ASSERT_INT(0, queue_bib(&candidate.additions, &c), "add c");
+	success &= ASSERT_INT(0, queue_bib(&candidate.additions, &d), "add d");
+	if (!success)
+		goto end;
+
+	success &= ASSERT_INT(-EINVAL, commit_diff(&candidate), "commit");
+	success &= ASSERT_BOOL(false, replace.called, "not replaced");
+	success &= assert_bib(true, &a, "a restored");
+	success &= assert_bib(true, &b, "b restored");
+	success &= assert_bib(false, &c, "c rolled back");
+	success &= assert_bib(false, &d, "d not added");
+
+end:
+	end();
+	return success;
+}
+
+/* If pool4 doesn't change, the BIB doesn't need to be walked. */
+static bool test_same_pool4(void)
+{
+	struct bib_entry c;
+	bool success = true;
+
+	if (init())
+		return false;
+
+	init_bib(&c, "2001:db8::3", 1003, "192.0.2.1", 1003);
+	success &= ASSERT_INT(0, add_pool4(candidate.pool4, "192.0.2.1"),
+			"pool4");
+	success &= ASSERT_INT(0, queue_bib(&candidate.removals, &a), "rm a");
+	success &= ASSERT_INT(0, queue_bib(&candidate.additions, &c), "add c");
+	if (!success)
+		goto end;
+
+	success &= ASSERT_INT(0, commit_diff(&candidate), "commit");
+	success &= ASSERT_BOOL(true, replace.called, "replaced");
+	success &= ASSERT_BOOL(false, replace.check_bib, "BIB not walked");
+	success &= ASSERT_PTR(running_pool4, candidate.xlator.nat64.pool4,
+			"pool4 kept");
+	success &= assert_bib(false, &a, "a removed");
+	success &= assert_bib(true, &b, "b untouched");
+	success &= assert_bib(true, &c, "c added");
+
+end:
+	end();
+	return success;
+}
+
+/*
+ * If pool4 changes, and a static BIB entry the diff didn't touch falls outside
+ * of it, the commit is rejected and everything is reverted.
+ */
+static bool test_pool4_orphans_bib(void)
+{
+	struct bib_entry c;
+	bool success = true;
+
+	if (init())
+		return false;
+
+	/* @b is untouched, and 192.0.2.1 is no longer in pool4. */
+	init_bib(&c, "2001:db8::3", 1003, "192.0.2.2", 1003);
+	success &= ASSERT_INT(0, add_pool4(candidate.pool4, "192.0.2.2"),
+			"pool4");
+	success &= ASSERT_INT(0, queue_bib(&candidate.removals, &a), "rm a");
+	success &= ASSERT_INT(0, queue_bib(&candidate.additions, &c), "add c");
+	if (!success)
+		goto end;
+
+	success &= ASSERT_INT(-EINVAL, commit_diff(&candidate), "commit");
+	success &= ASSERT_BOOL(true, replace.check_bib, "BIB walked");
+	success &= ASSERT_PTR(running_pool4, candidate.xlator.nat64.pool4,
+			"pool4 restored");
+	success &= assert_bib(true, &a, "a restored");
+	success &= assert_bib(true, &b, "b untouched");
+	success &= assert_bib(false, &c, "c rolled back");
+
+end:
+	end();
+	return success;
+}
+
+/* Rollback failures need to reach the caller. */
+static bool test_failed_rollback(void)
+{
+	struct bib_entry c;
+	bool success = true;
+
+	if (init())
+		return false;
+
+	init_bib(&c, "2001:db8::3", 1003, "192.0.2.1", 1003);
+	success &= ASSERT_INT(0, add_pool4(candidate.pool4, "192.0.2.1"),
+			"pool4");
+	success &= ASSERT_INT(0, queue_bib(&candidate.removals, &a), "rm a");
+	success &= ASSERT_INT(0, queue_bib(&candidate.additions, &c), "add c");
+	if (!success)
+		goto end;
+
+	/* @c will already be gone when the rollback tries to remove it. */
+	replace.error = -ENOMEM;
+	replace.sabotage = &c;
+
+	success &= ASSERT_INT(-ENOTRECOVERABLE, commit_diff(&candidate),
+			"commit");
+	success &= assert_bib(true, &a, "a restored");
+	success &= assert_bib(false, &c, "c gone");
+
+end:
+	end();
+	return success;
+}
+
+int init_module(void)
+{
+	struct test_group test = {
+		.name = "Atomic Configuration",
+	};
+
+	if (test_group_begin(&test))
+		return -EINVAL;
+
+	test_group_test(&test, test_failed_addition, "Failed addition");
+	test_group_test(&test, test_same_pool4, "Unchanged pool4");
+	test_group_test(&test, test_pool4_orphans_bib, "pool4 orphans a BIB entry");
+	test_group_test(&test, test_failed_rollback, "Failed rollback");
+
+	return test_group_end(&test);
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
@@ -0,0 +1,153 @@
+#include "mod/common/xlator.h"
+#include "mod/common/db/denylist4.h"
+#include "mod/common/db/eam.h"
+#include "mod/common/db/bib/events.h"
+#include "mod/common/db/bib/pkt_queue.h"
+#include "mod/common/db/pool4/rfc6056.h"
+#include "mod/common/nl/global.h"
+#include "mod/common/nl/nl_common.h"
+#include "framework/unit_test.h"
+
+/*
+ * The tests only exercise BIB changes, so the SIIT tables, the Netlink
+ * plumbing and the packet queue are never reached.
+ */
+
+static struct fake_pktqueue {
+	int junk;
+} dummy;
+
+int xlator_find(struct net *ns, xlator_flags flags, const char *iname,
+		struct xlator *result)
+{
+	return broken_unit_call(__func__);
+}
+
+int xlator_replace(struct xlator *jool)
+{
+	return broken_unit_call(__func__);
+}
+
+int eamt_add(struct eam_table *eamt, struct eamt_entry *new, bool force,
+		bool synchronize)
+{
+	return broken_unit_call(__func__);
+}
+
+int eamt_rm(struct eam_table *eamt, struct ipv6_prefix *prefix6,
+		struct ipv4_prefix *prefix4)
+{
+	return broken_unit_call(__func__);
+}
+
+int denylist4_add(struct addr4_pool *pool, struct ipv4_prefix *prefix,
+		bool force)
+{
+	return broken_unit_call(__func__);
+}
+
+int denylist4_rm(struct addr4_pool *pool, struct ipv4_prefix *prefix)
+{
+	return broken_unit_call(__func__);
+}
+
+int global_update(struct jool_globals *cfg, xlator_type xt, bool force,
+		struct nlattr *root)
+{
+	return broken_unit_call(__func__);
+}
+
+struct joolnlhdr *get_jool_hdr(struct genl_info *info)
+{
+	broken_unit_call(__func__);
+	return NULL;
+}
+
+int rfc6056_f(struct xlation *state, unsigned int *result)
+{
+	return broken_unit_call(__func__);
+}
+
+int __rfc6052_6to4(struct ipv6_prefix const *prefix, struct in6_addr const *src,
+		struct in_addr *dst)
+{
+	return broken_unit_call(__func__);
+}
+
+verdict predict_route64(struct xlation *state)
+{
+	broken_unit_call(__func__);
+	return VERDICT_DROP;
+}
+
+int foreach_ifa(struct net *ns, int (*cb)(struct in_ifaddr *, void const *),
+		void const *args)
+{
+	return broken_unit_call(__func__);
+}
+
+struct pktqueue *pktqueue_alloc(void)
+{
+	return (struct pktqueue *)&dummy;
+}
+
+void pktqueue_release(struct pktqueue *queue)
+{
+	/* No code. */
+}
+
+int pktqueue_add(struct pktqueue *queue, struct packet *pkt,
+		struct ipv6_transport_addr *dst6, bool too_many)
+{
+	return broken_unit_call(__func__);
+}
+
+void pktqueue_rm(struct pktqueue *queue, struct ipv4_transport_addr *src4)
+{
+	/* No code. */
+}
+
+struct pktqueue_session *pktqueue_find(struct pktqueue *queue,
+		struct ipv6_transport_addr *addr,
+		struct mask_domain *masks)
+{
+	broken_unit_call(__func__);
+	return NULL;
+}
+
+void pktqueue_put_node(struct xlator *jool, struct pktqueue_session *node)
+{
+	broken_unit_call(__func__);
+}
+
+unsigned int pktqueue_prepare_clean(struct pktqueue *queue,
+		struct list_head *probes)
+{
+	return broken_unit_call(__func__);
+}
+
+void pktqueue_clean(struct xlator *jool, struct list_head *probes)
+{
+	broken_unit_call(__func__);
+}
+
+struct bib_events *bibev_alloc(void)
+{
+	return (struct bib_events *)&dummy;
+}
+
+void bibev_free(struct bib_events *events)
+{
+	/* No code. */
+}
+
+void bibev_add(struct xlator *jool, struct bib_events *events,
+		struct bib_event_record const *record)
+{
+	broken_unit_call(__func__);
+}
+
+void bibev_flush(struct xlator *jool, struct bib_events *events)
+{
+	/* No code. */
+}
@@ -0,0 +1,295 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include "framework/unit_test.h"
+#include "mod/common/db/bib/events.c"
+
+MODULE_LICENSE(JOOL_LICENSE);
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("BIB events test.");
+
+/********************** Mocks **********************/
+
+static struct sk_buff_head sent;
+/* If nonzero, sendpkt_multicast_events() fails with this. */
+static int send_error;
+static unsigned int kicks;
+static unsigned int stats[JSTAT_COUNT];
+
+int sendpkt_multicast_events(struct xlator *jool, struct sk_buff *skb)
+{
+	if (send_error) {
+		kfree_skb(skb);
+		return send_error;
+	}
+
+	skb_queue_tail(&sent, skb);
+	return 0;
+}
+
+static struct genl_family family_mock = {
+	.id = 1234,
+	.hdrsize = sizeof(struct joolnlhdr),
+	.version = 2,
+	.module = THIS_MODULE,
+};
+
+struct genl_family *jnl_family(void)
+{
+	return &family_mock;
+}
+
+void jtimer_kick(void)
+{
+	kicks++;
+}
+
+void jstat_add(struct jool_stats *unused, enum jool_stat_id stat, int addend)
+{
+	stats[stat] += addend;
+}
+
+/********************** Init **********************/
+
+static struct xlator jool;
+static struct bib_events *events;
+
+static int init(void)
+{
+	memset(&jool, 0, sizeof(jool));
+	strcpy(jool.iname, INAME_DEFAULT);
+	skb_queue_head_init(&sent);
+	send_error = 0;
+	kicks = 0;
+	memset(stats, 0, sizeof(stats));
+
+	events = bibev_alloc();
+	return events ? 0 : -ENOMEM;
+}
+
+static void end(void)
+{
+	skb_queue_purge(&sent);
+	bibev_free(events);
+}
+
+/*
+ * Queues records @first through @first + @count - 1. (The timestamp is the
+ * record's index.)
+ * Stays on one CPU, so the batches are predictable.
+ */
+static void add_records(unsigned int first, unsigned int count)
+{
+	struct bib_event_record record;
+	unsigned int i;
+
+	memset(&record, 0, sizeof(record));
+	record.type = BEV_SESSION_ADD;
+	record.proto = L4PROTO_TCP;
+
+	get_cpu();
+	for (i = first; i < first + count; i++) {
+		record.timestamp = cpu_to_be64(i);
+		bibev_add(&jool, events, &record);
+	}
+	put_cpu();
+}
+
+/********************** Asserts **********************/
+
+/*
+ * Asserts the next sent message is number @seq, reports @lost drops, and
+ * contains records @first through @first + @count - 1.
+ */
+static bool assert_msg(__u32 seq, __u32 lost, unsigned int first,
+		unsigned int count)
+{
+	struct sk_buff *skb;
+	struct nlattr *attr;
+	struct bib_event_record *records;
+	unsigned int i;
+	bool success;
+
+	skb = skb_dequeue(&sent);
+	if (!ASSERT_NOTNULL(skb, "skb was sent"))
+		return false;
+
+	success = true;
+
+	attr = nlmsg_find_attr(nlmsg_hdr(skb), GENL_HDRLEN + JOOLNL_HDRLEN,
+			JNLAR_EVENT_SEQ);
+	if (ASSERT_NOTNULL(attr, "seq"))
+		success &= ASSERT_UINT(seq, nla_get_u32(attr), "seq value");
+	else
+		success = false;
+
+	attr = nlmsg_find_attr(nlmsg_hdr(skb), GENL_HDRLEN + JOOLNL_HDRLEN,
+			JNLAR_EVENT_LOST);
+	if (ASSERT_NOTNULL(attr, "lost"))
+		success &= ASSERT_UINT(lost, nla_get_u32(attr), "lost value");
+	else
+		success = false;
+
+	attr = nlmsg_find_attr(nlmsg_hdr(skb), GENL_HDRLEN + JOOLNL_HDRLEN,
+			JNLAR_EVENT_RECORDS);
+	if (!ASSERT_NOTNULL(attr, "records")) {
+		success = false;
+		goto end;
+	}
+	if (!ASSERT_INT(count * (int)sizeof(struct bib_event_record),
+			nla_len(attr), "records length")) {
+		success = false;
+		goto end;
+	}
+
+	records = nla_data(attr);
+	for (i = 0; i < count; i++) {
+		success &= ASSERT_U64((u64)(first + i),
+				be64_to_cpu(records[i].timestamp),
+				"record %u", i);
+	}
+
+end:
+	kfree_skb(skb);
+	return success;
+}
+
+static bool assert_nothing_sent(void)
+{
+	struct sk_buff *skb;
+	bool success;
+
+	skb = skb_dequeue(&sent);
+	success = ASSERT_NULL(skb, "skb was not sent");
+	kfree_skb(skb);
+	return success;
+}
+
+static bool assert_lost(unsigned int expected)
+{
+	return ASSERT_UINT(expected, (unsigned int)atomic_read(&events->lost),
+			"lost")
+			&& ASSERT_UINT(expected, stats[JSTAT_BIB_EVENTS_LOST],
+					"lost stat");
+}
+
+/********************** Unit tests **********************/
+
+/*
+ * The packet path never sends; full batches only poke the timer, and the
+ * flush sends everything, one message per batch.
+ */
+static bool test_batching(void)
+{
+	bool success = true;
+
+	if (init())
+		return false;
+
+	add_records(0, 2 * BIBEV_BATCH + 3);
+	success &= ASSERT_UINT(2, kicks, "kicks");
+	success &= assert_nothing_sent();
+
+	bibev_flush(&jool, events);
+	success &= assert_msg(0, 0, 0, BIBEV_BATCH);
+	success &= assert_msg(1, 0, BIBEV_BATCH, BIBEV_BATCH);
+	success &= assert_msg(2, 0, 2 * BIBEV_BATCH, 3);
+	success &= assert_nothing_sent();
+	success &= assert_lost(0);
+
+	/* Nothing pending, so nothing to send. */
+	bibev_flush(&jool, events);
+	success &= assert_nothing_sent();
+
+	/* This one wraps around the ring. */
+	add_records(500, BIBEV_BATCHES * BIBEV_BATCH - 1);
+	bibev_flush(&jool, events);
+	success &= assert_msg(3, 0, 500, BIBEV_BATCH);
+	success &= assert_msg(4, 0, 500 + BIBEV_BATCH, BIBEV_BATCH);
+	success &= assert_msg(5, 0, 500 + 2 * BIBEV_BATCH, BIBEV_BATCH);
+	success &= assert_msg(6, 0, 500 + 3 * BIBEV_BATCH, BIBEV_BATCH - 1);
+	success &= assert_nothing_sent();
+
+	end();
+	return success;
+}
+
+/* If the timer falls behind, the records that don't fit are counted. */
+static bool test_overflow(void)
+{
+	bool success = true;
+
+	if (init())
+		return false;
+
+	add_records(0, BIBEV_BATCHES * BIBEV_BATCH + 5);
+	success &= ASSERT_UINT(BIBEV_BATCHES, kicks, "kicks");
+	success &= assert_nothing_sent();
+	success &= assert_lost(5);
+
+	bibev_flush(&jool, events);
+	success &= assert_msg(0, 5, 0, BIBEV_BATCH);
+	success &= assert_msg(1, 5, BIBEV_BATCH, BIBEV_BATCH);
+	success &= assert_msg(2, 5, 2 * BIBEV_BATCH, BIBEV_BATCH);
+	success &= assert_msg(3, 5, 3 * BIBEV_BATCH, BIBEV_BATCH);
+	success &= assert_nothing_sent();
+
+	/* Flushing made room again. */
+	add_records(1000, 1);
+	bibev_flush(&jool, events);
+	success &= assert_msg(4, 5, 1000, 1);
+	success &= assert_nothing_sent();
+	success &= assert_lost(5);
+
+	end();
+	return success;
+}
+
+/* Nobody listening is not a loss; a listener falling behind is. */
+static bool test_send_errors(void)
+{
+	bool success = true;
+
+	if (init())
+		return false;
+
+	send_error = -ESRCH;
+	add_records(0, 3);
+	bibev_flush(&jool, events);
+	success &= assert_lost(0);
+
+	send_error = -ENOBUFS;
+	add_records(3, 4);
+	bibev_flush(&jool, events);
+	success &= assert_lost(4);
+
+	send_error = 0;
+	add_records(7, 2);
+	bibev_flush(&jool, events);
+	success &= assert_msg(2, 4, 7, 2);
+	success &= assert_nothing_sent();
+
+	end();
+	return success;
+}
+
+int init_module(void)
+{
+	struct test_group test = {
+		.name = "BIB events",
+	};
+
+	if (test_group_begin(&test))
+		return -EINVAL;
+
+	test_group_test(&test, test_batching, "batching");
+	test_group_test(&test, test_overflow, "overflow");
+	test_group_test(&test, test_send_errors, "send errors");
+
+	return test_group_end(&test);
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
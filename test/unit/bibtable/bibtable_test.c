@@ -142,6 +142,209 @@ static bool test_foreach(void)
 	return success;
 }
 
+/* Enough to span several of bib_foreach()'s chunks. */
+#define CHUNK_TEST_COUNT 100
+
+struct chunk_args {
+	unsigned int count;
+	unsigned int stop;
+	__u16 last_port;
+	bool sorted;
+};
+
+static int chunk_cb(struct bib_entry const *bib, void *void_args)
+{
+	struct chunk_args *args = void_args;
+
+	if (bib->addr4.l4 <= args->last_port)
+		args->sorted = false;
+	args->last_port = bib->addr4.l4;
+	args->count++;
+
+	return (args->count == args->stop) ? 1 : 0;
+}
+
+static bool test_foreach_chunks(void)
+{
+	struct bib_entry entry;
+	struct ipv4_transport_addr offset;
+	struct chunk_args args;
+	unsigned int i;
+	int error;
+	bool success = true;
+
+	if (str_to_addr4("198.51.100.1", &entry.addr4.l3))
+		return false;
+	if (str_to_addr6("2001:db8::1", &entry.addr6.l3))
+		return false;
+	entry.l4_proto = L4PROTO_UDP;
+	for (i = 1; i <= CHUNK_TEST_COUNT; i++) {
+		entry.addr4.l4 = i;
+		entry.addr6.l4 = i;
+		if (bib_add_static(&jool, &entry))
+			return false;
+	}
+
+	/* Everything, in order, once. */
+	memset(&args, 0, sizeof(args));
+	args.sorted = true;
+	error = bib_foreach(jool.nat64.bib, L4PROTO_UDP, chunk_cb, &args, NULL);
+	success &= ASSERT_INT(0, error, "full result");
+	success &= ASSERT_UINT(CHUNK_TEST_COUNT, args.count, "full count");
+	success &= ASSERT_BOOL(true, args.sorted, "full sorted");
+
+	/* The callback interrupts the iteration in the middle of a chunk. */
+	memset(&args, 0, sizeof(args));
+	args.sorted = true;
+	args.stop = 50;
+	error = bib_foreach(jool.nat64.bib, L4PROTO_UDP, chunk_cb, &args, NULL);
+	success &= ASSERT_INT(1, error, "stop result");
+	success &= ASSERT_UINT(50, args.count, "stop count");
+
+	/* Resume from an offset. */
+	offset = entry.addr4;
+	offset.l4 = 40;
+	memset(&args, 0, sizeof(args));
+	args.sorted = true;
+	args.last_port = 40;
+	error = bib_foreach(jool.nat64.bib, L4PROTO_UDP, chunk_cb, &args,
+			&offset);
+	success &= ASSERT_INT(0, error, "offset result");
+	success &= ASSERT_UINT(CHUNK_TEST_COUNT - 40, args.count,
+			"offset count");
+	success &= ASSERT_BOOL(true, args.sorted, "offset sorted");
+
+	return success;
+}
+
+struct usage_args {
+	struct bib_usage usages[TEST_BIB_COUNT];
+	unsigned int count;
+};
+
+static int usage_cb(struct bib_usage const *usage, void *void_args)
+{
+	struct usage_args *args = void_args;
+
+	if (args->count >= TEST_BIB_COUNT)
+		return -EINVAL;
+	args->usages[args->count++] = *usage;
+	return 0;
+}
+
+static bool assert_usage(struct usage_args *args, unsigned int index,
+		char *addr, bool marked, __u32 mark, unsigned int bibs)
+{
+	struct bib_usage *usage = &args->usages[index];
+	bool success = true;
+
+	success &= ASSERT_ADDR4(addr, &usage->addr, "addr");
+	success &= ASSERT_BOOL(marked, usage->marked, "marked");
+	if (marked)
+		success &= ASSERT_UINT(mark, usage->mark, "mark");
+	success &= ASSERT_UINT(bibs, usage->bibs, "bibs");
+	return success;
+}
+
+static int init_usage_offset(char *addr, __u32 mark, struct bib_usage *offset)
+{
+	offset->marked = true;
+	offset->mark = mark;
+	return str_to_addr4(addr, &offset->addr);
+}
+
+/*
+ * (impersonator/bib.c attributes ports 1-99 to mark 0, 100-199 to mark 1, and
+ * the rest to nobody.)
+ */
+static bool test_usage(void)
+{
+	struct usage_args args;
+	struct bib_usage offset;
+	struct bib_entry orphan;
+	int error;
+	bool success = true;
+
+	if (!insert_test_bibs())
+		return false;
+
+	memset(&args, 0, sizeof(args));
+	error = bib_foreach_usage(jool.nat64.bib, L4PROTO_UDP, usage_cb,
+			&args, NULL);
+	success &= ASSERT_INT(0, error, "full result");
+	success &= ASSERT_UINT(4, args.count, "full count");
+	if (!success)
+		return false;
+	success &= assert_usage(&args, 0, "192.0.2.1", true, 1, 1);
+	/* 192.0.2.2's ports are split between marks. */
+	success &= assert_usage(&args, 1, "192.0.2.2", true, 0, 1);
+	success &= assert_usage(&args, 2, "192.0.2.2", true, 1, 2);
+	success &= assert_usage(&args, 3, "192.0.2.3", true, 1, 1);
+
+	/* Other tables are not affected. */
+	memset(&args, 0, sizeof(args));
+	error = bib_foreach_usage(jool.nat64.bib, L4PROTO_TCP, usage_cb,
+			&args, NULL);
+	success &= ASSERT_INT(0, error, "TCP result");
+	success &= ASSERT_UINT(0, args.count, "TCP count");
+
+	/* Counts decrease, and addresses vanish once unused. */
+	if (bib_rm(&jool, &entries[0]) || bib_rm(&jool, &entries[2]))
+		return false;
+
+	memset(&args, 0, sizeof(args));
+	error = bib_foreach_usage(jool.nat64.bib, L4PROTO_UDP, usage_cb,
+			&args, NULL);
+	success &= ASSERT_INT(0, error, "rm result");
+	success &= ASSERT_UINT(3, args.count, "rm count");
+	if (!success)
+		return false;
+	success &= assert_usage(&args, 0, "192.0.2.2", true, 0, 1);
+	success &= assert_usage(&args, 1, "192.0.2.2", true, 1, 1);
+	success &= assert_usage(&args, 2, "192.0.2.3", true, 1, 1);
+
+	/* Offset; also from an address that is no longer tracked. */
+	if (init_usage_offset("192.0.2.1", 1, &offset))
+		return false;
+	memset(&args, 0, sizeof(args));
+	error = bib_foreach_usage(jool.nat64.bib, L4PROTO_UDP, usage_cb,
+			&args, &offset);
+	success &= ASSERT_INT(0, error, "offset result");
+	success &= ASSERT_UINT(3, args.count, "offset count");
+
+	/* Offset in the middle of an address. */
+	if (init_usage_offset("192.0.2.2", 0, &offset))
+		return false;
+	memset(&args, 0, sizeof(args));
+	error = bib_foreach_usage(jool.nat64.bib, L4PROTO_UDP, usage_cb,
+			&args, &offset);
+	success &= ASSERT_INT(0, error, "offset 2 result");
+	success &= ASSERT_UINT(2, args.count, "offset 2 count");
+	if (success) {
+		success &= assert_usage(&args, 0, "192.0.2.2", true, 1, 1);
+		success &= assert_usage(&args, 1, "192.0.2.3", true, 1, 1);
+	}
+
+	/* Entries outside of pool4 are counted apart, before the marks. */
+	orphan = entries[1];
+	orphan.addr4.l4 = 500;
+	orphan.addr6.l4 = 500;
+	if (bib_add_static(&jool, &orphan))
+		return false;
+
+	memset(&args, 0, sizeof(args));
+	error = bib_foreach_usage(jool.nat64.bib, L4PROTO_UDP, usage_cb,
+			&args, NULL);
+	success &= ASSERT_INT(0, error, "orphan result");
+	success &= ASSERT_UINT(4, args.count, "orphan count");
+	if (success) {
+		success &= assert_usage(&args, 0, "192.0.2.2", false, 0, 1);
+		success &= assert_usage(&args, 1, "192.0.2.2", true, 0, 1);
+	}
+
+	return success;
+}
+
 enum session_fate tcp_est_expire_cb(struct session_entry *session, void *arg)
 {
 	return FATE_RM;
@@ -171,6 +374,8 @@ int init_module(void)
 		return -EINVAL;
 
 	test_group_test(&test, test_foreach, "Foreach");
+	test_group_test(&test, test_foreach_chunks, "Foreach, several chunks");
+	test_group_test(&test, test_usage, "Address usage");
 
 	return test_group_end(&test);
 }
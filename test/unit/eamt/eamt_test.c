@@ -455,6 +455,108 @@ static bool remove_test(void)
 	return success;
 }
 
+static bool init_entry(struct eamt_entry *entry, char *addr4, __u8 len4,
+		char *addr6, __u8 len6)
+{
+	if (str_to_addr4(addr4, &entry->prefix4.addr))
+		return false;
+	entry->prefix4.len = len4;
+	if (str_to_addr6(addr6, &entry->prefix6.addr))
+		return false;
+	entry->prefix6.len = len6;
+	return true;
+}
+
+static bool bulk_test(void)
+{
+	struct eamt_entry entries[5];
+	int results[5];
+	bool success = true;
+
+	/* Add */
+	success &= init_entry(&entries[0], "1.0.0.0", 32, "1::", 128);
+	success &= init_entry(&entries[1], "2.0.0.0", 32, "2::", 128);
+	success &= init_entry(&entries[2], "2.0.0.0", 32, "2::", 128);
+	success &= init_entry(&entries[3], "3.0.0.0", 32, "3::", 128);
+	success &= init_entry(&entries[4], "4.0.0.0", 32, "4::", 128);
+	if (!success)
+		return false;
+
+	memset(results, 0, sizeof(results));
+	results[3] = -EINVAL; /* Pretend it could not be parsed */
+	eamt_add_many(eamt, entries, results, 5, false);
+
+	success &= ASSERT_INT(0, results[0], "add result 0");
+	success &= ASSERT_INT(0, results[1], "add result 1");
+	success &= ASSERT_INT(-EEXIST, results[2], "add result 2");
+	success &= ASSERT_INT(-EINVAL, results[3], "add result 3");
+	success &= ASSERT_INT(0, results[4], "add result 4");
+	success &= ASSERT_U64(3ULL, eamt->count, "Table count after add");
+	success &= test("1.0.0.0", "1::");
+	success &= test("2.0.0.0", "2::");
+	success &= test("4.0.0.0", "4::");
+
+	/* Remove */
+	success &= init_entry(&entries[2], "5.0.0.0", 32, "5::", 128);
+	success &= init_entry(&entries[3], "4.0.0.0", 32, "6::", 128);
+	if (!success)
+		return false;
+
+	memset(results, 0, sizeof(results));
+	results[4] = -EINVAL;
+	eamt_rm_many(eamt, entries, results, 5);
+
+	success &= ASSERT_INT(0, results[0], "rm result 0");
+	success &= ASSERT_INT(0, results[1], "rm result 1");
+	success &= ASSERT_INT(-ESRCH, results[2], "rm result 2");
+	success &= ASSERT_INT(-ESRCH, results[3], "rm result 3");
+	success &= ASSERT_INT(-EINVAL, results[4], "rm result 4");
+	success &= ASSERT_U64(1ULL, eamt->count, "Table count after rm");
+	success &= test_6to4("1::", NULL);
+	success &= test_4to6("2.0.0.0", NULL);
+	success &= test("4.0.0.0", "4::");
+
+	eamt_flush(eamt);
+	return success;
+}
+
+/* eamt_add_many() on a table that already has entries. */
+static bool bulk_populated_test(void)
+{
+	struct eamt_entry entries[3];
+	int results[3];
+	bool success = true;
+
+	success &= init_entry(&entries[0], "1.0.0.0", 32, "1::", 128);
+	success &= init_entry(&entries[1], "2.0.0.0", 24, "2::", 120);
+	if (!success)
+		return false;
+	success &= ASSERT_INT(0, eamt_add(eamt, &entries[0], false, true),
+			"add 0");
+	success &= ASSERT_INT(0, eamt_add(eamt, &entries[1], false, true),
+			"add 1");
+
+	success &= init_entry(&entries[0], "3.0.0.0", 32, "3::", 128);
+	success &= init_entry(&entries[1], "2.0.0.0", 24, "2::", 120);
+	success &= init_entry(&entries[2], "2.0.0.0", 25, "2::", 121);
+	if (!success)
+		return false;
+
+	memset(results, 0, sizeof(results));
+	eamt_add_many(eamt, entries, results, 3, false);
+
+	success &= ASSERT_INT(0, results[0], "result 0");
+	success &= ASSERT_INT(-EEXIST, results[1], "result 1");
+	success &= ASSERT_INT(-EEXIST, results[2], "result 2");
+	success &= ASSERT_U64(3ULL, eamt->count, "Table count");
+	success &= test("1.0.0.0", "1::");
+	success &= test("2.0.0.1", "2::1");
+	success &= test("3.0.0.0", "3::");
+
+	eamt_flush(eamt);
+	return success;
+}
+
 static int address_mapping_test_init(void)
 {
 	struct test_group test = {
@@ -472,6 +574,8 @@ static int address_mapping_test_init(void)
 	test_group_test(&test, rfc7757_overlapping_test, "RFC 7757 Section 5, 1st half");
 	test_group_test(&test, rfc7757_identical_test, "RFC 7757 Section 5, 2nd half");
 	test_group_test(&test, remove_test, "remove function");
+	test_group_test(&test, bulk_test, "bulk functions");
+	test_group_test(&test, bulk_populated_test, "bulk add, populated table");
 
 	return test_group_end(&test);
 }
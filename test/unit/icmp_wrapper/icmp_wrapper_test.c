@@ -0,0 +1,112 @@
+#include <linux/module.h>
+#include "mod/common/icmp_wrapper.c"
+#include "framework/unit_test.h"
+
+MODULE_LICENSE(JOOL_LICENSE);
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("ICMP error rate limiter test.");
+
+#define RATE 10
+#define BURST 5
+
+/* Arbitrary, but far from zero. */
+#define START (1000 * HZ)
+/* Jiffies it takes to earn one token */
+#define TOKEN DIV_ROUND_UP(HZ, RATE)
+
+static bool spend(struct icmprl_bucket *bucket, unsigned long now,
+		unsigned int expected_successes)
+{
+	unsigned int i;
+	bool success = true;
+
+	for (i = 0; i < expected_successes; i++)
+		success &= ASSERT_TRUE(icmprl_spend(bucket, now, RATE, BURST),
+				"Token %u", i);
+	success &= ASSERT_FALSE(icmprl_spend(bucket, now, RATE, BURST),
+			"Bucket is empty");
+
+	return success;
+}
+
+static bool test_burst(void)
+{
+	struct icmprl_bucket bucket;
+
+	memset(&bucket, 0, sizeof(bucket));
+	return spend(&bucket, START, BURST);
+}
+
+static bool test_refill(void)
+{
+	struct icmprl_bucket bucket;
+	bool success = true;
+
+	memset(&bucket, 0, sizeof(bucket));
+	success &= spend(&bucket, START, BURST);
+
+	/* One token every 1/RATE seconds */
+	success &= spend(&bucket, START + TOKEN, 1);
+	success &= spend(&bucket, START + TOKEN + 1, 0);
+	success &= spend(&bucket, START + 4 * TOKEN, 3);
+
+	/* The bucket never holds more than BURST tokens */
+	success &= spend(&bucket, START + 10 * HZ, BURST);
+	/* Even after a very long time (elapsed * rate would overflow) */
+	success &= spend(&bucket, START + 10 * HZ + ULONG_MAX / 2, BURST);
+
+	return success;
+}
+
+/* Prefixes that land on the same slot share the bucket. */
+static bool test_collisions(void)
+{
+	struct xlator jool;
+	unsigned int i;
+	bool success = true;
+
+	memset(&jool, 0, sizeof(jool));
+	jool.globals.icmp_errors_rate = 1;
+	jool.globals.icmp_errors_burst = BURST;
+	jool.stats = jstat_alloc();
+	jool.icmp_rl = icmprl_alloc();
+	if (!jool.icmp_rl)
+		return false;
+
+	/* The tables are per-CPU; stay on one of them. */
+	get_cpu();
+
+	for (i = 0; i < BURST; i++)
+		success &= ASSERT_TRUE(icmprl_allow(&jool, 1), "Token %u", i);
+	success &= ASSERT_FALSE(icmprl_allow(&jool, 1), "Empty");
+	success &= ASSERT_FALSE(icmprl_allow(&jool, 1 + ICMPRL_BUCKETS),
+			"Colliding prefix");
+	success &= ASSERT_FALSE(icmprl_allow(&jool, 1), "Still empty");
+	success &= ASSERT_TRUE(icmprl_allow(&jool, 2), "Another slot");
+
+	put_cpu();
+
+	icmprl_put(jool.icmp_rl);
+	return success;
+}
+
+int init_module(void)
+{
+	struct test_group test = {
+		.name = "ICMP Wrapper",
+	};
+
+	if (test_group_begin(&test))
+		return -EINVAL;
+
+	test_group_test(&test, test_burst, "Burst");
+	test_group_test(&test, test_refill, "Refill");
+	test_group_test(&test, test_collisions, "Collisions");
+
+	return test_group_end(&test);
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
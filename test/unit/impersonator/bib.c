@@ -1,4 +1,5 @@
 #include "mod/common/db/pool4/db.h"
+#include "mod/common/db/bib/events.h"
 #include "mod/common/db/bib/pkt_queue.h"
 #include "framework/unit_test.h"
 
@@ -35,6 +36,19 @@ __u32 mask_domain_get_mark(struct mask_domain *masks)
 	return 0;
 }
 
+/*
+ * Pretends pool4 lends ports 1-99 of every address to mark 0, and ports
+ * 100-199 to mark 1. Other ports are not in pool4.
+ */
+int pool4db_find_mark(struct pool4 *pool, l4_protocol proto,
+		struct ipv4_transport_addr const *addr, __u32 *mark)
+{
+	if (addr->l4 < 1 || addr->l4 > 199)
+		return -ESRCH;
+	*mark = addr->l4 / 100;
+	return 0;
+}
+
 struct pktqueue *pktqueue_alloc(void)
 {
 	return (struct pktqueue *)&dummy;
@@ -75,7 +89,28 @@ unsigned int pktqueue_prepare_clean(struct pktqueue *queue,
 	return broken_unit_call(__func__);
 }
 
-void pktqueue_clean(struct list_head *probes)
+void pktqueue_clean(struct xlator *jool, struct list_head *probes)
 {
 	broken_unit_call(__func__);
 }
+
+struct bib_events *bibev_alloc(void)
+{
+	return (struct bib_events *)&dummy;
+}
+
+void bibev_free(struct bib_events *events)
+{
+	/* No code. */
+}
+
+void bibev_add(struct xlator *jool, struct bib_events *events,
+		struct bib_event_record const *record)
+{
+	broken_unit_call(__func__);
+}
+
+void bibev_flush(struct xlator *jool, struct bib_events *events)
+{
+	/* No code. */
+}
@@ -516,6 +516,70 @@ static bool test_flush(void)
 	return success;
 }
 
+static bool add_mark(__u32 addr, __u16 min, __u16 max, __u32 mark)
+{
+	struct pool4_entry entry;
+
+	entry.mark = mark;
+	entry.iterations = 0;
+	entry.flags = ITERATIONS_SET | ITERATIONS_INFINITE;
+	entry.proto = L4PROTO_TCP;
+	entry.range.prefix.addr.s_addr = cpu_to_be32(addr);
+	entry.range.prefix.len = 32;
+	entry.range.ports.min = min;
+	entry.range.ports.max = max;
+
+	return ASSERT_INT(0, pool4db_add(pool, &entry), "add %pI4 (%u-%u) %u",
+			&entry.range.prefix.addr, min, max, mark);
+}
+
+static bool assert_mark(__u32 addr, __u16 port, int expected_error,
+		__u32 expected_mark)
+{
+	struct ipv4_transport_addr taddr;
+	__u32 mark = 0;
+	bool success = true;
+
+	taddr.l3.s_addr = cpu_to_be32(addr);
+	taddr.l4 = port;
+
+	success &= ASSERT_INT(expected_error,
+			pool4db_find_mark(pool, L4PROTO_TCP, &taddr, &mark),
+			"find mark of %pI4#%u", &taddr.l3, port);
+	if (!expected_error)
+		success &= ASSERT_UINT(expected_mark, mark, "mark of %pI4#%u",
+				&taddr.l3, port);
+
+	return success;
+}
+
+static bool test_find_mark(void)
+{
+	bool success = true;
+
+	if (!add_mark(0xc0000201U, 100, 200, 1))
+		return false;
+	if (!add_mark(0xc0000202U, 100, 200, 2))
+		return false;
+	/* Address shared by two marks. */
+	if (!add_mark(0xc0000203U, 100, 200, 3))
+		return false;
+	if (!add_mark(0xc0000203U, 300, 400, 4))
+		return false;
+
+	success &= assert_mark(0xc0000201U, 150, 0, 1);
+	success &= assert_mark(0xc0000202U, 100, 0, 2);
+	success &= assert_mark(0xc0000202U, 200, 0, 2);
+	success &= assert_mark(0xc0000203U, 150, 0, 3);
+	success &= assert_mark(0xc0000203U, 350, 0, 4);
+
+	success &= assert_mark(0xc0000201U, 250, -ESRCH, 0);
+	success &= assert_mark(0xc0000203U, 250, -ESRCH, 0);
+	success &= assert_mark(0xc0000204U, 150, -ESRCH, 0);
+
+	return success;
+}
+
 static int init(void)
 {
 	pool = pool4db_alloc();
@@ -557,6 +621,7 @@ int init_module(void)
 	test_group_test(&test, test_add, "Add");
 	test_group_test(&test, test_rm, "Rm");
 	test_group_test(&test, test_flush, "Flush");
+	test_group_test(&test, test_find_mark, "Find mark");
 
 	return test_group_end(&test);
 }
@@ -99,11 +99,10 @@ static bool test_db(void)
 	return success;
 }
 
-static bool inject(unsigned int index, __u32 src_addr, __u16 src_id,
+static void init_session(unsigned int index, __u32 src_addr, __u16 src_id,
 		__u32 dst_addr, __u16 dst_id)
 {
 	struct session_entry *entry;
-	int error;
 
 	entry = &session_instances[index];
 	sessions[src_addr][src_id][dst_addr][dst_id] = entry;
@@ -118,8 +117,16 @@ static bool inject(unsigned int index, __u32 src_addr, __u16 src_id,
 	entry->update_time = jiffies;
 	entry->timeout = UDP_DEFAULT;
 	entry->has_stored = false;
+}
+
+static bool inject(unsigned int index, __u32 src_addr, __u16 src_id,
+		__u32 dst_addr, __u16 dst_id)
+{
+	int error;
+
+	init_session(index, src_addr, src_id, dst_addr, dst_id);
 
-	error = bib_add_session(&jool, entry, NULL);
+	error = bib_add_session(&jool, &session_instances[index], NULL);
 	if (error) {
 		log_err("Errcode %d on sessiontable_add.", error);
 		return false;
@@ -250,6 +257,108 @@ static bool simple_session(void)
 	return success;
 }
 
+static enum session_fate bulk_cb(struct session_entry *old, void *arg)
+{
+	return session_equals(old, arg) ? FATE_TIMER_EST : FATE_PRESERVE;
+}
+
+static bool bulk_session(void)
+{
+	/* (Static because it's too big for the stack.) */
+	static struct session_entry batch[18];
+	struct bib_bulk_result result;
+	unsigned int i;
+	bool success = true;
+
+	memset(session_instances, 0, sizeof(session_instances));
+	memset(sessions, 0, sizeof(sessions));
+
+	/* Same as insert_test_sessions(), but all at once. */
+	init_session(0, 1, 2, 2, 2);
+	init_session(1, 1, 1, 2, 1);
+	init_session(2, 2, 1, 2, 1);
+	init_session(3, 2, 2, 2, 2);
+	init_session(4, 1, 1, 2, 2);
+	init_session(5, 2, 2, 1, 1);
+	init_session(6, 2, 1, 1, 1);
+	init_session(7, 1, 1, 1, 1);
+	init_session(8, 2, 2, 1, 2);
+	init_session(9, 1, 2, 1, 1);
+	init_session(10, 2, 1, 1, 2);
+	init_session(11, 1, 2, 1, 2);
+	init_session(12, 2, 1, 2, 2);
+	init_session(13, 1, 1, 1, 2);
+	init_session(14, 1, 2, 2, 1);
+	init_session(15, 2, 2, 2, 1);
+	for (i = 0; i < 16; i++)
+		batch[i] = session_instances[i];
+
+	/* A repeated session, */
+	batch[16] = session_instances[7];
+	/* and one whose IPv4 address belongs to some other BIB entry. */
+	batch[17] = session_instances[0];
+	batch[17].src6.l3.s6_addr32[3] = cpu_to_be32(3);
+
+	bib_add_sessions(&jool, batch, ARRAY_SIZE(batch), bulk_cb, &result);
+	success &= ASSERT_UINT(16, result.added, "added");
+	success &= ASSERT_UINT(1, result.updated, "updated");
+	success &= ASSERT_UINT(1, result.collisions, "collisions");
+	success &= ASSERT_UINT(0, result.errors, "errors");
+	success &= test_db();
+
+	/* Again; everything exists now. */
+	for (i = 0; i < 16; i++)
+		batch[i] = session_instances[i];
+	bib_add_sessions(&jool, batch, 16, bulk_cb, &result);
+	success &= ASSERT_UINT(0, result.added, "added 2");
+	success &= ASSERT_UINT(16, result.updated, "updated 2");
+	success &= ASSERT_UINT(0, result.collisions, "collisions 2");
+	success &= test_db();
+
+	success &= flush();
+	return success;
+}
+
+static enum session_fate bulk_rm_cb(struct session_entry *old, void *arg)
+{
+	return FATE_RM;
+}
+
+/*
+ * A collision whose callback removes the last session of a BIB entry also
+ * removes the BIB entry. The next session in the batch used to find it anyway,
+ * because it shares the IPv6 address.
+ */
+static bool bulk_session_rm(void)
+{
+	struct session_entry batch[2];
+	struct bib_bulk_result result;
+	bool success = true;
+
+	memset(session_instances, 0, sizeof(session_instances));
+	memset(sessions, 0, sizeof(sessions));
+
+	init_session(0, 1, 1, 1, 1);
+	init_session(1, 1, 1, 2, 1);
+
+	batch[0] = session_instances[0];
+	bib_add_sessions(&jool, batch, 1, bulk_rm_cb, &result);
+	success &= ASSERT_UINT(1, result.added, "first added");
+
+	batch[0] = session_instances[0];
+	batch[1] = session_instances[1];
+	bib_add_sessions(&jool, batch, 2, bulk_rm_cb, &result);
+	success &= ASSERT_UINT(1, result.updated, "removed");
+	success &= ASSERT_UINT(1, result.added, "second added");
+	success &= ASSERT_UINT(0, result.errors, "errors");
+
+	sessions[1][1][1][1] = NULL;
+	success &= test_db();
+
+	success &= flush();
+	return success;
+}
+
 enum session_fate tcp_est_expire_cb(struct session_entry *session, void *arg)
 {
 	return FATE_RM;
@@ -279,6 +388,8 @@ int init_module(void)
 		return -EINVAL;
 
 	test_group_test(&test, simple_session, "Single Session");
+	test_group_test(&test, bulk_session, "Bulk Session");
+	test_group_test(&test, bulk_session_rm, "Bulk Session, removing collision");
 
 	return test_group_end(&test);
 }
@@ -2,6 +2,7 @@
 #include "framework/unit_test.h"
 #include "common/constants.h"
 #include "mod/common/db/bib/db.h"
+#include "mod/common/db/bib/query.h"
 
 MODULE_LICENSE(JOOL_LICENSE);
 MODULE_AUTHOR("Alberto Leiva");
@@ -266,6 +267,108 @@ static bool test_foreach(void)
 	return success;
 }
 
+static bool assert_group(struct session_group *group, __u32 key,
+		__u32 sessions, char *name)
+{
+	bool success = true;
+
+	success &= ASSERT_BOOL(true, group != NULL, "%s exists", name);
+	if (!success)
+		return false;
+
+	success &= ASSERT_BE32(key, group->key.value, "%s key", name);
+	success &= ASSERT_UINT(sessions, group->sessions, "%s sessions", name);
+	return success;
+}
+
+/* Runs a query, and returns the number of sessions of its only group. */
+static int count(struct session_filter *filter)
+{
+	struct session_groups *groups;
+	struct session_group *group;
+	int result;
+
+	groups = sgroups_create(SG_TOTAL);
+	if (!groups)
+		return -ENOMEM;
+
+	result = sgroups_collect(&jool, L4PROTO_UDP, filter, groups);
+	if (!result) {
+		group = sgroups_first(groups);
+		result = group ? group->sessions : 0;
+	}
+
+	sgroups_destroy(groups);
+	return result;
+}
+
+static bool test_query(void)
+{
+	struct session_filter filter;
+	struct session_groups *groups;
+	struct session_group *group;
+	bool success = true;
+
+	if (!insert_test_sessions())
+		return false;
+
+	session_filter_init(&filter);
+
+	/* Per pool4 address */
+	groups = sgroups_create(SG_SRC4);
+	if (!groups)
+		return false;
+	success &= ASSERT_INT(0, sgroups_collect(&jool, L4PROTO_UDP, &filter,
+			groups), "src4 result");
+	success &= ASSERT_UINT(3, groups->count, "src4 groups");
+	group = sgroups_first(groups);
+	success &= assert_group(group, 0xcb007101u, 1, "203.0.113.1");
+	group = group ? sgroups_next(group) : NULL;
+	success &= assert_group(group, 0xcb007102u, 7, "203.0.113.2");
+	group = group ? sgroups_next(group) : NULL;
+	success &= assert_group(group, 0xcb007103u, 1, "203.0.113.3");
+	sgroups_destroy(groups);
+
+	/* Per /64; the sources only differ in their last bytes */
+	groups = sgroups_create(SG_SRC6);
+	if (!groups)
+		return false;
+	success &= ASSERT_INT(0, sgroups_collect(&jool, L4PROTO_UDP, &filter,
+			groups), "src6 result");
+	success &= ASSERT_UINT(1, groups->count, "src6 groups");
+	group = sgroups_first(groups);
+	success &= assert_group(group, 0x20010db8u, 9, "2001:db8::/64");
+	sgroups_destroy(groups);
+
+	/* Filters */
+	success &= ASSERT_INT(9, count(&filter), "no filter");
+
+	filter.src4.set = true;
+	filter.src4.prefix.addr.s_addr = cpu_to_be32(0xcb007102u);
+	filter.src4.prefix.len = 32;
+	success &= ASSERT_INT(7, count(&filter), "src4");
+	filter.ports.min = 200;
+	filter.ports.max = 300;
+	success &= ASSERT_INT(6, count(&filter), "src4 + ports");
+
+	session_filter_init(&filter);
+	filter.dst4.set = true;
+	filter.dst4.prefix.addr.s_addr = cpu_to_be32(0xc0000203u);
+	filter.dst4.prefix.len = 32;
+	success &= ASSERT_INT(3, count(&filter), "dst4");
+
+	session_filter_init(&filter);
+	filter.state_set = true;
+	filter.state = V4_INIT;
+	success &= ASSERT_INT(0, count(&filter), "state");
+
+	session_filter_init(&filter);
+	filter.min_age = 60 * 60 * 1000;
+	success &= ASSERT_INT(0, count(&filter), "age");
+
+	return success;
+}
+
 enum session_fate tcp_est_expire_cb(struct session_entry *session, void *arg)
 {
 	return FATE_RM;
@@ -295,6 +398,7 @@ int init_module(void)
 		return -EINVAL;
 
 	test_group_test(&test, test_foreach, "Foreach");
+	test_group_test(&test, test_query, "Query");
 
 	return test_group_end(&test);
 }
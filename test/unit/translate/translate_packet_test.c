@@ -232,6 +232,7 @@ static bool test_function_build_protocol_field(void)
 	struct ipv6_opt_hdr *routing_hdr;
 	struct ipv6_opt_hdr *dest_options_hdr;
 	struct icmp6hdr *icmp6_hdr;
+	struct ipv6_chain chain;
 
 	ip6_hdr = kmalloc(sizeof(*ip6_hdr) + 8 + 16 + 24 + sizeof(struct tcphdr), GFP_ATOMIC);
 	if (!ip6_hdr) {
@@ -242,7 +243,8 @@ static bool test_function_build_protocol_field(void)
 	/* Just ICMP. */
 	ip6_hdr->nexthdr = NEXTHDR_ICMP;
 	ip6_hdr->payload_len = cpu_to_be16(sizeof(*icmp6_hdr));
-	if (!ASSERT_UINT(IPPROTO_ICMP, xlat_proto(ip6_hdr), "Just ICMP"))
+	ipv6_chain_init(&chain, ip6_hdr);
+	if (!ASSERT_UINT(IPPROTO_ICMP, xlat_proto(&chain), "Just ICMP"))
 		goto failure;
 
 	/* Skippable headers then ICMP. */
@@ -261,13 +263,15 @@ static bool test_function_build_protocol_field(void)
 	dest_options_hdr->nexthdr = NEXTHDR_ICMP;
 	dest_options_hdr->hdrlen = 2;
 
-	if (!ASSERT_UINT(IPPROTO_ICMP, xlat_proto(ip6_hdr), "Skippable then ICMP"))
+	ipv6_chain_init(&chain, ip6_hdr);
+	if (!ASSERT_UINT(IPPROTO_ICMP, xlat_proto(&chain), "Skippable then ICMP"))
 		goto failure;
 
 	/* Skippable headers then something else */
 	dest_options_hdr->nexthdr = NEXTHDR_TCP;
 	ip6_hdr->payload_len = cpu_to_be16(8 + 16 + 24 + sizeof(struct tcphdr));
-	if (!ASSERT_UINT(IPPROTO_TCP, xlat_proto(ip6_hdr), "Skippable then TCP"))
+	ipv6_chain_init(&chain, ip6_hdr);
+	if (!ASSERT_UINT(IPPROTO_TCP, xlat_proto(&chain), "Skippable then TCP"))
 		goto failure;
 
 	kfree(ip6_hdr);
@@ -283,6 +287,7 @@ static bool test_function_has_nonzero_segments_left(void)
 	struct ipv6hdr *ip6_hdr;
 	struct ipv6_rt_hdr *routing_hdr;
 	struct frag_hdr *fragment_hdr;
+	struct ipv6_chain chain;
 	__u32 offset;
 
 	bool success = true;
@@ -296,7 +301,8 @@ static bool test_function_has_nonzero_segments_left(void)
 
 	/* No extension headers. */
 	ip6_hdr->nexthdr = NEXTHDR_TCP;
-	success &= ASSERT_BOOL(false, has_nonzero_segments_left(ip6_hdr, &offset), "No extension headers");
+	ipv6_chain_init(&chain, ip6_hdr);
+	success &= ASSERT_BOOL(false, has_nonzero_segments_left(ip6_hdr, &chain, &offset), "No extension headers");
 
 	if (!success)
 		goto end;
@@ -304,8 +310,11 @@ static bool test_function_has_nonzero_segments_left(void)
 	/* Routing header with nonzero segments left. */
 	ip6_hdr->nexthdr = NEXTHDR_ROUTING;
 	routing_hdr = (struct ipv6_rt_hdr *) (ip6_hdr + 1);
+	routing_hdr->nexthdr = NEXTHDR_NONE;
+	routing_hdr->hdrlen = 0;
 	routing_hdr->segments_left = 12;
-	success &= ASSERT_BOOL(true, has_nonzero_segments_left(ip6_hdr, &offset), "Nonzero left - result");
+	ipv6_chain_init(&chain, ip6_hdr);
+	success &= ASSERT_BOOL(true, has_nonzero_segments_left(ip6_hdr, &chain, &offset), "Nonzero left - result");
 	success &= ASSERT_UINT(40 + 3, offset, "Nonzero left - offset");
 
 	if (!success)
@@ -313,7 +322,7 @@ static bool test_function_has_nonzero_segments_left(void)
 
 	/* Routing header with zero segments left. */
 	routing_hdr->segments_left = 0;
-	success &= ASSERT_BOOL(false, has_nonzero_segments_left(ip6_hdr, &offset), "Zero left");
+	success &= ASSERT_BOOL(false, has_nonzero_segments_left(ip6_hdr, &chain, &offset), "Zero left");
 
 	if (!success)
 		goto end;
@@ -326,8 +335,11 @@ static bool test_function_has_nonzero_segments_left(void)
 	fragment_hdr = (struct frag_hdr *) (ip6_hdr + 1);
 	fragment_hdr->nexthdr = NEXTHDR_ROUTING;
 	routing_hdr = (struct ipv6_rt_hdr *) (fragment_hdr + 1);
+	routing_hdr->nexthdr = NEXTHDR_NONE;
+	routing_hdr->hdrlen = 0;
 	routing_hdr->segments_left = 24;
-	success &= ASSERT_BOOL(true, has_nonzero_segments_left(ip6_hdr, &offset), "Two headers - result");
+	ipv6_chain_init(&chain, ip6_hdr);
+	success &= ASSERT_BOOL(true, has_nonzero_segments_left(ip6_hdr, &chain, &offset), "Two headers - result");
 	success &= ASSERT_UINT(40 + 8 + 3, offset, "Two headers - offset");
 
 	/* Fall through. */
@@ -347,6 +359,180 @@ static bool test_function_icmp4_minimum_mtu(void)
 	return success;
 }
 
+/*
+ * Compares icmperr_csum_compute()'s result to a full traversal of @out, which
+ * is a translation of @in, possibly truncated.
+ */
+static bool assert_icmperr_csum(struct sk_buff *in, struct sk_buff *out,
+		unsigned int in_hdrs_len, unsigned int out_hdrs_len,
+		bool in_msg_valid, char *test_name)
+{
+	struct xlation state;
+	struct icmperr_csum csum;
+	int in_offset;
+	int out_offset;
+	__sum16 expected;
+
+	memset(&state, 0, sizeof(state));
+	state.in.skb = in;
+	state.out.skb = out;
+
+	in_offset = skb_transport_offset(in);
+	out_offset = skb_transport_offset(out);
+
+	/* Garbage, if @in_msg_valid is false. */
+	csum.in_msg = in_msg_valid
+			? skb_checksum(in, in_offset, in->len - in_offset, 0)
+			: (__force __wsum)0x1234;
+	csum.in_msg_valid = in_msg_valid;
+	csum.in_hdrs_len = in_hdrs_len;
+	csum.out_hdrs_len = out_hdrs_len;
+
+	expected = csum_fold(skb_checksum(out, out_offset,
+			out->len - out_offset, 0));
+	return ASSERT_UINT((__force __u16)expected,
+			(__force __u16)csum_fold(icmperr_csum_compute(&state,
+					&csum)),
+			"%s", test_name);
+}
+
+#define ICMP4ERR_HDRS_LEN (sizeof(struct icmphdr) + sizeof(struct iphdr) \
+		+ sizeof(struct tcphdr))
+#define ICMP6ERR_HDRS_LEN (sizeof(struct icmp6hdr) + sizeof(struct ipv6hdr) \
+		+ sizeof(struct tcphdr))
+
+/*
+ * The generators fill both inner payloads with the same pattern, so a
+ * shorter outgoing packet is a truncated translation of a longer incoming one.
+ */
+static bool test_icmperr_csum_64(void)
+{
+	struct sk_buff *in;
+	struct sk_buff *out;
+	bool success = true;
+
+	/* 1232 bytes of ICMPv6 payload; 1172 bytes of inner TCP payload. */
+	if (create_skb6_icmp_error("1::1", "64::192.0.2.5", 1232, 32, &in))
+		return false;
+	icmp6_hdr(in)->icmp6_cksum = 0;
+
+	/* Same inner TCP payload. */
+	if (create_skb4_icmp_error("192.0.2.1", "192.0.2.5", 1212, 32, &out))
+		goto end_in;
+	success &= assert_icmperr_csum(in, out, ICMP6ERR_HDRS_LEN,
+			ICMP4ERR_HDRS_LEN, true, "Untruncated");
+	success &= assert_icmperr_csum(in, out, ICMP6ERR_HDRS_LEN,
+			ICMP4ERR_HDRS_LEN, false, "Untruncated, unknown sum");
+	kfree_skb(out);
+
+	/* Trimmed to 576 bytes, the way trim_576() would. */
+	if (create_skb4_icmp_error("192.0.2.1", "192.0.2.5", 576 - 20 - 8, 32,
+			&out))
+		goto end_in;
+	success &= ASSERT_UINT(576, out->len, "576 length");
+	success &= assert_icmperr_csum(in, out, ICMP6ERR_HDRS_LEN,
+			ICMP4ERR_HDRS_LEN, true, "Truncated to 576");
+	success &= assert_icmperr_csum(in, out, ICMP6ERR_HDRS_LEN,
+			ICMP4ERR_HDRS_LEN, false, "Truncated, unknown sum");
+	kfree_skb(out);
+
+	kfree_skb(in);
+	return success;
+
+end_in:
+	kfree_skb(in);
+	return false;
+}
+
+static bool test_icmperr_csum_46(void)
+{
+	struct sk_buff *in;
+	struct sk_buff *out;
+	bool success = true;
+
+	/* 1400 bytes of ICMPv4 payload; 1360 bytes of inner TCP payload. */
+	if (create_skb4_icmp_error("192.0.2.1", "192.0.2.5", 1400, 32, &in))
+		return false;
+
+	/* Same inner TCP payload. */
+	if (create_skb6_icmp_error("1::1", "64::192.0.2.5", 1420, 32, &out))
+		goto end_in;
+	icmp6_hdr(out)->icmp6_cksum = 0;
+	success &= assert_icmperr_csum(in, out, ICMP4ERR_HDRS_LEN,
+			ICMP6ERR_HDRS_LEN, true, "Untruncated");
+	kfree_skb(out);
+
+	/* Trimmed to 1280 bytes, the way trim_1280() would. */
+	if (create_skb6_icmp_error("1::1", "64::192.0.2.5", 1280 - 40 - 8, 32,
+			&out))
+		goto end_in;
+	icmp6_hdr(out)->icmp6_cksum = 0;
+	success &= ASSERT_UINT(1280, out->len, "1280 length");
+	success &= assert_icmperr_csum(in, out, ICMP4ERR_HDRS_LEN,
+			ICMP6ERR_HDRS_LEN, true, "Truncated to 1280");
+	success &= assert_icmperr_csum(in, out, ICMP4ERR_HDRS_LEN,
+			ICMP6ERR_HDRS_LEN, false, "Truncated, unknown sum");
+	kfree_skb(out);
+
+	kfree_skb(in);
+	return success;
+
+end_in:
+	kfree_skb(in);
+	return false;
+}
+
+static bool test_validate_icmp4_csum(void)
+{
+	struct xlation state;
+	struct icmperr_csum csum;
+	struct icmphdr *hdr;
+	__wsum sum;
+	bool success = true;
+
+	memset(&state, 0, sizeof(state));
+	if (create_skb4_icmp_error("192.0.2.1", "192.0.2.5", 100, 32,
+			&state.in.skb))
+		return false;
+	hdr = icmp_hdr(state.in.skb);
+	hdr->checksum = 0;
+	sum = skb_checksum(state.in.skb, sizeof(struct iphdr), 108, 0);
+	hdr->checksum = csum_fold(sum);
+
+	state.in.skb->ip_summed = CHECKSUM_UNNECESSARY;
+	csum.in_msg_valid = false;
+	success &= ASSERT_VERDICT(CONTINUE, validate_icmp4_csum(&state, &csum),
+			"Unnecessary result");
+	success &= ASSERT_BOOL(true, csum.in_msg_valid, "Unnecessary valid");
+	success &= ASSERT_UINT(0, (__force __u32)csum.in_msg,
+			"Unnecessary sum");
+
+	state.in.skb->ip_summed = CHECKSUM_NONE;
+	csum.in_msg_valid = false;
+	success &= ASSERT_VERDICT(CONTINUE, validate_icmp4_csum(&state, &csum),
+			"None result");
+	success &= ASSERT_BOOL(true, csum.in_msg_valid, "None valid");
+	success &= ASSERT_UINT(0, (__force __u16)csum_fold(csum.in_msg),
+			"None sum");
+
+	state.in.skb->ip_summed = CHECKSUM_PARTIAL;
+	csum.in_msg_valid = true;
+	success &= ASSERT_VERDICT(CONTINUE, validate_icmp4_csum(&state, &csum),
+			"Partial result");
+	success &= ASSERT_BOOL(false, csum.in_msg_valid, "Partial valid");
+
+	state.in.skb->ip_summed = CHECKSUM_COMPLETE;
+	state.in.skb->csum_valid = 0;
+	csum.in_msg_valid = true;
+	success &= ASSERT_VERDICT(CONTINUE, validate_icmp4_csum(&state, &csum),
+			"Unverified complete result");
+	success &= ASSERT_BOOL(false, csum.in_msg_valid,
+			"Unverified complete valid");
+
+	kfree_skb(state.in.skb);
+	return success;
+}
+
 int init_module(void)
 {
 	struct test_group test = {
@@ -366,6 +552,10 @@ int init_module(void)
 	test_group_test(&test, test_function_has_nonzero_segments_left, "Segments left indicator function");
 	test_group_test(&test, test_function_icmp4_minimum_mtu, "ICMP4 Minimum MTU function");
 
+	test_group_test(&test, test_icmperr_csum_64, "ICMPv6 error to v4 checksum");
+	test_group_test(&test, test_icmperr_csum_46, "ICMPv4 error to v6 checksum");
+	test_group_test(&test, test_validate_icmp4_csum, "ICMPv4 error checksum validation");
+
 	return test_group_end(&test);
 }
 